@@ -0,0 +1,181 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+namespace btree::bench {
+
+/**
+ * @brief splitmix64, a tiny and fast PRNG so that generating the next operation
+ *  does not dominate the measured operation itself
+ */
+class Random {
+public:
+  explicit Random(uint64_t seed) : state_(seed) {}
+
+  uint64_t Next() {
+    uint64_t z = (this->state_ += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  /** Uniform in [0, bound) */
+  uint64_t Uniform(uint64_t bound) { return this->Next() % bound; }
+
+  /** Uniform in [0, 1) */
+  double NextDouble() { return (this->Next() >> 11) * (1.0 / (uint64_t{1} << 53)); }
+
+private:
+  uint64_t state_;
+};
+
+/**
+ * @brief Zipfian ranks in [0, items), rank 0 being the most popular one
+ *  Same algorithm as YCSB, from Gray et al., "Quickly Generating Billion-Record
+ *  Synthetic Databases", SIGMOD 1994
+ */
+class ZipfianGenerator {
+public:
+  static constexpr double YCSB_THETA = 0.99;
+
+  explicit ZipfianGenerator(uint64_t items, double theta = YCSB_THETA)
+      : items_(items), theta_(theta), zeta_n_(Zeta(items, theta)), alpha_(1.0 / (1.0 - theta)) {
+    this->eta_ = (1 - std::pow(2.0 / items, 1 - theta)) / (1 - Zeta(2, theta) / this->zeta_n_);
+    this->half_pow_theta_ = 1 + std::pow(0.5, theta);
+  }
+
+  uint64_t Next(Random &random) const {
+    auto u = random.NextDouble();
+    auto uz = u * this->zeta_n_;
+    if (uz < 1) return 0;
+    if (uz < this->half_pow_theta_) return 1;
+    auto rank = static_cast<uint64_t>(this->items_ * std::pow(this->eta_ * u - this->eta_ + 1, this->alpha_));
+    return (rank < this->items_) ? rank : this->items_ - 1;
+  }
+
+private:
+  static double Zeta(uint64_t items, double theta) {
+    double sum = 0;
+    for (uint64_t idx = 1; idx <= items; ++idx) sum += 1 / std::pow(idx, theta);
+    return sum;
+  }
+
+  uint64_t items_;
+  double theta_;
+  double zeta_n_;
+  double alpha_;
+  double eta_;
+  double half_pow_theta_;
+};
+
+/**
+ * Spread the popular ranks over the whole key space, as the scrambled zipfian
+ *  generator of YCSB does, so that hot keys are not all in the same leaves
+ */
+inline uint64_t ScrambleRank(uint64_t rank, uint64_t items) {
+  // FNV-1a over the 8 bytes of `rank`
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int byte = 0; byte < 8; ++byte) {
+    hash ^= (rank >> (byte * 8)) & 0xff;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash % items;
+}
+
+enum class Distribution { UNIFORM, ZIPFIAN };
+
+inline std::string DistributionName(Distribution distribution) {
+  return (distribution == Distribution::UNIFORM) ? "uniform" : "zipfian";
+}
+
+enum class Operation { READ, UPDATE, INSERT, SCAN, READ_MODIFY_WRITE };
+
+/**
+ * @brief Operation mix of a YCSB core workload
+ *  Inserted keys are always new ones, appended after the loaded records
+ */
+struct Workload {
+  char name_;
+  double read_;
+  double update_;
+  double insert_;
+  double scan_;
+  double read_modify_write_;
+  /** Reads favor the most recently inserted keys (workload D) */
+  bool latest_;
+
+  Operation Choose(Random &random) const {
+    auto dice = random.NextDouble();
+    if ((dice -= this->read_) < 0) return Operation::READ;
+    if ((dice -= this->update_) < 0) return Operation::UPDATE;
+    if ((dice -= this->insert_) < 0) return Operation::INSERT;
+    if ((dice -= this->scan_) < 0) return Operation::SCAN;
+    return Operation::READ_MODIFY_WRITE;
+  }
+};
+
+// clang-format off
+inline constexpr Workload YCSB_WORKLOADS[] = {
+    // name  read  update insert scan  rmw  latest
+    {'A',    0.50, 0.50,  0,     0,    0,   false},  // update heavy
+    {'B',    0.95, 0.05,  0,     0,    0,   false},  // read mostly
+    {'C',    1.00, 0,     0,     0,    0,   false},  // read only
+    {'D',    0.95, 0,     0.05,  0,    0,   true},   // read latest
+    {'E',    0,    0,     0.05,  0.95, 0,   false},  // short ranges
+    {'F',    0.50, 0,     0,     0,    0.5, false},  // read-modify-write
+};
+// clang-format on
+
+/** Scan lengths are uniform in [1, MAX_SCAN_LENGTH], as in YCSB */
+inline constexpr uint64_t MAX_SCAN_LENGTH = 100;
+
+/**
+ * @brief Choose the ids of the records accessed by a workload, among the
+ *  `inserted` ones which exist so far
+ */
+class KeyChooser {
+public:
+  KeyChooser(Distribution distribution, uint64_t records, bool latest)
+      : distribution_(distribution), records_(records), latest_(latest), zipfian_(records) {}
+
+  uint64_t Next(Random &random, uint64_t inserted) const {
+    if (this->distribution_ == Distribution::UNIFORM) return random.Uniform(inserted);
+    auto rank = this->zipfian_.Next(random);
+    if (this->latest_) return inserted - 1 - rank % inserted;
+    return ScrambleRank(rank, this->records_);
+  }
+
+private:
+  Distribution distribution_;
+  uint64_t records_;
+  bool latest_;
+  ZipfianGenerator zipfian_;
+};
+
+}  // namespace btree::bench
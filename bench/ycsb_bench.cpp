@@ -0,0 +1,232 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+ * YCSB core workloads A-F over all tree engines
+ *  ./ycsb_bench --benchmark_filter='YCSB-A/zipfian/.*'
+ * Environment variables:
+ *  - BTREE_BENCH_RECORDS: number of loaded records, 2^20 by default
+ *  - BTREE_BENCH_THREADS: comma-separated thread counts, powers of two up to
+ *    the number of hardware threads by default
+ * Every benchmark reports the throughput as items_per_second, and the
+ *  percentiles of a sample of its operation latencies
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "common/spinlock.h"
+#include "common/statistics.h"
+#include "tree/blink.h"
+#include "tree/lock_crabbing.h"
+#include "tree/optimistic_lock_coupling.h"
+#include "tree/shadowing.h"
+#include "tree/sharded.h"
+#include "workload.h"
+
+namespace btree::bench {
+
+/** One out of (LATENCY_SAMPLE_MASK + 1) operations is timed */
+constexpr uint64_t LATENCY_SAMPLE_MASK = 7;
+
+uint64_t Records() {
+  auto records = std::getenv("BTREE_BENCH_RECORDS");
+  return (records != nullptr) ? std::strtoull(records, nullptr, 10) : (uint64_t{1} << 20);
+}
+
+std::vector<int> ThreadCounts() {
+  std::vector<int> counts;
+  if (auto threads = std::getenv("BTREE_BENCH_THREADS")) {
+    std::stringstream ss(threads);
+    std::string count;
+    while (std::getline(ss, count, ',')) counts.push_back(std::stoi(count));
+  } else {
+    int hardware_threads = std::max(1U, std::thread::hardware_concurrency());
+    for (int count = 1; count < hardware_threads; count *= 2) counts.push_back(count);
+    counts.push_back(hardware_threads);
+  }
+  return counts;
+}
+
+template <typename KeyType>
+KeyType MakeKey(uint64_t id) {
+  return static_cast<KeyType>(id);
+}
+
+/**
+ * Hash-sharded lock crabbing trees, spread over all NUMA nodes
+ */
+template <typename KeyType, typename ValueType, int Capacity>
+struct ShardedTree : implementation::ShardedBTree<KeyType, ValueType, Capacity, Capacity> {
+  static constexpr std::size_t SHARDS = 8;
+
+  ShardedTree() : implementation::ShardedBTree<KeyType, ValueType, Capacity, Capacity>(
+                      implementation::HashPartitioner<KeyType>(SHARDS)) {}
+};
+
+/**
+ * State shared by all threads of a benchmark run
+ */
+template <typename Tree>
+struct SharedState {
+  Tree tree_;
+  KeyChooser chooser_;
+  /** Records [0, inserted_) exist in the tree */
+  std::atomic<uint64_t> inserted_;
+  common::LatencyHistogram latency_;
+
+  SharedState(Distribution distribution, uint64_t records, bool latest)
+      : chooser_(distribution, records, latest), inserted_(records) {}
+};
+
+template <typename Tree, typename Context, typename KeyType, typename ValueType>
+void RunWorkload(benchmark::State &state, const Workload &workload, Distribution distribution) {
+  // every run replaces the state of the previous one, which is only freed
+  //  here, once all contexts of the previous run are gone
+  static std::unique_ptr<SharedState<Tree>> shared;
+  if (state.thread_index() == 0) {
+    auto records = Records();
+    shared = std::make_unique<SharedState<Tree>>(distribution, records, workload.latest_);
+    std::vector<uint64_t> ids(records);
+    std::iota(ids.begin(), ids.end(), 0);
+    Random shuffle_random(records);
+    for (auto idx = ids.size(); idx > 1; --idx) std::swap(ids[idx - 1], ids[shuffle_random.Uniform(idx)]);
+    Context context;
+    for (auto id : ids) shared->tree_.Insert(MakeKey<KeyType>(id), static_cast<ValueType>(id), &context);
+  }
+
+  Random random(0x5eed + state.thread_index());
+  Context context;
+  KeyType key;
+  ValueType value{};
+  uint64_t ops = 0;
+  for (auto _ : state) {
+    auto sampled = (ops++ & LATENCY_SAMPLE_MASK) == 0;
+    std::chrono::steady_clock::time_point start;
+    if (sampled) start = std::chrono::steady_clock::now();
+
+    auto &tree = shared->tree_;
+    switch (workload.Choose(random)) {
+      case Operation::READ:
+        key = MakeKey<KeyType>(shared->chooser_.Next(random, shared->inserted_.load(std::memory_order_relaxed)));
+        benchmark::DoNotOptimize(tree.Search(key, value, &context));
+        break;
+      case Operation::UPDATE:
+        key = MakeKey<KeyType>(shared->chooser_.Next(random, shared->inserted_.load(std::memory_order_relaxed)));
+        tree.Update(key, static_cast<ValueType>(random.Next()), &context);
+        break;
+      case Operation::INSERT: {
+        auto id = shared->inserted_.fetch_add(1, std::memory_order_relaxed);
+        tree.Insert(MakeKey<KeyType>(id), static_cast<ValueType>(id), &context);
+      } break;
+      case Operation::SCAN: {
+        auto id = shared->chooser_.Next(random, shared->inserted_.load(std::memory_order_relaxed));
+        auto key_high = MakeKey<KeyType>(id + 1 + random.Uniform(MAX_SCAN_LENGTH));
+        std::unique_ptr<std::remove_pointer_t<decltype(tree.RangeQuery(key, key_high, &context))>> it(
+            tree.RangeQuery(MakeKey<KeyType>(id), key_high, &context));
+        while (it->Next(key, value)) benchmark::DoNotOptimize(value);
+      } break;
+      case Operation::READ_MODIFY_WRITE:
+        key = MakeKey<KeyType>(shared->chooser_.Next(random, shared->inserted_.load(std::memory_order_relaxed)));
+        tree.Search(key, value, &context);
+        tree.Insert(key, value + 1, &context);
+        break;
+    }
+
+    if (sampled) {
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      shared->latency_.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  // user counters are summed over all threads, hence only set by one of them
+  //  after the loop, the other threads have stopped recording already
+  if (state.thread_index() == 0) {
+    auto latency = shared->latency_.Read();
+    state.counters["p50_ns"] = latency.Percentile(0.5);
+    state.counters["p99_ns"] = latency.Percentile(0.99);
+    state.counters["p999_ns"] = latency.Percentile(0.999);
+  }
+}
+
+template <typename Tree, typename Context, typename KeyType, typename ValueType>
+void RegisterEngine(const std::string &engine) {
+  for (auto &workload : YCSB_WORKLOADS) {
+    for (auto distribution : {Distribution::UNIFORM, Distribution::ZIPFIAN}) {
+      auto name = std::string("YCSB-") + workload.name_ + "/" + DistributionName(distribution) + "/" + engine;
+      auto bench = benchmark::RegisterBenchmark(name.c_str(), [&workload, distribution](benchmark::State &state) {
+        RunWorkload<Tree, Context, KeyType, ValueType>(state, workload, distribution);
+      });
+      for (auto threads : ThreadCounts()) bench->Threads(threads);
+      bench->UseRealTime();
+    }
+  }
+}
+
+/**
+ * Register all engines with the same key/value types and node capacity
+ */
+template <typename KeyType, typename ValueType, int Capacity>
+void RegisterEngines(const std::string &suffix) {
+  RegisterEngine<implementation::MemoryBTree<KeyType, ValueType, Capacity, Capacity>, implementation::QueryContext,
+                 KeyType, ValueType>("LockCrabbing" + suffix);
+  using SpinlockTree = implementation::MemoryBTree<KeyType, ValueType, Capacity, Capacity,
+                                                   common::DefaultNodeAllocator, common::SharedSpinlock>;
+  RegisterEngine<SpinlockTree, typename SpinlockTree::QueryContext, KeyType, ValueType>("LockCrabbingSpinlock" +
+                                                                                         suffix);
+  RegisterEngine<implementation::olc::MemoryBTree<KeyType, ValueType, Capacity, Capacity>,
+                 implementation::olc::QueryContext, KeyType, ValueType>("OLC" + suffix);
+  RegisterEngine<implementation::shadow::MemoryBTree<KeyType, ValueType, Capacity, Capacity>,
+                 implementation::shadow::QueryContext, KeyType, ValueType>("Shadowing" + suffix);
+  RegisterEngine<implementation::blink::MemoryBTree<KeyType, ValueType, Capacity, Capacity>,
+                 implementation::blink::QueryContext, KeyType, ValueType>("BLink" + suffix);
+  RegisterEngine<ShardedTree<KeyType, ValueType, Capacity>, implementation::QueryContext, KeyType, ValueType>(
+      "Sharded" + suffix);
+}
+
+}  // namespace btree::bench
+
+int main(int argc, char **argv) {
+  using namespace btree::bench;
+  benchmark::Initialize(&argc, argv);
+  RegisterEngines<int64_t, int64_t, 64>("<int64,int64,64>");
+  RegisterEngines<int64_t, int64_t, 256>("<int64,int64,256>");
+  RegisterEngines<int32_t, int32_t, 64>("<int32,int32,64>");
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,421 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common/constants.h"
+
+namespace btree::common {
+
+using PageId = uint32_t;
+static constexpr PageId INVALID_PAGE_ID = UINT32_MAX;
+
+/**
+ * @brief File of fixed-size pages, page I is stored at offset I * PageSize
+ *  Pages are allocated at the end of the file, and read as zeros until they
+ *  are written for the first time
+ */
+template <std::size_t PageSize>
+class PageFile {
+public:
+  /**
+   * Open `path`, which is created if it doesn't exist
+   * @throw std::runtime_error if it can't be opened
+   */
+  explicit PageFile(const std::string &path) : path_(path) {
+    this->fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (this->fd_ < 0) throw std::runtime_error("Can't open page file " + path);
+    struct stat file_stat;
+    if (::fstat(this->fd_, &file_stat) != 0) {
+      ::close(this->fd_);
+      throw std::runtime_error("Can't stat page file " + path);
+    }
+    this->page_count_ = (file_stat.st_size + PageSize - 1) / PageSize;
+  }
+
+  ~PageFile() { ::close(this->fd_); }
+
+  // non-copyable, as it owns the file descriptor
+  PageFile(const PageFile &) = delete;
+  PageFile &operator=(const PageFile &) = delete;
+
+  PageId PageCount() const { return this->page_count_; }
+
+  PageId AllocatePage() { return this->page_count_++; }
+
+  /**
+   * @throw std::runtime_error on I/O errors
+   */
+  void ReadPage(PageId page_id, char *data) {
+    auto read = ::pread(this->fd_, data, PageSize, static_cast<off_t>(page_id) * PageSize);
+    if (read < 0) throw std::runtime_error("Can't read page file " + this->path_);
+    // the page was allocated, but never written
+    std::memset(data + read, 0, PageSize - read);
+  }
+
+  /**
+   * @throw std::runtime_error on I/O errors
+   */
+  void WritePage(PageId page_id, const char *data) {
+    auto written = ::pwrite(this->fd_, data, PageSize, static_cast<off_t>(page_id) * PageSize);
+    if (written != static_cast<ssize_t>(PageSize)) throw std::runtime_error("Can't write page file " + this->path_);
+  }
+
+  /** Make all the written pages durable */
+  void Sync() {
+    if (::fdatasync(this->fd_) != 0) throw std::runtime_error("Can't sync page file " + this->path_);
+  }
+
+  /** Drop all pages, the caller should make sure that none of them is in use */
+  void Truncate() {
+    if (::ftruncate(this->fd_, 0) != 0) throw std::runtime_error("Can't truncate page file " + this->path_);
+    this->page_count_ = 0;
+  }
+
+private:
+  std::string path_;
+  int fd_;
+  std::atomic<PageId> page_count_;
+};
+
+/**
+ * @brief Fixed number of in-memory frames caching the pages of a PageFile
+ *  A fetched page is pinned until it is unpinned, and only unpinned frames are
+ *    evicted, following the CLOCK policy: a frame is skipped if it was
+ *    referenced since the last sweep of the clock hand
+ *  Every frame has its own latch, which protects the page content. The pool
+ *    itself never latches a page, except while reading it in (EXCLUSIVE), and
+ *    while writing it back (SHARE)
+ *  Dirty pages are written back by a background flusher, so that eviction
+ *    mostly finds clean victims. A dirty victim is written back synchronously,
+ *    but without the latch of the pool
+ */
+template <std::size_t PageSize, typename Latch = std::shared_mutex>
+class BufferPool {
+public:
+  class Frame {
+  public:
+    char *Data() { return this->data_; }
+    Latch *LatchPtr() { return &this->latch_; }
+    PageId Id() const { return this->page_id_; }
+
+    /** Require the caller to have EXCLUSIVE latched this frame */
+    void MarkDirty() { this->dirty_ = true; }
+
+    void Unpin() { this->pool_->UnpinPage(this); }
+
+  private:
+    friend class BufferPool;
+
+    alignas(Constants::CACHELINE_SIZE) char data_[PageSize];
+    Latch latch_;
+    BufferPool *pool_ = nullptr;
+    /** The fields below are protected by the latch of the pool */
+    PageId page_id_ = INVALID_PAGE_ID;
+    int pin_count_ = 0;
+    bool referenced_ = false;
+    /** Cleared by the write-back, under the SHARE latch of the frame */
+    std::atomic<bool> dirty_ = false;
+  };
+
+  /**
+   * @param flush_interval  Period of the background flusher, which is also
+   *    woken up whenever a dirty victim is evicted
+   */
+  BufferPool(PageFile<PageSize> *file, std::size_t frame_count,
+             std::chrono::milliseconds flush_interval = std::chrono::milliseconds(10))
+      : file_(file), frame_count_(frame_count), frames_(new Frame[frame_count]), clock_hand_(0), stopped_(false) {
+    assert(frame_count > 0);
+    for (std::size_t idx = 0; idx < frame_count; ++idx) {
+      this->frames_[idx].pool_ = this;
+      this->free_frames_.push_back(&this->frames_[frame_count - idx - 1]);
+    }
+    this->flusher_ = std::thread([this, flush_interval]() { this->FlushInBackground(flush_interval); });
+  }
+
+  ~BufferPool() {
+    {
+      std::lock_guard<std::mutex> guard(this->flusher_latch_);
+      this->stopped_ = true;
+    }
+    this->flusher_cv_.notify_one();
+    this->flusher_.join();
+    this->FlushAll();
+  }
+
+  // non-copyable/non-movable, as frames point to their pool
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  /**
+   * @return The pinned frame of `page_id`, read from the file if it is not
+   *  cached yet. It is not latched, the caller should latch it before reading
+   * @throw std::runtime_error if all frames are pinned
+   */
+  Frame *FetchPage(PageId page_id) {
+    std::unique_lock<std::mutex> guard(this->latch_);
+    auto cached = this->PinCachedPage(page_id);
+    if (cached != nullptr) return cached;
+    auto frame = this->Evict(guard);
+    // the page may have been read in while a dirty victim was written back
+    cached = this->PinCachedPage(page_id);
+    if (cached != nullptr) {
+      frame->page_id_ = INVALID_PAGE_ID;
+      this->free_frames_.push_back(frame);
+      return cached;
+    }
+    this->Install(frame, page_id);
+    // the page is read without the pool latch, anyone fetching it meanwhile
+    //  waits on the frame latch
+    frame->latch_.lock();
+    guard.unlock();
+    try {
+      this->file_->ReadPage(page_id, frame->data_);
+    } catch (...) {
+      // the next fetch of the page reads it again into another frame, while
+      //  the threads which pinned this one meanwhile keep it until they unpin it
+      guard.lock();
+      this->page_table_.erase(page_id);
+      frame->page_id_ = INVALID_PAGE_ID;
+      frame->dirty_ = false;
+      if (--frame->pin_count_ == 0) this->free_frames_.push_back(frame);
+      frame->latch_.unlock();
+      throw;
+    }
+    frame->latch_.unlock();
+    this->page_reads_++;
+    return frame;
+  }
+
+  /**
+   * Allocate a new page at the end of the file
+   * @return Its pinned and zeroed frame, the caller should EXCLUSIVE latch it
+   *  before filling it in, and mark it dirty
+   * @throw std::runtime_error if all frames are pinned
+   */
+  Frame *NewPage() {
+    std::unique_lock<std::mutex> guard(this->latch_);
+    auto frame = this->Evict(guard);
+    this->Install(frame, this->file_->AllocatePage());
+    std::memset(frame->data_, 0, PageSize);
+    frame->dirty_ = true;
+    return frame;
+  }
+
+  void UnpinPage(Frame *frame) {
+    std::lock_guard<std::mutex> guard(this->latch_);
+    assert(frame->pin_count_ > 0);
+    frame->pin_count_--;
+  }
+
+  /** Write all dirty pages back */
+  void FlushAll() {
+    for (std::size_t idx = 0; idx < this->frame_count_; ++idx) this->FlushFrame(&this->frames_[idx], false);
+  }
+
+  /**
+   * Drop all cached pages without writing them back, e.g. after the file is
+   *  truncated. The caller should make sure that no page is pinned
+   */
+  void Reset() {
+    // wait for the sweep of the background flusher, if any
+    std::lock_guard<std::mutex> flusher_guard(this->flusher_latch_);
+    std::lock_guard<std::mutex> guard(this->latch_);
+    this->page_table_.clear();
+    this->free_frames_.clear();
+    for (std::size_t idx = 0; idx < this->frame_count_; ++idx) {
+      auto frame = &this->frames_[idx];
+      assert(frame->pin_count_ == 0);
+      frame->page_id_ = INVALID_PAGE_ID;
+      frame->dirty_ = false;
+      this->free_frames_.push_back(frame);
+    }
+  }
+
+  std::size_t FrameCount() const { return this->frame_count_; }
+  /** Number of pages read from the file */
+  std::size_t PageReads() const { return this->page_reads_; }
+  /** Number of dirty pages written back while being evicted */
+  std::size_t SyncWrites() const { return this->sync_writes_; }
+
+private:
+  PageFile<PageSize> *file_;
+  std::size_t frame_count_;
+  std::unique_ptr<Frame[]> frames_;
+
+  /** Protects the page table, the free frames, and the bookkeeping of every frame */
+  std::mutex latch_;
+  std::unordered_map<PageId, Frame *> page_table_;
+  std::vector<Frame *> free_frames_;
+  std::size_t clock_hand_;
+
+  std::atomic<std::size_t> page_reads_ = 0;
+  std::atomic<std::size_t> sync_writes_ = 0;
+
+  std::thread flusher_;
+  /** Held by the flusher during every sweep */
+  std::mutex flusher_latch_;
+  std::condition_variable flusher_cv_;
+  bool stopped_;
+
+  /**
+   * Pick a free frame, or evict the page of an unpinned one
+   * Require the caller to already have locked the pool with `guard`, which is
+   *  released while a dirty victim is written back
+   */
+  Frame *Evict(std::unique_lock<std::mutex> &guard) {
+    if (!this->free_frames_.empty()) {
+      auto frame = this->free_frames_.back();
+      this->free_frames_.pop_back();
+      return frame;
+    }
+    // the second sweep finds the frames whose reference bit was cleared by the first one
+    for (std::size_t step = 0; step < 2 * this->frame_count_; ++step) {
+      auto frame = &this->frames_[this->clock_hand_];
+      this->clock_hand_ = (this->clock_hand_ + 1) % this->frame_count_;
+      if (frame->pin_count_ > 0) continue;
+      if (frame->referenced_) {
+        frame->referenced_ = false;
+        continue;
+      }
+      // a frame whose read failed is dropped, see FetchPage()
+      if (frame->dirty_ && frame->page_id_ != INVALID_PAGE_ID) {
+        // the victim is pinned during its write-back, so that no other eviction
+        //  picks it, while its page can still be fetched
+        frame->pin_count_++;
+        guard.unlock();
+        frame->latch_.lock_shared();
+        try {
+          this->WriteBack(frame);
+        } catch (...) {
+          frame->latch_.unlock_shared();
+          guard.lock();
+          frame->pin_count_--;
+          throw;
+        }
+        frame->latch_.unlock_shared();
+        this->sync_writes_++;
+        this->flusher_cv_.notify_one();
+        guard.lock();
+        frame->pin_count_--;
+        // the page was fetched, or even dirtied again meanwhile
+        if (frame->pin_count_ > 0 || frame->referenced_ || frame->dirty_) continue;
+      }
+      this->page_table_.erase(frame->page_id_);
+      return frame;
+    }
+    throw std::runtime_error("All frames of the buffer pool are pinned");
+  }
+
+  /**
+   * @return The pinned frame of `page_id` if it is cached, nullptr otherwise
+   * Require the caller to already have locked the pool
+   */
+  Frame *PinCachedPage(PageId page_id) {
+    auto it = this->page_table_.find(page_id);
+    if (it == this->page_table_.end()) return nullptr;
+    it->second->pin_count_++;
+    it->second->referenced_ = true;
+    return it->second;
+  }
+
+  /** Require the caller to already have locked the pool */
+  void Install(Frame *frame, PageId page_id) {
+    frame->page_id_ = page_id;
+    frame->pin_count_ = 1;
+    frame->referenced_ = true;
+    this->page_table_[page_id] = frame;
+  }
+
+  /**
+   * Write `frame` back if it is dirty, it is pinned meanwhile so that it can't
+   *  be evicted
+   * @param try_latch   Skip the frame if it is latched by a writer, instead of
+   *    waiting for it
+   */
+  void FlushFrame(Frame *frame, bool try_latch) {
+    {
+      std::lock_guard<std::mutex> guard(this->latch_);
+      if (frame->page_id_ == INVALID_PAGE_ID || !frame->dirty_) return;
+      frame->pin_count_++;
+    }
+    if (try_latch) {
+      if (frame->latch_.try_lock_shared()) {
+        this->WriteBack(frame);
+        frame->latch_.unlock_shared();
+      }
+    } else {
+      frame->latch_.lock_shared();
+      this->WriteBack(frame);
+      frame->latch_.unlock_shared();
+    }
+    this->UnpinPage(frame);
+  }
+
+  /** Require the caller to already have SHARE latched the frame */
+  void WriteBack(Frame *frame) {
+    if (!frame->dirty_) return;
+    // writers only dirty a frame under its EXCLUSIVE latch
+    frame->dirty_ = false;
+    try {
+      this->file_->WritePage(frame->page_id_, frame->data_);
+    } catch (...) {
+      frame->dirty_ = true;
+      throw;
+    }
+  }
+
+  void FlushInBackground(std::chrono::milliseconds flush_interval) {
+    std::unique_lock<std::mutex> guard(this->flusher_latch_);
+    while (!this->stopped_) {
+      this->flusher_cv_.wait_for(guard, flush_interval);
+      if (this->stopped_) break;
+      try {
+        for (std::size_t idx = 0; idx < this->frame_count_; ++idx) this->FlushFrame(&this->frames_[idx], true);
+      } catch (const std::runtime_error &) {
+        // the pages stay dirty, and the error surfaces on eviction or FlushAll()
+      }
+    }
+  }
+};
+
+}  // namespace btree::common
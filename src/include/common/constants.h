@@ -42,6 +42,11 @@ struct Constants {
    */
   static const int OVERFLOW_SIZE = 1;
 
+  /**
+   * @brief Size of a cache line, node slots of NodePool are aligned to it
+   */
+  static const int CACHELINE_SIZE = 64;
+
   /**
    * @brief Various types of shared lock
    */
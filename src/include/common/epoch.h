@@ -0,0 +1,230 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "common/constants.h"
+
+namespace btree::common {
+
+/**
+ * @brief Epoch-based memory reclamation
+ *  Threads register themselves as participants, and enter the current global
+ *    epoch before touching any shared node
+ *  A node unlinked from the tree is retired, tagged with the global epoch at
+ *    that moment, rather than freed
+ *  The global epoch only advances once all active participants have entered
+ *    it, hence a node retired at epoch E can be freed when the global epoch
+ *    reaches E + 2: no participant can still hold a reference to it
+ */
+class EpochManager {
+private:
+  struct RetiredObject {
+    void *object_;
+    void (*deleter_)(void *);
+    uint64_t epoch_;
+  };
+
+  template <typename T>
+  static void DeleteObject(void *object) {
+    delete static_cast<T *>(object);
+  }
+
+  /**
+   * Free all objects whose grace period has elapsed, `retired` is sorted by
+   * epoch already
+   */
+  static void FreeExpired(std::vector<RetiredObject> &retired, uint64_t global_epoch) {
+    auto expired = std::find_if(retired.begin(), retired.end(),
+                                [&](const RetiredObject &obj) { return obj.epoch_ + 2 > global_epoch; });
+    for (auto it = retired.begin(); it != expired; ++it) it->deleter_(it->object_);
+    retired.erase(retired.begin(), expired);
+  }
+
+public:
+  /**
+   * @brief A registered thread, which should not be shared among threads
+   */
+  class Participant {
+    friend class EpochManager;
+
+  public:
+    static constexpr uint64_t INACTIVE = std::numeric_limits<uint64_t>::max();
+
+    explicit Participant(EpochManager *manager) : local_epoch_(INACTIVE), depth_(0), manager_(manager) {}
+
+    EpochManager *Manager() const { return this->manager_; }
+
+    bool IsActive() const { return this->depth_ > 0; }
+
+    /**
+     * @brief Enter the current global epoch, nested calls are allowed
+     */
+    void Enter() {
+      if (this->depth_++ > 0) return;
+      this->local_epoch_.store(this->manager_->global_epoch_.load(std::memory_order_relaxed),
+                               std::memory_order_relaxed);
+      // the announcement has to be visible before reading any shared node
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void Exit() {
+      assert(this->depth_ > 0);
+      if (--this->depth_ > 0) return;
+      this->local_epoch_.store(INACTIVE, std::memory_order_release);
+    }
+
+    /**
+     * @brief Defer the deletion of an unlinked `object`
+     */
+    template <typename T>
+    void Retire(T *object) {
+      this->retired_.push_back({object, &DeleteObject<T>, this->manager_->GlobalEpoch()});
+      if (this->retired_.size() >= this->manager_->reclaim_threshold_) this->Reclaim();
+    }
+
+    /**
+     * @brief Try to advance the global epoch, and free all expired objects
+     */
+    void Reclaim() {
+      this->manager_->TryAdvance();
+      FreeExpired(this->retired_, this->manager_->GlobalEpoch());
+    }
+
+    size_t RetiredCount() const { return this->retired_.size(); }
+
+  private:
+    alignas(Constants::CACHELINE_SIZE) std::atomic<uint64_t> local_epoch_;
+    int depth_;
+    EpochManager *manager_;
+    std::vector<RetiredObject> retired_;
+  };
+
+  /**
+   * @param reclaim_threshold   Number of retired objects of a participant
+   *    before it tries to reclaim them
+   */
+  explicit EpochManager(size_t reclaim_threshold = 64) : global_epoch_(0), reclaim_threshold_(reclaim_threshold) {}
+
+  // non-copyable/non-movable
+  EpochManager(const EpochManager &) = delete;
+  EpochManager(EpochManager &&) = delete;
+  EpochManager &operator=(const EpochManager &) = delete;
+
+  /**
+   * All participants should be inactive by now, so everything can be freed
+   */
+  ~EpochManager() {
+    for (auto &participant : this->participants_) {
+      assert(!participant->IsActive());
+      FreeExpired(participant->retired_, std::numeric_limits<uint64_t>::max());
+    }
+    FreeExpired(this->orphans_, std::numeric_limits<uint64_t>::max());
+  }
+
+  uint64_t GlobalEpoch() const { return this->global_epoch_.load(std::memory_order_acquire); }
+
+  Participant *Register() {
+    std::lock_guard<std::mutex> guard(this->participants_latch_);
+    this->participants_.push_back(std::make_unique<Participant>(this));
+    return this->participants_.back().get();
+  }
+
+  /**
+   * @brief Remove an inactive participant, its remaining retired objects are
+   * handed over to the manager
+   */
+  void Unregister(Participant *participant) {
+    assert(participant->manager_ == this && !participant->IsActive());
+    std::lock_guard<std::mutex> guard(this->participants_latch_);
+    this->orphans_.insert(this->orphans_.end(), participant->retired_.begin(), participant->retired_.end());
+    auto it = std::find_if(this->participants_.begin(), this->participants_.end(),
+                           [&](const std::unique_ptr<Participant> &ptr) { return ptr.get() == participant; });
+    assert(it != this->participants_.end());
+    this->participants_.erase(it);
+  }
+
+  /**
+   * @brief Retire an object without any participant, e.g. from maintenance
+   * operations
+   */
+  template <typename T>
+  void Retire(T *object) {
+    std::lock_guard<std::mutex> guard(this->participants_latch_);
+    this->orphans_.push_back({object, &DeleteObject<T>, this->GlobalEpoch()});
+  }
+
+  /**
+   * @brief Advance the global epoch if all active participants have entered
+   * it, expired orphans are freed as well
+   * @return Whether the global epoch is advanced
+   */
+  bool TryAdvance() {
+    std::lock_guard<std::mutex> guard(this->participants_latch_);
+    auto epoch = this->GlobalEpoch();
+    for (auto &participant : this->participants_) {
+      auto local_epoch = participant->local_epoch_.load(std::memory_order_acquire);
+      if (local_epoch != Participant::INACTIVE && local_epoch != epoch) return false;
+    }
+    bool advanced = this->global_epoch_.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel);
+    FreeExpired(this->orphans_, this->GlobalEpoch());
+    return advanced;
+  }
+
+private:
+  std::atomic<uint64_t> global_epoch_;
+  const size_t reclaim_threshold_;
+  /** Protect both `participants_` and `orphans_` */
+  std::mutex participants_latch_;
+  std::vector<std::unique_ptr<Participant>> participants_;
+  std::vector<RetiredObject> orphans_;
+};
+
+/**
+ * @brief RAII helper to stay in an epoch during a scope
+ */
+class EpochGuard {
+public:
+  explicit EpochGuard(EpochManager::Participant *participant) : participant_(participant) {
+    this->participant_->Enter();
+  }
+  ~EpochGuard() { this->participant_->Exit(); }
+
+  // non-copyable/non-movable
+  EpochGuard(const EpochGuard &) = delete;
+  EpochGuard &operator=(const EpochGuard &) = delete;
+
+private:
+  EpochManager::Participant *participant_;
+};
+
+}  // namespace btree::common
@@ -0,0 +1,90 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace btree::common {
+
+/**
+ * @brief String key stored inline, up to `Capacity` bytes
+ *  Unlike std::string, the characters are never allocated on the heap, so a
+ *    node's key array holds the keys themselves rather than pointers to them:
+ *    intra-node search stays within the node, and shifting keys is a plain
+ *    memory copy
+ *  It is trivially copyable, hence it can also be used by the optimistic
+ *    engines
+ */
+template <std::size_t Capacity>
+class FixedString {
+  static_assert(Capacity > 0 && Capacity <= UINT8_MAX, "The length of a FixedString is stored in a single byte");
+
+public:
+  FixedString() : size_(0) {}
+
+  /**
+   * @throw std::length_error if `str` is longer than `Capacity`
+   */
+  FixedString(std::string_view str) : size_(str.size()) {
+    if (str.size() > Capacity) throw std::length_error("FixedString can't store a key that long");
+    std::memcpy(this->data_, str.data(), str.size());
+  }
+  FixedString(const char *str) : FixedString(std::string_view(str)) {}
+  FixedString(const std::string &str) : FixedString(std::string_view(str)) {}
+
+  std::string_view View() const { return std::string_view(this->data_, this->size_); }
+  std::size_t Size() const { return this->size_; }
+
+  int Compare(const FixedString &other) const {
+    auto common_size = std::min(this->size_, other.size_);
+    auto result = std::memcmp(this->data_, other.data_, common_size);
+    if (result != 0) return result;
+    return static_cast<int>(this->size_) - static_cast<int>(other.size_);
+  }
+
+  // non-member operators, so that string literals convert on either side
+  friend bool operator==(const FixedString &lhs, const FixedString &rhs) {
+    return lhs.size_ == rhs.size_ && std::memcmp(lhs.data_, rhs.data_, lhs.size_) == 0;
+  }
+  friend bool operator!=(const FixedString &lhs, const FixedString &rhs) { return !(lhs == rhs); }
+  friend bool operator<(const FixedString &lhs, const FixedString &rhs) { return lhs.Compare(rhs) < 0; }
+  friend bool operator<=(const FixedString &lhs, const FixedString &rhs) { return lhs.Compare(rhs) <= 0; }
+  friend bool operator>(const FixedString &lhs, const FixedString &rhs) { return lhs.Compare(rhs) > 0; }
+  friend bool operator>=(const FixedString &lhs, const FixedString &rhs) { return lhs.Compare(rhs) >= 0; }
+
+  friend std::ostream &operator<<(std::ostream &os, const FixedString &str) { return os << str.View(); }
+
+private:
+  uint8_t size_;
+  char data_[Capacity];
+};
+
+}  // namespace btree::common
@@ -0,0 +1,75 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+
+namespace btree::common {
+
+/**
+ * @brief Vector of at most `Capacity` elements, stored inline
+ *  It never allocates, hence it suits per-operation bookkeeping on the hot
+ *    path, e.g. the latches held during a descent, whose number is bounded
+ *    by the tree height
+ *  It provides the subset of the std::vector interface used by the trees, so
+ *    that it can replace one without touching its users
+ */
+template <typename T, std::size_t Capacity>
+class FixedVector {
+public:
+  FixedVector() : size_(0) {}
+
+  std::size_t size() const { return this->size_; }
+  bool empty() const { return this->size_ == 0; }
+  static constexpr std::size_t capacity() { return Capacity; }
+
+  void clear() { this->size_ = 0; }
+
+  /**
+   * @throw std::length_error if the vector is full already
+   */
+  void push_back(const T &value) {
+    if (this->size_ == Capacity) throw std::length_error("FixedVector can't store more than Capacity elements");
+    this->data_[this->size_++] = value;
+  }
+
+  void pop_back() { --this->size_; }
+
+  T &operator[](std::size_t idx) { return this->data_[idx]; }
+  const T &operator[](std::size_t idx) const { return this->data_[idx]; }
+  T &back() { return this->data_[this->size_ - 1]; }
+
+  T *begin() { return this->data_; }
+  T *end() { return this->data_ + this->size_; }
+  const T *begin() const { return this->data_; }
+  const T *end() const { return this->data_ + this->size_; }
+
+private:
+  std::size_t size_;
+  T data_[Capacity];
+};
+
+}  // namespace btree::common
@@ -0,0 +1,126 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "common/macros.h"
+
+namespace btree::common {
+
+/**
+ * @brief Hybrid latch, which supports optimistic, shared, and exclusive modes
+ *  The shared and exclusive modes follow the interface of std::shared_mutex,
+ *    hence it can be the node latch of lock crabbing trees
+ *  The optimistic mode follows OptimisticLatch: readers never write to the
+ *    latch, and validate that no writer locked it since their read started
+ *  The state word is laid out as follow:
+ *    - bit 0 to 30: number of shared readers
+ *    - bit 31: exclusive flag
+ *    - the remaining bits: version counter, increased after every exclusive
+ *      lock, shared readers never change it
+ */
+class HybridLatch {
+public:
+  HybridLatch() : state_(0) {}
+
+  // non-copyable/non-movable
+  HybridLatch(const HybridLatch &) = delete;
+  HybridLatch(HybridLatch &&) = delete;
+  HybridLatch &operator=(const HybridLatch &) = delete;
+
+  /**********************************************************************
+   * @brief Pessimistic modes                                           *
+   **********************************************************************/
+
+  inline void lock() {
+    while (!this->try_lock()) NOP_PAUSE;
+  }
+
+  inline bool try_lock() {
+    auto state = this->state_.load(std::memory_order_relaxed);
+    return (state & (EXCLUSIVE_BIT | READERS_MASK)) == 0 &&
+           this->state_.compare_exchange_strong(state, state | EXCLUSIVE_BIT, std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Release the exclusive lock, which also increases the version counter
+   */
+  inline void unlock() { this->state_.fetch_add(VERSION_STEP - EXCLUSIVE_BIT, std::memory_order_release); }
+
+  inline void lock_shared() {
+    while (!this->try_lock_shared()) NOP_PAUSE;
+  }
+
+  inline bool try_lock_shared() {
+    auto state = this->state_.load(std::memory_order_relaxed);
+    while ((state & EXCLUSIVE_BIT) == 0) {
+      if (this->state_.compare_exchange_weak(state, state + 1, std::memory_order_acquire)) return true;
+    }
+    return false;
+  }
+
+  inline void unlock_shared() { this->state_.fetch_sub(1, std::memory_order_release); }
+
+  /**********************************************************************
+   * @brief Optimistic mode                                             *
+   **********************************************************************/
+
+  /**
+   * @brief Wait until the latch is not exclusively locked, and return its version
+   */
+  inline uint64_t ReadLockOrRestart(bool & /* restart */) const {
+    auto state = this->state_.load(std::memory_order_acquire);
+    while ((state & EXCLUSIVE_BIT) != 0) {
+      NOP_PAUSE;
+      state = this->state_.load(std::memory_order_acquire);
+    }
+    return state & VERSION_MASK;
+  }
+
+  /**
+   * @brief Validate that no writer locked the latch since `version`
+   */
+  inline void ReadUnlockOrRestart(uint64_t version, bool &restart) const {
+    // all reads on the protected content should be done before loading the
+    // state word
+    std::atomic_thread_fence(std::memory_order_acquire);
+    auto state = this->state_.load(std::memory_order_relaxed);
+    if ((state & EXCLUSIVE_BIT) != 0 || (state & VERSION_MASK) != version) restart = true;
+  }
+
+  inline bool IsWriteLocked() const { return (this->state_.load(std::memory_order_relaxed) & EXCLUSIVE_BIT) != 0; }
+
+private:
+  static constexpr uint64_t READERS_MASK = (1ULL << 31) - 1;
+  static constexpr uint64_t EXCLUSIVE_BIT = 1ULL << 31;
+  static constexpr uint64_t VERSION_STEP = 1ULL << 32;
+  static constexpr uint64_t VERSION_MASK = ~(VERSION_STEP - 1);
+
+  std::atomic<uint64_t> state_;
+};
+
+}  // namespace btree::common
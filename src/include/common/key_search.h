@@ -0,0 +1,185 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "common/fixed_string.h"
+
+namespace btree::common {
+
+/**
+ * @brief Intra-node search over a sorted key array
+ *  The generic version is std::lower_bound, integral keys of 32/64 bits use a
+ *    SIMD kernel instead (see below)
+ */
+template <typename KeyType, typename Enable = void>
+struct KeySearch {
+  /**
+   * @return Index of the first key in `keys[0, size)` which is not less than `key`
+   */
+  static int LowerBound(const KeyType *keys, int size, const KeyType &key) {
+    return std::lower_bound(keys, keys + size, key) - keys;
+  }
+};
+
+/**
+ * @brief Branch-free search for 32/64-bit integral keys
+ *  A branch-free binary search narrows the range down to a few SIMD registers
+ *    worth of keys, then the keys less than `key` in that block are counted
+ *  The kernel is chosen at compile time: AVX-512 if __AVX512F__, AVX2 if
+ *    __AVX2__, and a scalar loop otherwise (configure with ENABLE_NATIVE_ARCH)
+ *  The result is always within [0, size] even if `keys` is not sorted, e.g.
+ *    during an optimistic read
+ */
+template <typename KeyType>
+struct KeySearch<KeyType,
+                 std::enable_if_t<std::is_integral_v<KeyType> && (sizeof(KeyType) == 4 || sizeof(KeyType) == 8)>> {
+#if defined(__AVX512F__)
+  static constexpr int LANES = 64 / sizeof(KeyType);
+#elif defined(__AVX2__)
+  static constexpr int LANES = 32 / sizeof(KeyType);
+#else
+  static constexpr int LANES = 8;
+#endif
+  /** Size of the block scanned linearly at the end of the binary search */
+  static constexpr int BLOCK_SIZE = 4 * LANES;
+
+  static int LowerBound(const KeyType *keys, int size, const KeyType &key) {
+    // invariant: keys before `base` are less than `key`, and the result is at most base + size
+    auto base = keys;
+    while (size > BLOCK_SIZE) {
+      int half = size / 2;
+      base = (base[half - 1] < key) ? base + half : base;
+      size -= half;
+    }
+    return (base - keys) + CountLess(base, size, key);
+  }
+
+private:
+  static int CountLess(const KeyType *keys, int size, KeyType key) {
+    int count = 0, idx = 0;
+#if defined(__AVX512F__)
+    if constexpr (sizeof(KeyType) == 4) {
+      auto pivot = _mm512_set1_epi32(key);
+      for (; idx + LANES <= size; idx += LANES) {
+        auto block = _mm512_loadu_si512(keys + idx);
+        auto mask = std::is_signed_v<KeyType> ? _mm512_cmplt_epi32_mask(block, pivot)
+                                              : _mm512_cmplt_epu32_mask(block, pivot);
+        count += __builtin_popcount(mask);
+      }
+    } else {
+      auto pivot = _mm512_set1_epi64(key);
+      for (; idx + LANES <= size; idx += LANES) {
+        auto block = _mm512_loadu_si512(keys + idx);
+        auto mask = std::is_signed_v<KeyType> ? _mm512_cmplt_epi64_mask(block, pivot)
+                                              : _mm512_cmplt_epu64_mask(block, pivot);
+        count += __builtin_popcount(mask);
+      }
+    }
+#elif defined(__AVX2__)
+    // AVX2 only compares signed integers, unsigned ones are shifted by flipping their sign bit
+    constexpr KeyType SIGN_FLIP = std::is_signed_v<KeyType> ? 0 : KeyType(1) << (8 * sizeof(KeyType) - 1);
+    if constexpr (sizeof(KeyType) == 4) {
+      auto flip = _mm256_set1_epi32(static_cast<int32_t>(SIGN_FLIP));
+      auto pivot = _mm256_set1_epi32(static_cast<int32_t>(key ^ SIGN_FLIP));
+      for (; idx + LANES <= size; idx += LANES) {
+        auto block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + idx)), flip);
+        auto less = _mm256_cmpgt_epi32(pivot, block);
+        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(less)));
+      }
+    } else {
+      auto flip = _mm256_set1_epi64x(static_cast<int64_t>(SIGN_FLIP));
+      auto pivot = _mm256_set1_epi64x(static_cast<int64_t>(key ^ SIGN_FLIP));
+      for (; idx + LANES <= size; idx += LANES) {
+        auto block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + idx)), flip);
+        auto less = _mm256_cmpgt_epi64(pivot, block);
+        count += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(less)));
+      }
+    }
+#endif
+    // scalar remainder, which compilers can vectorize on their own as well
+    for (; idx < size; ++idx) count += (keys[idx] < key);
+    return count;
+  }
+};
+
+/**
+ * @brief Separator keys produced by leaf splits
+ *  The separator `s` of two adjacent leaves only has to route the keys
+ *    correctly, i.e. left_max <= s < right_min, the generic version is left_max
+ */
+template <typename KeyType, typename Enable = void>
+struct KeySeparator {
+  static KeyType Shortest(const KeyType &left_max, const KeyType & /* right_min */) { return left_max; }
+};
+
+/**
+ * @brief Suffix truncation for string keys
+ *  The shortest prefix of right_min which is greater than left_max still
+ *    separates the two leaves, e.g. "abc" and "abxyz" are separated by "abx"
+ *  Shorter separators make internal nodes smaller and faster to search
+ */
+struct StringKeySeparator {
+  /**
+   * @return Length of the prefix of `right_min` to use as the separator, or 0
+   * if left_max itself is not longer than that prefix
+   */
+  static std::size_t PrefixLength(std::string_view left_max, std::string_view right_min) {
+    assert(left_max < right_min);
+    auto mismatch = std::mismatch(left_max.begin(), left_max.end(), right_min.begin(), right_min.end());
+    std::size_t length = mismatch.second - right_min.begin() + 1;
+    // the separator should be strictly less than right_min, hence a proper prefix of it
+    return (length < right_min.size() && length < left_max.size()) ? length : 0;
+  }
+};
+
+template <>
+struct KeySeparator<std::string> {
+  static std::string Shortest(const std::string &left_max, const std::string &right_min) {
+    auto length = StringKeySeparator::PrefixLength(left_max, right_min);
+    return (length > 0) ? right_min.substr(0, length) : left_max;
+  }
+};
+
+template <std::size_t Capacity>
+struct KeySeparator<FixedString<Capacity>> {
+  static FixedString<Capacity> Shortest(const FixedString<Capacity> &left_max,
+                                        const FixedString<Capacity> &right_min) {
+    auto length = StringKeySeparator::PrefixLength(left_max.View(), right_min.View());
+    return (length > 0) ? FixedString<Capacity>(right_min.View().substr(0, length)) : left_max;
+  }
+};
+
+}  // namespace btree::common
@@ -28,10 +28,22 @@ OTHER DEALINGS IN THE SOFTWARE.
  */
 #define NOP_PAUSE ({ __asm__ volatile("pause" ::); })
 
+/**
+ * Prefetch the first LINES cache lines starting at ADDR for reading
+ */
+#define PREFETCH_READ(ADDR, LINES)                                                                                  \
+  ({                                                                                                                \
+    for (int __line = 0; __line < (LINES); ++__line) {                                                              \
+      __builtin_prefetch(reinterpret_cast<const char *>(ADDR) + __line * btree::common::Constants::CACHELINE_SIZE); \
+    }                                                                                                               \
+  })
+
 //===----------------------------------------------------------------------===//
 // Helper macros for B-Tree
 //===----------------------------------------------------------------------===//
 #define UNDERFLOW_BOUND(N) (((N) + 1) / 2)
+// smallest size of a node with capacity N that is not rebalanced, i.e. N * PERCENT% rounded up
+#define MERGE_BOUND(N, PERCENT) (((N) * (PERCENT) + 99) / 100)
 #define LEFTMOST_KEY(NODE)      \
   ({                            \
     assert((NODE)->Size() > 0); \
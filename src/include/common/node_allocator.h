@@ -0,0 +1,211 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "common/constants.h"
+#include "common/numa.h"
+#include "common/spinlock.h"
+
+namespace btree::common {
+
+/**
+ * @brief Node allocators provide memory for tree nodes
+ *  Every node allocator should provide:
+ *  - void *Allocate(std::size_t size)
+ *  - static void Deallocate(void *ptr, std::size_t size)
+ *  - static Allocator *Owner(const void *ptr, std::size_t size): the allocator
+ *    which allocated `ptr`, used to allocate the new sibling of a split node
+ *  - static constexpr bool GLOBAL: whether nodes can be allocated without any
+ *    allocator instance
+ *
+ *  Every allocated node should be aligned to the cache line size
+ *
+ * DefaultNodeAllocator simply forwards all requests to the global allocator
+ */
+class DefaultNodeAllocator {
+public:
+  static constexpr bool GLOBAL = true;
+
+  static DefaultNodeAllocator *Owner(const void * /* ptr */, std::size_t /* size */) {
+    static DefaultNodeAllocator instance;
+    return &instance;
+  }
+
+  void *Allocate(std::size_t size) { return ::operator new(size, std::align_val_t(Constants::CACHELINE_SIZE)); }
+
+  static void Deallocate(void *ptr, std::size_t /* size */) {
+    ::operator delete(ptr, std::align_val_t(Constants::CACHELINE_SIZE));
+  }
+};
+
+/**
+ * @brief Slab allocator for tree nodes
+ *  Nodes are carved out of cache-line aligned slabs, and freed nodes are kept
+ *    in a free list per slot size for later allocations
+ *  Every slot stores a pointer to its owning pool right after the node, hence
+ *    a node can be freed without knowing its pool
+ *  Slabs are only returned to the system when the pool is destroyed, so the
+ *    pool must outlive all of its nodes
+ *  The pool can be bound to a NUMA node, which is then preferred for all of
+ *    its slabs
+ */
+template <std::size_t SlabSize = (1 << 16)>
+class NodePool {
+public:
+  static constexpr bool GLOBAL = false;
+
+  NodePool() = default;
+
+  // non-copyable/non-movable
+  NodePool(const NodePool &) = delete;
+  NodePool(NodePool &&) = delete;
+  NodePool &operator=(const NodePool &) = delete;
+
+  ~NodePool() {
+    for (auto &slab : this->slabs_) std::free(slab.data_);
+  }
+
+  void *Allocate(std::size_t size) {
+    auto slot_size = SlotSize(size);
+    void *slot;
+    this->latch_.Lock();
+    auto &size_class = this->FindSizeClass(slot_size);
+    if (size_class.free_list_ != nullptr) {
+      slot = size_class.free_list_;
+      size_class.free_list_ = size_class.free_list_->next_;
+    } else {
+      if (static_cast<std::size_t>(size_class.end_ - size_class.next_) < slot_size && !this->NewSlab(size_class)) {
+        this->latch_.Unlock();
+        throw std::bad_alloc();
+      }
+      slot = size_class.next_;
+      size_class.next_ += slot_size;
+    }
+    this->latch_.Unlock();
+    *OwnerPtr(slot, size) = this;
+    return slot;
+  }
+
+  static void Deallocate(void *ptr, std::size_t size) {
+    auto pool = Owner(ptr, size);
+    auto free_slot = static_cast<FreeSlot *>(ptr);
+    pool->latch_.Lock();
+    auto &size_class = pool->FindSizeClass(SlotSize(size));
+    free_slot->next_ = size_class.free_list_;
+    size_class.free_list_ = free_slot;
+    pool->latch_.Unlock();
+  }
+
+  static NodePool *Owner(const void *ptr, std::size_t size) { return *OwnerPtr(ptr, size); }
+
+  /**
+   * Prefer `numa_node` for all slabs, including the existing ones, whose pages
+   *  are migrated there
+   */
+  void BindToNode(int numa_node) {
+    this->latch_.Lock();
+    this->numa_node_ = numa_node;
+    for (auto &slab : this->slabs_) Numa::BindMemory(slab.data_, slab.size_, numa_node);
+    this->latch_.Unlock();
+  }
+
+  /** Number of slabs reserved from the system */
+  std::size_t SlabCount() {
+    this->latch_.Lock();
+    auto count = this->slabs_.size();
+    this->latch_.Unlock();
+    return count;
+  }
+
+private:
+  static_assert(SlabSize % Constants::CACHELINE_SIZE == 0, "Slabs should be cache-line aligned");
+
+  struct FreeSlot {
+    FreeSlot *next_;
+  };
+
+  struct Slab {
+    char *data_;
+    std::size_t size_;
+  };
+
+  struct SizeClass {
+    std::size_t slot_size_;
+    FreeSlot *free_list_;
+    /** Unused area of the latest slab of this size class */
+    char *next_;
+    char *end_;
+  };
+
+  static constexpr std::size_t OwnerOffset(std::size_t size) {
+    return (size + alignof(NodePool *) - 1) / alignof(NodePool *) * alignof(NodePool *);
+  }
+
+  static constexpr std::size_t SlotSize(std::size_t size) {
+    return (OwnerOffset(size) + sizeof(NodePool *) + Constants::CACHELINE_SIZE - 1) / Constants::CACHELINE_SIZE *
+           Constants::CACHELINE_SIZE;
+  }
+
+  static NodePool **OwnerPtr(const void *ptr, std::size_t size) {
+    return reinterpret_cast<NodePool **>(static_cast<char *>(const_cast<void *>(ptr)) + OwnerOffset(size));
+  }
+
+  /**
+   * Require the caller to already have locked the pool
+   *  The returned reference is invalidated by the next call
+   */
+  SizeClass &FindSizeClass(std::size_t slot_size) {
+    for (auto &size_class : this->size_classes_) {
+      if (size_class.slot_size_ == slot_size) return size_class;
+    }
+    this->size_classes_.push_back({slot_size, nullptr, nullptr, nullptr});
+    return this->size_classes_.back();
+  }
+
+  bool NewSlab(SizeClass &size_class) {
+    // nodes larger than a slab get a dedicated one
+    auto slab_size = std::max(SlabSize, size_class.slot_size_);
+    auto slab = static_cast<char *>(std::aligned_alloc(Constants::CACHELINE_SIZE, slab_size));
+    if (slab == nullptr) return false;
+    // before the first touch, so that the pages are directly allocated there
+    if (this->numa_node_ >= 0) Numa::BindMemory(slab, slab_size, this->numa_node_);
+    this->slabs_.push_back({slab, slab_size});
+    size_class.next_ = slab;
+    size_class.end_ = slab + slab_size;
+    return true;
+  }
+
+  Spinlock latch_;
+  std::vector<SizeClass> size_classes_;
+  std::vector<Slab> slabs_;
+  int numa_node_ = -1;
+};
+
+}  // namespace btree::common
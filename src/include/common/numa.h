@@ -0,0 +1,108 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace btree::common {
+
+/**
+ * @brief Minimal NUMA helpers, which read the topology from sysfs and call
+ *  the kernel directly, so that libnuma is not required
+ *  All of them are best-effort: on a machine (or container) without NUMA
+ *  support, there is a single node 0, and binding silently does nothing
+ */
+struct Numa {
+  /** Largest node ID supported by the bitmasks below */
+  static constexpr int MAX_NODES = 64;
+
+  /** @return Number of online nodes, at least 1 */
+  static int NodeCount() {
+    int count = 0;
+    ForEachInList("/sys/devices/system/node/online", [&](int node) { count = std::max(count, node + 1); });
+    return std::max(1, std::min(count, MAX_NODES));
+  }
+
+  /**
+   * Prefer `node` for the pages of [addr, addr + size), including the ones
+   *  already touched, which are migrated. Only the pages fully inside the
+   *  range are bound, so that neighbouring allocations are left alone
+   * @return Whether the kernel accepted the policy
+   */
+  static bool BindMemory(void *addr, std::size_t size, int node) {
+    if (node < 0 || node >= MAX_NODES) return false;
+    auto page_size = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+    auto begin = (reinterpret_cast<uintptr_t>(addr) + page_size - 1) / page_size * page_size;
+    auto end = (reinterpret_cast<uintptr_t>(addr) + size) / page_size * page_size;
+    if (begin >= end) return false;
+    unsigned long node_mask = 1UL << node;
+    return ::syscall(SYS_mbind, begin, end - begin, MPOL_PREFERRED, &node_mask, MAX_NODES + 1, MPOL_MF_MOVE) == 0;
+  }
+
+  /**
+   * Restrict the calling thread to the CPUs of `node`
+   * @return Whether the affinity was changed
+   */
+  static bool BindThread(int node) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    ForEachInList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", [&](int cpu) {
+      if (cpu < CPU_SETSIZE) CPU_SET(cpu, &cpus);
+    });
+    return CPU_COUNT(&cpus) > 0 && ::sched_setaffinity(0, sizeof(cpu_set_t), &cpus) == 0;
+  }
+
+private:
+  /** From linux/mempolicy.h */
+  static constexpr int MPOL_PREFERRED = 1;
+  static constexpr unsigned MPOL_MF_MOVE = 1U << 1;
+
+  /** Parse a sysfs list such as "0-3,8-11" */
+  template <typename Fn>
+  static void ForEachInList(const std::string &path, Fn fn) {
+    std::ifstream file(path);
+    std::string range;
+    while (std::getline(file, range, ',')) {
+      auto dash = range.find('-');
+      try {
+        int first = std::stoi(range.substr(0, dash));
+        int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+        for (int id = first; id <= last; ++id) fn(id);
+      } catch (const std::logic_error &) {
+        return;
+      }
+    }
+  }
+};
+
+}  // namespace btree::common
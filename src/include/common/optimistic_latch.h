@@ -0,0 +1,127 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "common/macros.h"
+
+namespace btree::common {
+
+/**
+ * @brief Version latch for Optimistic Lock Coupling
+ *  The version word is laid out as follow:
+ *    - bit 0: obsolete flag, the node is no longer part of the tree
+ *    - bit 1: exclusive flag, a writer is modifying the node
+ *    - the remaining bits: version counter, increased after every modification
+ *  Readers never write to the latch, they only validate that the version does
+ *    not change during their read
+ *  All the *OrRestart() utilities set `restart` to true if the caller has to
+ *    restart its operation, `restart` is never reset to false
+ */
+class OptimisticLatch {
+public:
+  OptimisticLatch() : version_(VERSION_STEP) {}
+
+  // non-copyable/non-movable
+  OptimisticLatch(const OptimisticLatch &) = delete;
+  OptimisticLatch(OptimisticLatch &&) = delete;
+  OptimisticLatch &operator=(const OptimisticLatch &) = delete;
+
+  static constexpr bool IsLocked(uint64_t version) { return (version & LOCKED_BIT) == LOCKED_BIT; }
+  static constexpr bool IsObsolete(uint64_t version) { return (version & OBSOLETE_BIT) == OBSOLETE_BIT; }
+
+  /**
+   * @brief Wait until the latch is not exclusively locked, and return its version
+   */
+  inline uint64_t ReadLockOrRestart(bool &restart) const {
+    auto version = this->AwaitNodeUnlocked();
+    if (IsObsolete(version)) restart = true;
+    return version;
+  }
+
+  /**
+   * @brief Validate that the protected content is not modified since `version`
+   *  Alias of ReadUnlockOrRestart, used when the caller still continues reading
+   */
+  inline void CheckOrRestart(uint64_t version, bool &restart) const { this->ReadUnlockOrRestart(version, restart); }
+
+  inline void ReadUnlockOrRestart(uint64_t version, bool &restart) const {
+    // all reads on the protected content should be done before loading the
+    // version word
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (version != this->version_.load(std::memory_order_relaxed)) restart = true;
+  }
+
+  /**
+   * @brief Atomically upgrade a read `version` to the exclusive lock
+   *  The upgrade fails if anyone modifies the content since `version`
+   */
+  inline void UpgradeToWriteLockOrRestart(uint64_t version, bool &restart) {
+    if (!this->version_.compare_exchange_strong(version, version + LOCKED_BIT, std::memory_order_acquire)) {
+      restart = true;
+    }
+  }
+
+  inline void WriteLockOrRestart(bool &restart) {
+    while (true) {
+      auto version = this->ReadLockOrRestart(restart);
+      if (restart) return;
+      bool upgrade_failed = false;
+      this->UpgradeToWriteLockOrRestart(version, upgrade_failed);
+      if (!upgrade_failed) return;
+    }
+  }
+
+  /**
+   * @brief Release the exclusive lock, which also increases the version counter
+   */
+  inline void WriteUnlock() { this->version_.fetch_add(LOCKED_BIT, std::memory_order_release); }
+
+  /**
+   * @brief Release the exclusive lock and mark the protected content as obsolete
+   */
+  inline void WriteUnlockObsolete() { this->version_.fetch_add(LOCKED_BIT + OBSOLETE_BIT, std::memory_order_release); }
+
+  inline bool IsWriteLocked() const { return IsLocked(this->version_.load(std::memory_order_relaxed)); }
+
+private:
+  static constexpr uint64_t OBSOLETE_BIT = 0b01;
+  static constexpr uint64_t LOCKED_BIT = 0b10;
+  static constexpr uint64_t VERSION_STEP = 0b100;
+
+  inline uint64_t AwaitNodeUnlocked() const {
+    auto version = this->version_.load(std::memory_order_acquire);
+    while (IsLocked(version)) {
+      NOP_PAUSE;
+      version = this->version_.load(std::memory_order_acquire);
+    }
+    return version;
+  }
+
+  std::atomic<uint64_t> version_;
+};
+
+}  // namespace btree::common
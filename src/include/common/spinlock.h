@@ -24,6 +24,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 
 #include "common/macros.h"
 
@@ -50,4 +51,60 @@ private:
   std::atomic_flag flag_;
 };
 
+/**
+ * @brief Compact reader-writer spinlock, a drop-in replacement of
+ *    std::shared_mutex (4 bytes instead of 56, and no futex sleep)
+ *  The state word is laid out as follow:
+ *    - bit 31: exclusive flag
+ *    - bit 30: pending flag, a writer is waiting, so new readers back off to
+ *      prevent writer starvation
+ *    - the remaining bits: number of readers
+ */
+class SharedSpinlock {
+public:
+  SharedSpinlock() : state_(0) {}
+
+  // non-copyable/non-movable
+  SharedSpinlock(const SharedSpinlock &) = delete;
+  SharedSpinlock(SharedSpinlock &&) = delete;
+  SharedSpinlock &operator=(const SharedSpinlock &) = delete;
+
+  inline void lock() {
+    while (!this->try_lock()) {
+      this->state_.fetch_or(PENDING_BIT, std::memory_order_relaxed);
+      NOP_PAUSE;
+    }
+  }
+
+  inline bool try_lock() {
+    auto state = this->state_.load(std::memory_order_relaxed);
+    // only succeed without any reader or writer, the pending flag is cleared as well
+    return (state & ~PENDING_BIT) == 0 &&
+           this->state_.compare_exchange_strong(state, EXCLUSIVE_BIT, std::memory_order_acquire);
+  }
+
+  inline void unlock() { this->state_.store(0, std::memory_order_release); }
+
+  inline void lock_shared() {
+    while (!this->try_lock_shared()) NOP_PAUSE;
+  }
+
+  inline bool try_lock_shared() {
+    auto state = this->state_.load(std::memory_order_relaxed);
+    // a failed CAS reloads `state`, so only other readers can make it retry
+    while ((state & (EXCLUSIVE_BIT | PENDING_BIT)) == 0) {
+      if (this->state_.compare_exchange_weak(state, state + 1, std::memory_order_acquire)) return true;
+    }
+    return false;
+  }
+
+  inline void unlock_shared() { this->state_.fetch_sub(1, std::memory_order_release); }
+
+private:
+  static constexpr uint32_t EXCLUSIVE_BIT = 1U << 31;
+  static constexpr uint32_t PENDING_BIT = 1U << 30;
+
+  std::atomic<uint32_t> state_;
+};
+
 }  // namespace btree::common
\ No newline at end of file
@@ -0,0 +1,224 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common/constants.h"
+
+namespace btree::common {
+
+/**
+ * @brief Latency histogram with power-of-two buckets
+ *  Bucket I counts the latencies in [2^I, 2^(I+1)) nanoseconds, except bucket
+ *    0 which counts [0, 2), and the last one which counts everything above
+ *  Recording is a few relaxed atomic increments, readers get a snapshot which
+ *    may be slightly inconsistent under concurrent recording
+ */
+class LatencyHistogram {
+public:
+  static constexpr int BUCKETS = 40;
+
+  struct Snapshot {
+    std::array<uint64_t, BUCKETS> buckets_{};
+    uint64_t count_ = 0;
+    uint64_t total_nanos_ = 0;
+
+    double Mean() const { return (this->count_ == 0) ? 0 : static_cast<double>(this->total_nanos_) / this->count_; }
+
+    /**
+     * @return Upper bound (in nanoseconds) of the bucket of the `percentile`
+     * latency, e.g. Percentile(0.99)
+     */
+    uint64_t Percentile(double percentile) const {
+      auto target = static_cast<uint64_t>(percentile * this->count_);
+      uint64_t seen = 0;
+      for (int idx = 0; idx < BUCKETS; ++idx) {
+        seen += this->buckets_[idx];
+        if (seen > target) return (uint64_t{2} << idx) - 1;
+      }
+      return (this->count_ == 0) ? 0 : (uint64_t{2} << (BUCKETS - 1)) - 1;
+    }
+  };
+
+  static constexpr int BucketIndex(uint64_t nanos) {
+    int idx = 0;
+    while (nanos > 1 && idx < BUCKETS - 1) {
+      nanos >>= 1;
+      idx++;
+    }
+    return idx;
+  }
+
+  void Record(uint64_t nanos) {
+    this->buckets_[BucketIndex(nanos)].fetch_add(1, std::memory_order_relaxed);
+    this->total_nanos_.fetch_add(nanos, std::memory_order_relaxed);
+  }
+
+  Snapshot Read() const {
+    Snapshot snapshot;
+    for (int idx = 0; idx < BUCKETS; ++idx) {
+      snapshot.buckets_[idx] = this->buckets_[idx].load(std::memory_order_relaxed);
+      snapshot.count_ += snapshot.buckets_[idx];
+    }
+    snapshot.total_nanos_ = this->total_nanos_.load(std::memory_order_relaxed);
+    return snapshot;
+  }
+
+private:
+  std::array<std::atomic<uint64_t>, BUCKETS> buckets_{};
+  std::atomic<uint64_t> total_nanos_{0};
+};
+
+/**
+ * @brief Occupancy of all nodes of a tree level
+ */
+struct LevelFill {
+  static constexpr int BUCKETS = 10;
+
+  size_t nodes_ = 0;
+  size_t entries_ = 0;
+  /** Capacity of a single node of this level */
+  size_t capacity_ = 0;
+  /**
+   * Bucket I counts the nodes whose fill factor is in [I / 10, (I + 1) / 10),
+   * and the last one counts the full nodes
+   */
+  std::array<size_t, BUCKETS + 1> fill_histogram_{};
+
+  void AddNode(size_t entries) {
+    this->nodes_++;
+    this->entries_ += entries;
+    this->fill_histogram_[entries * BUCKETS / this->capacity_]++;
+  }
+
+  double FillFactor() const {
+    return (this->nodes_ == 0) ? 0 : static_cast<double>(this->entries_) / (this->nodes_ * this->capacity_);
+  }
+};
+
+/**
+ * @brief A point-in-time copy of the statistics of a tree
+ *  The counters and latch wait histograms are only collected if the tree is
+ *    built with ENABLE_STATISTICS, they are all zero otherwise
+ */
+struct TreeStatisticsSnapshot {
+  /**
+   * Latch wait latencies by latch depth: 0 is the tree latch, 1 the root, and
+   *  so on. Only contended acquisitions are recorded
+   */
+  std::vector<LatencyHistogram::Snapshot> latch_waits_;
+  uint64_t leaf_splits_ = 0;
+  uint64_t internal_splits_ = 0;
+  uint64_t merges_ = 0;
+  uint64_t borrows_ = 0;
+  uint64_t root_changes_ = 0;
+  /** Optimistic writes which had to restart pessimistically */
+  uint64_t optimistic_restarts_ = 0;
+  /** Inserts into the leaf cached by the previous Insert of their thread */
+  uint64_t leaf_cache_hits_ = 0;
+  /** Iterators which re-descended from the root as their next leaf was busy */
+  uint64_t scan_restarts_ = 0;
+};
+
+/**
+ * @brief Contention and structure modification counters of a tree, updated by
+ *  the operations when built with ENABLE_STATISTICS
+ */
+class TreeStatistics {
+public:
+  /** Latches deeper than that, e.g. of leaves reached by scans, share the last histogram */
+  static constexpr int LEVELS = Constants::MAX_HEIGHT + 1;
+
+  void RecordLatchWait(size_t depth, uint64_t nanos) {
+    this->latch_waits_[(depth < LEVELS) ? depth : LEVELS - 1].Record(nanos);
+  }
+
+  /** Fill the counters of `snapshot` */
+  void Read(TreeStatisticsSnapshot &snapshot) const {
+    // trailing levels which were never waited on are left out
+    int used = LEVELS;
+    while (used > 0 && this->latch_waits_[used - 1].Read().count_ == 0) used--;
+    for (int depth = 0; depth < used; ++depth) snapshot.latch_waits_.push_back(this->latch_waits_[depth].Read());
+    snapshot.leaf_splits_ = this->leaf_splits_.load(std::memory_order_relaxed);
+    snapshot.internal_splits_ = this->internal_splits_.load(std::memory_order_relaxed);
+    snapshot.merges_ = this->merges_.load(std::memory_order_relaxed);
+    snapshot.borrows_ = this->borrows_.load(std::memory_order_relaxed);
+    snapshot.root_changes_ = this->root_changes_.load(std::memory_order_relaxed);
+    snapshot.optimistic_restarts_ = this->optimistic_restarts_.load(std::memory_order_relaxed);
+    snapshot.leaf_cache_hits_ = this->leaf_cache_hits_.load(std::memory_order_relaxed);
+    snapshot.scan_restarts_ = this->scan_restarts_.load(std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> leaf_splits_{0};
+  std::atomic<uint64_t> internal_splits_{0};
+  std::atomic<uint64_t> merges_{0};
+  std::atomic<uint64_t> borrows_{0};
+  std::atomic<uint64_t> root_changes_{0};
+  std::atomic<uint64_t> optimistic_restarts_{0};
+  std::atomic<uint64_t> leaf_cache_hits_{0};
+  std::atomic<uint64_t> scan_restarts_{0};
+
+private:
+  std::array<LatencyHistogram, LEVELS> latch_waits_;
+};
+
+/**
+ * @brief Lock `latch` through `try_lock`/`lock`, and record the wait into
+ *  `statistics` if the first attempt fails, an uncontended acquisition only
+ *  costs a single try-lock
+ */
+template <typename TryLockFn, typename LockFn>
+inline void TimedLock(TreeStatistics *statistics, size_t depth, const TryLockFn &try_lock, const LockFn &lock) {
+  if (try_lock()) return;
+  auto start = std::chrono::steady_clock::now();
+  lock();
+  if (statistics != nullptr) {
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    statistics->RecordLatchWait(depth, nanos.count());
+  }
+}
+
+}  // namespace btree::common
+
+/**
+ * Increase COUNTER of the TreeStatistics attached to CONTEXT, which compiles to
+ *  nothing without ENABLE_STATISTICS
+ */
+#ifdef ENABLE_STATISTICS
+#define STATISTICS_INC(CONTEXT, COUNTER)                                       \
+  ({                                                                           \
+    if ((CONTEXT)->statistics_ != nullptr) {                                   \
+      (CONTEXT)->statistics_->COUNTER.fetch_add(1, std::memory_order_relaxed); \
+    }                                                                          \
+  })
+#else
+#define STATISTICS_INC(CONTEXT, COUNTER) ({})
+#endif
@@ -0,0 +1,419 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace btree::common {
+
+/**
+ * @brief Logical redo log of a tree, whose records are group-committed by a
+ *  dedicated flusher thread
+ *  A record is a 1-byte type followed by the raw bytes of the key, and of the
+ *    value for INSERT records. Records are appended to an in-memory buffer,
+ *    and the flusher writes the whole buffer as a single batch with one
+ *    fdatasync(), so that all the writers waiting meanwhile share it
+ *  Every batch is prefixed by its size and checksum, a torn batch at the end
+ *    of the file is discarded when the log is opened
+ *  Log Sequence Numbers (LSN) are the logical byte offsets of the end of the
+ *    records, i.e. a record is durable once the durable LSN reaches its LSN.
+ *    The file starts with the LSN of its first byte, so that LSNs keep growing
+ *    across Rewrite()
+ */
+template <typename KeyType, typename ValueType>
+class WriteAheadLog {
+  static_assert(std::is_trivially_copyable_v<KeyType> && std::is_trivially_copyable_v<ValueType>,
+                "Records are written as raw bytes");
+
+public:
+  enum RecordType : uint8_t { INSERT = 1, DELETE = 2 };
+
+  /**
+   * Open the log of `path`, which is created if it doesn't exist
+   * @param synchronous     Whether WaitDurable() blocks until the record is
+   *    on disk. Otherwise, at most `flush_interval` of writes is lost on crash
+   * @param flush_interval  Period of the flusher, which is also woken up by
+   *    every synchronous commit
+   * @throw std::runtime_error if it can't be opened, or is not a log file
+   */
+  explicit WriteAheadLog(const std::string &path, bool synchronous = true,
+                         std::chrono::microseconds flush_interval = std::chrono::microseconds(1000))
+      : path_(path), synchronous_(synchronous), flush_interval_(flush_interval), stopped_(false), failed_(false) {
+    this->fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (this->fd_ < 0) throw std::runtime_error("Can't open log file " + path);
+    auto base_lsn = this->ReadLogHeader();
+    this->file_size_ = this->ValidSize();
+    if (::ftruncate(this->fd_, this->file_size_) != 0) {
+      ::close(this->fd_);
+      throw std::runtime_error("Can't truncate log file " + path);
+    }
+    this->appended_lsn_ = this->durable_lsn_ = base_lsn + this->file_size_ - sizeof(LogHeader);
+    this->flusher_ = std::thread([this]() { this->FlushInBackground(); });
+  }
+
+  ~WriteAheadLog() {
+    {
+      std::lock_guard<std::mutex> guard(this->latch_);
+      this->stopped_ = true;
+    }
+    this->flusher_cv_.notify_one();
+    this->flusher_.join();
+    ::close(this->fd_);
+  }
+
+  // non-copyable, as it owns the file descriptor and the flusher
+  WriteAheadLog(const WriteAheadLog &) = delete;
+  WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+  bool Synchronous() const { return this->synchronous_; }
+
+  /**
+   * Append a record, which is not durable before WaitDurable() returns
+   *  Records of the same key should be appended in the order they are applied
+   * @return LSN of the record
+   * @throw std::runtime_error if the log can't be written anymore
+   */
+  uint64_t Append(RecordType type, const KeyType &key, const ValueType *val) {
+    char record[1 + sizeof(KeyType) + sizeof(ValueType)];
+    record[0] = type;
+    std::memcpy(record + 1, &key, sizeof(KeyType));
+    std::size_t size = 1 + sizeof(KeyType);
+    if (type == INSERT) {
+      std::memcpy(record + size, val, sizeof(ValueType));
+      size += sizeof(ValueType);
+    }
+    std::lock_guard<std::mutex> guard(this->latch_);
+    if (this->failed_) throw std::runtime_error("Can't write log file " + this->path_);
+    this->buffer_.insert(this->buffer_.end(), record, record + size);
+    this->appended_lsn_ += size;
+    return this->appended_lsn_;
+  }
+
+  /**
+   * Block until the record of `lsn` is durable, if the log is synchronous
+   *  Should be called without holding any latch of the tree, so that all the
+   *  writers waiting for the same batch do so concurrently
+   * @throw std::runtime_error if the log can't be written anymore
+   */
+  void WaitDurable(uint64_t lsn) {
+    if (!this->synchronous_) return;
+    std::unique_lock<std::mutex> guard(this->latch_);
+    this->WaitForLsn(guard, lsn);
+  }
+
+  /** Write and sync all the appended records */
+  void Flush() {
+    std::unique_lock<std::mutex> guard(this->latch_);
+    this->WaitForLsn(guard, this->appended_lsn_);
+  }
+
+  uint64_t DurableLsn() {
+    std::lock_guard<std::mutex> guard(this->latch_);
+    return this->durable_lsn_;
+  }
+
+  /** Number of batches written, each of them with a single sync */
+  std::size_t BatchCount() const { return this->batch_count_; }
+
+  /**
+   * Redo all the durable records in order, by calling
+   *  `redo(type, key, value)`, where `value` is nullptr for DELETE records
+   *  Records still in the buffer are flushed first
+   * Require no concurrent Append()
+   */
+  template <typename RedoFn>
+  void Replay(RedoFn redo) {
+    this->Flush();
+    std::lock_guard<std::mutex> write_guard(this->write_latch_);
+    std::vector<char> batch;
+    for (off_t offset = sizeof(LogHeader); offset < this->file_size_;) {
+      BatchHeader header;
+      this->ReadFully(&header, sizeof(BatchHeader), offset);
+      batch.resize(header.size_);
+      this->ReadFully(batch.data(), header.size_, offset + sizeof(BatchHeader));
+      offset += sizeof(BatchHeader) + header.size_;
+      for (std::size_t pos = 0; pos < batch.size();) {
+        auto type = static_cast<RecordType>(batch[pos]);
+        KeyType key;
+        std::memcpy(&key, batch.data() + pos + 1, sizeof(KeyType));
+        pos += 1 + sizeof(KeyType);
+        if (type == INSERT) {
+          ValueType val;
+          std::memcpy(&val, batch.data() + pos, sizeof(ValueType));
+          pos += sizeof(ValueType);
+          redo(type, key, &val);
+        } else {
+          redo(type, key, static_cast<const ValueType *>(nullptr));
+        }
+      }
+    }
+  }
+
+  /**
+   * Replace the whole log by the records emitted by `fill(append)`, where
+   *  `append(key, value)` emits an INSERT record, e.g. to compact the log
+   *  into the current content of the tree
+   *  The new log is written next to the current one, and atomically renamed,
+   *    the rename is durable once the parent directory is synced
+   * Require no concurrent Append()
+   */
+  template <typename FillFn>
+  void Rewrite(FillFn fill) {
+    this->Flush();
+    std::lock_guard<std::mutex> write_guard(this->write_latch_);
+    auto tmp_path = this->path_ + ".rewrite";
+    int tmp_fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (tmp_fd < 0) throw std::runtime_error("Can't open log file " + tmp_path);
+    // the new log continues the LSNs of the current one
+    LogHeader log_header{LogHeader::MAGIC, this->DurableLsn()};
+    if (::pwrite(tmp_fd, &log_header, sizeof(LogHeader), 0) != static_cast<ssize_t>(sizeof(LogHeader))) {
+      ::close(tmp_fd);
+      throw std::runtime_error("Can't write log file " + tmp_path);
+    }
+    off_t size = sizeof(LogHeader);
+    std::vector<char> batch;
+    auto write_batch = [&]() {
+      if (batch.empty()) return;
+      if (!WriteBatch(tmp_fd, batch, size)) {
+        ::close(tmp_fd);
+        throw std::runtime_error("Can't write log file " + tmp_path);
+      }
+      size += sizeof(BatchHeader) + batch.size();
+      batch.clear();
+    };
+    fill([&](const KeyType &key, const ValueType &val) {
+      batch.push_back(INSERT);
+      batch.insert(batch.end(), reinterpret_cast<const char *>(&key),
+                   reinterpret_cast<const char *>(&key) + sizeof(KeyType));
+      batch.insert(batch.end(), reinterpret_cast<const char *>(&val),
+                   reinterpret_cast<const char *>(&val) + sizeof(ValueType));
+      if (batch.size() >= REWRITE_BATCH_SIZE) write_batch();
+    });
+    write_batch();
+    if (::fdatasync(tmp_fd) != 0 || ::rename(tmp_path.c_str(), this->path_.c_str()) != 0) {
+      ::close(tmp_fd);
+      throw std::runtime_error("Can't replace log file " + this->path_);
+    }
+    ::close(this->fd_);
+    this->fd_ = tmp_fd;
+    this->file_size_ = size;
+    {
+      std::lock_guard<std::mutex> guard(this->latch_);
+      this->appended_lsn_ = this->durable_lsn_ = log_header.base_lsn_ + size - sizeof(LogHeader);
+    }
+    // the new log is in use from now on, even if its name is not durable yet
+    if (!SyncParentDirectory(this->path_)) throw std::runtime_error("Can't sync the directory of " + this->path_);
+  }
+
+  /** Drop all records, require no concurrent Append() */
+  void Reset() {
+    this->Rewrite([](auto /* append */) {});
+  }
+
+private:
+  struct LogHeader {
+    static constexpr uint64_t MAGIC = 0x474f4c4545525442;  // "BTREELOG"
+
+    uint64_t magic_;
+    /** LSN of the first byte after this header */
+    uint64_t base_lsn_;
+  };
+
+  struct BatchHeader {
+    uint32_t size_;
+    uint32_t checksum_;
+  };
+
+  static constexpr std::size_t REWRITE_BATCH_SIZE = 1 << 20;
+
+  std::string path_;
+  int fd_;
+  bool synchronous_;
+  std::chrono::microseconds flush_interval_;
+
+  /** Protects the buffer, the LSNs, and the flusher state */
+  std::mutex latch_;
+  std::vector<char> buffer_;
+  uint64_t appended_lsn_;
+  uint64_t durable_lsn_;
+  std::condition_variable durable_cv_;
+
+  /** Held while writing to the file, which is only done by one thread at a time */
+  std::mutex write_latch_;
+  off_t file_size_;
+  std::atomic<std::size_t> batch_count_ = 0;
+
+  std::thread flusher_;
+  std::condition_variable flusher_cv_;
+  bool stopped_;
+  bool failed_;
+
+  /** FNV-1a */
+  static uint32_t Checksum(const char *data, std::size_t size) {
+    uint32_t hash = 2166136261U;
+    for (std::size_t idx = 0; idx < size; ++idx) {
+      hash ^= static_cast<uint8_t>(data[idx]);
+      hash *= 16777619U;
+    }
+    return hash;
+  }
+
+  static bool WriteBatch(int fd, const std::vector<char> &batch, off_t offset) {
+    BatchHeader header{static_cast<uint32_t>(batch.size()), Checksum(batch.data(), batch.size())};
+    return ::pwrite(fd, &header, sizeof(BatchHeader), offset) == static_cast<ssize_t>(sizeof(BatchHeader)) &&
+           ::pwrite(fd, batch.data(), batch.size(), offset + sizeof(BatchHeader)) ==
+               static_cast<ssize_t>(batch.size());
+  }
+
+  static bool SyncParentDirectory(const std::string &path) {
+    auto separator = path.rfind('/');
+    auto directory = (separator == std::string::npos) ? std::string(".") : path.substr(0, separator + 1);
+    int dir_fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd < 0) return false;
+    bool synced = (::fsync(dir_fd) == 0);
+    ::close(dir_fd);
+    return synced;
+  }
+
+  void ReadFully(void *data, std::size_t size, off_t offset) {
+    if (::pread(this->fd_, data, size, offset) != static_cast<ssize_t>(size)) {
+      throw std::runtime_error("Can't read log file " + this->path_);
+    }
+  }
+
+  /**
+   * Read the header of the log, which is written first if the file is new, or
+   *  if its creation was torn
+   * @return The LSN of the first byte after the header
+   */
+  uint64_t ReadLogHeader() {
+    LogHeader header{LogHeader::MAGIC, 0};
+    auto read = ::pread(this->fd_, &header, sizeof(LogHeader), 0);
+    if (read == static_cast<ssize_t>(sizeof(LogHeader))) {
+      if (header.magic_ == LogHeader::MAGIC) return header.base_lsn_;
+      ::close(this->fd_);
+      throw std::runtime_error("Not a log file " + this->path_);
+    }
+    header = {LogHeader::MAGIC, 0};
+    if (read < 0 || ::pwrite(this->fd_, &header, sizeof(LogHeader), 0) != static_cast<ssize_t>(sizeof(LogHeader)) ||
+        ::fdatasync(this->fd_) != 0) {
+      ::close(this->fd_);
+      throw std::runtime_error("Can't write log file " + this->path_);
+    }
+    return header.base_lsn_;
+  }
+
+  /**
+   * @return Size of the prefix of the file made of complete batches
+   */
+  off_t ValidSize() {
+    struct stat file_stat;
+    if (::fstat(this->fd_, &file_stat) != 0) {
+      ::close(this->fd_);
+      throw std::runtime_error("Can't stat log file " + this->path_);
+    }
+    std::vector<char> batch;
+    off_t offset = sizeof(LogHeader);
+    while (offset + static_cast<off_t>(sizeof(BatchHeader)) <= file_stat.st_size) {
+      BatchHeader header;
+      if (::pread(this->fd_, &header, sizeof(BatchHeader), offset) != static_cast<ssize_t>(sizeof(BatchHeader)) ||
+          offset + static_cast<off_t>(sizeof(BatchHeader) + header.size_) > file_stat.st_size) {
+        break;
+      }
+      batch.resize(header.size_);
+      if (::pread(this->fd_, batch.data(), header.size_, offset + sizeof(BatchHeader)) !=
+              static_cast<ssize_t>(header.size_) ||
+          Checksum(batch.data(), batch.size()) != header.checksum_) {
+        break;
+      }
+      offset += sizeof(BatchHeader) + header.size_;
+    }
+    return offset;
+  }
+
+  /**
+   * Wake the flusher up, and block until `lsn` is durable
+   * Require the caller to already have locked the log
+   */
+  void WaitForLsn(std::unique_lock<std::mutex> &guard, uint64_t lsn) {
+    this->flusher_cv_.notify_one();
+    auto durable = [&]() { return this->durable_lsn_ >= lsn || this->failed_; };
+    while (!this->durable_cv_.wait_for(guard, this->flush_interval_, durable)) {
+    }
+    if (this->durable_lsn_ < lsn) throw std::runtime_error("Can't write log file " + this->path_);
+  }
+
+  void FlushInBackground() {
+    std::vector<char> batch;
+    std::unique_lock<std::mutex> guard(this->latch_);
+    while (true) {
+      if (this->buffer_.empty() && !this->stopped_) this->flusher_cv_.wait_for(guard, this->flush_interval_);
+      if (this->buffer_.empty()) {
+        if (this->stopped_) break;
+        continue;
+      }
+      if (this->failed_) {
+        this->buffer_.clear();
+        continue;
+      }
+      // records appended from now on make up the next batch
+      std::swap(batch, this->buffer_);
+      auto batch_lsn = this->appended_lsn_;
+      guard.unlock();
+      bool written;
+      {
+        std::lock_guard<std::mutex> write_guard(this->write_latch_);
+        written = WriteBatch(this->fd_, batch, this->file_size_) && ::fdatasync(this->fd_) == 0;
+        if (written) this->file_size_ += sizeof(BatchHeader) + batch.size();
+      }
+      batch.clear();
+      guard.lock();
+      if (written) {
+        this->durable_lsn_ = batch_lsn;
+        this->batch_count_++;
+      } else {
+        // the records of the batch are lost, hence nothing can be committed after them
+        this->failed_ = true;
+      }
+      this->durable_cv_.notify_all();
+    }
+  }
+};
+
+}  // namespace btree::common
@@ -0,0 +1,763 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest_prod.h>
+
+#include "common/constants.h"
+#include "common/key_search.h"
+#include "common/macros.h"
+#include "tree/definitions.h"
+
+/**
+ * Lehman-Yao B-link tree
+ *  Every node maintains a high key - the upper bound of all keys in its subtree
+ *  A split only latches the splitting node: the new right sibling is linked
+ *    by `right_sibl_` first, and the separator is posted to the parent later,
+ *    after the latch on the split node is released
+ *  Anyone who lands on a stale node (key > its high key) chases `right_sibl_`
+ *  Therefore, at most two latches (moving right) are held at any moment
+ *
+ * Underflow is tolerated, nodes are never merged nor de-allocated while the
+ *  tree is alive
+ */
+namespace btree::implementation::blink {
+
+/**
+ * @brief NodeMetadata definition for B-link nodes
+ */
+class NodeMetadata {
+public:
+  /** Size of current node */
+  int size_;
+
+  /** Level of current node, leaves are at level 0 */
+  int level_;
+
+  /** Latch for each node */
+  std::shared_mutex latch_;
+
+  /** Constructor */
+  explicit NodeMetadata(int level = 0) : size_(0), level_(level) {}
+
+  constexpr std::shared_mutex *SharedLatchPtr() { return &(this->latch_); }
+
+  void Latch(common::Constants::SharedLockType latch_type) {
+    assert(latch_type != common::Constants::NONE);
+    if (latch_type == common::Constants::SHARE) {
+      this->latch_.lock_shared();
+    } else {
+      this->latch_.lock();
+    }
+  }
+
+  void Unlatch(common::Constants::SharedLockType latch_type) {
+    assert(latch_type != common::Constants::NONE);
+    if (latch_type == common::Constants::SHARE) {
+      this->latch_.unlock_shared();
+    } else {
+      this->latch_.unlock();
+    }
+  }
+};
+
+/**
+ * @brief QueryContext of B-link tree
+ *  Every node releases its own latch, so there is no latch chain to keep
+ */
+class QueryContext {
+public:
+  /** Number of right-links chased by the latest operation */
+  int right_moves_;
+
+  QueryContext() : right_moves_(0) {}
+
+  void Clear() { this->right_moves_ = 0; }
+};
+
+/**
+ * @brief LeafNode class definition
+ */
+template <typename KeyType, typename ValueType, int Capacity>
+class LeafNode : public Node<KeyType, ValueType, QueryContext, NodeMetadata> {
+private:
+  KeyType keys_[Capacity];
+  ValueType values_[Capacity];
+  LeafNode<KeyType, ValueType, Capacity> *right_sibl_;
+  /** All keys in this node are <= high_key_, the right-most leaf doesn't have any */
+  KeyType high_key_;
+  bool has_high_key_;
+
+  bool SearchKeyIndex(const KeyType &key, int &index) {
+    index = common::KeySearch<KeyType>::LowerBound(this->keys_, this->Size(), key);
+    return (index < this->Size() && this->keys_[index] == key);
+  }
+
+  void DeleteIndex(int index, bool &underflow) {
+    std::move(this->keys_ + index + 1, this->keys_ + this->Size(), this->keys_ + index);
+    std::move(this->values_ + index + 1, this->values_ + this->Size(), this->values_ + index);
+    underflow = (--this->Size() < UNDERFLOW_BOUND(Capacity));
+  }
+
+  void ShiftAndInsert(const KeyType &key, const ValueType &val, int insert_pos) {
+    std::move_backward(this->keys_ + insert_pos, this->keys_ + this->Size(), this->keys_ + this->Size() + 1);
+    std::move_backward(this->values_ + insert_pos, this->values_ + this->Size(), this->values_ + this->Size() + 1);
+    this->keys_[insert_pos] = key;
+    this->values_[insert_pos] = val;
+    this->Size()++;
+  }
+
+  /**
+   * Insert into a latched leaf which covers `key`, split it if it's full
+   */
+  bool InsertLatched(const KeyType &key, const ValueType &val,
+                     Split<KeyType, ValueType, QueryContext, NodeMetadata> &split) {
+    int insert_pos;
+    if (this->SearchKeyIndex(key, insert_pos)) {
+      this->values_[insert_pos] = val;
+      return false;
+    }
+    if (this->Size() < Capacity) {
+      this->ShiftAndInsert(key, val, insert_pos);
+      return false;
+    }
+
+    int boundary_idx = UNDERFLOW_BOUND(this->Size());
+    auto new_sibling =
+        new LeafNode<KeyType, ValueType, Capacity>(this->keys_, this->values_, boundary_idx, this->right_sibl_);
+    new_sibling->high_key_ = this->high_key_;
+    new_sibling->has_high_key_ = this->has_high_key_;
+    this->Size() = boundary_idx;
+
+    if (insert_pos < boundary_idx) {
+      this->ShiftAndInsert(key, val, insert_pos);
+    } else {
+      new_sibling->ShiftAndInsert(key, val, insert_pos - boundary_idx);
+    }
+
+    // the new sibling is reachable through the right-link from now on
+    this->high_key_ = RIGHTMOST_KEY(this);
+    this->has_high_key_ = true;
+    this->right_sibl_ = new_sibling;
+
+    split.left = this;
+    split.right = new_sibling;
+    split.boundary_key = this->high_key_;
+    return true;
+  }
+
+public:
+  LeafNode() : right_sibl_(nullptr), has_high_key_(false) {}
+  ~LeafNode() = default;
+
+  /**
+   * Right sibling constructor
+   * @param keys        An array of keys from current LeafNode
+   * @param values      An array of values from current LeafNode
+   * @param start_idx   The new sibling should clone keys in the range of
+   * [start_idx, end)
+   * @param right_sibling
+   */
+  LeafNode(KeyType (&keys)[Capacity], ValueType (&values)[Capacity], int start_idx,
+           LeafNode<KeyType, ValueType, Capacity> *right_sibling)
+      : right_sibl_(right_sibling), has_high_key_(false) {
+    this->Size() = Capacity - start_idx;
+    std::copy(keys + start_idx, keys + Capacity, this->keys_);
+    std::copy(values + start_idx, values + Capacity, this->values_);
+  }
+
+  constexpr NodeType Type() { return LEAF; };
+  LeafNode<KeyType, ValueType, Capacity> *RightSibling() const { return this->right_sibl_; }
+
+  /**
+   * Whether `key` belongs to this node, i.e. its high key is not exceeded
+   * Require the caller to already have latched the node
+   */
+  bool Covers(const KeyType &key) const { return !this->has_high_key_ || key <= this->high_key_; }
+
+  /**
+   * Chase the right-links from this latched node until reaching the one which
+   * covers `key`, the returned node is latched in `latch_type` mode
+   */
+  LeafNode<KeyType, ValueType, Capacity> *MoveRight(const KeyType &key, common::Constants::SharedLockType latch_type,
+                                                    QueryContext *context) {
+    auto node = this;
+    while (!node->Covers(key)) {
+      auto right_sibling = node->right_sibl_;
+      right_sibling->Metadata().Latch(latch_type);
+      node->Metadata().Unlatch(latch_type);
+      node = right_sibling;
+      context->right_moves_++;
+    }
+    return node;
+  }
+
+  std::string String() {
+    std::stringstream ss;
+    ss << "[LEAF: ";
+    for (int idx = 0; idx < this->Size(); idx++) {
+      ss << "(" << this->keys_[idx] << "," << this->values_[idx] << ")";
+      if (idx < this->Size() - 1) ss << " ";
+    }
+    ss << "]";
+    return ss.str();
+  }
+
+  constexpr KeyType &GetKey(int offset) {
+    assert(offset >= 0 && offset < Capacity);
+    return this->keys_[offset];
+  }
+
+  /**
+   * Get an entry of a Leaf node given the index of the entry
+   * Require the caller to already have shared-lock on the leaf
+   * @param offset
+   * @param key
+   * @param val
+   * @return false if offset is out of range, true otherwise
+   */
+  bool GetEntry(int offset, KeyType &key, ValueType &value) {
+    if (offset < 0 || offset >= this->Size()) return false;
+    key = this->keys_[offset];
+    value = this->values_[offset];
+    return true;
+  }
+
+  /**************************************************************************************
+   * @brief Core utilities are placed below, and all are thread-safe, except
+   *Balance    *
+   **************************************************************************************/
+
+  bool Insert(const KeyType &key, const ValueType &val, Split<KeyType, ValueType, QueryContext, NodeMetadata> &split,
+              QueryContext *context) {
+    this->Metadata().Latch(common::Constants::EXCLUSIVE);
+    auto node = this->MoveRight(key, common::Constants::EXCLUSIVE, context);
+    auto is_split = node->InsertLatched(key, val, split);
+    // the split is posted to the parent after this latch is released
+    node->Metadata().Unlatch(common::Constants::EXCLUSIVE);
+    return is_split;
+  }
+
+  bool Search(const KeyType &key, ValueType &value, QueryContext *context) {
+    int index;
+    this->Metadata().Latch(common::Constants::SHARE);
+    auto node = this->MoveRight(key, common::Constants::SHARE, context);
+    bool found = node->SearchKeyIndex(key, index);
+    if (found) value = node->values_[index];
+    node->Metadata().Unlatch(common::Constants::SHARE);
+    return found;
+  }
+
+  bool Update(const KeyType &key, const ValueType &value, QueryContext *context) {
+    int index;
+    this->Metadata().Latch(common::Constants::EXCLUSIVE);
+    auto node = this->MoveRight(key, common::Constants::EXCLUSIVE, context);
+    bool found = node->SearchKeyIndex(key, index);
+    if (found) node->values_[index] = value;
+    node->Metadata().Unlatch(common::Constants::EXCLUSIVE);
+    return found;
+  }
+
+  bool Delete(const KeyType &key, bool &underflow, QueryContext *context) {
+    int index;
+    // underflow is tolerated in B-link tree
+    underflow = false;
+    this->Metadata().Latch(common::Constants::EXCLUSIVE);
+    auto node = this->MoveRight(key, common::Constants::EXCLUSIVE, context);
+    bool found = node->SearchKeyIndex(key, index);
+    if (found) {
+      bool unused_underflow;
+      node->DeleteIndex(index, unused_underflow);
+    }
+    node->Metadata().Unlatch(common::Constants::EXCLUSIVE);
+    return found;
+  }
+
+  bool OptimisticInsert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    int insert_pos;
+    this->Metadata().Latch(common::Constants::EXCLUSIVE);
+    auto node = this->MoveRight(key, common::Constants::EXCLUSIVE, context);
+    bool safe = node->SearchKeyIndex(key, insert_pos) || node->Size() < Capacity;
+    if (safe) {
+      Split<KeyType, ValueType, QueryContext, NodeMetadata> unused_split;
+      node->InsertLatched(key, val, unused_split);
+    }
+    node->Metadata().Unlatch(common::Constants::EXCLUSIVE);
+    return safe;
+  }
+
+  bool OptimisticDelete(const KeyType &key, bool &deleted, QueryContext *context) {
+    bool unused_underflow;
+    deleted = this->Delete(key, unused_underflow, context);
+    return true;
+  }
+
+  /**
+   * Locate the leaf which covers `key`, it is kept SHARE latched for the
+   * caller to iterate on
+   */
+  bool LocateKey(const KeyType &key, Node<KeyType, ValueType, QueryContext, NodeMetadata> *&child, int &position,
+                 QueryContext *context) {
+    this->Metadata().Latch(common::Constants::SHARE);
+    auto node = this->MoveRight(key, common::Constants::SHARE, context);
+    child = node;
+    return node->SearchKeyIndex(key, position);
+  }
+
+  /**
+   * Same as the lock crabbing LeafNode::Balance, the high key of this node is
+   * adjusted to the new `boundary`
+   * Require the caller to already have exclusive-lock on both nodes
+   */
+  bool Balance(Node<KeyType, ValueType, QueryContext, NodeMetadata> *right, KeyType &boundary) {
+    auto right_sibling = static_cast<LeafNode<KeyType, ValueType, Capacity> *>(right);
+    if (this->Size() < UNDERFLOW_BOUND(Capacity) && right_sibling->Size() > UNDERFLOW_BOUND(Capacity)) {
+      boundary = LEFTMOST_KEY(right_sibling);
+      this->ShiftAndInsert(right_sibling->keys_[0], right_sibling->values_[0], this->Size());
+      bool unused_underflow = false;
+      right_sibling->DeleteIndex(0, unused_underflow);
+      this->high_key_ = boundary;
+      return false;
+    }
+    if (this->Size() > UNDERFLOW_BOUND(Capacity) && right_sibling->Size() < UNDERFLOW_BOUND(Capacity)) {
+      right_sibling->ShiftAndInsert(this->keys_[this->Size() - 1], this->values_[this->Size() - 1], 0);
+      bool unused_underflow = false;
+      this->DeleteIndex(this->Size() - 1, unused_underflow);
+      boundary = RIGHTMOST_KEY(this);
+      this->high_key_ = boundary;
+      return false;
+    }
+    std::copy(right_sibling->keys_, right_sibling->keys_ + right_sibling->Size(), this->keys_ + this->Size());
+    std::copy(right_sibling->values_, right_sibling->values_ + right_sibling->Size(), this->values_ + this->Size());
+    this->Size() += right_sibling->Size();
+    this->right_sibl_ = right_sibling->right_sibl_;
+    this->high_key_ = right_sibling->high_key_;
+    this->has_high_key_ = right_sibling->has_high_key_;
+    boundary = RIGHTMOST_KEY(this);
+
+    return true;
+  }
+};
+
+/**
+ * @brief InternalNode class definition
+ *  Same layout as the lock crabbing InternalNode, with an additional high key
+ */
+template <typename KeyType, typename ValueType, int Capacity>
+class InternalNode : public Node<KeyType, ValueType, QueryContext, NodeMetadata> {
+private:
+  KeyType keys_[Capacity + common::Constants::OVERFLOW_SIZE];
+  Node<KeyType, ValueType, QueryContext, NodeMetadata> *child_[Capacity + common::Constants::OVERFLOW_SIZE];
+
+  InternalNode<KeyType, ValueType, Capacity> *right_sibl_;
+  /** All keys in this subtree are <= high_key_, the right-most node doesn't have any */
+  KeyType high_key_;
+  bool has_high_key_;
+
+  void ShiftAndInsert(const KeyType &key, Node<KeyType, ValueType, QueryContext, NodeMetadata> *child, int insert_pos) {
+    if (insert_pos <= this->Size()) {
+      std::move_backward(this->keys_ + insert_pos, this->keys_ + this->Size(),
+                         this->keys_ + this->Size() + common::Constants::OVERFLOW_SIZE);
+      this->keys_[insert_pos] = key;
+    }
+    std::move_backward(this->child_ + insert_pos, this->child_ + this->Size(),
+                       this->child_ + this->Size() + common::Constants::OVERFLOW_SIZE);
+    this->child_[insert_pos] = child;
+    this->Size()++;
+  }
+
+  void DeleteIndex(int index, bool &underflow) {
+    if (index < this->Size()) {
+      std::move(this->keys_ + index + 1, this->keys_ + this->Size(), this->keys_ + index);
+      std::move(this->child_ + index + 1, this->child_ + this->Size() + 1, this->child_ + index);
+    }
+    underflow = (--this->Size() < UNDERFLOW_BOUND(Capacity)) ? true : false;
+  }
+
+  /**
+   * Read the child which may contain `key`, without holding any latch on
+   * return
+   */
+  Node<KeyType, ValueType, QueryContext, NodeMetadata> *TraverseChild(const KeyType &key, QueryContext *context) {
+    this->Metadata().Latch(common::Constants::SHARE);
+    auto node = this->MoveRight(key, common::Constants::SHARE, context);
+    auto target = node->child_[node->SearchChildIndex(key)];
+    node->Metadata().Unlatch(common::Constants::SHARE);
+    return target;
+  }
+
+public:
+  /**
+   * New root constructor
+   *  The last key of an internal node is never compared against, hence the
+   *  right child is not read here, as it may be modified concurrently
+   */
+  InternalNode(Node<KeyType, ValueType, QueryContext, NodeMetadata> *left_chld,
+               Node<KeyType, ValueType, QueryContext, NodeMetadata> *right_chld, KeyType boundary_key)
+      : keys_{boundary_key, boundary_key},
+        child_{left_chld, right_chld},
+        right_sibl_(nullptr),
+        has_high_key_(false) {
+    this->Size() = 2;
+    this->Metadata().level_ = left_chld->Metadata().level_ + 1;
+  }
+
+  InternalNode(Split<KeyType, ValueType, QueryContext, NodeMetadata> &split)
+      : InternalNode(split.left, split.right, split.boundary_key) {}
+
+  /**
+   * Right sibling constructor, should only executed only when this is overflow
+   * @param keys        An array of keys from current InternalNode
+   * @param children    An array of child pointers from current InternalNode
+   * @param start_idx   The new sibling should clone keys in the range of
+   * [start_idx, end)
+   * @param right_sibling
+   */
+  InternalNode(
+      KeyType (&keys)[Capacity + common::Constants::OVERFLOW_SIZE],
+      Node<KeyType, ValueType, QueryContext, NodeMetadata> *(&children)[Capacity + common::Constants::OVERFLOW_SIZE],
+      int start_idx, InternalNode<KeyType, ValueType, Capacity> *right_sibling)
+      : right_sibl_(right_sibling), has_high_key_(false) {
+    this->Size() = Capacity - start_idx + 1;
+    this->Metadata().level_ = children[start_idx]->Metadata().level_ + 1;
+    std::copy(keys + start_idx, keys + Capacity + common::Constants::OVERFLOW_SIZE, this->keys_);
+    std::copy(children + start_idx, children + Capacity + common::Constants::OVERFLOW_SIZE, this->child_);
+  }
+
+  ~InternalNode() {
+    for (int idx = 0; idx < this->Size(); idx++) {
+      delete this->child_[idx];
+    }
+  }
+
+  int SearchChildIndex(const KeyType &key) {
+    return common::KeySearch<KeyType>::LowerBound(this->keys_, this->Size() - 1, key);
+  }
+
+  constexpr NodeType Type() { return INTERNAL; };
+
+  /** Same as LeafNode::Covers */
+  bool Covers(const KeyType &key) const { return !this->has_high_key_ || key <= this->high_key_; }
+
+  /** Same as LeafNode::MoveRight */
+  InternalNode<KeyType, ValueType, Capacity> *MoveRight(const KeyType &key,
+                                                        common::Constants::SharedLockType latch_type,
+                                                        QueryContext *context) {
+    auto node = this;
+    while (!node->Covers(key)) {
+      auto right_sibling = node->right_sibl_;
+      right_sibling->Metadata().Latch(latch_type);
+      node->Metadata().Unlatch(latch_type);
+      node = right_sibling;
+      context->right_moves_++;
+    }
+    return node;
+  }
+
+  std::string String() {
+    std::stringstream ss;
+    ss << "[INTERNAL: ";
+    for (int idx = 0; idx < this->Size() - 1; idx++) {
+      ss << this->child_[idx]->String() << " | " << this->keys_[idx] << " | ";
+    }
+    ss << this->child_[this->Size() - 1]->String() << "]";
+    return ss.str();
+  }
+
+  constexpr KeyType &GetKey(int offset) {
+    assert(offset >= 0 && offset < Capacity);
+    return this->keys_[offset];
+  }
+
+  /**
+   * Get the child at index `idx`
+   * Require the caller to already have shared-lock on the internal node
+   * @param idx
+   * @return
+   */
+  Node<KeyType, ValueType, QueryContext, NodeMetadata> *GetChild(int idx) {
+    assert(idx < this->meta_.size_ + 1);
+    return this->child_[idx];
+  }
+
+  InternalNode<KeyType, ValueType, Capacity> *RightSibling() const { return this->right_sibl_; }
+
+  /**************************************************************************************
+   * @brief Core utilities are placed below, and all are thread-safe, except
+   *Balance    *
+   **************************************************************************************/
+
+  /**
+   * Post the separator of a split child to this node (or to its right
+   * siblings, if this node was split in the meantime)
+   *  No latch should be held by the caller
+   * @return true if this node is split as well, `split` is then overwritten
+   */
+  bool InsertChild(Split<KeyType, ValueType, QueryContext, NodeMetadata> &split, QueryContext *context) {
+    this->Metadata().Latch(common::Constants::EXCLUSIVE);
+    auto node = this->MoveRight(split.boundary_key, common::Constants::EXCLUSIVE, context);
+
+    /**
+     * the child which contains `split.boundary_key` is, or is a left sibling
+     * of, `split.right`, hence `split.right` inherits its key boundary
+     */
+    int target_idx = node->SearchChildIndex(split.boundary_key);
+    std::swap(node->keys_[target_idx], split.boundary_key);
+    node->ShiftAndInsert(split.boundary_key, split.right, target_idx + 1);
+
+    if (node->Size() <= Capacity) {
+      node->Metadata().Unlatch(common::Constants::EXCLUSIVE);
+      return false;
+    }
+
+    int boundary_idx = UNDERFLOW_BOUND(node->Size());
+    auto new_sibling =
+        new InternalNode<KeyType, ValueType, Capacity>(node->keys_, node->child_, boundary_idx, node->right_sibl_);
+    new_sibling->high_key_ = node->high_key_;
+    new_sibling->has_high_key_ = node->has_high_key_;
+    node->Size() = boundary_idx;
+    node->high_key_ = node->keys_[boundary_idx - 1];
+    node->has_high_key_ = true;
+    node->right_sibl_ = new_sibling;
+    node->Metadata().Unlatch(common::Constants::EXCLUSIVE);
+
+    split.left = node;
+    split.right = new_sibling;
+    split.boundary_key = node->high_key_;
+    return true;
+  }
+
+  /**
+   * Post the separator of a split node at `level` - 1, used when that node
+   * did not come from this subtree's traversal path (e.g. it was the root)
+   */
+  bool InsertChildAtLevel(Split<KeyType, ValueType, QueryContext, NodeMetadata> &split, int level,
+                          QueryContext *context) {
+    assert(this->Metadata().level_ >= level);
+    if (this->Metadata().level_ == level) return this->InsertChild(split, context);
+    auto target = static_cast<InternalNode<KeyType, ValueType, Capacity> *>(
+        this->TraverseChild(split.boundary_key, context));
+    if (!target->InsertChildAtLevel(split, level, context)) return false;
+    return this->InsertChild(split, context);
+  }
+
+  bool Insert(const KeyType &key, const ValueType &val, Split<KeyType, ValueType, QueryContext, NodeMetadata> &split,
+              QueryContext *context) {
+    auto target = this->TraverseChild(key, context);
+    if (!target->Insert(key, val, split, context)) return false;
+    return this->InsertChild(split, context);
+  }
+
+  bool Search(const KeyType &key, ValueType &value, QueryContext *context) {
+    return this->TraverseChild(key, context)->Search(key, value, context);
+  }
+
+  bool Update(const KeyType &key, const ValueType &value, QueryContext *context) {
+    return this->TraverseChild(key, context)->Update(key, value, context);
+  }
+
+  bool LocateKey(const KeyType &key, Node<KeyType, ValueType, QueryContext, NodeMetadata> *&child, int &position,
+                 QueryContext *context) {
+    return this->TraverseChild(key, context)->LocateKey(key, child, position, context);
+  }
+
+  bool Delete(const KeyType &key, bool &underflow, QueryContext *context) {
+    return this->TraverseChild(key, context)->Delete(key, underflow, context);
+  }
+
+  bool OptimisticInsert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    return this->TraverseChild(key, context)->OptimisticInsert(key, val, context);
+  }
+
+  bool OptimisticDelete(const KeyType &key, bool &deleted, QueryContext *context) {
+    return this->TraverseChild(key, context)->OptimisticDelete(key, deleted, context);
+  }
+
+  /**
+   * Same as the lock crabbing InternalNode::Balance, the high key of this node
+   * is adjusted to the new `boundary`
+   * Require the caller to already have exclusive-lock on both nodes
+   */
+  bool Balance(Node<KeyType, ValueType, QueryContext, NodeMetadata> *right, KeyType &boundary) {
+    auto right_sibling = static_cast<InternalNode<KeyType, ValueType, Capacity> *>(right);
+    this->right_sibl_ = right_sibling;
+    if (this->Size() < UNDERFLOW_BOUND(Capacity) && right_sibling->Size() > UNDERFLOW_BOUND(Capacity)) {
+      this->child_[this->Size()] = right_sibling->child_[0];
+      this->keys_[this->Size() - 1] = boundary;
+      boundary = right_sibling->keys_[0];
+      this->Size()++;
+      bool unused_underflow = false;
+      right_sibling->DeleteIndex(0, unused_underflow);
+      this->high_key_ = boundary;
+      return false;
+    }
+    if (this->Size() > UNDERFLOW_BOUND(Capacity) && right_sibling->Size() < UNDERFLOW_BOUND(Capacity)) {
+      right_sibling->ShiftAndInsert(boundary, this->child_[this->Size() - 1], 0);
+      --this->Size();
+      boundary = this->keys_[this->Size() - 1];
+      this->high_key_ = boundary;
+      return false;
+    }
+    this->keys_[this->Size() - 1] = boundary;
+    std::copy(right_sibling->keys_, right_sibling->keys_ + right_sibling->Size(), this->keys_ + this->Size());
+    std::copy(right_sibling->child_, right_sibling->child_ + right_sibling->Size(), this->child_ + this->Size());
+    this->Size() += right_sibling->Size();
+    this->right_sibl_ = right_sibling->right_sibl_;
+    this->high_key_ = right_sibling->high_key_;
+    this->has_high_key_ = right_sibling->has_high_key_;
+
+    return true;
+  }
+};
+
+/**
+ * A memory B-link tree implementation
+ */
+template <typename KeyType, typename ValueType, int LeafCapacity, int InternalCapacity>
+class MemoryBTree : public BTreeInterface<KeyType, ValueType, QueryContext> {
+private:
+  std::atomic<Node<KeyType, ValueType, QueryContext, NodeMetadata> *> root_;
+  /** Only protects the installation of a new root */
+  std::mutex root_latch_;
+  FRIEND_TEST(BLinkTree, RightLinksAfterSplits);
+
+public:
+  MemoryBTree() : root_(new LeafNode<KeyType, ValueType, LeafCapacity>()) {}
+  ~MemoryBTree() { delete this->root_.load(); }
+
+  std::string String() const { return this->root_.load()->String(); }
+
+  bool Search(const KeyType &key, ValueType &val, QueryContext *context) {
+    context->Clear();
+    return this->root_.load()->Search(key, val, context);
+  }
+
+  void Insert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    context->Clear();
+    Split<KeyType, ValueType, QueryContext, NodeMetadata> split;
+    bool is_split = this->root_.load()->Insert(key, val, split, context);
+    while (is_split) {
+      int parent_level = split.left->Metadata().level_ + 1;
+      std::unique_lock<std::mutex> guard(this->root_latch_);
+      auto root = this->root_.load();
+      if (root->Metadata().level_ < parent_level) {
+        /**
+         * the current root is the left-most node of the split level, and all
+         * nodes between it and `split.right` are reachable by right-links
+         */
+        this->root_.store(new InternalNode<KeyType, ValueType, InternalCapacity>(root, split.right,
+                                                                                 split.boundary_key));
+        return;
+      }
+      guard.unlock();
+      // the split node was the root when it was traversed, hence its new
+      // parent has to be looked up from the latest root
+      is_split = static_cast<InternalNode<KeyType, ValueType, InternalCapacity> *>(root)->InsertChildAtLevel(
+          split, parent_level, context);
+    }
+  }
+
+  bool Update(const KeyType &key, const ValueType &val, QueryContext *context) {
+    context->Clear();
+    return this->root_.load()->Update(key, val, context);
+  }
+
+  bool Delete(const KeyType &key, QueryContext *context) {
+    context->Clear();
+    bool unused_underflow;
+    return this->root_.load()->Delete(key, unused_underflow, context);
+  }
+
+  void Clear() {
+    delete this->root_.load();
+    this->root_.store(new LeafNode<KeyType, ValueType, LeafCapacity>());
+  };
+
+  /**
+   * Iterator of B-link tree, it keeps the current leaf SHARE latched
+   *  Leaves are always latched from left to right, hence moving to the next
+   * leaf never deadlocks
+   */
+  class MemoryIterator : public BTreeInterface<KeyType, ValueType, QueryContext>::Iterator {
+  private:
+    int offset_;
+    KeyType key_high_;
+    bool upper_bound_;
+    LeafNode<KeyType, ValueType, LeafCapacity> *current_;
+
+  public:
+    MemoryIterator(LeafNode<KeyType, ValueType, LeafCapacity> *node, int offset, const KeyType &key_high)
+        : offset_(offset), key_high_(key_high), upper_bound_(true), current_(node) {}
+    MemoryIterator(LeafNode<KeyType, ValueType, LeafCapacity> *node)
+        : offset_(0), upper_bound_(false), current_(node) {}
+    ~MemoryIterator() {
+      if (this->current_) this->current_->Metadata().Unlatch(common::Constants::SHARE);
+    }
+
+    bool Next(KeyType &key, ValueType &val) {
+      while (this->current_) {
+        if (this->current_->GetEntry(this->offset_, key, val)) {
+          this->offset_++;
+          return !this->upper_bound_ || key <= this->key_high_;
+        }
+        auto right_sibl = this->current_->RightSibling();
+        if (right_sibl) right_sibl->Metadata().Latch(common::Constants::SHARE);
+        this->current_->Metadata().Unlatch(common::Constants::SHARE);
+        this->current_ = right_sibl;
+        this->offset_ = 0;
+      }
+      return false;
+    }
+  };
+
+  MemoryIterator *RangeQuery(const KeyType &key_low, const KeyType &key_high, QueryContext *context) {
+    context->Clear();
+    Node<KeyType, ValueType, QueryContext, NodeMetadata> *leaf;
+    int offset;
+    this->root_.load()->LocateKey(key_low, leaf, offset, context);
+    return new MemoryIterator(static_cast<LeafNode<KeyType, ValueType, LeafCapacity> *>(leaf), offset, key_high);
+  }
+
+  MemoryIterator *TreeScan(QueryContext *context) {
+    context->Clear();
+    // the left-most child of a node never changes, because a split always
+    // moves the upper half to the new sibling
+    auto current = this->root_.load();
+    while (current->Type() == NodeType::INTERNAL) {
+      current = static_cast<InternalNode<KeyType, ValueType, InternalCapacity> *>(current)->GetChild(0);
+    }
+    current->Metadata().Latch(common::Constants::SHARE);
+    return new MemoryIterator(static_cast<LeafNode<KeyType, ValueType, LeafCapacity> *>(current));
+  }
+};
+
+}  // namespace btree::implementation::blink
@@ -67,14 +67,16 @@ public:
 
   /**
    * @return Metadata of this node
+   *  Both Metadata and Size are non-virtual, as they are called on every hop
+   *  of a descent
    */
-  virtual constexpr MetadataClass &Metadata() = 0;
+  constexpr MetadataClass &Metadata() { return this->meta_; }
 
   /**
    * @return Number of entries in the leaf node or the number of children in the
    * internal node
    */
-  virtual int &Size() = 0;
+  int &Size() { return this->meta_.size_; }
 
   /**
    * @return The current right sibling of this node
@@ -133,6 +135,27 @@ public:
    */
   virtual bool Delete(const KeyType &key, bool &underflow, ContextType *context) = 0;
 
+  /**
+   * Optimistic (Bayer-Schkolnick) version of Insert
+   *  The traversal only SHARE latches the internal nodes, and EXCLUSIVE latches the target leaf
+   *  If the leaf is not safe for the insertion (i.e. it would split), nothing is modified
+   * All latches in `context` are released before this function returns
+   * @param key
+   * @param val
+   * @return true if the entry is inserted, false if the caller has to restart with the pessimistic Insert
+   */
+  virtual bool OptimisticInsert(const KeyType &key, const ValueType &val, ContextType *context) = 0;
+
+  /**
+   * Optimistic (Bayer-Schkolnick) version of Delete
+   *  Similar to OptimisticInsert, nothing is modified if the leaf would underflow
+   * All latches in `context` are released before this function returns
+   * @param key
+   * @param deleted Whether the searched key is found and deleted
+   * @return true if the operation is completed, false if the caller has to restart with the pessimistic Delete
+   */
+  virtual bool OptimisticDelete(const KeyType &key, bool &deleted, ContextType *context) = 0;
+
   /**
    * This function is called when either this node or its right sibling node
    * overflows The underflow is solved by borrowing one entry from one node to
@@ -170,6 +193,8 @@ public:
   virtual void Insert(const KeyType &key, const ValueType &val, Context *context) = 0;
   virtual bool Delete(const KeyType &key, Context *context) = 0;
   virtual bool Search(const KeyType &key, ValueType &val, Context *context) = 0;
+  // replace the value of an existing key, return whether the key is found
+  virtual bool Update(const KeyType &key, const ValueType &val, Context *context) = 0;
   // the caller must makes sure that there is no other thread using the tree
   // before running Clear()
   virtual void Clear() = 0;
@@ -0,0 +1,868 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "common/buffer_pool.h"
+#include "common/constants.h"
+#include "common/fixed_vector.h"
+#include "common/key_search.h"
+#include "common/macros.h"
+#include "common/wal.h"
+#include "tree/definitions.h"
+
+/**
+ * Disk-based B+Tree
+ *  Nodes are fixed-size pages of a PageFile, addressed by page ID instead of
+ *    pointers, and accessed through a BufferPool, hence the tree can be much
+ *    larger than the memory
+ *  The lock crabbing protocol is the same as the one of the in-memory
+ *    MemoryBTree, including its optimistic leaf-only path. Every latched page
+ *    is pinned by the QueryContext, and unpinned once its latch is released
+ *  Pages are plain structs of trivially copyable keys and values, rather than
+ *    Node objects with a vtable, so that they can be written as raw bytes
+ *  Similar to the B-link tree, underflow is tolerated: pages are never merged,
+ *    and the file only shrinks on Clear()
+ *  Pages are written back in any order, hence the page file is only
+ *    consistent after a clean shutdown. With a WriteAheadLog, the tree is
+ *    rebuilt by redoing the whole log after a crash
+ */
+namespace btree::implementation::disk {
+
+/**
+ * @brief QueryContext to provide Lock Crabbing protocol on top of the pages of
+ *  a BufferPool
+ *  Same bookkeeping as the in-memory BasicQueryContext, plus the frame of
+ *  every latched page, which is unpinned when its latch is released
+ */
+template <typename Frame, typename Latch = std::shared_mutex>
+class BasicQueryContext {
+public:
+  static constexpr std::size_t MAX_LATCHES = common::Constants::MAX_HEIGHT + 1;
+
+  struct HeldLatch {
+    Latch *latch_;
+    /** nullptr for the tree latch */
+    Frame *frame_;
+  };
+
+  short smallest_unlk_idx_;
+  common::FixedVector<HeldLatch, MAX_LATCHES> latches_;
+
+  BasicQueryContext() : smallest_unlk_idx_(0) {}
+
+  bool IsEmpty() const { return latches_.empty(); }
+
+  void Clear() {
+    this->latches_.clear();
+    this->smallest_unlk_idx_ = 0;
+  }
+
+  /**
+   * @return The index of the new latch in this context
+   * @throw std::length_error if the context holds MAX_LATCHES latches already
+   */
+  int AcquireLatch(Latch *latch, Frame *frame, common::Constants::SharedLockType latch_type) {
+    Lock(latch, latch_type);
+    this->latches_.push_back({latch, frame});
+    return this->latches_.size() - 1;
+  }
+
+  /** Replace the latch at `idx` by the already acquired `latch` */
+  void ReplaceLatch(short idx, Latch *latch, Frame *frame, common::Constants::SharedLockType latch_type) {
+    Unlock(this->latches_[idx], latch_type);
+    this->latches_[idx] = {latch, frame};
+  }
+
+  void ReleaseLatch(short upto_idx, common::Constants::SharedLockType latch_type) {
+    assert(upto_idx <= static_cast<int>(this->latches_.size()));
+    for (auto idx = smallest_unlk_idx_; idx < upto_idx; ++idx) Unlock(this->latches_[idx], latch_type);
+    smallest_unlk_idx_ = std::max(smallest_unlk_idx_, upto_idx);
+  }
+
+private:
+  static void Lock(Latch *latch, common::Constants::SharedLockType latch_type) {
+    switch (latch_type) {
+      case common::Constants::SHARE:
+        latch->lock_shared();
+        break;
+      case common::Constants::EXCLUSIVE:
+        latch->lock();
+        break;
+      default:
+        throw std::invalid_argument("Should not acquire NONE latch");
+    }
+  }
+
+  static void Unlock(HeldLatch &held, common::Constants::SharedLockType latch_type) {
+    switch (latch_type) {
+      case common::Constants::SHARE:
+        held.latch_->unlock_shared();
+        break;
+      case common::Constants::EXCLUSIVE:
+        held.latch_->unlock();
+        break;
+      default:
+        throw std::invalid_argument("Should not release NONE latch");
+    }
+    if (held.frame_ != nullptr) held.frame_->Unpin();
+  }
+};
+
+/**
+ * @brief Header of every tree page
+ */
+struct PageHeader {
+  /** Number of entries in a leaf, or of children in an internal page */
+  int size_;
+  /** Distance to the leaves, which are at level 0 */
+  int level_;
+  /** Right sibling of a leaf, INVALID_PAGE_ID for the right-most one */
+  common::PageId right_sibl_;
+};
+
+/**
+ * @brief Page 0 of the file, which locates the root
+ */
+struct MetaPage {
+  static constexpr uint64_t MAGIC = 0x454552544b534944;  // "DISKTREE"
+
+  uint64_t magic_;
+  uint32_t page_size_;
+  uint32_t key_size_;
+  uint32_t value_size_;
+  common::PageId root_;
+  int root_level_;
+  /** Whether the tree was closed cleanly, i.e. all its pages were written back */
+  uint32_t clean_;
+};
+
+/**
+ * @brief Leaf page, same layout as the in-memory LeafNode
+ */
+template <typename KeyType, typename ValueType, int Capacity>
+struct LeafPage {
+  PageHeader header_;
+  KeyType keys_[Capacity];
+  ValueType values_[Capacity];
+
+  int &Size() { return this->header_.size_; }
+
+  KeyType &GetKey(int offset) {
+    assert(offset >= 0 && offset < Capacity);
+    return this->keys_[offset];
+  }
+
+  bool SearchKeyIndex(const KeyType &key, int &index) {
+    index = common::KeySearch<KeyType>::LowerBound(this->keys_, this->Size(), key);
+    return (index < this->Size() && this->keys_[index] == key);
+  }
+
+  void ShiftAndInsert(const KeyType &key, const ValueType &val, int insert_pos) {
+    std::move_backward(this->keys_ + insert_pos, this->keys_ + this->Size(), this->keys_ + this->Size() + 1);
+    std::move_backward(this->values_ + insert_pos, this->values_ + this->Size(), this->values_ + this->Size() + 1);
+    this->keys_[insert_pos] = key;
+    this->values_[insert_pos] = val;
+    this->Size()++;
+  }
+
+  void DeleteIndex(int index) {
+    std::move(this->keys_ + index + 1, this->keys_ + this->Size(), this->keys_ + index);
+    std::move(this->values_ + index + 1, this->values_ + this->Size(), this->values_ + index);
+    this->Size()--;
+  }
+
+  /**
+   * Move the upper half of this full page to the empty `sibling`, which is
+   *  linked as its right sibling, and insert (key, val) at `insert_pos`
+   * Require the caller to already have exclusive-lock on both pages
+   * @return The separator of the two pages
+   */
+  KeyType SplitAndInsert(LeafPage *sibling, common::PageId sibling_id, const KeyType &key, const ValueType &val,
+                         int insert_pos) {
+    int boundary_idx = UNDERFLOW_BOUND(this->Size());
+    std::copy(this->keys_ + boundary_idx, this->keys_ + this->Size(), sibling->keys_);
+    std::copy(this->values_ + boundary_idx, this->values_ + this->Size(), sibling->values_);
+    sibling->header_ = {this->Size() - boundary_idx, 0, this->header_.right_sibl_};
+    this->Size() = boundary_idx;
+    this->header_.right_sibl_ = sibling_id;
+
+    if (insert_pos < boundary_idx) {
+      this->ShiftAndInsert(key, val, insert_pos);
+    } else {
+      sibling->ShiftAndInsert(key, val, insert_pos - boundary_idx);
+    }
+    return common::KeySeparator<KeyType>::Shortest(RIGHTMOST_KEY(this), LEFTMOST_KEY(sibling));
+  }
+};
+
+/**
+ * @brief Internal page, same layout as the in-memory InternalNode, with child
+ *  page IDs instead of child pointers
+ *  child_[I] contains all keys <= keys_[I], the last key is never compared
+ */
+template <typename KeyType, int Capacity>
+struct InternalPage {
+  PageHeader header_;
+  KeyType keys_[Capacity + common::Constants::OVERFLOW_SIZE];
+  common::PageId child_[Capacity + common::Constants::OVERFLOW_SIZE];
+
+  int &Size() { return this->header_.size_; }
+
+  int SearchChildIndex(const KeyType &key) {
+    return common::KeySearch<KeyType>::LowerBound(this->keys_, this->Size() - 1, key);
+  }
+
+  /**
+   * @return Index of the first child which may contain a key greater than `key`
+   */
+  int SearchChildIndexAfter(const KeyType &key) {
+    return std::upper_bound(this->keys_, this->keys_ + this->Size() - 1, key) - this->keys_;
+  }
+
+  void InitRoot(common::PageId left, common::PageId right, const KeyType &boundary, int level) {
+    this->header_ = {2, level, common::INVALID_PAGE_ID};
+    this->keys_[0] = boundary;
+    this->child_[0] = left;
+    this->child_[1] = right;
+  }
+
+  /**
+   * Insert `right`, the new right sibling of the split child at `target_idx`,
+   *  whose separator is `boundary`
+   * @return Whether this page overflows, and should be split by SplitInto()
+   */
+  bool InsertSplitChild(int target_idx, KeyType boundary, common::PageId right) {
+    // `target` keeps the new separator, while `right` inherits its old one
+    std::swap(this->keys_[target_idx], boundary);
+    int insert_pos = target_idx + 1;
+    std::move_backward(this->keys_ + insert_pos, this->keys_ + this->Size(), this->keys_ + this->Size() + 1);
+    std::move_backward(this->child_ + insert_pos, this->child_ + this->Size(), this->child_ + this->Size() + 1);
+    this->keys_[insert_pos] = boundary;
+    this->child_[insert_pos] = right;
+    this->Size()++;
+    return this->Size() > Capacity;
+  }
+
+  /**
+   * Move the upper half of this overflowed page to the empty `sibling`
+   * @return The separator of the two pages
+   */
+  KeyType SplitInto(InternalPage *sibling) {
+    int boundary_idx = UNDERFLOW_BOUND(this->Size());
+    std::copy(this->keys_ + boundary_idx, this->keys_ + this->Size(), sibling->keys_);
+    std::copy(this->child_ + boundary_idx, this->child_ + this->Size(), sibling->child_);
+    sibling->header_ = {this->Size() - boundary_idx, this->header_.level_, common::INVALID_PAGE_ID};
+    this->Size() = boundary_idx;
+    return this->keys_[boundary_idx - 1];
+  }
+};
+
+/**
+ * @return The largest capacity of a LeafPage which fits in `PageSize` bytes,
+ *  leaving room for the padding before both arrays
+ */
+template <typename KeyType, typename ValueType, std::size_t PageSize>
+constexpr int DiskLeafCapacity() {
+  return (PageSize - sizeof(PageHeader) - alignof(KeyType) - alignof(ValueType)) /
+         (sizeof(KeyType) + sizeof(ValueType));
+}
+
+/**
+ * @return The largest capacity of an InternalPage which fits in `PageSize`
+ *  bytes, including its overflow slots
+ */
+template <typename KeyType, std::size_t PageSize>
+constexpr int DiskInternalCapacity() {
+  return (PageSize - sizeof(PageHeader) - alignof(KeyType) - alignof(common::PageId)) /
+             (sizeof(KeyType) + sizeof(common::PageId)) -
+         common::Constants::OVERFLOW_SIZE;
+}
+
+/**
+ * A disk-based B+Tree, whose capacities are derived from `PageSize`
+ *  The file is reopened with its content if it exists already, dirty pages
+ *  are written back by the buffer pool in the background, and all of them are
+ *  written back by Flush() or on destruction
+ *  Insert/Update/Delete append a logical record to the optional
+ *    WriteAheadLog while holding the leaf latch, so that records of the same
+ *    key are in the order they are applied, then wait for its group commit
+ *    after all latches are released
+ */
+template <typename KeyType, typename ValueType, std::size_t PageSize = 4096>
+class DiskBTree
+    : public BTreeInterface<KeyType, ValueType, BasicQueryContext<typename common::BufferPool<PageSize>::Frame>> {
+public:
+  using BufferPool = common::BufferPool<PageSize>;
+  using Frame = typename BufferPool::Frame;
+  using QueryContext = BasicQueryContext<Frame>;
+  static constexpr int LEAF_CAPACITY = DiskLeafCapacity<KeyType, ValueType, PageSize>();
+  static constexpr int INTERNAL_CAPACITY = DiskInternalCapacity<KeyType, PageSize>();
+  using LeafType = LeafPage<KeyType, ValueType, LEAF_CAPACITY>;
+  using InternalType = InternalPage<KeyType, INTERNAL_CAPACITY>;
+  using LogType = common::WriteAheadLog<KeyType, ValueType>;
+
+  static_assert(std::is_trivially_copyable_v<KeyType> && std::is_trivially_copyable_v<ValueType>,
+                "Pages are written as raw bytes");
+  static_assert(LEAF_CAPACITY >= 2 && INTERNAL_CAPACITY >= 3, "Pages are too small for these keys and values");
+  static_assert(sizeof(LeafType) <= PageSize && sizeof(InternalType) <= PageSize && sizeof(MetaPage) <= PageSize);
+
+private:
+  static constexpr common::PageId META_PAGE_ID = 0;
+
+  /** Declared before `pool_`, which writes its dirty pages back when destroyed */
+  common::PageFile<PageSize> file_;
+  BufferPool pool_;
+  std::shared_mutex tree_latch_;
+  /** Both are protected by `tree_latch_`, and persisted in the meta page */
+  common::PageId root_;
+  int root_level_;
+  /** Set in the meta page on destruction only */
+  bool clean_;
+  /** nullptr if the tree is not logged, e.g. during recovery */
+  LogType *wal_;
+
+  template <typename PageType>
+  static PageType *As(Frame *frame) {
+    return reinterpret_cast<PageType *>(frame->Data());
+  }
+
+  /**
+   * Fetch a page to be latched by `context`
+   *  If the buffer pool is exhausted, the `held_latch_type` latches of
+   *  `context` are released before the error is rethrown
+   */
+  Frame *FetchPage(common::PageId page_id, common::Constants::SharedLockType held_latch_type, QueryContext *context) {
+    try {
+      return this->pool_.FetchPage(page_id);
+    } catch (...) {
+      context->ReleaseLatch(context->latches_.size(), held_latch_type);
+      context->Clear();
+      throw;
+    }
+  }
+
+  /**
+   * Allocate a new page, which is EXCLUSIVE latched and pinned until
+   *  ReleaseNewPage()
+   */
+  Frame *NewPage() {
+    auto frame = this->pool_.NewPage();
+    frame->LatchPtr()->lock();
+    return frame;
+  }
+
+  static void ReleaseNewPage(Frame *frame) {
+    frame->MarkDirty();
+    frame->LatchPtr()->unlock();
+    frame->Unpin();
+  }
+
+  /**
+   * SHARE lock crabbing descent to the leaf of `key`, which is latched in
+   *  `leaf_latch_type` mode. Its parent stays SHARE latched
+   * Require the caller to already have SHARE latch on the tree
+   * @param depth   Index of the leaf latch in `context`
+   */
+  template <typename ChildIndexFn>
+  Frame *Descend(common::Constants::SharedLockType leaf_latch_type, QueryContext *context, int &depth,
+                 ChildIndexFn child_index) {
+    auto page_id = this->root_;
+    for (auto level = this->root_level_;; --level) {
+      auto frame = this->FetchPage(page_id, common::Constants::SHARE, context);
+      if (level == 0) {
+        depth = context->AcquireLatch(frame->LatchPtr(), frame, leaf_latch_type);
+        return frame;
+      }
+      depth = context->AcquireLatch(frame->LatchPtr(), frame, common::Constants::SHARE);
+      context->ReleaseLatch(depth, common::Constants::SHARE);
+      auto inner = As<InternalType>(frame);
+      page_id = inner->child_[child_index(inner)];
+    }
+  }
+
+  Frame *DescendToLeaf(const KeyType &key, common::Constants::SharedLockType leaf_latch_type, QueryContext *context,
+                       int &depth) {
+    return this->Descend(leaf_latch_type, context, depth, [&](auto inner) { return inner->SearchChildIndex(key); });
+  }
+
+  /**
+   * Write the root into the meta page
+   * Require the caller to already have EXCLUSIVE latch on the tree
+   */
+  void WriteMetaPage() {
+    auto frame = this->pool_.FetchPage(META_PAGE_ID);
+    frame->LatchPtr()->lock();
+    auto meta = As<MetaPage>(frame);
+    *meta = {MetaPage::MAGIC, PageSize,          sizeof(KeyType), sizeof(ValueType),
+             this->root_,     this->root_level_, this->clean_};
+    frame->MarkDirty();
+    frame->LatchPtr()->unlock();
+    frame->Unpin();
+  }
+
+  /** Format an empty file: the meta page, and an empty root leaf */
+  void Initialize() {
+    this->clean_ = false;
+    auto meta_frame = this->NewPage();
+    assert(meta_frame->Id() == META_PAGE_ID);
+    ReleaseNewPage(meta_frame);
+    auto root_frame = this->NewPage();
+    As<LeafType>(root_frame)->header_ = {0, 0, common::INVALID_PAGE_ID};
+    this->root_ = root_frame->Id();
+    this->root_level_ = 0;
+    ReleaseNewPage(root_frame);
+    this->WriteMetaPage();
+  }
+
+  /**
+   * @throw std::invalid_argument if the file was not written by a tree of the
+   *  same page size and key/value types
+   */
+  void ReadMetaPage() {
+    auto frame = this->pool_.FetchPage(META_PAGE_ID);
+    frame->LatchPtr()->lock_shared();
+    auto meta = *As<MetaPage>(frame);
+    frame->LatchPtr()->unlock_shared();
+    frame->Unpin();
+    if (meta.magic_ != MetaPage::MAGIC || meta.page_size_ != PageSize || meta.key_size_ != sizeof(KeyType) ||
+        meta.value_size_ != sizeof(ValueType)) {
+      throw std::invalid_argument("The page file holds another kind of tree");
+    }
+    this->root_ = meta.root_;
+    this->root_level_ = meta.root_level_;
+    this->clean_ = meta.clean_ != 0;
+  }
+
+  /** Rebuild the tree from scratch by redoing all the records of the log */
+  void Recover() {
+    auto wal = this->wal_;
+    this->wal_ = nullptr;
+    this->pool_.Reset();
+    this->file_.Truncate();
+    this->Initialize();
+    QueryContext context;
+    wal->Replay([&](typename LogType::RecordType type, const KeyType &key, const ValueType *val) {
+      if (type == LogType::INSERT) {
+        this->Insert(key, *val, &context);
+      } else {
+        this->Delete(key, &context);
+      }
+    });
+    this->wal_ = wal;
+  }
+
+  /**
+   * Require the caller to hold EXCLUSIVE latches only, which are released if
+   *  the log can't be written anymore
+   * @return LSN of the new record, 0 if the tree is not logged
+   */
+  uint64_t Log(typename LogType::RecordType type, const KeyType &key, const ValueType *val, QueryContext *context) {
+    if (this->wal_ == nullptr) return 0;
+    try {
+      return this->wal_->Append(type, key, val);
+    } catch (...) {
+      context->ReleaseLatch(context->latches_.size(), common::Constants::EXCLUSIVE);
+      context->Clear();
+      throw;
+    }
+  }
+
+  void WaitDurable(uint64_t lsn) {
+    if (lsn > 0) this->wal_->WaitDurable(lsn);
+  }
+
+  /**
+   * Pessimistic lock crabbing Insert, the EXCLUSIVE latches of the ancestors
+   *  are released as soon as a page can absorb a new entry/child
+   */
+  uint64_t PessimisticInsert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    struct PathEntry {
+      Frame *frame_;
+      int child_idx_;
+    };
+    common::FixedVector<PathEntry, common::Constants::MAX_HEIGHT> path;
+    this->AcquireTreeLatch(context, common::Constants::EXCLUSIVE);
+    auto page_id = this->root_;
+    for (auto level = this->root_level_; level > 0; --level) {
+      auto frame = this->FetchPage(page_id, common::Constants::EXCLUSIVE, context);
+      auto depth = context->AcquireLatch(frame->LatchPtr(), frame, common::Constants::EXCLUSIVE);
+      auto inner = As<InternalType>(frame);
+      if (inner->Size() < INTERNAL_CAPACITY) context->ReleaseLatch(depth, common::Constants::EXCLUSIVE);
+      int child_idx = inner->SearchChildIndex(key);
+      path.push_back({frame, child_idx});
+      page_id = inner->child_[child_idx];
+    }
+
+    auto frame = this->FetchPage(page_id, common::Constants::EXCLUSIVE, context);
+    auto depth = context->AcquireLatch(frame->LatchPtr(), frame, common::Constants::EXCLUSIVE);
+    auto leaf = As<LeafType>(frame);
+    if (leaf->Size() < LEAF_CAPACITY) context->ReleaseLatch(depth, common::Constants::EXCLUSIVE);
+    int insert_pos;
+    frame->MarkDirty();
+    auto lsn = this->Log(LogType::INSERT, key, &val, context);
+    // a page can't be allocated, or the meta page can't be written
+    try {
+      if (leaf->SearchKeyIndex(key, insert_pos)) {
+        leaf->values_[insert_pos] = val;
+      } else if (leaf->Size() < LEAF_CAPACITY) {
+        leaf->ShiftAndInsert(key, val, insert_pos);
+      } else {
+        auto sibling_frame = this->NewPage();
+        auto boundary = leaf->SplitAndInsert(As<LeafType>(sibling_frame), sibling_frame->Id(), key, val, insert_pos);
+        auto right = sibling_frame->Id();
+        ReleaseNewPage(sibling_frame);
+
+        // propagate the split up to the lowest page which can absorb it
+        bool is_split = true;
+        for (auto it = path.end(); is_split && it != path.begin();) {
+          --it;
+          auto inner = As<InternalType>(it->frame_);
+          it->frame_->MarkDirty();
+          is_split = inner->InsertSplitChild(it->child_idx_, boundary, right);
+          if (is_split) {
+            auto new_frame = this->NewPage();
+            boundary = inner->SplitInto(As<InternalType>(new_frame));
+            right = new_frame->Id();
+            ReleaseNewPage(new_frame);
+          }
+        }
+        if (is_split) {
+          // the root is split as well
+          auto root_frame = this->NewPage();
+          As<InternalType>(root_frame)->InitRoot(this->root_, right, boundary, this->root_level_ + 1);
+          this->root_ = root_frame->Id();
+          this->root_level_++;
+          ReleaseNewPage(root_frame);
+          this->WriteMetaPage();
+        }
+      }
+    } catch (...) {
+      context->ReleaseLatch(context->latches_.size(), common::Constants::EXCLUSIVE);
+      context->Clear();
+      throw;
+    }
+    context->ReleaseLatch(context->latches_.size(), common::Constants::EXCLUSIVE);
+    context->Clear();
+    return lsn;
+  }
+
+  void PageString(common::PageId page_id, std::stringstream &ss) {
+    auto frame = this->pool_.FetchPage(page_id);
+    frame->LatchPtr()->lock_shared();
+    if (As<PageHeader>(frame)->level_ == 0) {
+      auto leaf = As<LeafType>(frame);
+      ss << "[LEAF: ";
+      for (int idx = 0; idx < leaf->Size(); idx++) {
+        ss << "(" << leaf->keys_[idx] << "," << leaf->values_[idx] << ")";
+        if (idx < leaf->Size() - 1) ss << " ";
+      }
+    } else {
+      auto inner = As<InternalType>(frame);
+      ss << "[INTERNAL: ";
+      for (int idx = 0; idx < inner->Size(); idx++) {
+        this->PageString(inner->child_[idx], ss);
+        if (idx < inner->Size() - 1) ss << " | " << inner->keys_[idx] << " | ";
+      }
+    }
+    ss << "]";
+    frame->LatchPtr()->unlock_shared();
+    frame->Unpin();
+  }
+
+  int AcquireTreeLatch(QueryContext *context, common::Constants::SharedLockType latch_type) {
+    return context->AcquireLatch(&this->tree_latch_, nullptr, latch_type);
+  }
+
+public:
+  /**
+   * Open the tree stored in `path`, or create an empty one
+   * @param frame_count   Number of pages cached in memory, every thread pins
+   *    at most one page per level at any moment
+   * @param wal           Optional log of all the modifications, which should
+   *    outlive the tree. The tree is recovered from it if it was not closed
+   *    cleanly
+   * @throw std::runtime_error/std::invalid_argument, see PageFile and
+   *    ReadMetaPage()
+   */
+  DiskBTree(const std::string &path, std::size_t frame_count, LogType *wal = nullptr)
+      : file_(path), pool_(&this->file_, frame_count), wal_(wal) {
+    if (this->file_.PageCount() == 0) {
+      this->Initialize();
+    } else {
+      this->ReadMetaPage();
+    }
+    if (this->wal_ != nullptr && !this->clean_) this->Recover();
+    // pages are written back in any order from now on
+    this->clean_ = false;
+    this->WriteMetaPage();
+    this->Flush();
+  }
+
+  ~DiskBTree() {
+    try {
+      if (this->wal_ != nullptr) this->wal_->Flush();
+      this->Flush();
+      this->clean_ = true;
+      this->WriteMetaPage();
+      this->Flush();
+    } catch (const std::runtime_error &) {
+      // the tree is recovered from the log when it is reopened
+    }
+  }
+
+  /** Write all dirty pages back, and make them durable */
+  void Flush() {
+    this->pool_.FlushAll();
+    this->file_.Sync();
+  }
+
+  BufferPool &Pool() { return this->pool_; }
+
+  /** Number of levels, a single root leaf being 1 */
+  int Height() {
+    std::shared_lock<std::shared_mutex> guard(this->tree_latch_);
+    return this->root_level_ + 1;
+  }
+
+  std::string String() const {
+    auto self = const_cast<DiskBTree *>(this);
+    std::shared_lock<std::shared_mutex> guard(self->tree_latch_);
+    std::stringstream ss;
+    self->PageString(self->root_, ss);
+    return ss.str();
+  }
+
+  bool Search(const KeyType &key, ValueType &val, QueryContext *context) {
+    this->AcquireTreeLatch(context, common::Constants::SHARE);
+    int depth;
+    auto leaf = As<LeafType>(this->DescendToLeaf(key, common::Constants::SHARE, context, depth));
+    context->ReleaseLatch(depth, common::Constants::SHARE);
+    int index;
+    bool found = leaf->SearchKeyIndex(key, index);
+    if (found) val = leaf->values_[index];
+    context->ReleaseLatch(depth + 1, common::Constants::SHARE);
+    context->Clear();
+    return found;
+  }
+
+  void Insert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    // similar to MemoryBTree, first try to only EXCLUSIVE latch the leaf
+    this->AcquireTreeLatch(context, common::Constants::SHARE);
+    int depth;
+    auto frame = this->DescendToLeaf(key, common::Constants::EXCLUSIVE, context, depth);
+    context->ReleaseLatch(depth, common::Constants::SHARE);
+    auto leaf = As<LeafType>(frame);
+    int insert_pos;
+    bool found = leaf->SearchKeyIndex(key, insert_pos);
+    bool safe = found || leaf->Size() < LEAF_CAPACITY;
+    uint64_t lsn = 0;
+    if (safe) {
+      lsn = this->Log(LogType::INSERT, key, &val, context);
+      frame->MarkDirty();
+    }
+    if (found) {
+      leaf->values_[insert_pos] = val;
+    } else if (safe) {
+      leaf->ShiftAndInsert(key, val, insert_pos);
+    }
+    context->ReleaseLatch(depth + 1, common::Constants::EXCLUSIVE);
+    context->Clear();
+    if (!safe) lsn = this->PessimisticInsert(key, val, context);
+    this->WaitDurable(lsn);
+  }
+
+  bool Update(const KeyType &key, const ValueType &val, QueryContext *context) {
+    this->AcquireTreeLatch(context, common::Constants::SHARE);
+    int depth;
+    auto frame = this->DescendToLeaf(key, common::Constants::EXCLUSIVE, context, depth);
+    context->ReleaseLatch(depth, common::Constants::SHARE);
+    auto leaf = As<LeafType>(frame);
+    int index;
+    bool found = leaf->SearchKeyIndex(key, index);
+    uint64_t lsn = 0;
+    if (found) {
+      // redone as an Insert, which is equivalent as the key exists
+      lsn = this->Log(LogType::INSERT, key, &val, context);
+      leaf->values_[index] = val;
+      frame->MarkDirty();
+    }
+    context->ReleaseLatch(depth + 1, common::Constants::EXCLUSIVE);
+    context->Clear();
+    this->WaitDurable(lsn);
+    return found;
+  }
+
+  /**
+   * Pages are never merged, hence only the leaf is EXCLUSIVE latched
+   */
+  bool Delete(const KeyType &key, QueryContext *context) {
+    this->AcquireTreeLatch(context, common::Constants::SHARE);
+    int depth;
+    auto frame = this->DescendToLeaf(key, common::Constants::EXCLUSIVE, context, depth);
+    context->ReleaseLatch(depth, common::Constants::SHARE);
+    auto leaf = As<LeafType>(frame);
+    int index;
+    bool found = leaf->SearchKeyIndex(key, index);
+    uint64_t lsn = 0;
+    if (found) {
+      lsn = this->Log(LogType::DELETE, key, nullptr, context);
+      leaf->DeleteIndex(index);
+      frame->MarkDirty();
+    }
+    context->ReleaseLatch(depth + 1, common::Constants::EXCLUSIVE);
+    context->Clear();
+    this->WaitDurable(lsn);
+    return found;
+  }
+
+  /**
+   * Drop all pages, and truncate the file
+   *  Like the other engines, no other thread should use the tree meanwhile
+   */
+  void Clear() {
+    this->pool_.Reset();
+    this->file_.Truncate();
+    this->Initialize();
+    if (this->wal_ != nullptr) this->wal_->Reset();
+  }
+
+  /**
+   * Compact the log into the current content of the tree, so that recovery
+   *  only redoes one record per key
+   *  Like Clear(), no other thread should use the tree meanwhile
+   */
+  void Checkpoint() {
+    if (this->wal_ == nullptr) return;
+    QueryContext context;
+    this->wal_->Rewrite([&](auto append) {
+      std::unique_ptr<DiskIterator> scan(this->TreeScan(&context));
+      KeyType key;
+      ValueType val;
+      while (scan->Next(key, val)) append(key, val);
+    });
+  }
+
+  /**
+   * @brief Iterator over the leaves, which keeps its current leaf SHARE
+   *  latched and pinned until the scan is exhausted or the iterator is
+   *  destroyed
+   *  Leaves are never merged, and writers never latch a leaf while holding its
+   *  right sibling, hence moving right simply waits for the latch of the right
+   *  sibling
+   */
+  class DiskIterator final : public BTreeInterface<KeyType, ValueType, QueryContext>::Iterator {
+  private:
+    DiskBTree *tree_;
+    int offset_;
+    KeyType key_high_;
+    bool upper_bound_;
+    /** The latched leaf, or nullptr once the scan is exhausted */
+    Frame *current_;
+    QueryContext *ctx_;
+
+    void Release() {
+      this->ctx_->ReleaseLatch(this->ctx_->latches_.size(), common::Constants::SHARE);
+      this->ctx_->Clear();
+      this->current_ = nullptr;
+    }
+
+    void MoveRight() {
+      auto right_sibl = As<LeafType>(this->current_)->header_.right_sibl_;
+      if (right_sibl == common::INVALID_PAGE_ID) {
+        this->Release();
+        return;
+      }
+      auto frame = this->tree_->FetchPage(right_sibl, common::Constants::SHARE, this->ctx_);
+      frame->LatchPtr()->lock_shared();
+      this->ctx_->ReplaceLatch(this->ctx_->latches_.size() - 1, frame->LatchPtr(), frame, common::Constants::SHARE);
+      this->current_ = frame;
+      this->offset_ = 0;
+    }
+
+  public:
+    /**
+     * Scan from `key_low` (inclusive) to `key_high` (inclusive)
+     */
+    DiskIterator(DiskBTree *tree, const KeyType &key_low, const KeyType &key_high, QueryContext *context)
+        : tree_(tree), key_high_(key_high), upper_bound_(true), ctx_(context) {
+      tree->AcquireTreeLatch(context, common::Constants::SHARE);
+      int depth;
+      this->current_ = tree->DescendToLeaf(key_low, common::Constants::SHARE, context, depth);
+      context->ReleaseLatch(depth, common::Constants::SHARE);
+      As<LeafType>(this->current_)->SearchKeyIndex(key_low, this->offset_);
+    }
+    /**
+     * Scan the whole tree
+     */
+    DiskIterator(DiskBTree *tree, QueryContext *context)
+        : tree_(tree), offset_(0), upper_bound_(false), ctx_(context) {
+      tree->AcquireTreeLatch(context, common::Constants::SHARE);
+      int depth;
+      this->current_ = tree->Descend(common::Constants::SHARE, context, depth, [](auto /* inner */) { return 0; });
+      context->ReleaseLatch(depth, common::Constants::SHARE);
+    }
+    ~DiskIterator() {
+      if (this->current_ != nullptr) this->Release();
+    }
+
+    // non-copyable, as the iterator may hold a latch
+    DiskIterator(const DiskIterator &) = delete;
+    DiskIterator &operator=(const DiskIterator &) = delete;
+
+    bool Next(KeyType &key, ValueType &val) {
+      while (this->current_ != nullptr) {
+        auto leaf = As<LeafType>(this->current_);
+        if (this->offset_ >= leaf->Size()) {
+          this->MoveRight();
+          continue;
+        }
+        key = leaf->keys_[this->offset_];
+        if (this->upper_bound_ && this->key_high_ < key) {
+          this->Release();
+          return false;
+        }
+        val = leaf->values_[this->offset_++];
+        return true;
+      }
+      return false;
+    }
+  };
+
+  DiskIterator *RangeQuery(const KeyType &key_low, const KeyType &key_high, QueryContext *context) {
+    return new DiskIterator(this, key_low, key_high, context);
+  }
+  DiskIterator *TreeScan(QueryContext *context) { return new DiskIterator(this, context); }
+};
+
+}  // namespace btree::implementation::disk
@@ -23,46 +23,86 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <numeric>
 #include <shared_mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <gtest/gtest_prod.h>
 
 #include "common/constants.h"
+#include "common/fixed_vector.h"
+#include "common/hybrid_latch.h"
+#include "common/key_search.h"
 #include "common/macros.h"
+#include "common/node_allocator.h"
+#include "common/spinlock.h"
+#include "common/statistics.h"
 #include "tree/definitions.h"
+#include "tree/snapshot.h"
 
 namespace btree::implementation {
 
 /**
  * @brief NodeMetadata definition
  *        It provides some useful utilities, such as latch per node
+ * @tparam Latch  Type of the node latch, which should provide the interface of
+ *    std::shared_mutex, e.g. common::SharedSpinlock or common::HybridLatch
  */
-class NodeMetadata {
+template <typename Latch>
+class BasicNodeMetadata {
 public:
-  /** Size of current node */
+  /**
+   * Latch for each node
+   *  With std::shared_mutex, together with the vtable pointer, it fills the
+   *  first cache line of a node, so that latching a node does not invalidate
+   *  the cache line of its keys
+   *  With a compact latch, the whole header shares a cache line with the
+   *  first keys instead
+   */
+  Latch latch_;
+
+  /** Size of current node, which shares a cache line with the first keys */
   int size_;
 
-  /** Latch for each node */
-  std::shared_mutex latch_;
+  /**
+   * Type tag of current node, so that MemoryBTree can dispatch to the concrete
+   *  node class without any virtual call, nodes are leaves until an
+   *  InternalNode constructor overrides it
+   */
+  NodeType type_;
 
   /** Constructor */
-  NodeMetadata() : size_(0) {}
+  BasicNodeMetadata() : size_(0), type_(NodeType::LEAF) {}
 
-  constexpr std::shared_mutex *SharedLatchPtr() { return &(this->latch_); }
+  constexpr Latch *SharedLatchPtr() { return &(this->latch_); }
 };
 
+using NodeMetadata = BasicNodeMetadata<std::shared_mutex>;
+
 /**
  * @brief QueryContext to provide Lock Crabbing protocol
  *          with the Depth-First Search operation
  *          on top of the in-memory B+Tree index
  */
-class QueryContext {
+template <typename Latch>
+class BasicQueryContext {
 public:
+  /**
+   * At most one latch per level, plus the tree latch, is held at any moment,
+   *  hence the latches are kept inline and a descent never allocates
+   */
+  static constexpr std::size_t MAX_LATCHES = common::Constants::MAX_HEIGHT + 1;
+
   /**
    * @brief All latches in this QueryContext should have the same type
    *        Either all are SHARE or EXCLUSIVE latches
@@ -70,17 +110,36 @@ public:
    * SHARE and EXCLUSIVE latches
    */
   short smallest_unlk_idx_;
-  std::vector<std::shared_mutex *> latches_;
+  common::FixedVector<Latch *, MAX_LATCHES> latches_;
 #ifdef NDEBUG
   short expected_unlk_depth_;
   bool have_released_all_;
 #endif
+#ifdef ENABLE_STATISTICS
+  /** Statistics of the tree being accessed, attached by the tree operations */
+  common::TreeStatistics *statistics_;
+#endif
 
-  QueryContext() : smallest_unlk_idx_(0), latches_(0) {
+  BasicQueryContext() : smallest_unlk_idx_(0) {
 #ifdef NDEBUG
     expected_unlk_depth_ = -1;
     have_released_all_ = false;
 #endif
+#ifdef ENABLE_STATISTICS
+    statistics_ = nullptr;
+#endif
+  }
+
+  /**
+   * @brief The context of the calling thread, so that an operation does not
+   * need to construct one
+   *  Every operation leaves the context cleared, but an unfinished iterator
+   *    keeps it busy: no other operation of the thread should use the thread
+   *    context until that iterator is destroyed
+   */
+  static BasicQueryContext *ThreadLocal() {
+    thread_local BasicQueryContext context;
+    return &context;
   }
 
   bool IsEmpty() const { return latches_.empty(); }
@@ -104,17 +163,29 @@ public:
    * @param latch
    * @param latch_type
    * @return int  the current latch index of the caller
+   * @throw std::length_error if the context holds MAX_LATCHES latches already
    */
-  int AcquireLatch(std::shared_mutex *latch, common::Constants::SharedLockType latch_type) {
+  int AcquireLatch(Latch *latch, common::Constants::SharedLockType latch_type) {
 #ifdef NDEBUG
     have_released_all_ = false;
 #endif
     switch (latch_type) {
       case common::Constants::SHARE:
+#ifdef ENABLE_STATISTICS
+        common::TimedLock(
+            this->statistics_, this->latches_.size(), [&]() { return latch->try_lock_shared(); },
+            [&]() { latch->lock_shared(); });
+#else
         latch->lock_shared();
+#endif
         break;
       case common::Constants::EXCLUSIVE:
+#ifdef ENABLE_STATISTICS
+        common::TimedLock(
+            this->statistics_, this->latches_.size(), [&]() { return latch->try_lock(); }, [&]() { latch->lock(); });
+#else
         latch->lock();
+#endif
         break;
       default:
         // user can specify common::Constants::NONE in case he/she simply wants to
@@ -126,7 +197,7 @@ public:
     return this->latches_.size() - 1;
   }
 
-  void ReplaceLatch(short idx, std::shared_mutex *latch, common::Constants::SharedLockType latch_type) {
+  void ReplaceLatch(short idx, Latch *latch, common::Constants::SharedLockType latch_type) {
     switch (latch_type) {
       case common::Constants::SHARE:
         this->latches_[idx]->unlock_shared();
@@ -187,27 +258,48 @@ public:
   }
 };
 
+using QueryContext = BasicQueryContext<std::shared_mutex>;
+
 /**
  * @brief LeafNode class definition
  */
-template <typename KeyType, typename ValueType, int Capacity>
-class LeafNode : public Node<KeyType, ValueType, QueryContext, NodeMetadata> {
+template <typename KeyType, typename ValueType, int Capacity, typename Allocator = common::DefaultNodeAllocator,
+          typename Latch = std::shared_mutex, int MergePercent = 50>
+class alignas(common::Constants::CACHELINE_SIZE) LeafNode final
+    : public Node<KeyType, ValueType, BasicQueryContext<Latch>, BasicNodeMetadata<Latch>> {
 private:
+  using QueryContext = BasicQueryContext<Latch>;
+  using NodeMetadata = BasicNodeMetadata<Latch>;
+
+  static_assert(MergePercent >= 0 && MergePercent <= 50, "Two sibling leaves at MIN_SIZE should fit into one");
+  /**
+   * A leaf is rebalanced with a sibling once it has less than MIN_SIZE entries
+   *  Below the default 50%, most deletions leave the leaf underfull instead,
+   *  hence they only latch that leaf, and an empty leaf is always rebalanced
+   */
+  static constexpr int MIN_SIZE = std::max(1, MERGE_BOUND(Capacity, MergePercent));
+
+  // the member order is assumed by NodeByteSize
+  LeafNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *right_sibl_;
+  /**
+   * Only modified with the exclusive latch of this node, even by writers which
+   *  split/merge its left sibling, hence it can be read with a SHARE latch
+   */
+  LeafNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *left_sibl_;
   KeyType keys_[Capacity];
   ValueType values_[Capacity];
-  LeafNode<KeyType, ValueType, Capacity> *right_sibl_;
   FRIEND_TEST(LeafNode, BalanceBorrowing);
   FRIEND_TEST(LeafNode, BalanceMerge);
 
   bool SearchKeyIndex(const KeyType &key, int &index) {
-    index = std::lower_bound(this->keys_, this->keys_ + this->Size(), key) - this->keys_;
+    index = common::KeySearch<KeyType>::LowerBound(this->keys_, this->Size(), key);
     return (index < this->Size() && this->keys_[index] == key);
   }
 
   void DeleteIndex(int index, bool &underflow) {
     std::move(this->keys_ + index + 1, this->keys_ + this->Size(), this->keys_ + index);
     std::move(this->values_ + index + 1, this->values_ + this->Size(), this->values_ + index);
-    underflow = (--this->Size() < UNDERFLOW_BOUND(Capacity));
+    underflow = (--this->Size() < MIN_SIZE);
   }
 
   void ShiftAndInsert(const KeyType &key, const ValueType &val, int insert_pos) {
@@ -221,8 +313,72 @@ private:
     this->Size()++;
   }
 
+  /**
+   * Split this full node into two, and insert (key, val) at `insert_pos` into
+   *  the one it belongs to
+   * Require the caller to already have exclusive-lock on this node
+   */
+  void SplitAndInsert(const KeyType &key, const ValueType &val, int insert_pos,
+                      Split<KeyType, ValueType, QueryContext, NodeMetadata> &split) {
+    int boundary_idx = UNDERFLOW_BOUND(this->Size());
+
+    // initialize new right sibling
+    auto new_sibling = new (this->NodeAllocator())
+        LeafNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent>(this->keys_, this->values_, boundary_idx,
+                                                                               this->right_sibl_, this);
+    LinkLeftSibling(this->right_sibl_, new_sibling);
+
+    // modify in-memory content of this node
+    this->Size() = boundary_idx;
+    this->right_sibl_ = new_sibling;
+
+    // insert the new (key, val) pair
+    if (insert_pos < boundary_idx) {
+      this->ShiftAndInsert(key, val, insert_pos);
+    } else {
+      new_sibling->ShiftAndInsert(key, val, insert_pos - boundary_idx);
+    }
+
+    // populate split data structure
+    split.left = this;
+    split.right = new_sibling;
+    split.boundary_key = common::KeySeparator<KeyType>::Shortest(RIGHTMOST_KEY(this), LEFTMOST_KEY(new_sibling));
+  }
+
+  Allocator *NodeAllocator() const { return Allocator::Owner(this, sizeof(*this)); }
+
+  /**
+   * Point the left link of `right_sibling` to `left_sibling`
+   *  The exclusive latch of `right_sibling` is taken while holding the one of
+   *  `left_sibling`, i.e. from left to right. `right_sibling` may be a cousin
+   *  under another parent, which the caller has not latched. This cannot
+   *  deadlock since Delete/Balance only latch a sibling from right to left
+   *  under their latched common parent, nothing else latches leftwards, and
+   *  readers only try-lock their siblings
+   *  Note that a forward iterator keeping the SHARE latch of `right_sibling`
+   *  blocks the writer splitting `left_sibling` until it moves on
+   */
+  static void LinkLeftSibling(LeafNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *right_sibling,
+                              LeafNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *left_sibling) {
+    if (right_sibling == nullptr) return;
+    right_sibling->Metadata().SharedLatchPtr()->lock();
+    right_sibling->left_sibl_ = left_sibling;
+    right_sibling->Metadata().SharedLatchPtr()->unlock();
+  }
+
 public:
-  LeafNode() : right_sibl_(nullptr) {}
+  /**
+   * Nodes are allocated by `Allocator`, and the new sibling of a split node is
+   * allocated by the allocator of that node
+   */
+  static void *operator new(std::size_t size, Allocator *allocator) { return allocator->Allocate(size); }
+  static void *operator new(std::size_t size) {
+    static_assert(Allocator::GLOBAL, "Nodes of a node pool should be allocated by that pool");
+    return Allocator::Owner(nullptr, size)->Allocate(size);
+  }
+  static void operator delete(void *ptr, std::size_t size) { Allocator::Deallocate(ptr, size); }
+
+  LeafNode() : right_sibl_(nullptr), left_sibl_(nullptr) {}
 #ifdef ENABLE_TESTING
   // special constructor just for testing purpose
   LeafNode(KeyType infinity_key, ValueType infinity_val) : LeafNode() {
@@ -240,19 +396,50 @@ public:
    * @param start_idx   The new sibling should clone keys in the range of
    * [start_idx, end)
    * @param right_sibling
+   * @param left_sibling
    */
   LeafNode(KeyType (&keys)[Capacity], ValueType (&values)[Capacity], int start_idx,
-           LeafNode<KeyType, ValueType, Capacity> *right_sibling) {
+           LeafNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *right_sibling,
+           LeafNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *left_sibling) {
     this->right_sibl_ = right_sibling;
+    this->left_sibl_ = left_sibling;
     this->Size() = Capacity - start_idx;
     std::copy(keys + start_idx, keys + Capacity, this->keys_);
     std::copy(values + start_idx, values + Capacity, this->values_);
   }
 
+  /**
+   * Bulk-load constructor
+   * @param first   Iterator to sorted <key, value> pairs, it is advanced past
+   * the `count` copied entries
+   * @param count
+   */
+  template <typename InputIt>
+  LeafNode(InputIt &first, int count) : right_sibl_(nullptr), left_sibl_(nullptr) {
+    assert(count <= Capacity);
+    for (int idx = 0; idx < count; ++idx, ++first) {
+      this->keys_[idx] = first->first;
+      this->values_[idx] = first->second;
+    }
+    this->Size() = count;
+  }
+
+  /**
+   * Link a bulk-loaded leaf to its right sibling (and back), should only be
+   * called before both leaves are reachable from the tree
+   */
+  void LinkRightSibling(LeafNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *right_sibling) {
+    this->right_sibl_ = right_sibling;
+    right_sibling->left_sibl_ = this;
+  }
+
   constexpr NodeType Type() { return LEAF; };
-  constexpr NodeMetadata &Metadata() { return this->meta_; }
-  int &Size() { return this->Metadata().size_; };
-  LeafNode<KeyType, ValueType, Capacity> *RightSibling() const { return this->right_sibl_; }
+  LeafNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *RightSibling() const {
+    return this->right_sibl_;
+  }
+  LeafNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *LeftSibling() const {
+    return this->left_sibl_;
+  }
 
   std::string String() {
     std::stringstream ss;
@@ -285,6 +472,21 @@ public:
     return true;
   }
 
+  /**
+   * Copy up to `capacity` entries starting from `offset`, stopping before the
+   *  first key greater than `key_high` if it is given
+   * Require the caller to already have shared-lock on the leaf
+   * @return Number of copied entries
+   */
+  int CopyEntries(int offset, const KeyType *key_high, KeyType *keys, ValueType *values, int capacity) {
+    auto end = std::clamp(offset + capacity, offset, this->Size());
+    if (key_high != nullptr) end = std::upper_bound(this->keys_ + offset, this->keys_ + end, *key_high) - this->keys_;
+    if (end <= offset) return 0;
+    std::copy(this->keys_ + offset, this->keys_ + end, keys);
+    std::copy(this->values_ + offset, this->values_ + end, values);
+    return end - offset;
+  }
+
   /**************************************************************************************
    * @brief Core utilities are placed below, and all are thread-safe, except
    *Balance    *
@@ -317,27 +519,8 @@ public:
     }
 
     // come here means that we have to split current node into two
-    int boundary_idx = UNDERFLOW_BOUND(this->Size());
-
-    // initialize new right sibling
-    auto new_sibling =
-        new LeafNode<KeyType, ValueType, Capacity>(this->keys_, this->values_, boundary_idx, this->right_sibl_);
-
-    // modify in-memory content of this node
-    this->Size() = boundary_idx;
-    this->right_sibl_ = new_sibling;
-
-    // insert the new (key, val) pair
-    if (insert_pos < boundary_idx) {
-      this->ShiftAndInsert(key, val, insert_pos);
-    } else {
-      new_sibling->ShiftAndInsert(key, val, insert_pos - boundary_idx);
-    }
-
-    // populate split data structure
-    split.left = this;
-    split.right = new_sibling;
-    split.boundary_key = RIGHTMOST_KEY(this);
+    this->SplitAndInsert(key, val, insert_pos, split);
+    STATISTICS_INC(context, leaf_splits_);
 
     // because this insertion causes a split, its exclusive latch will be
     // unlocked by its parent
@@ -362,23 +545,146 @@ public:
     return found;
   }
 
+  /**
+   * Search a sorted batch keys[order[0]], ..., keys[order[count - 1]]
+   * Require the caller to already have shared-lock on the leaf
+   * @return Number of found keys
+   */
+  size_t MultiSearch(const KeyType *keys, const size_t *order, size_t count, ValueType *values, bool *found) {
+    size_t found_count = 0;
+    int index = 0;
+    for (size_t idx = 0; idx < count; ++idx) {
+      auto pos = order[idx];
+      // the batch is sorted, so every search starts from the previous position
+      index += common::KeySearch<KeyType>::LowerBound(this->keys_ + index, this->Size() - index, keys[pos]);
+      found[pos] = (index < this->Size() && this->keys_[index] == keys[pos]);
+      if (found[pos]) {
+        values[pos] = this->values_[index];
+        found_count++;
+      }
+    }
+    return found_count;
+  }
+
+  /**
+   * Insert a batch of entries sorted in strictly ascending key order, existing
+   *  keys are updated, and the leaf is split at most once
+   * Require the caller to already have exclusive-lock on the leaf, and
+   *  Size() + count <= 2 * Capacity
+   * @return true if the leaf is split, and `split` is populated accordingly
+   */
+  bool BatchInsert(const KeyType *keys, const ValueType *values, size_t count,
+                   Split<KeyType, ValueType, QueryContext, NodeMetadata> &split) {
+    assert(this->Size() + count <= 2 * Capacity);
+    KeyType merged_keys[2 * Capacity];
+    ValueType merged_values[2 * Capacity];
+    int size = 0, index = 0;
+    for (size_t batch_idx = 0; index < this->Size() || batch_idx < count; ++size) {
+      if (batch_idx == count || (index < this->Size() && this->keys_[index] < keys[batch_idx])) {
+        merged_keys[size] = this->keys_[index];
+        merged_values[size] = this->values_[index++];
+      } else {
+        // an existing key is overwritten by the batch
+        if (index < this->Size() && this->keys_[index] == keys[batch_idx]) index++;
+        merged_keys[size] = keys[batch_idx];
+        merged_values[size] = values[batch_idx++];
+      }
+    }
+
+    if (size <= Capacity) {
+      std::copy(merged_keys, merged_keys + size, this->keys_);
+      std::copy(merged_values, merged_values + size, this->values_);
+      this->Size() = size;
+      return false;
+    }
+
+    int boundary_idx = UNDERFLOW_BOUND(size);
+    auto new_sibling = new (this->NodeAllocator())
+        LeafNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent>();
+    std::copy(merged_keys + boundary_idx, merged_keys + size, new_sibling->keys_);
+    std::copy(merged_values + boundary_idx, merged_values + size, new_sibling->values_);
+    new_sibling->Size() = size - boundary_idx;
+    new_sibling->right_sibl_ = this->right_sibl_;
+    new_sibling->left_sibl_ = this;
+    LinkLeftSibling(this->right_sibl_, new_sibling);
+
+    std::copy(merged_keys, merged_keys + boundary_idx, this->keys_);
+    std::copy(merged_values, merged_values + boundary_idx, this->values_);
+    this->Size() = boundary_idx;
+    this->right_sibl_ = new_sibling;
+
+    split.left = this;
+    split.right = new_sibling;
+    split.boundary_key = common::KeySeparator<KeyType>::Shortest(RIGHTMOST_KEY(this), LEFTMOST_KEY(new_sibling));
+    return true;
+  }
+
   bool Update(const KeyType &key, const ValueType &value, QueryContext *context) {
     int index;
-    // lock crabbing: acquire share latch on current node and unlock all share
-    // latches on its ancestors
+    // an update never changes the structure, hence all ancestors are SHARE
+    // latched, and they are released once this leaf is EXCLUSIVE latched
     auto depth = context->AcquireLatch(this->Metadata().SharedLatchPtr(), common::Constants::EXCLUSIVE);
-    context->ReleaseLatch(depth, common::Constants::EXCLUSIVE);
+    context->ReleaseLatch(depth, common::Constants::SHARE);
 
     bool found = this->SearchKeyIndex(key, index);
     if (found) {
       this->values_[index] = value;
     }
 
-    // unlock latch on current node after completing the search
-    context->ReleaseLatch(depth + 1, common::Constants::SHARE);
+    // unlock latch on current node after completing the update
+    context->ReleaseLatch(depth + 1, common::Constants::EXCLUSIVE);
     return found;
   }
 
+  /**
+   * Call `modify(value, found)` on the value of `key`, which is inserted with
+   *  a value-initialized value first if it is not found
+   * Require the caller to already have exclusive-lock on this leaf
+   * @param found Whether `key` was found
+   * @return false if no split caused, true otherwise
+   */
+  template <typename ModifyFunction>
+  bool Upsert(const KeyType &key, const ModifyFunction &modify, bool &found,
+              Split<KeyType, ValueType, QueryContext, NodeMetadata> &split) {
+    int insert_pos;
+    found = this->SearchKeyIndex(key, insert_pos);
+    if (found) {
+      modify(this->values_[insert_pos], true);
+      return false;
+    }
+    ValueType value{};
+    modify(value, false);
+    if (this->Size() < Capacity) {
+      this->ShiftAndInsert(key, value, insert_pos);
+      return false;
+    }
+    this->SplitAndInsert(key, value, insert_pos, split);
+    return true;
+  }
+
+  /**
+   * Optimistic version of Upsert, similar to OptimisticInsert
+   *  `modify` is not called if the leaf would split
+   * @return true if the operation is completed, false if the caller has to
+   * restart with the pessimistic path
+   */
+  template <typename ModifyFunction>
+  bool OptimisticUpsert(const KeyType &key, const ModifyFunction &modify, bool &found, QueryContext *context) {
+    auto depth = context->AcquireLatch(this->Metadata().SharedLatchPtr(), common::Constants::EXCLUSIVE);
+    context->ReleaseLatch(depth, common::Constants::SHARE);
+
+    int insert_pos;
+    bool safe = this->SearchKeyIndex(key, insert_pos) || this->Size() < Capacity;
+    if (safe) {
+      Split<KeyType, ValueType, QueryContext, NodeMetadata> unused_split;
+      [[maybe_unused]] bool is_split = this->Upsert(key, modify, found, unused_split);
+      assert(!is_split);
+    }
+
+    context->ReleaseLatch(depth + 1, common::Constants::EXCLUSIVE);
+    return safe;
+  }
+
   bool Delete(const KeyType &key, bool &underflow, QueryContext *context) {
     int index;
     // the unnecessity below is to mute warning
@@ -387,7 +693,7 @@ public:
     auto depth = context->AcquireLatch(this->Metadata().SharedLatchPtr(), common::Constants::EXCLUSIVE);
     // if this node is likely to be safe, we should unlock all the exclusive
     // latches on its ancestors ASAP
-    if (this->Size() - 1 >= UNDERFLOW_BOUND(Capacity)) {
+    if (this->Size() - 1 >= MIN_SIZE) {
       context->ReleaseLatch(depth, common::Constants::EXCLUSIVE);
     }
 
@@ -408,6 +714,43 @@ public:
     return found;
   }
 
+  bool OptimisticInsert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    int insert_pos;
+    // all ancestors are SHARE latched, and they are useless once this leaf is
+    // EXCLUSIVE latched, because this leaf is the only node to be modified
+    auto depth = context->AcquireLatch(this->Metadata().SharedLatchPtr(), common::Constants::EXCLUSIVE);
+    context->ReleaseLatch(depth, common::Constants::SHARE);
+
+    bool found = this->SearchKeyIndex(key, insert_pos);
+    bool safe = found || this->Size() < Capacity;
+    if (found) {
+      this->values_[insert_pos] = val;
+    } else if (safe) {
+      this->ShiftAndInsert(key, val, insert_pos);
+    }
+
+    context->ReleaseLatch(depth + 1, common::Constants::EXCLUSIVE);
+    return safe;
+  }
+
+  bool OptimisticDelete(const KeyType &key, bool &deleted, QueryContext *context) {
+    int index;
+    auto depth = context->AcquireLatch(this->Metadata().SharedLatchPtr(), common::Constants::EXCLUSIVE);
+    context->ReleaseLatch(depth, common::Constants::SHARE);
+
+    bool found = this->SearchKeyIndex(key, index);
+    bool safe = !found || this->Size() - 1 >= MIN_SIZE;
+    deleted = found && safe;
+    if (deleted) {
+      bool unused_underflow = false;
+      this->DeleteIndex(index, unused_underflow);
+      assert(unused_underflow == false);
+    }
+
+    context->ReleaseLatch(depth + 1, common::Constants::EXCLUSIVE);
+    return safe;
+  }
+
   bool LocateKey(const KeyType &key, Node<KeyType, ValueType, QueryContext, NodeMetadata> *&child, int &position,
                  QueryContext *context) {
     auto depth = context->AcquireLatch(this->Metadata().SharedLatchPtr(), common::Constants::SHARE);
@@ -423,9 +766,9 @@ public:
   }
 
   bool Balance(Node<KeyType, ValueType, QueryContext, NodeMetadata> *right, KeyType &boundary) {
-    auto right_sibling = static_cast<LeafNode<KeyType, ValueType, Capacity> *>(right);
-    if (this->Size() < UNDERFLOW_BOUND(Capacity) && right_sibling->Size() > UNDERFLOW_BOUND(Capacity)) {
-      assert(this->Size() == UNDERFLOW_BOUND(Capacity) - 1);
+    auto right_sibling = static_cast<LeafNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *>(right);
+    if (this->Size() < MIN_SIZE && right_sibling->Size() > MIN_SIZE) {
+      assert(this->Size() == MIN_SIZE - 1);
       /**
        * this node is underflow, while its right sibling is not
        * start borrowing process - borrow 1 item from its right sibling
@@ -437,8 +780,8 @@ public:
       assert(unused_underflow == false);
       return false;
     }
-    if (this->Size() > UNDERFLOW_BOUND(Capacity) && right_sibling->Size() < UNDERFLOW_BOUND(Capacity)) {
-      assert(right_sibling->Size() == UNDERFLOW_BOUND(Capacity) - 1);
+    if (this->Size() > MIN_SIZE && right_sibling->Size() < MIN_SIZE) {
+      assert(right_sibling->Size() == MIN_SIZE - 1);
       /**
        * right sibling is underflow, while the current node is not
        * start borrowing process
@@ -458,6 +801,7 @@ public:
     std::copy(right_sibling->values_, right_sibling->values_ + right_sibling->Size(), this->values_ + this->Size());
     this->Size() += right_sibling->Size();
     this->right_sibl_ = right_sibling->right_sibl_;
+    LinkLeftSibling(this->right_sibl_, this);
     boundary = RIGHTMOST_KEY(this);
 
     return true;
@@ -467,9 +811,21 @@ public:
 /**
  * @brief InternalNode class definition
  */
-template <typename KeyType, typename ValueType, int Capacity>
-class InternalNode : public Node<KeyType, ValueType, QueryContext, NodeMetadata> {
+template <typename KeyType, typename ValueType, int Capacity, typename Allocator = common::DefaultNodeAllocator,
+          typename Latch = std::shared_mutex, int MergePercent = 50>
+class alignas(common::Constants::CACHELINE_SIZE) InternalNode final
+    : public Node<KeyType, ValueType, BasicQueryContext<Latch>, BasicNodeMetadata<Latch>> {
 private:
+  using QueryContext = BasicQueryContext<Latch>;
+  using NodeMetadata = BasicNodeMetadata<Latch>;
+
+  static_assert(MergePercent >= 0 && MergePercent <= 50, "Two sibling nodes at MIN_SIZE should fit into one");
+  /**
+   * Similar to LeafNode::MIN_SIZE, but an internal node with a single child is
+   *  always rebalanced, so that a root left with one child is collapsed
+   */
+  static constexpr int MIN_SIZE = std::max(2, MERGE_BOUND(Capacity, MergePercent));
+
   /**
    * The internal node maintains N-1 keys and N child pointers (N == Capacity)
    *    and child[I] contains all <Key, Value> pairs whose key <= keys[I]
@@ -480,12 +836,13 @@ private:
    * We also allow extra OVERFLOW_SIZE entries to easily implement Internal Node
    * split operation these OVERFLOW_SIZE entries are in-memory only, which
    * means, these entries won't be persisted in non-volatile media
+   *
+   * Similar to LeafNode, the member order is assumed by NodeByteSize
    */
+  InternalNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *right_sibl_;
   KeyType keys_[Capacity + common::Constants::OVERFLOW_SIZE];
   Node<KeyType, ValueType, QueryContext, NodeMetadata> *child_[Capacity + common::Constants::OVERFLOW_SIZE];
 
-  InternalNode<KeyType, ValueType, Capacity> *right_sibl_;
-
   void ShiftAndInsert(const KeyType &key, Node<KeyType, ValueType, QueryContext, NodeMetadata> *child, int insert_pos) {
     // only move backward key array if new child is not supposed to be new
     // right-most child
@@ -495,8 +852,8 @@ private:
       this->keys_[insert_pos] = key;
     }
     // insert new child
-    std::move_backward(this->child_ + insert_pos, this->child_ + this->Size() + 1,
-                       this->child_ + this->Size() + common::Constants::OVERFLOW_SIZE + 1);
+    std::move_backward(this->child_ + insert_pos, this->child_ + this->Size(),
+                       this->child_ + this->Size() + common::Constants::OVERFLOW_SIZE);
     this->child_[insert_pos] = child;
     this->Size()++;
   }
@@ -506,18 +863,32 @@ private:
       std::move(this->keys_ + index + 1, this->keys_ + this->Size(), this->keys_ + index);
       std::move(this->child_ + index + 1, this->child_ + this->Size() + 1, this->child_ + index);
     }
-    underflow = (--this->Size() < UNDERFLOW_BOUND(Capacity)) ? true : false;
+    underflow = (--this->Size() < MIN_SIZE) ? true : false;
   }
 
+  Allocator *NodeAllocator() const { return Allocator::Owner(this, sizeof(*this)); }
+
 public:
-  InternalNode() = default;
+  /**
+   * Nodes are allocated by `Allocator`, and the new sibling of a split node is
+   * allocated by the allocator of that node
+   */
+  static void *operator new(std::size_t size, Allocator *allocator) { return allocator->Allocate(size); }
+  static void *operator new(std::size_t size) {
+    static_assert(Allocator::GLOBAL, "Nodes of a node pool should be allocated by that pool");
+    return Allocator::Owner(nullptr, size)->Allocate(size);
+  }
+  static void operator delete(void *ptr, std::size_t size) { Allocator::Deallocate(ptr, size); }
+
+  InternalNode() : right_sibl_(nullptr) { this->Metadata().type_ = NodeType::INTERNAL; }
 
   InternalNode(Node<KeyType, ValueType, QueryContext, NodeMetadata> *left_chld,
                Node<KeyType, ValueType, QueryContext, NodeMetadata> *right_chld, KeyType boundary_key)
-      : keys_{boundary_key, RIGHTMOST_KEY(right_chld)},
+      : right_sibl_(nullptr),
+        keys_{boundary_key, RIGHTMOST_KEY(right_chld)},
         child_{static_cast<Node<KeyType, ValueType, QueryContext, NodeMetadata> *>(left_chld),
-               static_cast<Node<KeyType, ValueType, QueryContext, NodeMetadata> *>(right_chld)},
-        right_sibl_(nullptr) {
+               static_cast<Node<KeyType, ValueType, QueryContext, NodeMetadata> *>(right_chld)} {
+    this->Metadata().type_ = NodeType::INTERNAL;
     this->Size() = 2;
   }
 
@@ -535,13 +906,38 @@ public:
   InternalNode(
       KeyType (&keys)[Capacity + common::Constants::OVERFLOW_SIZE],
       Node<KeyType, ValueType, QueryContext, NodeMetadata> *(&children)[Capacity + common::Constants::OVERFLOW_SIZE],
-      int start_idx, InternalNode<KeyType, ValueType, Capacity> *right_sibling) {
+      int start_idx, InternalNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *right_sibling) {
     this->right_sibl_ = right_sibling;
+    this->Metadata().type_ = NodeType::INTERNAL;
     this->Size() = Capacity - start_idx + 1;
     std::copy(keys + start_idx, keys + Capacity + common::Constants::OVERFLOW_SIZE, this->keys_);
     std::copy(children + start_idx, children + Capacity + common::Constants::OVERFLOW_SIZE, this->child_);
   }
 
+  /**
+   * Bulk-load constructor
+   * @param children    Array of `count` children in ascending key order
+   * @param high_keys   high_keys[I] should be the largest key of children[I]
+   * @param count
+   */
+  InternalNode(Node<KeyType, ValueType, QueryContext, NodeMetadata> *const *children, const KeyType *high_keys,
+               int count)
+      : right_sibl_(nullptr) {
+    this->Metadata().type_ = NodeType::INTERNAL;
+    assert(count <= Capacity);
+    std::copy(children, children + count, this->child_);
+    std::copy(high_keys, high_keys + count, this->keys_);
+    this->Size() = count;
+  }
+
+  /**
+   * Link a bulk-loaded internal node to its right sibling, should only be
+   * called before the node is reachable from the tree
+   */
+  void LinkRightSibling(InternalNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *right_sibling) {
+    this->right_sibl_ = right_sibling;
+  }
+
   ~InternalNode() {
     for (int idx = 0; idx < this->Size(); idx++) {
       delete this->child_[idx];
@@ -549,11 +945,17 @@ public:
   }
 
   int SearchChildIndex(const KeyType &key) {
-    return std::lower_bound(this->keys_, this->keys_ + this->Size() - 1, key) - this->keys_;
+    return common::KeySearch<KeyType>::LowerBound(this->keys_, this->Size() - 1, key);
+  }
+
+  /**
+   * @return Index of the first child which may contain a key greater than `key`
+   */
+  int SearchChildIndexAfter(const KeyType &key) {
+    return std::upper_bound(this->keys_, this->keys_ + this->Size() - 1, key) - this->keys_;
   }
 
   constexpr NodeType Type() { return INTERNAL; };
-  constexpr NodeMetadata &Metadata() { return this->meta_; }
 
   std::string String() {
     std::stringstream ss;
@@ -588,8 +990,9 @@ public:
    */
   void ClearChildArray() { std::fill_n(this->child_, std::size(this->child_), nullptr); }
 
-  int &Size() { return this->Metadata().size_; };
-  InternalNode<KeyType, ValueType, Capacity> *RightSibling() const { return this->right_sibl_; }
+  InternalNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *RightSibling() const {
+    return this->right_sibl_;
+  }
 
   /**************************************************************************************
    * @brief Core utilities are placed below, and all are thread-safe, except
@@ -619,6 +1022,26 @@ public:
       return false;
     }
 
+    // no need to split this current internal node, release all latches from
+    // this safe internal node to its lowest leaf
+    if (!this->InsertSplitChild(target_idx, split)) {
+      context->ReleaseLatchFromParent(depth, common::Constants::EXCLUSIVE);
+      return false;
+    }
+
+    // because the current node splits, the unlocking responsibility belongs to
+    // its lowest safe ancestor
+    STATISTICS_INC(context, internal_splits_);
+    return true;
+  }
+
+  /**
+   * Insert the new right sibling of the split child at `target_idx`, and split
+   *  this node as well if it overflows
+   * Require the caller to already have exclusive-lock on this node
+   * @return true if this node is split, and `split` is populated accordingly
+   */
+  bool InsertSplitChild(int target_idx, Split<KeyType, ValueType, QueryContext, NodeMetadata> &split) {
     // new sibling should be inserted next to `target`
     int insert_pos = target_idx + 1;
 
@@ -631,20 +1054,15 @@ public:
     std::swap(this->keys_[target_idx], split.boundary_key);
     this->ShiftAndInsert(split.boundary_key,
                          static_cast<Node<KeyType, ValueType, QueryContext, NodeMetadata> *>(split.right), insert_pos);
-
-    // no need to split this current internal node, release all latches from
-    // this safe internal node to its lowest leaf
-    if (this->Size() <= Capacity) {
-      context->ReleaseLatchFromParent(depth, common::Constants::EXCLUSIVE);
-      return false;
-    }
+    if (this->Size() <= Capacity) return false;
 
     // come here means that we have to split current node into two
     int boundary_idx = UNDERFLOW_BOUND(this->Size());
 
     // initialize new right sibling
-    auto new_sibling =
-        new InternalNode<KeyType, ValueType, Capacity>(this->keys_, this->child_, boundary_idx, this->right_sibl_);
+    auto new_sibling = new (this->NodeAllocator())
+        InternalNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent>(this->keys_, this->child_,
+                                                                                   boundary_idx, this->right_sibl_);
 
     // modify in-memory content of this node
     this->Size() = boundary_idx;
@@ -654,9 +1072,6 @@ public:
     split.left = this;
     split.right = new_sibling;
     split.boundary_key = this->keys_[boundary_idx - 1];
-
-    // because the current node splits, the unlocking responsibility belongs to
-    // its lowest safe ancestor
     return true;
   }
 
@@ -675,9 +1090,9 @@ public:
 
   bool Update(const KeyType &key, const ValueType &value, QueryContext *context) {
     // lock crabbing: acquire share latch on current node and unlock all share
-    // latches on its ancestors
-    auto depth = context->AcquireLatch(this->Metadata().SharedLatchPtr(), common::Constants::EXCLUSIVE);
-    context->ReleaseLatch(depth, common::Constants::EXCLUSIVE);
+    // latches on its ancestors, only the leaf is EXCLUSIVE latched
+    auto depth = context->AcquireLatch(this->Metadata().SharedLatchPtr(), common::Constants::SHARE);
+    context->ReleaseLatch(depth, common::Constants::SHARE);
 
     auto target = this->child_[this->SearchChildIndex(key)];
 
@@ -700,12 +1115,33 @@ public:
     return target->LocateKey(key, child, position, context);
   }
 
+  bool OptimisticInsert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    // optimistic crabbing: internal nodes are never modified in this path,
+    // hence SHARE latches are enough to protect the traversal
+    auto depth = context->AcquireLatch(this->Metadata().SharedLatchPtr(), common::Constants::SHARE);
+    context->ReleaseLatch(depth, common::Constants::SHARE);
+
+    auto target = this->child_[this->SearchChildIndex(key)];
+
+    // latch on this node will be unlocked by its child
+    return target->OptimisticInsert(key, val, context);
+  }
+
+  bool OptimisticDelete(const KeyType &key, bool &deleted, QueryContext *context) {
+    auto depth = context->AcquireLatch(this->Metadata().SharedLatchPtr(), common::Constants::SHARE);
+    context->ReleaseLatch(depth, common::Constants::SHARE);
+
+    auto target = this->child_[this->SearchChildIndex(key)];
+
+    return target->OptimisticDelete(key, deleted, context);
+  }
+
   bool Delete(const KeyType &key, bool &underflow, QueryContext *context) {
     // lock crabbing: acquire exclusive latch on current node
     auto depth = context->AcquireLatch(this->Metadata().SharedLatchPtr(), common::Constants::EXCLUSIVE);
     // if this node is likely to be safe, we should unlock all the exclusive
     // latches on its ancestors ASAP
-    if (this->Size() - 1 >= UNDERFLOW_BOUND(Capacity)) {
+    if (this->Size() - 1 >= MIN_SIZE) {
       context->ReleaseLatch(depth, common::Constants::EXCLUSIVE);
     }
 
@@ -748,12 +1184,17 @@ public:
       left_child = target;
       right_child = this->child_[target_idx + 1];
     }
-    auto target_latch = target->Metadata().SharedLatchPtr();
+    [[maybe_unused]] auto target_latch = target->Metadata().SharedLatchPtr();
     auto sibl_latch = this->child_[sibl_index]->Metadata().SharedLatchPtr();
     sibl_latch->lock();
     KeyType boundary = this->keys_[boundary_idx];
 
     auto merged = left_child->Balance(right_child, boundary);
+    if (merged) {
+      STATISTICS_INC(context, merges_);
+    } else {
+      STATISTICS_INC(context, borrows_);
+    }
     // note that, for ease of the impl, we should assume that only latch of
     // left_child is hold after the Balance operation
     //  the main reason for that is, if a merge op is executed, right_child will
@@ -787,8 +1228,9 @@ public:
     // right_child
     std::swap(this->keys_[boundary_idx], this->keys_[boundary_idx + 1]);
     this->DeleteIndex(boundary_idx + 1, underflow);
-    if (right_child->Type() == INTERNAL) {
-      static_cast<InternalNode<KeyType, ValueType, Capacity> *>(right_child)->ClearChildArray();
+    if (right_child->Metadata().type_ == INTERNAL) {
+      static_cast<InternalNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *>(right_child)
+          ->ClearChildArray();
     }
     delete right_child;
 
@@ -805,12 +1247,13 @@ public:
   }
 
   bool Balance(Node<KeyType, ValueType, QueryContext, NodeMetadata> *right, KeyType &boundary) {
-    auto right_sibling = static_cast<InternalNode<KeyType, ValueType, Capacity> *>(right);
+    auto right_sibling =
+        static_cast<InternalNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *>(right);
     // The right-sibling pointer is wrong (very rarely), just reset it for
     // safety
     this->right_sibl_ = right_sibling;
-    if (this->Size() < UNDERFLOW_BOUND(Capacity) && right_sibling->Size() > UNDERFLOW_BOUND(Capacity)) {
-      assert(this->Size() == UNDERFLOW_BOUND(Capacity) - 1);
+    if (this->Size() < MIN_SIZE && right_sibling->Size() > MIN_SIZE) {
+      assert(this->Size() == MIN_SIZE - 1);
       /**
        * this node is underflow, while its right sibling is not
        * start borrowing process:
@@ -826,8 +1269,8 @@ public:
       assert(unused_underflow == false);
       return false;
     }
-    if (this->Size() > UNDERFLOW_BOUND(Capacity) && right_sibling->Size() < UNDERFLOW_BOUND(Capacity)) {
-      assert(right_sibling->Size() == UNDERFLOW_BOUND(Capacity) - 1);
+    if (this->Size() > MIN_SIZE && right_sibling->Size() < MIN_SIZE) {
+      assert(right_sibling->Size() == MIN_SIZE - 1);
       /**
        * right sibling is underflow, while the current node is not
        * start borrowing process for right sibling:
@@ -853,34 +1296,725 @@ public:
 
     return true;
   }
+
+  /**
+   * Merge adjacent children whose total size is at most `max_size`, from left
+   *  to right, the right one of every merged pair is de-allocated
+   * Both children of a pair are EXCLUSIVE latched, from left to right, while
+   *  they are merged, so that readers and writers which already reached them
+   *  have left
+   * Require the caller to already have exclusive-lock on this node, and none
+   *  of its children
+   * @param is_root   Whether this node is the root, which may shrink down to
+   *    a single child, while other nodes never underflow
+   * @return Number of merged children
+   */
+  int MergeChildren(int max_size, bool is_root) {
+    auto min_size = is_root ? 1 : MIN_SIZE;
+    int merged = 0;
+    int idx = 0;
+    auto left = this->child_[0];
+    left->Metadata().SharedLatchPtr()->lock();
+    while (idx + 1 < this->Size()) {
+      auto right = this->child_[idx + 1];
+      auto right_latch = right->Metadata().SharedLatchPtr();
+      right_latch->lock();
+      if (this->Size() > min_size && left->Size() + right->Size() <= max_size) {
+        KeyType boundary = this->keys_[idx];
+        if (left->Balance(right, boundary)) {
+          // similar to Delete, the right child is released before being freed
+          right_latch->unlock();
+          std::swap(this->keys_[idx], this->keys_[idx + 1]);
+          bool unused_underflow = false;
+          this->DeleteIndex(idx + 1, unused_underflow);
+          if (right->Metadata().type_ == INTERNAL) {
+            static_cast<InternalNode<KeyType, ValueType, Capacity, Allocator, Latch, MergePercent> *>(right)
+                ->ClearChildArray();
+          }
+          delete right;
+          merged++;
+          continue;
+        }
+        // an underflowed child borrows an entry instead
+        this->keys_[idx] = boundary;
+      }
+      left->Metadata().SharedLatchPtr()->unlock();
+      left = right;
+      idx++;
+    }
+    left->Metadata().SharedLatchPtr()->unlock();
+    return merged;
+  }
 };
 
 /**
- * A memory B+Tree implementation, distinguished by the KeyType, ValueType and
- * the capacity of Leaf and Internal nodes
+ * Byte size of a LeafNode/InternalNode, whose members follow the node header
+ *  in this order: `links` sibling pointers, `count` keys, then `count` slots
+ *  of SlotType (values or child pointers)
  */
-template <typename KeyType, typename ValueType, int LeafCapacity, int InternalCapacity>
-class MemoryBTree : public BTreeInterface<KeyType, ValueType, QueryContext> {
-private:
-  std::unique_ptr<Node<KeyType, ValueType, QueryContext, NodeMetadata>> root_;
-  std::shared_mutex tree_latch_;
-
-  constexpr std::shared_mutex *LatchPtr() { return &this->tree_latch_; }
-
-public:
-  MemoryBTree() { root_ = std::make_unique<LeafNode<KeyType, ValueType, LeafCapacity>>(); }
+template <typename KeyType, typename SlotType, typename Latch = std::shared_mutex>
+constexpr std::size_t NodeByteSize(std::size_t count, std::size_t links = 1) {
+  auto align_up = [](std::size_t offset, std::size_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+  };
+  // the node header: the vtable pointer and NodeMetadata
+  auto offset = align_up(sizeof(void *), alignof(BasicNodeMetadata<Latch>)) + sizeof(BasicNodeMetadata<Latch>);
+  offset = align_up(offset, alignof(void *)) + links * sizeof(void *);
+  offset = align_up(offset, alignof(KeyType)) + count * sizeof(KeyType);
+  offset = align_up(offset, alignof(SlotType)) + count * sizeof(SlotType);
+  return align_up(offset, common::Constants::CACHELINE_SIZE);
+}
 
-  std::string String() const { return this->root_->String(); }
+/**
+ * @return The largest capacity of a LeafNode which fits in `node_size` bytes,
+ *  e.g. MemoryBTree<int, int, LeafNodeCapacity<int, int>(4096), ...>
+ */
+template <typename KeyType, typename ValueType, typename Latch = std::shared_mutex>
+constexpr int LeafNodeCapacity(std::size_t node_size) {
+  int capacity = node_size / (sizeof(KeyType) + sizeof(ValueType));
+  while (capacity > 0 && NodeByteSize<KeyType, ValueType, Latch>(capacity, 2) > node_size) capacity--;
+  return capacity;
+}
 
-  bool Search(const KeyType &key, ValueType &val, QueryContext *context) {
-    context->AcquireLatch(this->LatchPtr(), common::Constants::SHARE);
-    auto found = this->root_->Search(key, val, context);
-    context->Clear();
-    return found;
+/**
+ * @return The largest capacity of an InternalNode which fits in `node_size`
+ *  bytes, including its overflow slots
+ */
+template <typename KeyType, typename ValueType, typename Latch = std::shared_mutex>
+constexpr int InternalNodeCapacity(std::size_t node_size) {
+  using ChildPtr = Node<KeyType, ValueType, BasicQueryContext<Latch>, BasicNodeMetadata<Latch>> *;
+  int capacity = node_size / (sizeof(KeyType) + sizeof(ChildPtr));
+  while (capacity > 0 &&
+         NodeByteSize<KeyType, ChildPtr, Latch>(capacity + common::Constants::OVERFLOW_SIZE) > node_size) {
+    capacity--;
   }
+  return capacity;
+}
 
-  void Insert(const KeyType &key, const ValueType &val, QueryContext *context) {
-    context->AcquireLatch(this->LatchPtr(), common::Constants::EXCLUSIVE);
+/**
+ * A memory B+Tree implementation, distinguished by the KeyType, ValueType and
+ * the capacity of Leaf and Internal nodes
+ * @tparam Latch  Type of both the node latches and the tree latch, which should
+ *    provide the interface of std::shared_mutex, e.g. common::SharedSpinlock
+ *    or common::HybridLatch
+ * @tparam MergePercent  Fill factor, in percent of the capacity, below which a
+ *    node is rebalanced on delete. The default 50% keeps every node half-full,
+ *    while a lower one defers the merges of delete-heavy workloads, e.g. 0
+ *    only rebalances a leaf once it is empty
+ * Every thread remembers the leaf of its last Insert into the tree, which the
+ *  next one tries before descending, so that appends and hot keys skip the
+ *  descent, see LeafCache
+ */
+template <typename KeyType, typename ValueType, int LeafCapacity, int InternalCapacity,
+          typename Allocator = common::DefaultNodeAllocator, typename Latch = std::shared_mutex, int MergePercent = 50>
+class MemoryBTree : public BTreeInterface<KeyType, ValueType, BasicQueryContext<Latch>> {
+public:
+  using QueryContext = BasicQueryContext<Latch>;
+  using NodeMetadata = BasicNodeMetadata<Latch>;
+  using LeafType = LeafNode<KeyType, ValueType, LeafCapacity, Allocator, Latch, MergePercent>;
+  using InternalType = InternalNode<KeyType, ValueType, InternalCapacity, Allocator, Latch, MergePercent>;
+
+  /**
+   * Outcome of Compact()
+   *  Freed nodes go back to `Allocator`, e.g. a NodePool keeps them for later
+   *  allocations rather than returning them to the system
+   */
+  struct CompactionResult {
+    size_t leaf_merges_ = 0;
+    size_t internal_merges_ = 0;
+    size_t bytes_reclaimed_ = 0;
+  };
+
+private:
+  /** Declared before `root_`, as the allocator should outlive all nodes */
+  Allocator allocator_;
+  std::unique_ptr<Node<KeyType, ValueType, QueryContext, NodeMetadata>> root_;
+  Latch tree_latch_;
+  /**
+   * Validates the leaves cached by Insert: the high 32 bits count the
+   *  structure modifications started so far, the low ones those which are
+   *  still running, see BeginStructureChange()
+   */
+  std::atomic<uint64_t> structure_version_{0};
+  /** Tells this tree apart from a former one at the same address */
+  const uint64_t instance_id_ = NextInstanceId();
+#ifdef ENABLE_STATISTICS
+  common::TreeStatistics statistics_;
+#endif
+
+  static constexpr uint64_t STRUCTURE_CHANGE = uint64_t(1) << 32;
+
+  /**
+   * The leaf reached by the last successful optimistic Insert of a thread,
+   *  with the separators of its closest ancestors, i.e. it holds the keys of
+   *  (low_, high_]
+   *  It is only trusted while the structure version is the one it was cached
+   *    at, which had no running modification: since then, no leaf was split,
+   *    merged, or freed, nor any separator moved
+   *  Every thread has LEAF_CACHE_SLOTS of them, indexed by the tree instance
+   *    id, so that threads alternating between trees of the same type, e.g.
+   *    the shards of a ShardedBTree, keep the leaf of each tree
+   */
+  struct LeafCache {
+    uint64_t tree_id_ = 0;
+    uint64_t version_ = 0;
+    LeafType *leaf_ = nullptr;
+    bool has_low_ = false;
+    bool has_high_ = false;
+    KeyType low_{};
+    KeyType high_{};
+
+    bool Covers(uint64_t tree_id, uint64_t version, const KeyType &key) const {
+      return this->tree_id_ == tree_id && this->version_ == version && (!this->has_low_ || this->low_ < key) &&
+             (!this->has_high_ || key <= this->high_);
+    }
+  };
+
+  static constexpr size_t LEAF_CACHE_SLOTS = 8;
+
+  LeafCache &ThreadLeafCache() const {
+    thread_local LeafCache caches[LEAF_CACHE_SLOTS];
+    return caches[this->instance_id_ % LEAF_CACHE_SLOTS];
+  }
+
+  static uint64_t NextInstanceId() {
+    static std::atomic<uint64_t> next_id{1};
+    return next_id++;
+  }
+
+  /**
+   * Invalidate all cached leaves before modifying the structure of the tree
+   *  Require the EXCLUSIVE tree latch, hence no thread is using a cached leaf,
+   *  as they hold the SHARE tree latch until their leaf is latched. Until
+   *  EndStructureChange(), no leaf is cached anymore either
+   */
+  void BeginStructureChange() { this->structure_version_.fetch_add(STRUCTURE_CHANGE + 1); }
+
+  void EndStructureChange() { this->structure_version_.fetch_sub(1); }
+
+  constexpr Latch *LatchPtr() { return &this->tree_latch_; }
+
+  /**
+   * Every operation starts by latching the tree, which also attaches the
+   *  statistics of this tree to `context`
+   */
+  int AcquireTreeLatch(QueryContext *context, common::Constants::SharedLockType latch_type) {
+#ifdef ENABLE_STATISTICS
+    context->statistics_ = &this->statistics_;
+#endif
+    return context->AcquireLatch(this->LatchPtr(), latch_type);
+  }
+
+  /**
+   * Statically dispatched lock crabbing descent
+   *  Nodes are cast to their concrete (final) classes after checking their
+   *  type tags, hence no virtual call is made on the way down
+   * Require the caller to already have `latch_type` latch on the tree
+   * @param child_index   Index of the child to follow in an internal node
+   * @return The reached leaf, it is not latched yet, but all latches on its
+   * ancestors except its parent are released
+   */
+  template <typename ChildIndexFn>
+  LeafType *Descend(common::Constants::SharedLockType latch_type, QueryContext *context, ChildIndexFn child_index) {
+    auto node = this->root_.get();
+    while (node->Metadata().type_ == NodeType::INTERNAL) {
+      auto inner = static_cast<InternalType *>(node);
+      auto depth = context->AcquireLatch(inner->Metadata().SharedLatchPtr(), latch_type);
+      context->ReleaseLatch(depth, latch_type);
+      node = inner->GetChild(child_index(inner));
+    }
+    return static_cast<LeafType *>(node);
+  }
+
+  /**
+   * @return The leaf which may contain `key`, see Descend()
+   */
+  LeafType *DescendToLeaf(const KeyType &key, common::Constants::SharedLockType latch_type, QueryContext *context) {
+    return this->Descend(latch_type, context, [&](auto inner) { return inner->SearchChildIndex(key); });
+  }
+
+  /**
+   * Accumulate the occupancy of the subtree of `node` into `levels`, indexed
+   *  by the distance to the root. The path from the root to the visited node
+   *  is SHARE latched, hence the root is latched during the whole walk
+   */
+  void CollectLevelFill(Node<KeyType, ValueType, QueryContext, NodeMetadata> *node, size_t level,
+                        std::vector<common::LevelFill> &levels) {
+    auto latch = node->Metadata().SharedLatchPtr();
+    latch->lock_shared();
+    auto is_internal = (node->Metadata().type_ == NodeType::INTERNAL);
+    if (levels.size() <= level) {
+      levels.emplace_back();
+      levels.back().capacity_ = is_internal ? InternalCapacity : LeafCapacity;
+    }
+    levels[level].AddNode(node->Size());
+    if (is_internal) {
+      auto inner = static_cast<InternalType *>(node);
+      for (int idx = 0; idx < inner->Size(); ++idx) this->CollectLevelFill(inner->GetChild(idx), level + 1, levels);
+    }
+    latch->unlock_shared();
+  }
+
+  /**
+   * A single step of Compact(): merge the sparse children of the internal node
+   *  at `depth` (the root being at depth 0) which follows `cursor`, or of the
+   *  left-most one if there is no cursor yet
+   * Its ancestors are only SHARE latched on the way down and released once it
+   *  is EXCLUSIVE latched, as it keeps enough children to never underflow.
+   *  Only the root may shrink to a single child, hence it additionally holds
+   *  the EXCLUSIVE tree latch, so that it can be collapsed
+   * @param cursor  Set to the upper bound of the compacted node
+   * @return Whether there is a next node at `depth`
+   */
+  bool CompactNode(int depth, double fill_factor, bool &has_cursor, KeyType &cursor, CompactionResult &result,
+                   QueryContext *context) {
+    auto latch_type = (depth == 0) ? common::Constants::EXCLUSIVE : common::Constants::SHARE;
+    this->AcquireTreeLatch(context, latch_type);
+    auto node = this->root_.get();
+    bool has_fence = false;
+    KeyType fence{};
+    for (int level = 0; level < depth && node->Metadata().type_ == NodeType::INTERNAL; ++level) {
+      auto inner = static_cast<InternalType *>(node);
+      auto latch_depth = context->AcquireLatch(inner->Metadata().SharedLatchPtr(), common::Constants::SHARE);
+      context->ReleaseLatch(latch_depth, common::Constants::SHARE);
+      int child_idx = has_cursor ? inner->SearchChildIndexAfter(cursor) : 0;
+      if (child_idx < inner->Size() - 1) {
+        has_fence = true;
+        fence = inner->GetKey(child_idx);
+      }
+      node = inner->GetChild(child_idx);
+    }
+    // the tree is not that high (anymore)
+    if (node->Metadata().type_ == NodeType::LEAF) {
+      context->ReleaseLatch(context->latches_.size(), latch_type);
+      context->Clear();
+      return false;
+    }
+
+    auto inner = static_cast<InternalType *>(node);
+    auto latch_depth = context->AcquireLatch(inner->Metadata().SharedLatchPtr(), common::Constants::EXCLUSIVE);
+    if (depth > 0) context->ReleaseLatch(latch_depth, common::Constants::SHARE);
+    auto leaf_children = (inner->GetChild(0)->Metadata().type_ == NodeType::LEAF);
+    auto capacity = leaf_children ? LeafCapacity : InternalCapacity;
+    auto max_size = std::max(1, static_cast<int>(fill_factor * capacity));
+    auto merged = static_cast<size_t>(inner->MergeChildren(max_size, depth == 0));
+    if (leaf_children) {
+      result.leaf_merges_ += merged;
+      result.bytes_reclaimed_ += merged * sizeof(LeafType);
+    } else {
+      result.internal_merges_ += merged;
+      result.bytes_reclaimed_ += merged * sizeof(InternalType);
+    }
+    for (size_t idx = 0; idx < merged; ++idx) STATISTICS_INC(context, merges_);
+
+    if (depth == 0 && inner->Size() == 1) {
+      // similar to Delete, the root with a single child is collapsed
+      this->root_.release();
+      this->root_.reset(inner->GetChild(0));
+      inner->ClearChildArray();
+      STATISTICS_INC(context, root_changes_);
+      context->ReleaseLatchFromParent(0, common::Constants::EXCLUSIVE);
+      context->Clear();
+      delete inner;
+      result.internal_merges_++;
+      result.bytes_reclaimed_ += sizeof(InternalType);
+      return false;
+    }
+    context->ReleaseLatch(context->latches_.size(), common::Constants::EXCLUSIVE);
+    context->Clear();
+    has_cursor = true;
+    cursor = fence;
+    return has_fence;
+  }
+
+  /**
+   * Number of nodes to pack `entries` entries into, so that every node is
+   *  filled up to `fill_factor` of `capacity`, and none of them underflows
+   *  (except a single root node)
+   */
+  static size_t BulkNodeCount(size_t entries, int capacity, double fill_factor) {
+    auto min_size = static_cast<size_t>(UNDERFLOW_BOUND(capacity));
+    auto target =
+        std::clamp(static_cast<size_t>(fill_factor * capacity + 0.5), min_size, static_cast<size_t>(capacity));
+    auto node_count = std::max<size_t>((entries + target - 1) / target, 1);
+    // spreading the entries evenly may still leave too few entries per node
+    if (node_count > 1 && entries / node_count < min_size) node_count = entries / min_size;
+    return node_count;
+  }
+
+  /**
+   * Search the sorted batch keys[order[first]], ..., keys[order[last - 1]] in
+   *  the subtree of `node`, which is already SHARE latched by the caller
+   * The batch is split into runs of keys sharing the same child, and the
+   *  child of the next run is prefetched before descending into the current
+   *  one, so that cache misses on siblings overlap
+   */
+  size_t MultiSearchNode(Node<KeyType, ValueType, QueryContext, NodeMetadata> *node, const KeyType *keys,
+                         const size_t *order, size_t first, size_t last, ValueType *values, bool *found) {
+    if (node->Metadata().type_ == NodeType::LEAF) {
+      return static_cast<LeafType *>(node)->MultiSearch(keys, order + first, last - first, values, found);
+    }
+    auto inner = static_cast<InternalType *>(node);
+    size_t found_count = 0;
+    int child_idx = inner->SearchChildIndex(keys[order[first]]);
+    while (first < last) {
+      auto next = last;
+      // the right-most child covers all the remaining keys
+      if (child_idx < inner->Size() - 1) {
+        next = first + 1;
+        while (next < last && keys[order[next]] <= inner->GetKey(child_idx)) ++next;
+      }
+      int next_child_idx = -1;
+      if (next < last) {
+        next_child_idx = inner->SearchChildIndex(keys[order[next]]);
+        PREFETCH_READ(inner->GetChild(next_child_idx), 4);
+      }
+      // the parent stays latched until all of its runs are searched
+      auto child = inner->GetChild(child_idx);
+      child->Metadata().SharedLatchPtr()->lock_shared();
+      found_count += this->MultiSearchNode(child, keys, order, first, next, values, found);
+      child->Metadata().SharedLatchPtr()->unlock_shared();
+      first = next;
+      child_idx = next_child_idx;
+    }
+    return found_count;
+  }
+
+  /**
+   * Number of the leading keys of a sorted batch which are routed to the leaf
+   *  bounded by `fence` (if `has_fence`), at most `limit`
+   */
+  static size_t BatchRoutedCount(const KeyType *keys, size_t count, bool has_fence, const KeyType &fence,
+                                 size_t limit) {
+    auto routed = has_fence ? std::upper_bound(keys, keys + count, fence) - keys : count;
+    return std::min<size_t>(routed, limit);
+  }
+
+  /**
+   * Similar to Insert, first try to insert the leading keys of the batch that
+   *  fit into their leaf without splitting it, only EXCLUSIVE latching that leaf
+   * @return Number of inserted keys, 0 if the leaf is full
+   */
+  size_t OptimisticBatchInsert(const KeyType *keys, const ValueType *values, size_t count, QueryContext *context) {
+    this->AcquireTreeLatch(context, common::Constants::SHARE);
+    auto node = this->root_.get();
+    // the separator of the closest ancestor bounding the leaf from the right
+    bool has_fence = false;
+    KeyType fence{};
+    while (node->Metadata().type_ == NodeType::INTERNAL) {
+      auto depth = context->AcquireLatch(node->Metadata().SharedLatchPtr(), common::Constants::SHARE);
+      context->ReleaseLatch(depth, common::Constants::SHARE);
+      auto inner = static_cast<InternalType *>(node);
+      int child_idx = inner->SearchChildIndex(keys[0]);
+      if (child_idx < inner->Size() - 1) {
+        has_fence = true;
+        fence = inner->GetKey(child_idx);
+      }
+      node = inner->GetChild(child_idx);
+    }
+
+    auto leaf = static_cast<LeafType *>(node);
+    auto depth = context->AcquireLatch(leaf->Metadata().SharedLatchPtr(), common::Constants::EXCLUSIVE);
+    context->ReleaseLatch(depth, common::Constants::SHARE);
+    auto inserted = BatchRoutedCount(keys, count, has_fence, fence, LeafCapacity - leaf->Size());
+    if (inserted > 0) {
+      Split<KeyType, ValueType, QueryContext, NodeMetadata> unused_split;
+      [[maybe_unused]] bool is_split = leaf->BatchInsert(keys, values, inserted, unused_split);
+      assert(!is_split);
+    }
+    context->ReleaseLatch(depth + 1, common::Constants::EXCLUSIVE);
+    context->Clear();
+    return inserted;
+  }
+
+  /**
+   * Descend to the leaf of `key` with pessimistic lock crabbing, and call
+   *  `modify(leaf, depth, has_fence, fence, split)` under its EXCLUSIVE latch
+   *  - depth: index of the leaf latch in `context`, so that `modify` can
+   *    release the ancestors early once it knows the leaf won't split
+   *  - fence: the separator of the closest ancestor bounding the leaf from
+   *    the right, if `has_fence`
+   * The leaf splits at most once, i.e. if `modify` returns true, and the split
+   *  is propagated to its ancestors the same way Insert does
+   */
+  template <typename ModifyFunction>
+  void PessimisticLeafModify(const KeyType &key, const ModifyFunction &modify, QueryContext *context) {
+    struct PathEntry {
+      InternalType *node_;
+      int child_idx_;
+      int depth_;
+    };
+    std::vector<PathEntry> path;
+    this->AcquireTreeLatch(context, common::Constants::EXCLUSIVE);
+    this->BeginStructureChange();
+    auto node = this->root_.get();
+    bool has_fence = false;
+    KeyType fence{};
+    while (node->Metadata().type_ == NodeType::INTERNAL) {
+      auto inner = static_cast<InternalType *>(node);
+      auto depth = context->AcquireLatch(inner->Metadata().SharedLatchPtr(), common::Constants::EXCLUSIVE);
+      // this node can absorb a new child without splitting
+      if (inner->Size() < InternalCapacity) context->ReleaseLatch(depth, common::Constants::EXCLUSIVE);
+      int child_idx = inner->SearchChildIndex(key);
+      if (child_idx < inner->Size() - 1) {
+        has_fence = true;
+        fence = inner->GetKey(child_idx);
+      }
+      path.push_back({inner, child_idx, depth});
+      node = inner->GetChild(child_idx);
+    }
+
+    auto leaf = static_cast<LeafType *>(node);
+    auto depth = context->AcquireLatch(leaf->Metadata().SharedLatchPtr(), common::Constants::EXCLUSIVE);
+    Split<KeyType, ValueType, QueryContext, NodeMetadata> split;
+    if (!modify(leaf, depth, has_fence, fence, split)) {
+      context->ReleaseLatch(depth + 1, common::Constants::EXCLUSIVE);
+      context->Clear();
+      this->EndStructureChange();
+      return;
+    }
+    STATISTICS_INC(context, leaf_splits_);
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+      if (!it->node_->InsertSplitChild(it->child_idx_, split)) {
+        context->ReleaseLatchFromParent(it->depth_, common::Constants::EXCLUSIVE);
+        context->Clear();
+        this->EndStructureChange();
+        return;
+      }
+      STATISTICS_INC(context, internal_splits_);
+    }
+    // the root is split as well
+    this->root_.release();
+    this->root_.reset(new (&this->allocator_) InternalType(split));
+    STATISTICS_INC(context, root_changes_);
+    context->ReleaseLatchFromParent(0, common::Constants::EXCLUSIVE);
+    context->Clear();
+    this->EndStructureChange();
+  }
+
+  /**
+   * Insert the leading keys of the batch routed to the same leaf with lock
+   *  crabbing, see PessimisticLeafModify()
+   * The leaf splits at most once, so at most 2 * LeafCapacity - leaf->Size()
+   *  keys are inserted, the rest of the batch takes another descent
+   * @return Number of inserted keys
+   */
+  size_t PessimisticBatchInsert(const KeyType *keys, const ValueType *values, size_t count, QueryContext *context) {
+    size_t inserted = 0;
+    this->PessimisticLeafModify(
+        keys[0],
+        [&](auto leaf, int depth, bool has_fence, const KeyType &fence, auto &split) {
+          inserted = BatchRoutedCount(keys, count, has_fence, fence, 2 * LeafCapacity - leaf->Size());
+          if (leaf->Size() + inserted <= LeafCapacity) context->ReleaseLatch(depth, common::Constants::EXCLUSIVE);
+          return leaf->BatchInsert(keys, values, inserted, split);
+        },
+        context);
+    return inserted;
+  }
+
+  /**
+   * Index of the first entry of the `node_idx`-th node when `entries` entries
+   *  are spread evenly over `node_count` nodes
+   */
+  static size_t BulkNodeOffset(size_t node_idx, size_t entries, size_t node_count) {
+    return node_idx * (entries / node_count) + std::min(node_idx, entries % node_count);
+  }
+
+  /**
+   * Run `build(first, last)` over disjoint partitions of [0, count) in
+   *  `threads` threads, the calling thread builds the first partition
+   */
+  template <typename Function>
+  static void BulkParallelFor(size_t count, size_t threads, const Function &build) {
+    threads = std::clamp<size_t>(threads, 1, count);
+    std::vector<std::thread> workers;
+    for (size_t tidx = 1; tidx < threads; ++tidx) {
+      workers.emplace_back(build, BulkNodeOffset(tidx, count, threads), BulkNodeOffset(tidx + 1, count, threads));
+    }
+    build(0, BulkNodeOffset(1, count, threads));
+    for (auto &worker : workers) worker.join();
+  }
+
+  /**
+   * Link the last node of every run built by BulkParallelFor to the first node
+   *  of the next run
+   */
+  template <typename NodeClass>
+  static void BulkStitchRuns(std::vector<Node<KeyType, ValueType, QueryContext, NodeMetadata> *> &level,
+                             size_t threads) {
+    threads = std::clamp<size_t>(threads, 1, level.size());
+    for (size_t tidx = 1; tidx < threads; ++tidx) {
+      auto idx = BulkNodeOffset(tidx, level.size(), threads);
+      static_cast<NodeClass *>(level[idx - 1])->LinkRightSibling(static_cast<NodeClass *>(level[idx]));
+    }
+  }
+
+  /**
+   * Build the parent level of `level`, `high_keys` are the largest keys of
+   *  the nodes of `level`, and both are replaced by those of the new level
+   * Every thread builds a run of adjacent parents, and the runs are stitched
+   *  through their right siblings afterward
+   */
+  void BuildInternalLevel(std::vector<Node<KeyType, ValueType, QueryContext, NodeMetadata> *> &level,
+                          std::vector<KeyType> &high_keys, double fill_factor, size_t threads) {
+    auto node_count = BulkNodeCount(level.size(), InternalCapacity, fill_factor);
+    std::vector<Node<KeyType, ValueType, QueryContext, NodeMetadata> *> parents(node_count);
+    std::vector<KeyType> parent_high_keys(node_count);
+    BulkParallelFor(node_count, threads, [&](size_t first, size_t last) {
+      InternalType *prev = nullptr;
+      for (size_t idx = first; idx < last; ++idx) {
+        auto offset = BulkNodeOffset(idx, level.size(), node_count);
+        int count = BulkNodeOffset(idx + 1, level.size(), node_count) - offset;
+        auto node =
+            new (&this->allocator_) InternalType(level.data() + offset, high_keys.data() + offset, count);
+        if (prev != nullptr) prev->LinkRightSibling(node);
+        parents[idx] = node;
+        parent_high_keys[idx] = high_keys[offset + count - 1];
+        prev = node;
+      }
+    });
+    BulkStitchRuns<InternalType>(parents, threads);
+    level.swap(parents);
+    high_keys.swap(parent_high_keys);
+  }
+
+public:
+  MemoryBTree() { root_.reset(new (&this->allocator_) LeafType()); }
+
+  /** The allocator of all nodes, e.g. to bind a NodePool to a NUMA node */
+  Allocator *NodeAllocator() { return &this->allocator_; }
+
+  std::string String() const { return this->root_->String(); }
+
+  bool Search(const KeyType &key, ValueType &val, QueryContext *context) {
+    this->AcquireTreeLatch(context, common::Constants::SHARE);
+    auto found = this->DescendToLeaf(key, common::Constants::SHARE, context)->Search(key, val, context);
+    context->Clear();
+    return found;
+  }
+
+  /**
+   * Search a batch of `count` keys at once
+   *  The batch is sorted first, so that all keys of the same leaf are searched
+   *  within a single descent, and the tree latch is only acquired once
+   * @param keys
+   * @param count
+   * @param values  values[I] is set to the value of keys[I] if found[I]
+   * @param found
+   * @return Number of found keys
+   */
+  size_t MultiSearch(const KeyType *keys, size_t count, ValueType *values, bool *found, QueryContext *context) {
+    if (count == 0) return 0;
+    std::vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    if (!std::is_sorted(keys, keys + count)) {
+      std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+    }
+
+    this->AcquireTreeLatch(context, common::Constants::SHARE);
+    auto root = this->root_.get();
+    auto depth = context->AcquireLatch(root->Metadata().SharedLatchPtr(), common::Constants::SHARE);
+    context->ReleaseLatch(depth, common::Constants::SHARE);
+    auto found_count = this->MultiSearchNode(root, keys, order.data(), 0, count, values, found);
+    context->ReleaseLatch(depth + 1, common::Constants::SHARE);
+    context->Clear();
+    return found_count;
+  }
+
+  /**
+   * Replace the value of `key` if it is found
+   *  Only the leaf is EXCLUSIVE latched on the way down, since an update never
+   *  changes the structure of the tree
+   * @return Whether `key` is found
+   */
+  bool Update(const KeyType &key, const ValueType &val, QueryContext *context) {
+    this->AcquireTreeLatch(context, common::Constants::SHARE);
+    auto found = this->DescendToLeaf(key, common::Constants::SHARE, context)->Update(key, val, context);
+    context->Clear();
+    return found;
+  }
+
+  /**
+   * Atomic read-modify-write of the value of `key`
+   *  `modify(ValueType &value, bool found)` is called exactly once under the
+   *  EXCLUSIVE latch of the leaf, if `key` is not found it is inserted with
+   *  the value set by `modify`, starting from a value-initialized one
+   * Similar to Insert, the optimistic path, which only EXCLUSIVE latches the
+   *  leaf, is tried first
+   * @return Whether `key` was found
+   */
+  template <typename ModifyFunction>
+  bool Upsert(const KeyType &key, const ModifyFunction &modify, QueryContext *context) {
+    bool found = false;
+    this->AcquireTreeLatch(context, common::Constants::SHARE);
+    auto completed =
+        this->DescendToLeaf(key, common::Constants::SHARE, context)->OptimisticUpsert(key, modify, found, context);
+    context->Clear();
+    if (completed) return found;
+    STATISTICS_INC(context, optimistic_restarts_);
+
+    this->PessimisticLeafModify(
+        key,
+        [&](auto leaf, int depth, bool /* has_fence */, const KeyType & /* fence */, auto &split) {
+          if (leaf->Size() < LeafCapacity) context->ReleaseLatch(depth, common::Constants::EXCLUSIVE);
+          return leaf->Upsert(key, modify, found, split);
+        },
+        context);
+    return found;
+  }
+
+  void Insert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    /**
+     * Bayer-Schkolnick optimistic insert: most of the insertions don't split
+     *  hence we first try to only EXCLUSIVE latch the target leaf
+     * If that leaf is full, restart with the pessimistic lock crabbing below
+     * Even before, the leaf cached by the previous Insert of this thread is
+     *  directly latched if it covers `key`, the SHARE tree latch keeps it
+     *  valid until then
+     */
+    auto &cache = this->ThreadLeafCache();
+    this->AcquireTreeLatch(context, common::Constants::SHARE);
+    auto version = this->structure_version_.load();
+    if (cache.Covers(this->instance_id_, version, key)) {
+      auto completed = cache.leaf_->OptimisticInsert(key, val, context);
+      context->Clear();
+      if (completed) {
+        STATISTICS_INC(context, leaf_cache_hits_);
+        return;
+      }
+      this->AcquireTreeLatch(context, common::Constants::SHARE);
+      version = this->structure_version_.load();
+    }
+
+    LeafCache entry;
+    auto leaf = this->Descend(common::Constants::SHARE, context, [&](auto inner) {
+      int child_idx = inner->SearchChildIndex(key);
+      if (child_idx > 0) {
+        entry.has_low_ = true;
+        entry.low_ = inner->GetKey(child_idx - 1);
+      }
+      if (child_idx < inner->Size() - 1) {
+        entry.has_high_ = true;
+        entry.high_ = inner->GetKey(child_idx);
+      }
+      return child_idx;
+    });
+    auto completed = leaf->OptimisticInsert(key, val, context);
+    context->Clear();
+    if (completed) {
+      // the fences may be stale if a structure modification was running
+      if ((version & (STRUCTURE_CHANGE - 1)) == 0) {
+        entry.tree_id_ = this->instance_id_;
+        entry.version_ = version;
+        entry.leaf_ = leaf;
+        cache = std::move(entry);
+      }
+      return;
+    }
+    STATISTICS_INC(context, optimistic_restarts_);
+
+    this->AcquireTreeLatch(context, common::Constants::EXCLUSIVE);
+    this->BeginStructureChange();
     Split<KeyType, ValueType, QueryContext, NodeMetadata> split;
     bool required_split = this->root_->Insert(key, val, split, context);
     if (required_split) {
@@ -891,7 +2025,8 @@ public:
        * have to deallocate it
        */
       this->root_.release();
-      this->root_ = std::make_unique<InternalNode<KeyType, ValueType, InternalCapacity>>(split);
+      this->root_.reset(new (&this->allocator_) InternalType(split));
+      STATISTICS_INC(context, root_changes_);
       context->ReleaseLatchFromParent(0, common::Constants::EXCLUSIVE);
     }
 #ifdef NDEBUG
@@ -900,10 +2035,44 @@ public:
     }
 #endif
     context->Clear();
+    this->EndStructureChange();
+  }
+
+  /**
+   * Insert a batch of `count` entries sorted in strictly ascending key order,
+   *  existing keys are updated
+   * Every descent inserts the entries routed to the same leaf under a single
+   *  EXCLUSIVE latch, instead of one descent per entry
+   * A descent never splits its leaf more than once: when more entries are
+   *  routed to the leaf than two nodes can hold, the surplus is inserted by the
+   *  following descents, which then start at the new right sibling
+   */
+  void BatchInsert(const KeyType *keys, const ValueType *values, size_t count, QueryContext *context) {
+    assert(std::adjacent_find(keys, keys + count, std::greater_equal<KeyType>()) == keys + count);
+    while (count > 0) {
+      auto inserted = this->OptimisticBatchInsert(keys, values, count, context);
+      if (inserted == 0) {
+        STATISTICS_INC(context, optimistic_restarts_);
+        inserted = this->PessimisticBatchInsert(keys, values, count, context);
+      }
+      keys += inserted;
+      values += inserted;
+      count -= inserted;
+    }
   }
 
   bool Delete(const KeyType &key, QueryContext *context) {
-    context->AcquireLatch(this->LatchPtr(), common::Constants::EXCLUSIVE);
+    // similar to Insert, try the optimistic path first
+    bool deleted = false;
+    this->AcquireTreeLatch(context, common::Constants::SHARE);
+    auto completed =
+        this->DescendToLeaf(key, common::Constants::SHARE, context)->OptimisticDelete(key, deleted, context);
+    context->Clear();
+    if (completed) return deleted;
+    STATISTICS_INC(context, optimistic_restarts_);
+
+    this->AcquireTreeLatch(context, common::Constants::EXCLUSIVE);
+    this->BeginStructureChange();
     bool underflow = false;
     auto ret = this->root_->Delete(key, underflow, context);
     // if key is not found, then all latches should be unlocked already
@@ -912,20 +2081,24 @@ public:
       assert(context->smallest_unlk_idx_ == context->latches_.size());
       assert(!underflow);
 #endif
+      this->EndStructureChange();
       return ret;
     }
     /**
      * When the current root only has 1 child left,
      *  we have to push its only child and make that child the new root node
      */
-    if (this->root_->Type() == NodeType::INTERNAL && this->root_->Size() == 1) {
+    if (this->root_->Metadata().type_ == NodeType::INTERNAL && this->root_->Size() == 1) {
       assert(underflow == true);
-      auto old_root = static_cast<InternalNode<KeyType, ValueType, InternalCapacity> *>(this->root_.release());
+      auto old_root = static_cast<InternalType *>(this->root_.release());
       this->root_.reset(old_root->GetChild(0));
       old_root->ClearChildArray();
+      STATISTICS_INC(context, root_changes_);
+      // the latch of the old root is still held, release it before the old
+      // root is de-allocated
+      context->ReleaseLatchFromParent(0, common::Constants::EXCLUSIVE);
       delete old_root;
-    }
-    if (underflow) {
+    } else if (underflow) {
       context->ReleaseLatchFromParent(0, common::Constants::EXCLUSIVE);
     }
 #ifdef NDEBUG
@@ -934,70 +2107,575 @@ public:
     }
 #endif
     context->Clear();
+    this->EndStructureChange();
     return true;
   }
 
-  void Clear() { this->root_.reset(new LeafNode<KeyType, ValueType, LeafCapacity>()); };
+  void Clear() {
+    this->structure_version_ += STRUCTURE_CHANGE;
+    this->root_.reset(new (&this->allocator_) LeafType());
+  };
+
+  /**
+   * Read the counters and latch wait histograms of this tree, which require
+   *  ENABLE_STATISTICS, without latching anything
+   */
+  common::TreeStatisticsSnapshot Statistics() {
+    common::TreeStatisticsSnapshot snapshot;
+#ifdef ENABLE_STATISTICS
+    this->statistics_.Read(snapshot);
+#endif
+    return snapshot;
+  }
+
+  /**
+   * Collect the node occupancy by level, from the root to the leaves, by
+   *  walking the whole tree
+   * This is stop-the-world: the SHARE tree latch and the SHARE latch of the
+   *  root are held during the whole O(n) walk, so every pessimistic insert,
+   *  delete and Compact() waits for it. Meant for sizing the node capacities
+   *  offline, not for periodic monitoring
+   */
+  std::vector<common::LevelFill> Occupancy() {
+    std::vector<common::LevelFill> levels;
+    this->tree_latch_.lock_shared();
+    this->CollectLevelFill(this->root_.get(), 0, levels);
+    this->tree_latch_.unlock_shared();
+    return levels;
+  }
+
+  /**
+   * Online compaction, which merges adjacent sparse nodes level by level from
+   *  the leaves up, e.g. after a large wave of deletions
+   *  Every step only latches a single internal node and its children, see
+   *  CompactNode(), hence it can run concurrently with other operations
+   *  Only the children of the same parent are merged, so the levels are swept
+   *  again while the parents keep being merged
+   * @param fill_factor   Two siblings are merged if their entries fit into
+   *    this fraction of the capacity of a node
+   */
+  CompactionResult Compact(double fill_factor, QueryContext *context) {
+    assert(fill_factor > 0 && fill_factor <= 1);
+    CompactionResult result;
+    // the whole compaction counts as a single structure modification
+    this->AcquireTreeLatch(context, common::Constants::EXCLUSIVE);
+    this->BeginStructureChange();
+    context->ReleaseLatch(context->latches_.size(), common::Constants::EXCLUSIVE);
+    context->Clear();
+    size_t internal_merges;
+    do {
+      internal_merges = result.internal_merges_;
+      // the height may change concurrently, which is fine, as every step
+      //  checks the level it reaches anyway
+      this->AcquireTreeLatch(context, common::Constants::SHARE);
+      int height = 0;
+      this->Descend(common::Constants::SHARE, context, [&](auto /* inner */) {
+        height++;
+        return 0;
+      });
+      context->ReleaseLatch(context->latches_.size(), common::Constants::SHARE);
+      context->Clear();
+
+      for (int depth = height - 1; depth >= 0; --depth) {
+        bool has_cursor = false;
+        KeyType cursor{};
+        while (this->CompactNode(depth, fill_factor, has_cursor, cursor, result, context)) {
+        }
+      }
+    } while (result.internal_merges_ > internal_merges);
+    this->EndStructureChange();
+    return result;
+  }
 
-  class MemoryIterator : public BTreeInterface<KeyType, ValueType, QueryContext>::Iterator {
+  /**
+   * Replace the content of the tree with the entries of [begin, end), which is
+   *  much faster than inserting them one by one
+   *  Leaves are packed bottom-up, then every internal level on top of them
+   * Like Clear, it should not run concurrently with other operations
+   * @param begin         Forward iterator to <key, value> pairs, which should
+   * be sorted in strictly ascending key order, random access iterators let the
+   * threads seek to their partitions in constant time
+   * @param end
+   * @param fill_factor   Fraction of the capacity of every node to fill, nodes
+   * are never filled below the underflow bound
+   * @param threads       Number of threads to build every level with, the
+   * resulting tree does not depend on it
+   */
+  template <typename InputIt>
+  void BulkLoad(InputIt begin, InputIt end, double fill_factor = 1.0, size_t threads = 1) {
+    assert(fill_factor > 0 && fill_factor <= 1);
+    assert(std::is_sorted(begin, end, [](const auto &a, const auto &b) { return a.first <= b.first; }));
+    size_t entries = std::distance(begin, end);
+    if (entries == 0) {
+      this->Clear();
+      return;
+    }
+
+    auto node_count = BulkNodeCount(entries, LeafCapacity, fill_factor);
+    std::vector<Node<KeyType, ValueType, QueryContext, NodeMetadata> *> level(node_count);
+    std::vector<KeyType> high_keys(node_count);
+    BulkParallelFor(node_count, threads, [&](size_t first, size_t last) {
+      auto input = std::next(begin, BulkNodeOffset(first, entries, node_count));
+      LeafType *prev = nullptr;
+      for (size_t idx = first; idx < last; ++idx) {
+        int count = BulkNodeOffset(idx + 1, entries, node_count) - BulkNodeOffset(idx, entries, node_count);
+        auto leaf = new (&this->allocator_) LeafType(input, count);
+        if (prev != nullptr) prev->LinkRightSibling(leaf);
+        level[idx] = leaf;
+        high_keys[idx] = RIGHTMOST_KEY(leaf);
+        prev = leaf;
+      }
+    });
+    BulkStitchRuns<LeafType>(level, threads);
+    while (level.size() > 1) this->BuildInternalLevel(level, high_keys, fill_factor, threads);
+    this->structure_version_ += STRUCTURE_CHANGE;
+    this->root_.reset(level[0]);
+  }
+
+  /**
+   * Write the entries of the tree into a tree image at `path`, see
+   *  SnapshotHeader, which can be loaded by LoadSnapshot() or served directly
+   *  by a MappedBTree
+   *  The leaves are scanned batch by batch, and no latch is held while writing,
+   *  hence keys which are modified concurrently may or may not be dumped
+   * @throw std::runtime_error if the image can't be written
+   */
+  void DumpSnapshot(const std::string &path, QueryContext *context) {
+    SnapshotWriter<KeyType, ValueType> writer(path, LeafCapacity, InternalCapacity);
+    KeyType keys[LeafCapacity];
+    ValueType values[LeafCapacity];
+    MemoryIterator it(this, context);
+    while (auto count = it.NextBatch(keys, values, LeafCapacity)) writer.Append(keys, values, count);
+    writer.Finish();
+  }
+
+  /**
+   * Replace the content of the tree with the entries of the tree image at
+   *  `path`, which are streamed from the mapped image into BulkLoad()
+   * @throw std::runtime_error/std::invalid_argument, see MappedBTree
+   */
+  void LoadSnapshot(const std::string &path, double fill_factor = 1.0, size_t threads = 1) {
+    MappedBTree<KeyType, ValueType> snapshot(path);
+    this->BulkLoad(snapshot.begin(), snapshot.end(), fill_factor, threads);
+  }
+
+  /**
+   * @brief Iterator over the leaf level, which keeps a SHARE latch on its
+   *  current leaf until the scan is exhausted or the iterator is destroyed,
+   *  hence an unfinished iterator should be destroyed before reusing its context
+   *  Writers in Delete() may latch the left sibling while holding the right
+   *    one, hence waiting on the right sibling could deadlock. If the right
+   *    sibling is busy, the iterator releases its latch and re-descends from
+   *    the root instead, resuming right after the last returned key
+   *  Keys which exist during the whole scan are returned exactly once, in
+   *    order, while concurrently inserted/deleted ones may or may not be
+   *  The iterator can be allocated on the stack as well, e.g.
+   *    MemoryBTree<...>::MemoryIterator it(&tree, key_low, key_high, &context)
+   */
+  class MemoryIterator final : public BTreeInterface<KeyType, ValueType, QueryContext>::Iterator {
   private:
+    MemoryBTree *tree_;
     int offset_;
     KeyType key_high_;
     bool upper_bound_;
-    LeafNode<KeyType, ValueType, LeafCapacity> *current_;
+    /** The scan resumes from `resume_key_`, or from the leftmost leaf if there is none */
+    KeyType resume_key_;
+    bool has_resume_key_;
+    /** Whether `resume_key_` itself should be returned */
+    bool resume_inclusive_;
+    bool finished_;
+    /** The latched leaf, or nullptr if the iterator does not hold any latch */
+    LeafType *current_;
     QueryContext *ctx_;
 
+    /**
+     * Position the iterator at the resume point, and latch the leaf there
+     *  Require the caller to not hold any latch in `ctx_`
+     */
+    void Seek() {
+      this->tree_->AcquireTreeLatch(this->ctx_, common::Constants::SHARE);
+      if (!this->has_resume_key_) {
+        this->current_ =
+            this->tree_->Descend(common::Constants::SHARE, this->ctx_, [](auto /* inner */) { return 0; });
+        auto depth = this->ctx_->AcquireLatch(this->current_->Metadata().SharedLatchPtr(), common::Constants::SHARE);
+        this->ctx_->ReleaseLatch(depth, common::Constants::SHARE);
+        this->offset_ = 0;
+        return;
+      }
+      auto &key = this->resume_key_;
+      if (this->resume_inclusive_) {
+        this->current_ = this->tree_->DescendToLeaf(key, common::Constants::SHARE, this->ctx_);
+      } else {
+        // follow the first child which may contain a key greater than `key`
+        this->current_ = this->tree_->Descend(common::Constants::SHARE, this->ctx_, [&](auto inner) {
+          return inner->SearchChildIndexAfter(key);
+        });
+      }
+      Node<KeyType, ValueType, QueryContext, NodeMetadata> *leaf;
+      auto found = this->current_->LocateKey(key, leaf, this->offset_, this->ctx_);
+      if (found && !this->resume_inclusive_) this->offset_++;
+    }
+
+    /**
+     * Move to the right sibling of the current leaf, or re-descend to it from
+     *  the root if it is latched by a writer
+     */
+    void MoveRight() {
+      auto right_sibl = this->current_->RightSibling();
+      if (right_sibl == nullptr) {
+        this->Finish();
+        return;
+      }
+      if (right_sibl->Metadata().SharedLatchPtr()->try_lock_shared()) {
+        // the sibling takes the slot of the current leaf, so that a long scan
+        //  does not pile up latches in the context
+        this->ctx_->ReplaceLatch(this->ctx_->latches_.size() - 1, right_sibl->Metadata().SharedLatchPtr(),
+                                 common::Constants::SHARE);
+        this->current_ = right_sibl;
+        this->offset_ = 0;
+        return;
+      }
+      STATISTICS_INC(this->ctx_, scan_restarts_);
+      this->Release();
+      this->Seek();
+    }
+
+    void Release() {
+      this->ctx_->ReleaseLatch(this->ctx_->latches_.size(), common::Constants::SHARE);
+      this->ctx_->Clear();
+      this->current_ = nullptr;
+    }
+
+    void Finish() {
+      this->Release();
+      this->finished_ = true;
+    }
+
+    void Resume() {
+      if (this->current_ == nullptr && !this->finished_) this->Seek();
+    }
+
   public:
-    MemoryIterator(LeafNode<KeyType, ValueType, LeafCapacity> *node, int offset, const KeyType &key_high,
-                   QueryContext *context)
-        : offset_(offset), key_high_(key_high), upper_bound_(true), current_(node), ctx_(context) {}
-    MemoryIterator(LeafNode<KeyType, ValueType, LeafCapacity> *node, int offset, QueryContext *context)
-        : offset_(offset), upper_bound_(false), current_(node), ctx_(context) {}
-    MemoryIterator(LeafNode<KeyType, ValueType, LeafCapacity> *node, QueryContext *context)
-        : offset_(0), upper_bound_(false), current_(node), ctx_(context) {}
-    ~MemoryIterator() {}
+    /**
+     * Scan from `key_low` (inclusive) to `key_high` (inclusive)
+     */
+    MemoryIterator(MemoryBTree *tree, const KeyType &key_low, const KeyType &key_high, QueryContext *context)
+        : tree_(tree),
+          offset_(0),
+          key_high_(key_high),
+          upper_bound_(true),
+          resume_key_(key_low),
+          has_resume_key_(true),
+          resume_inclusive_(true),
+          finished_(false),
+          current_(nullptr),
+          ctx_(context) {
+      this->Seek();
+    }
+    /**
+     * Scan the whole tree
+     */
+    MemoryIterator(MemoryBTree *tree, QueryContext *context)
+        : tree_(tree),
+          offset_(0),
+          upper_bound_(false),
+          has_resume_key_(false),
+          resume_inclusive_(false),
+          finished_(false),
+          current_(nullptr),
+          ctx_(context) {
+      this->Seek();
+    }
+    /**
+     * Scan the keys greater than `key_low` up to `key_high` (inclusive), either
+     *  of them can be nullptr for an unbounded side
+     */
+    MemoryIterator(MemoryBTree *tree, const KeyType *key_low, const KeyType *key_high, QueryContext *context)
+        : tree_(tree),
+          offset_(0),
+          upper_bound_(key_high != nullptr),
+          has_resume_key_(key_low != nullptr),
+          resume_inclusive_(false),
+          finished_(false),
+          current_(nullptr),
+          ctx_(context) {
+      if (key_low != nullptr) this->resume_key_ = *key_low;
+      if (key_high != nullptr) this->key_high_ = *key_high;
+      this->Seek();
+    }
+    ~MemoryIterator() {
+      if (this->current_ != nullptr) this->Release();
+    }
+
+    // non-copyable, as the iterator may hold a latch
+    MemoryIterator(const MemoryIterator &) = delete;
+    MemoryIterator &operator=(const MemoryIterator &) = delete;
+
     bool Next(KeyType &key, ValueType &val) {
-      // current node is an invalid one
-      if (!this->current_) return false;
-      if (this->current_->GetEntry(this->offset_, key, val)) {
+      this->Resume();
+      while (this->current_ != nullptr) {
+        if (!this->current_->GetEntry(this->offset_, key, val)) {
+          this->MoveRight();
+          continue;
+        }
+        if (this->upper_bound_ && this->key_high_ < key) {
+          this->Finish();
+          return false;
+        }
         this->offset_++;
-        return !upper_bound_ || key <= this->key_high_;
-      } else {
-        this->offset_ = 0;
-        auto right_sibl = this->current_->RightSibling();
-        if (right_sibl) {
-          auto lock_success = right_sibl->Metadata().SharedLatchPtr()->try_lock_shared();
-          if (!lock_success) {
-            throw std::range_error("Can't acquire SHARE lock on next sibling");
-          }
-          auto sibl_depth = ctx_->AcquireLatch(right_sibl->Metadata().SharedLatchPtr(), common::Constants::NONE);
-          ctx_->ReleaseLatch(sibl_depth, common::Constants::SHARE);
+        this->resume_key_ = key;
+        this->has_resume_key_ = true;
+        this->resume_inclusive_ = false;
+        return true;
+      }
+      return false;
+    }
+
+    /**
+     * Copy the next entries of the current leaf, up to `capacity` ones, then
+     *  release its latch right away. The next call (or Next()) re-descends
+     *  from the root to resume the scan
+     * @return Number of copied entries, 0 if the scan is exhausted
+     */
+    size_t NextBatch(KeyType *keys, ValueType *values, size_t capacity) {
+      if (capacity == 0) return 0;
+      this->Resume();
+      int count = 0;
+      auto max_count = static_cast<int>(std::min<size_t>(capacity, LeafCapacity));
+      while (this->current_ != nullptr && count == 0) {
+        count = this->current_->CopyEntries(this->offset_, this->upper_bound_ ? &this->key_high_ : nullptr, keys,
+                                            values, max_count);
+        this->offset_ += count;
+        if (this->offset_ < this->current_->Size()) {
+          // stopped by either `key_high_` or `capacity`
+          if (count < max_count) this->Finish();
+        } else if (count == 0 || this->current_->RightSibling() == nullptr) {
+          this->MoveRight();
         }
-        this->current_ = right_sibl;
-        return this->Next(key, val);
       }
+      if (count > 0) {
+        this->resume_key_ = keys[count - 1];
+        this->has_resume_key_ = true;
+        this->resume_inclusive_ = false;
+      }
+      if (this->current_ != nullptr) this->Release();
+      return count;
+    }
+  };
+
+  /**
+   * @brief Iterator over the leaf level in descending key order
+   *  It follows the left sibling links with the same protocol as
+   *    MemoryIterator: the left sibling is only try-locked, as writers may
+   *    latch a right sibling while holding its left one. If it is busy, the
+   *    iterator re-descends from the root, resuming right before the last
+   *    returned key
+   */
+  class MemoryReverseIterator final : public BTreeInterface<KeyType, ValueType, QueryContext>::Iterator {
+  private:
+    MemoryBTree *tree_;
+    int offset_;
+    KeyType key_low_;
+    bool lower_bound_;
+    /** The scan resumes from `resume_key_`, or from the rightmost leaf if there is none */
+    KeyType resume_key_;
+    bool has_resume_key_;
+    /** Whether `resume_key_` itself should be returned */
+    bool resume_inclusive_;
+    LeafType *current_;
+    QueryContext *ctx_;
+
+    /**
+     * Position the iterator at the resume point, and latch the leaf there
+     *  Require the caller to not hold any latch in `ctx_`
+     */
+    void Seek() {
+      this->tree_->AcquireTreeLatch(this->ctx_, common::Constants::SHARE);
+      if (!this->has_resume_key_) {
+        this->current_ = this->tree_->Descend(common::Constants::SHARE, this->ctx_,
+                                              [](auto inner) { return inner->Size() - 1; });
+        auto depth = this->ctx_->AcquireLatch(this->current_->Metadata().SharedLatchPtr(), common::Constants::SHARE);
+        this->ctx_->ReleaseLatch(depth, common::Constants::SHARE);
+        this->offset_ = this->current_->Size() - 1;
+        return;
+      }
+      // keys smaller than `resume_key_` are either in its leaf or on its left
+      this->current_ = this->tree_->DescendToLeaf(this->resume_key_, common::Constants::SHARE, this->ctx_);
+      Node<KeyType, ValueType, QueryContext, NodeMetadata> *leaf;
+      auto found = this->current_->LocateKey(this->resume_key_, leaf, this->offset_, this->ctx_);
+      if (!found || !this->resume_inclusive_) this->offset_--;
+    }
+
+    /**
+     * Move to the left sibling of the current leaf, or re-descend to it from
+     *  the root if it is latched by a writer
+     */
+    void MoveLeft() {
+      auto left_sibl = this->current_->LeftSibling();
+      if (left_sibl == nullptr) {
+        this->Release();
+        return;
+      }
+      if (left_sibl->Metadata().SharedLatchPtr()->try_lock_shared()) {
+        // the sibling takes the slot of the current leaf, so that a long scan
+        //  does not pile up latches in the context
+        this->ctx_->ReplaceLatch(this->ctx_->latches_.size() - 1, left_sibl->Metadata().SharedLatchPtr(),
+                                 common::Constants::SHARE);
+        this->current_ = left_sibl;
+        this->offset_ = left_sibl->Size() - 1;
+        return;
+      }
+      STATISTICS_INC(this->ctx_, scan_restarts_);
+      this->Release();
+      this->Seek();
+    }
+
+    void Release() {
+      this->ctx_->ReleaseLatch(this->ctx_->latches_.size(), common::Constants::SHARE);
+      this->ctx_->Clear();
+      this->current_ = nullptr;
+    }
+
+  public:
+    /**
+     * Scan from `key_high` (inclusive) down to `key_low` (inclusive)
+     */
+    MemoryReverseIterator(MemoryBTree *tree, const KeyType &key_low, const KeyType &key_high, QueryContext *context)
+        : tree_(tree),
+          offset_(0),
+          key_low_(key_low),
+          lower_bound_(true),
+          resume_key_(key_high),
+          has_resume_key_(true),
+          resume_inclusive_(true),
+          current_(nullptr),
+          ctx_(context) {
+      this->Seek();
+    }
+    /**
+     * Scan the whole tree
+     */
+    MemoryReverseIterator(MemoryBTree *tree, QueryContext *context)
+        : tree_(tree),
+          offset_(0),
+          lower_bound_(false),
+          has_resume_key_(false),
+          resume_inclusive_(false),
+          current_(nullptr),
+          ctx_(context) {
+      this->Seek();
+    }
+    ~MemoryReverseIterator() {
+      if (this->current_ != nullptr) this->Release();
+    }
+
+    // non-copyable, as the iterator may hold a latch
+    MemoryReverseIterator(const MemoryReverseIterator &) = delete;
+    MemoryReverseIterator &operator=(const MemoryReverseIterator &) = delete;
+
+    bool Next(KeyType &key, ValueType &val) {
+      while (this->current_ != nullptr) {
+        if (!this->current_->GetEntry(this->offset_, key, val)) {
+          this->MoveLeft();
+          continue;
+        }
+        if (this->lower_bound_ && key < this->key_low_) {
+          this->Release();
+          return false;
+        }
+        this->offset_--;
+        this->resume_key_ = key;
+        this->has_resume_key_ = true;
+        this->resume_inclusive_ = false;
+        return true;
+      }
+      return false;
     }
   };
   MemoryIterator *RangeQuery(const KeyType &key_low, const KeyType &key_high, QueryContext *context) {
-    context->AcquireLatch(this->LatchPtr(), common::Constants::SHARE);
-    Node<KeyType, ValueType, QueryContext, NodeMetadata> *leaf;
-    int offset;
-    this->root_->LocateKey(key_low, leaf, offset, context);
-    assert(context->smallest_unlk_idx_ == static_cast<int>(context->latches_.size()) - 1);
-    return new MemoryIterator(dynamic_cast<LeafNode<KeyType, ValueType, LeafCapacity> *>(leaf), offset, key_high,
-                              context);
-  }
-  MemoryIterator *TreeScan(QueryContext *context) {
-    context->AcquireLatch(this->LatchPtr(), common::Constants::SHARE);
-    auto current = static_cast<Node<KeyType, ValueType, QueryContext, NodeMetadata> *>(this->root_.get());
-    context->AcquireLatch(current->Metadata().SharedLatchPtr(), common::Constants::SHARE);
-    while (current->Type() == NodeType::INTERNAL) {
-      auto child = (static_cast<InternalNode<KeyType, ValueType, InternalCapacity> *>(current))->GetChild(0);
-      auto child_depth = context->AcquireLatch(child->Metadata().SharedLatchPtr(), common::Constants::SHARE);
-      context->ReleaseLatch(child_depth, common::Constants::SHARE);
-      current = child;
-    }
-    return new MemoryIterator(dynamic_cast<LeafNode<KeyType, ValueType, LeafCapacity> *>(current), context);
+    return new MemoryIterator(this, key_low, key_high, context);
+  }
+  MemoryIterator *TreeScan(QueryContext *context) { return new MemoryIterator(this, context); }
+  /**
+   * Entries in [key_low, key_high], in descending key order
+   */
+  MemoryReverseIterator *ReverseRangeQuery(const KeyType &key_low, const KeyType &key_high, QueryContext *context) {
+    return new MemoryReverseIterator(this, key_low, key_high, context);
+  }
+  MemoryReverseIterator *ReverseTreeScan(QueryContext *context) { return new MemoryReverseIterator(this, context); }
+
+  /**
+   * Split the key space into up to `partitions` ranges, using the separators
+   *  of the highest internal level which has enough of them, so that every
+   *  range spans roughly the same number of subtrees
+   * @return The sorted upper bounds of all ranges but the last one, i.e. range
+   * I is (bounds[I - 1], bounds[I]], and the first/last ranges are unbounded
+   */
+  std::vector<KeyType> PartitionKeys(size_t partitions, QueryContext *context) {
+    std::vector<KeyType> bounds;
+    if (partitions <= 1) return bounds;
+    this->AcquireTreeLatch(context, common::Constants::SHARE);
+    std::vector<Node<KeyType, ValueType, QueryContext, NodeMetadata> *> level = {this->root_.get()};
+    // the internal levels are latched top-down, and kept latched until the
+    //  bounds are collected
+    //  a level may have more nodes than `context` can hold, hence these are
+    //  tracked here instead
+    std::vector<Latch *> latches;
+    while (bounds.size() + 1 < partitions && level[0]->Metadata().type_ == NodeType::INTERNAL) {
+      std::vector<Node<KeyType, ValueType, QueryContext, NodeMetadata> *> children;
+      std::vector<KeyType> child_bounds;
+      for (size_t idx = 0; idx < level.size(); ++idx) {
+        auto inner = static_cast<InternalType *>(level[idx]);
+        inner->Metadata().SharedLatchPtr()->lock_shared();
+        latches.push_back(inner->Metadata().SharedLatchPtr());
+        if (idx > 0) child_bounds.push_back(bounds[idx - 1]);
+        for (int child_idx = 0; child_idx < inner->Size(); ++child_idx) {
+          if (child_idx > 0) child_bounds.push_back(inner->GetKey(child_idx - 1));
+          children.push_back(inner->GetChild(child_idx));
+        }
+      }
+      level.swap(children);
+      bounds.swap(child_bounds);
+    }
+    for (auto latch : latches) latch->unlock_shared();
+    context->ReleaseLatch(context->latches_.size(), common::Constants::SHARE);
+    context->Clear();
+
+    // pick evenly spaced bounds out of the collected ones
+    partitions = std::min(partitions, bounds.size() + 1);
+    std::vector<KeyType> result;
+    for (size_t idx = 1; idx < partitions; ++idx) {
+      result.push_back(bounds[idx * (bounds.size() + 1) / partitions - 1]);
+    }
+    return result;
+  }
+
+  /**
+   * Scan the whole tree in parallel, the key space is split by PartitionKeys()
+   *  and the partitions are spread over `threads` threads, each of them with
+   *  its own QueryContext
+   * `scan(partition, key, value)` is called for every entry, in key order
+   *  within a partition, by the thread which scans that partition
+   * @return Number of partitions
+   */
+  template <typename ScanFunction>
+  size_t ParallelScan(size_t partitions, size_t threads, const ScanFunction &scan) {
+    std::vector<KeyType> bounds;
+    {
+      QueryContext context;
+      bounds = this->PartitionKeys(partitions, &context);
+    }
+    BulkParallelFor(bounds.size() + 1, threads, [&](size_t first, size_t last) {
+      QueryContext context;
+      KeyType key;
+      ValueType value;
+      for (size_t partition = first; partition < last; ++partition) {
+        MemoryIterator it(this, (partition > 0) ? &bounds[partition - 1] : nullptr,
+                          (partition < bounds.size()) ? &bounds[partition] : nullptr, &context);
+        while (it.Next(key, value)) scan(partition, key, value);
+      }
+    });
+    return bounds.size() + 1;
   }
 };
 
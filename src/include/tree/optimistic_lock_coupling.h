@@ -0,0 +1,894 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "common/constants.h"
+#include "common/epoch.h"
+#include "common/key_search.h"
+#include "common/macros.h"
+#include "common/optimistic_latch.h"
+#include "tree/definitions.h"
+
+/**
+ * B+Tree with Optimistic Lock Coupling (OLC) protocol
+ *  Every node carries a version latch (common::OptimisticLatch)
+ *  Readers never write to shared memory: they read the version of a node,
+ *    read its content, and validate that the version is unchanged
+ *  Writers upgrade the version latch of the nodes they modify to EXCLUSIVE
+ *  If any validation fails, the whole operation is restarted from the root
+ *
+ * Because nodes are read while they can be modified concurrently,
+ *  both KeyType and ValueType have to be trivially copyable
+ * Underflow is tolerated, i.e. Delete never merges nodes
+ * Nodes unlinked from the tree (i.e. by Clear) are retired to an epoch manager
+ *  (common::EpochManager) instead of being freed, and every operation and
+ *  iterator stays in an epoch, hence readers never touch reclaimed memory
+ */
+namespace btree::implementation::olc {
+
+/**
+ * @brief NodeMetadata definition for OLC nodes
+ */
+class NodeMetadata {
+public:
+  /** Size of current node */
+  int size_;
+
+  /** Version latch for each node */
+  common::OptimisticLatch latch_;
+
+  /** Constructor */
+  NodeMetadata() : size_(0) {}
+
+  constexpr common::OptimisticLatch *LatchPtr() { return &(this->latch_); }
+};
+
+/**
+ * @brief QueryContext to provide Optimistic Lock Coupling protocol
+ *  It keeps the version of the parent of the node being visited,
+ *  so that the child can validate that its parent is not modified,
+ *  and upgrade the parent latch if a split is required
+ */
+class QueryContext {
+public:
+  /** Set whenever a validation fails, the operation is then restarted */
+  bool restart_;
+  common::OptimisticLatch *parent_latch_;
+  uint64_t parent_version_;
+  /**
+   * Registered lazily to the epoch manager of the tree this context is used
+   *  with, hence a context should not outlive that tree
+   */
+  common::EpochManager::Participant *epoch_;
+
+  QueryContext() : restart_(false), parent_latch_(nullptr), parent_version_(0), epoch_(nullptr) {}
+  ~QueryContext() {
+    if (this->epoch_ != nullptr) this->epoch_->Manager()->Unregister(this->epoch_);
+  }
+
+  // non-copyable, as the epoch participant is owned by the context
+  QueryContext(const QueryContext &) = delete;
+  QueryContext &operator=(const QueryContext &) = delete;
+
+  /**
+   * @return The participant of this context in `manager`
+   */
+  common::EpochManager::Participant *EpochParticipant(common::EpochManager *manager) {
+    if (this->epoch_ == nullptr || this->epoch_->Manager() != manager) {
+      if (this->epoch_ != nullptr) this->epoch_->Manager()->Unregister(this->epoch_);
+      this->epoch_ = manager->Register();
+    }
+    return this->epoch_;
+  }
+
+  void Clear() {
+    this->restart_ = false;
+    this->parent_latch_ = nullptr;
+    this->parent_version_ = 0;
+  }
+
+  void SetParent(common::OptimisticLatch *latch, uint64_t version) {
+    this->parent_latch_ = latch;
+    this->parent_version_ = version;
+  }
+
+  void ValidateParent() {
+    if (this->parent_latch_ != nullptr) this->parent_latch_->ReadUnlockOrRestart(this->parent_version_, restart_);
+  }
+
+  void UpgradeParent() {
+    assert(this->parent_latch_ != nullptr);
+    this->parent_latch_->UpgradeToWriteLockOrRestart(this->parent_version_, restart_);
+  }
+
+  void UnlockParent() {
+    assert(this->parent_latch_ != nullptr);
+    this->parent_latch_->WriteUnlock();
+  }
+};
+
+/**
+ * @brief LeafNode class definition, it shares the same layout with the lock
+ * crabbing LeafNode
+ */
+template <typename KeyType, typename ValueType, int Capacity>
+class LeafNode : public Node<KeyType, ValueType, QueryContext, NodeMetadata> {
+private:
+  static_assert(std::is_trivially_copyable_v<KeyType>, "OLC nodes are read optimistically");
+  static_assert(std::is_trivially_copyable_v<ValueType>, "OLC nodes are read optimistically");
+
+  KeyType keys_[Capacity];
+  ValueType values_[Capacity];
+  LeafNode<KeyType, ValueType, Capacity> *right_sibl_;
+
+  bool SearchKeyIndex(const KeyType &key, int &index) {
+    // the size can be stale during an optimistic read, but never out of range
+    auto size = std::clamp(this->Size(), 0, Capacity);
+    index = common::KeySearch<KeyType>::LowerBound(this->keys_, size, key);
+    return (index < size && this->keys_[index] == key);
+  }
+
+  void DeleteIndex(int index, bool &underflow) {
+    std::move(this->keys_ + index + 1, this->keys_ + this->Size(), this->keys_ + index);
+    std::move(this->values_ + index + 1, this->values_ + this->Size(), this->values_ + index);
+    underflow = (--this->Size() < UNDERFLOW_BOUND(Capacity));
+  }
+
+  void ShiftAndInsert(const KeyType &key, const ValueType &val, int insert_pos) {
+    std::move_backward(this->keys_ + insert_pos, this->keys_ + this->Size(), this->keys_ + this->Size() + 1);
+    std::move_backward(this->values_ + insert_pos, this->values_ + this->Size(), this->values_ + this->Size() + 1);
+    this->keys_[insert_pos] = key;
+    this->values_[insert_pos] = val;
+    this->Size()++;
+  }
+
+  /**
+   * Upgrade the latch of this leaf with `version`, and insert/update the entry
+   *  The leaf should have enough space for the new entry
+   */
+  void UpgradeAndInsert(const KeyType &key, const ValueType &val, bool found, int insert_pos, uint64_t version,
+                        QueryContext *context) {
+    this->Metadata().latch_.UpgradeToWriteLockOrRestart(version, context->restart_);
+    if (context->restart_) return;
+    if (found) {
+      this->values_[insert_pos] = val;
+    } else {
+      this->ShiftAndInsert(key, val, insert_pos);
+    }
+    this->Metadata().latch_.WriteUnlock();
+  }
+
+public:
+  LeafNode() : right_sibl_(nullptr) {}
+  ~LeafNode() = default;
+
+  /**
+   * Right sibling constructor
+   * @param keys        An array of keys from current LeafNode
+   * @param values      An array of values from current LeafNode
+   * @param start_idx   The new sibling should clone keys in the range of
+   * [start_idx, end)
+   * @param right_sibling
+   */
+  LeafNode(KeyType (&keys)[Capacity], ValueType (&values)[Capacity], int start_idx,
+           LeafNode<KeyType, ValueType, Capacity> *right_sibling) {
+    this->right_sibl_ = right_sibling;
+    this->Size() = Capacity - start_idx;
+    std::copy(keys + start_idx, keys + Capacity, this->keys_);
+    std::copy(values + start_idx, values + Capacity, this->values_);
+  }
+
+  constexpr NodeType Type() { return LEAF; };
+  LeafNode<KeyType, ValueType, Capacity> *RightSibling() const { return this->right_sibl_; }
+
+  std::string String() {
+    std::stringstream ss;
+    ss << "[LEAF: ";
+    for (int idx = 0; idx < this->Size(); idx++) {
+      ss << "(" << this->keys_[idx] << "," << this->values_[idx] << ")";
+      if (idx < this->Size() - 1) ss << " ";
+    }
+    ss << "]";
+    return ss.str();
+  }
+
+  constexpr KeyType &GetKey(int offset) {
+    assert(offset >= 0 && offset < Capacity);
+    return this->keys_[offset];
+  }
+
+  /**
+   * Optimistically copy all entries whose key >= `key_low` into the buffers,
+   *  the copy is only valid if `restart` is still false
+   * @param key_low     nullptr if all entries should be copied
+   * @param exclusive   Whether the entry of `key_low` should be skipped
+   * @param keys
+   * @param values
+   * @param right_sibling The right sibling at the time of the copy
+   * @param restart
+   */
+  void CopyEntries(const KeyType *key_low, bool exclusive, std::vector<KeyType> &keys, std::vector<ValueType> &values,
+                   LeafNode<KeyType, ValueType, Capacity> *&right_sibling, bool &restart) {
+    keys.clear();
+    values.clear();
+    auto version = this->Metadata().latch_.ReadLockOrRestart(restart);
+    if (restart) return;
+    int start_idx = 0;
+    if (key_low != nullptr && this->SearchKeyIndex(*key_low, start_idx) && exclusive) start_idx++;
+    auto size = std::clamp(this->Size(), 0, Capacity);
+    for (int idx = start_idx; idx < size; idx++) {
+      keys.push_back(this->keys_[idx]);
+      values.push_back(this->values_[idx]);
+    }
+    right_sibling = this->right_sibl_;
+    this->Metadata().latch_.ReadUnlockOrRestart(version, restart);
+  }
+
+  /**************************************************************************************
+   * @brief Core utilities are placed below, and all are thread-safe, except
+   *Balance    *
+   **************************************************************************************/
+
+  bool Insert(const KeyType &key, const ValueType &val, Split<KeyType, ValueType, QueryContext, NodeMetadata> &split,
+              QueryContext *context) {
+    int insert_pos;
+    auto version = this->Metadata().latch_.ReadLockOrRestart(context->restart_);
+    if (context->restart_) return false;
+    // make sure that this is still the correct leaf for `key`
+    context->ValidateParent();
+    if (context->restart_) return false;
+
+    bool found = this->SearchKeyIndex(key, insert_pos);
+    if (found || this->Size() < Capacity) {
+      this->UpgradeAndInsert(key, val, found, insert_pos, version, context);
+      return false;
+    }
+
+    // a split is required, both parent and this leaf have to be EXCLUSIVE
+    // latched
+    context->UpgradeParent();
+    if (context->restart_) return false;
+    this->Metadata().latch_.UpgradeToWriteLockOrRestart(version, context->restart_);
+    if (context->restart_) {
+      context->UnlockParent();
+      return false;
+    }
+
+    int boundary_idx = UNDERFLOW_BOUND(this->Size());
+    auto new_sibling =
+        new LeafNode<KeyType, ValueType, Capacity>(this->keys_, this->values_, boundary_idx, this->right_sibl_);
+    this->Size() = boundary_idx;
+    this->right_sibl_ = new_sibling;
+    if (insert_pos < boundary_idx) {
+      this->ShiftAndInsert(key, val, insert_pos);
+    } else {
+      new_sibling->ShiftAndInsert(key, val, insert_pos - boundary_idx);
+    }
+
+    split.left = this;
+    split.right = new_sibling;
+    split.boundary_key = RIGHTMOST_KEY(this);
+
+    // both latches will be released by the parent after it inserts the new
+    // sibling
+    return true;
+  }
+
+  bool Search(const KeyType &key, ValueType &value, QueryContext *context) {
+    int index;
+    auto version = this->Metadata().latch_.ReadLockOrRestart(context->restart_);
+    if (context->restart_) return false;
+    context->ValidateParent();
+    if (context->restart_) return false;
+
+    bool found = this->SearchKeyIndex(key, index);
+    if (found) {
+      value = this->values_[index];
+    }
+
+    this->Metadata().latch_.ReadUnlockOrRestart(version, context->restart_);
+    return found;
+  }
+
+  bool Update(const KeyType &key, const ValueType &value, QueryContext *context) {
+    int index;
+    auto version = this->Metadata().latch_.ReadLockOrRestart(context->restart_);
+    if (context->restart_) return false;
+    context->ValidateParent();
+    if (context->restart_) return false;
+
+    bool found = this->SearchKeyIndex(key, index);
+    if (!found) {
+      this->Metadata().latch_.ReadUnlockOrRestart(version, context->restart_);
+      return false;
+    }
+
+    this->Metadata().latch_.UpgradeToWriteLockOrRestart(version, context->restart_);
+    if (context->restart_) return false;
+    this->values_[index] = value;
+    this->Metadata().latch_.WriteUnlock();
+    return true;
+  }
+
+  bool Delete(const KeyType &key, bool &underflow, QueryContext *context) {
+    int index;
+    underflow = false;
+    auto version = this->Metadata().latch_.ReadLockOrRestart(context->restart_);
+    if (context->restart_) return false;
+    context->ValidateParent();
+    if (context->restart_) return false;
+
+    bool found = this->SearchKeyIndex(key, index);
+    if (!found) {
+      this->Metadata().latch_.ReadUnlockOrRestart(version, context->restart_);
+      return false;
+    }
+
+    this->Metadata().latch_.UpgradeToWriteLockOrRestart(version, context->restart_);
+    if (context->restart_) return false;
+    // underflow is tolerated in OLC tree, hence `underflow` is never set
+    bool unused_underflow;
+    this->DeleteIndex(index, unused_underflow);
+    this->Metadata().latch_.WriteUnlock();
+    return true;
+  }
+
+  bool OptimisticInsert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    int insert_pos;
+    auto version = this->Metadata().latch_.ReadLockOrRestart(context->restart_);
+    if (context->restart_) return false;
+    context->ValidateParent();
+    if (context->restart_) return false;
+
+    bool found = this->SearchKeyIndex(key, insert_pos);
+    if (!found && this->Size() >= Capacity) {
+      this->Metadata().latch_.ReadUnlockOrRestart(version, context->restart_);
+      return false;
+    }
+    this->UpgradeAndInsert(key, val, found, insert_pos, version, context);
+    return !context->restart_;
+  }
+
+  bool OptimisticDelete(const KeyType &key, bool &deleted, QueryContext *context) {
+    bool unused_underflow;
+    deleted = this->Delete(key, unused_underflow, context);
+    return !context->restart_;
+  }
+
+  bool LocateKey(const KeyType &key, Node<KeyType, ValueType, QueryContext, NodeMetadata> *&child, int &position,
+                 QueryContext *context) {
+    auto version = this->Metadata().latch_.ReadLockOrRestart(context->restart_);
+    if (context->restart_) return false;
+    context->ValidateParent();
+    if (context->restart_) return false;
+
+    child = this;
+    auto found = this->SearchKeyIndex(key, position);
+    this->Metadata().latch_.ReadUnlockOrRestart(version, context->restart_);
+    return found;
+  }
+
+  /**
+   * Similar to the lock crabbing LeafNode::Balance,
+   *  the caller has to EXCLUSIVE latch both nodes and their parent
+   */
+  bool Balance(Node<KeyType, ValueType, QueryContext, NodeMetadata> *right, KeyType &boundary) {
+    auto right_sibling = static_cast<LeafNode<KeyType, ValueType, Capacity> *>(right);
+    if (this->Size() < UNDERFLOW_BOUND(Capacity) && right_sibling->Size() > UNDERFLOW_BOUND(Capacity)) {
+      boundary = LEFTMOST_KEY(right_sibling);
+      this->ShiftAndInsert(right_sibling->keys_[0], right_sibling->values_[0], this->Size());
+      bool unused_underflow = false;
+      right_sibling->DeleteIndex(0, unused_underflow);
+      return false;
+    }
+    if (this->Size() > UNDERFLOW_BOUND(Capacity) && right_sibling->Size() < UNDERFLOW_BOUND(Capacity)) {
+      right_sibling->ShiftAndInsert(this->keys_[this->Size() - 1], this->values_[this->Size() - 1], 0);
+      bool unused_underflow = false;
+      this->DeleteIndex(this->Size() - 1, unused_underflow);
+      boundary = RIGHTMOST_KEY(this);
+      return false;
+    }
+    std::copy(right_sibling->keys_, right_sibling->keys_ + right_sibling->Size(), this->keys_ + this->Size());
+    std::copy(right_sibling->values_, right_sibling->values_ + right_sibling->Size(), this->values_ + this->Size());
+    this->Size() += right_sibling->Size();
+    this->right_sibl_ = right_sibling->right_sibl_;
+    boundary = RIGHTMOST_KEY(this);
+    return true;
+  }
+};
+
+/**
+ * @brief InternalNode class definition, it shares the same layout with the
+ * lock crabbing InternalNode
+ *  Different from lock crabbing, an OLC InternalNode is split eagerly
+ *    in the traversal when it is full, so that it can always absorb the new
+ *    child of a split without propagating the split to its ancestors
+ */
+template <typename KeyType, typename ValueType, int Capacity>
+class InternalNode : public Node<KeyType, ValueType, QueryContext, NodeMetadata> {
+private:
+  static_assert(Capacity >= 3, "An OLC InternalNode should be able to hold at least 3 children");
+
+  KeyType keys_[Capacity + common::Constants::OVERFLOW_SIZE];
+  Node<KeyType, ValueType, QueryContext, NodeMetadata> *child_[Capacity + common::Constants::OVERFLOW_SIZE];
+
+  InternalNode<KeyType, ValueType, Capacity> *right_sibl_;
+
+  void ShiftAndInsert(const KeyType &key, Node<KeyType, ValueType, QueryContext, NodeMetadata> *child, int insert_pos) {
+    if (insert_pos <= this->Size()) {
+      std::move_backward(this->keys_ + insert_pos, this->keys_ + this->Size(),
+                         this->keys_ + this->Size() + common::Constants::OVERFLOW_SIZE);
+      this->keys_[insert_pos] = key;
+    }
+    std::move_backward(this->child_ + insert_pos, this->child_ + this->Size() + 1,
+                       this->child_ + this->Size() + common::Constants::OVERFLOW_SIZE + 1);
+    this->child_[insert_pos] = child;
+    this->Size()++;
+  }
+
+  void DeleteIndex(int index, bool &underflow) {
+    if (index < this->Size()) {
+      std::move(this->keys_ + index + 1, this->keys_ + this->Size(), this->keys_ + index);
+      std::move(this->child_ + index + 1, this->child_ + this->Size() + 1, this->child_ + index);
+    }
+    underflow = (--this->Size() < UNDERFLOW_BOUND(Capacity)) ? true : false;
+  }
+
+  /**
+   * Validate the parent, read the target child and validate this node again
+   *  If `context->restart_` is not set, the parent of the context will be this
+   * node
+   * @return The child which may contain `key`
+   */
+  Node<KeyType, ValueType, QueryContext, NodeMetadata> *TraverseChild(const KeyType &key, int &target_idx,
+                                                                     uint64_t version, QueryContext *context) {
+    context->ValidateParent();
+    if (context->restart_) return nullptr;
+    target_idx = this->SearchChildIndex(key);
+    auto target = this->child_[target_idx];
+    this->Metadata().latch_.CheckOrRestart(version, context->restart_);
+    if (context->restart_) return nullptr;
+    context->SetParent(this->Metadata().LatchPtr(), version);
+    return target;
+  }
+
+public:
+  InternalNode() = default;
+
+  InternalNode(Node<KeyType, ValueType, QueryContext, NodeMetadata> *left_chld,
+               Node<KeyType, ValueType, QueryContext, NodeMetadata> *right_chld, KeyType boundary_key)
+      : keys_{boundary_key, RIGHTMOST_KEY(right_chld)}, child_{left_chld, right_chld}, right_sibl_(nullptr) {
+    this->Size() = 2;
+  }
+
+  InternalNode(Split<KeyType, ValueType, QueryContext, NodeMetadata> &split)
+      : InternalNode(split.left, split.right, split.boundary_key) {}
+
+  /**
+   * Right sibling constructor, executed when the internal node is full
+   * @param keys        An array of keys from current InternalNode
+   * @param children    An array of child pointers from current InternalNode
+   * @param start_idx   The new sibling should clone keys in the range of
+   * [start_idx, Capacity)
+   * @param right_sibling
+   */
+  InternalNode(
+      KeyType (&keys)[Capacity + common::Constants::OVERFLOW_SIZE],
+      Node<KeyType, ValueType, QueryContext, NodeMetadata> *(&children)[Capacity + common::Constants::OVERFLOW_SIZE],
+      int start_idx, InternalNode<KeyType, ValueType, Capacity> *right_sibling) {
+    this->right_sibl_ = right_sibling;
+    this->Size() = Capacity - start_idx;
+    std::copy(keys + start_idx, keys + Capacity, this->keys_);
+    std::copy(children + start_idx, children + Capacity, this->child_);
+  }
+
+  ~InternalNode() {
+    for (int idx = 0; idx < this->Size(); idx++) {
+      delete this->child_[idx];
+    }
+  }
+
+  int SearchChildIndex(const KeyType &key) {
+    auto size = std::clamp(this->Size(), 1, Capacity);
+    return common::KeySearch<KeyType>::LowerBound(this->keys_, size - 1, key);
+  }
+
+  constexpr NodeType Type() { return INTERNAL; };
+
+  std::string String() {
+    std::stringstream ss;
+    ss << "[INTERNAL: ";
+    for (int idx = 0; idx < this->Size() - 1; idx++) {
+      ss << this->child_[idx]->String() << " | " << this->keys_[idx] << " | ";
+    }
+    ss << this->child_[this->Size() - 1]->String() << "]";
+    return ss.str();
+  }
+
+  constexpr KeyType &GetKey(int offset) {
+    assert(offset >= 0 && offset < Capacity);
+    return this->keys_[offset];
+  }
+
+  Node<KeyType, ValueType, QueryContext, NodeMetadata> *GetChild(int idx) {
+    assert(idx < this->meta_.size_ + 1);
+    return this->child_[idx];
+  }
+
+  void ClearChildArray() { std::fill_n(this->child_, std::size(this->child_), nullptr); }
+
+  InternalNode<KeyType, ValueType, Capacity> *RightSibling() const { return this->right_sibl_; }
+
+  /**************************************************************************************
+   * @brief Core utilities are placed below, and all are thread-safe, except
+   *Balance    *
+   **************************************************************************************/
+
+  bool Insert(const KeyType &key, const ValueType &val, Split<KeyType, ValueType, QueryContext, NodeMetadata> &split,
+              QueryContext *context) {
+    auto version = this->Metadata().latch_.ReadLockOrRestart(context->restart_);
+    if (context->restart_) return false;
+
+    if (this->Size() >= Capacity) {
+      /**
+       * this node can't absorb any new child, split it eagerly
+       * after the parent inserts the new sibling, the insertion is restarted
+       */
+      context->UpgradeParent();
+      if (context->restart_) return false;
+      this->Metadata().latch_.UpgradeToWriteLockOrRestart(version, context->restart_);
+      if (context->restart_) {
+        context->UnlockParent();
+        return false;
+      }
+
+      int boundary_idx = UNDERFLOW_BOUND(this->Size());
+      auto new_sibling =
+          new InternalNode<KeyType, ValueType, Capacity>(this->keys_, this->child_, boundary_idx, this->right_sibl_);
+      this->Size() = boundary_idx;
+      this->right_sibl_ = new_sibling;
+
+      split.left = this;
+      split.right = new_sibling;
+      split.boundary_key = this->keys_[boundary_idx - 1];
+      context->restart_ = true;
+      return true;
+    }
+
+    int target_idx;
+    auto target = this->TraverseChild(key, target_idx, version, context);
+    if (context->restart_) return false;
+
+    bool is_split = target->Insert(key, val, split, context);
+    if (!is_split) return false;
+
+    /**
+     * the child upgraded both its own latch and this node's latch with the
+     * version we read, hence `target_idx` is still valid
+     */
+    assert(this->Metadata().latch_.IsWriteLocked());
+    std::swap(this->keys_[target_idx], split.boundary_key);
+    this->ShiftAndInsert(split.boundary_key, split.right, target_idx + 1);
+    split.left->Metadata().latch_.WriteUnlock();
+    this->Metadata().latch_.WriteUnlock();
+    return false;
+  }
+
+  bool Search(const KeyType &key, ValueType &value, QueryContext *context) {
+    auto version = this->Metadata().latch_.ReadLockOrRestart(context->restart_);
+    if (context->restart_) return false;
+
+    int target_idx;
+    auto target = this->TraverseChild(key, target_idx, version, context);
+    if (context->restart_) return false;
+    return target->Search(key, value, context);
+  }
+
+  bool Update(const KeyType &key, const ValueType &value, QueryContext *context) {
+    auto version = this->Metadata().latch_.ReadLockOrRestart(context->restart_);
+    if (context->restart_) return false;
+
+    int target_idx;
+    auto target = this->TraverseChild(key, target_idx, version, context);
+    if (context->restart_) return false;
+    return target->Update(key, value, context);
+  }
+
+  bool LocateKey(const KeyType &key, Node<KeyType, ValueType, QueryContext, NodeMetadata> *&child, int &position,
+                 QueryContext *context) {
+    auto version = this->Metadata().latch_.ReadLockOrRestart(context->restart_);
+    if (context->restart_) return false;
+
+    int target_idx;
+    auto target = this->TraverseChild(key, target_idx, version, context);
+    if (context->restart_) return false;
+    return target->LocateKey(key, child, position, context);
+  }
+
+  bool Delete(const KeyType &key, bool &underflow, QueryContext *context) {
+    underflow = false;
+    auto version = this->Metadata().latch_.ReadLockOrRestart(context->restart_);
+    if (context->restart_) return false;
+
+    int target_idx;
+    auto target = this->TraverseChild(key, target_idx, version, context);
+    if (context->restart_) return false;
+    return target->Delete(key, underflow, context);
+  }
+
+  bool OptimisticInsert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    auto version = this->Metadata().latch_.ReadLockOrRestart(context->restart_);
+    if (context->restart_) return false;
+
+    int target_idx;
+    auto target = this->TraverseChild(key, target_idx, version, context);
+    if (context->restart_) return false;
+    return target->OptimisticInsert(key, val, context);
+  }
+
+  bool OptimisticDelete(const KeyType &key, bool &deleted, QueryContext *context) {
+    auto version = this->Metadata().latch_.ReadLockOrRestart(context->restart_);
+    if (context->restart_) return false;
+
+    int target_idx;
+    auto target = this->TraverseChild(key, target_idx, version, context);
+    if (context->restart_) return false;
+    return target->OptimisticDelete(key, deleted, context);
+  }
+
+  /**
+   * Similar to the lock crabbing InternalNode::Balance,
+   *  the caller has to EXCLUSIVE latch both nodes and their parent
+   */
+  bool Balance(Node<KeyType, ValueType, QueryContext, NodeMetadata> *right, KeyType &boundary) {
+    auto right_sibling = static_cast<InternalNode<KeyType, ValueType, Capacity> *>(right);
+    this->right_sibl_ = right_sibling;
+    if (this->Size() < UNDERFLOW_BOUND(Capacity) && right_sibling->Size() > UNDERFLOW_BOUND(Capacity)) {
+      this->child_[this->Size()] = right_sibling->child_[0];
+      this->keys_[this->Size()] = RIGHTMOST_KEY(this->child_[this->Size()]);
+      boundary = this->keys_[this->Size()++];
+      bool unused_underflow = false;
+      right_sibling->DeleteIndex(0, unused_underflow);
+      return false;
+    }
+    if (this->Size() > UNDERFLOW_BOUND(Capacity) && right_sibling->Size() < UNDERFLOW_BOUND(Capacity)) {
+      right_sibling->ShiftAndInsert(boundary, this->child_[this->Size() - 1], 0);
+      --this->Size();
+      boundary = RIGHTMOST_KEY(this);
+      return false;
+    }
+    this->keys_[this->Size()] = boundary;
+    std::copy(right_sibling->keys_, right_sibling->keys_ + right_sibling->Size(), this->keys_ + this->Size());
+    std::copy(right_sibling->child_, right_sibling->child_ + right_sibling->Size(), this->child_ + this->Size());
+    this->Size() += right_sibling->Size();
+    this->right_sibl_ = right_sibling->right_sibl_;
+    return true;
+  }
+};
+
+/**
+ * A memory B+Tree with Optimistic Lock Coupling protocol
+ */
+template <typename KeyType, typename ValueType, int LeafCapacity, int InternalCapacity>
+class MemoryBTree : public BTreeInterface<KeyType, ValueType, QueryContext> {
+private:
+  /** Declared first, so retired nodes are only freed after the tree is gone */
+  common::EpochManager epoch_manager_;
+  std::atomic<Node<KeyType, ValueType, QueryContext, NodeMetadata> *> root_;
+  /** Protect `root_`, it acts as the parent latch of the root node */
+  common::OptimisticLatch tree_latch_;
+
+  /**
+   * Prepare `context` to traverse from the root node
+   * @return The current root node
+   */
+  Node<KeyType, ValueType, QueryContext, NodeMetadata> *StartTraversal(QueryContext *context) {
+    context->Clear();
+    auto version = this->tree_latch_.ReadLockOrRestart(context->restart_);
+    auto root = this->root_.load(std::memory_order_acquire);
+    context->SetParent(&this->tree_latch_, version);
+    return root;
+  }
+
+public:
+  MemoryBTree() : root_(new LeafNode<KeyType, ValueType, LeafCapacity>()) {}
+  ~MemoryBTree() { delete this->root_.load(); }
+
+  std::string String() const { return this->root_.load()->String(); }
+
+  bool Search(const KeyType &key, ValueType &val, QueryContext *context) {
+    bool found;
+    common::EpochGuard guard(context->EpochParticipant(&this->epoch_manager_));
+    do {
+      auto root = this->StartTraversal(context);
+      found = root->Search(key, val, context);
+    } while (context->restart_);
+    context->Clear();
+    return found;
+  }
+
+  void Insert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    common::EpochGuard guard(context->EpochParticipant(&this->epoch_manager_));
+    do {
+      auto root = this->StartTraversal(context);
+      Split<KeyType, ValueType, QueryContext, NodeMetadata> split;
+      if (root->Insert(key, val, split, context)) {
+        // the old root is split, and both it and the tree latch are EXCLUSIVE
+        // latched
+        this->root_.store(new InternalNode<KeyType, ValueType, InternalCapacity>(split), std::memory_order_release);
+        split.left->Metadata().latch_.WriteUnlock();
+        this->tree_latch_.WriteUnlock();
+      }
+    } while (context->restart_);
+    context->Clear();
+  }
+
+  bool Update(const KeyType &key, const ValueType &val, QueryContext *context) {
+    bool found;
+    common::EpochGuard guard(context->EpochParticipant(&this->epoch_manager_));
+    do {
+      auto root = this->StartTraversal(context);
+      found = root->Update(key, val, context);
+    } while (context->restart_);
+    context->Clear();
+    return found;
+  }
+
+  bool Delete(const KeyType &key, QueryContext *context) {
+    bool deleted;
+    common::EpochGuard guard(context->EpochParticipant(&this->epoch_manager_));
+    do {
+      auto root = this->StartTraversal(context);
+      bool unused_underflow;
+      deleted = root->Delete(key, unused_underflow, context);
+    } while (context->restart_);
+    context->Clear();
+    return deleted;
+  }
+
+  /**
+   * Replace the whole tree with an empty leaf, concurrent operations which
+   *  already reached the old nodes simply finish on them before they are freed
+   */
+  void Clear() {
+    // the tree latch is never obsolete
+    bool unused_restart = false;
+    this->tree_latch_.WriteLockOrRestart(unused_restart);
+    auto old_root = this->root_.exchange(new LeafNode<KeyType, ValueType, LeafCapacity>(), std::memory_order_acq_rel);
+    this->tree_latch_.WriteUnlock();
+    this->epoch_manager_.Retire(old_root);
+    this->epoch_manager_.TryAdvance();
+  };
+
+  /**
+   * Iterator of OLC tree, which never blocks writers
+   *  The iterator copies the entries of a whole leaf at a time,
+   *  and remembers the last returned key, so a concurrent modification on a
+   *  leaf only causes that leaf to be copied again
+   *  The iterator stays in the epoch of its context until it is destroyed, so
+   *  it should be used by the thread owning that context
+   */
+  class MemoryIterator : public BTreeInterface<KeyType, ValueType, QueryContext>::Iterator {
+  private:
+    size_t offset_;
+    /** All the next returned keys should be >= key_low_ (or > if exclusive_low_) */
+    KeyType key_low_;
+    bool lower_bound_;
+    bool exclusive_low_;
+    KeyType key_high_;
+    bool upper_bound_;
+    LeafNode<KeyType, ValueType, LeafCapacity> *next_;
+    std::vector<KeyType> keys_;
+    std::vector<ValueType> values_;
+    common::EpochManager::Participant *epoch_;
+
+    void FetchNextLeaf() {
+      while (this->offset_ >= this->keys_.size() && this->next_ != nullptr) {
+        bool restart = false;
+        LeafNode<KeyType, ValueType, LeafCapacity> *right_sibl = nullptr;
+        this->next_->CopyEntries(this->lower_bound_ ? &this->key_low_ : nullptr, this->exclusive_low_, this->keys_,
+                                 this->values_, right_sibl, restart);
+        // the leaf was modified during the copy, simply copy it again
+        if (restart) continue;
+        this->offset_ = 0;
+        this->next_ = right_sibl;
+      }
+    }
+
+  public:
+    /**
+     * The iterator enters `epoch` once more for its own lifetime, hence the
+     * caller only needs to stay in the epoch until the iterator is created
+     */
+    MemoryIterator(LeafNode<KeyType, ValueType, LeafCapacity> *node, const KeyType &key_low, const KeyType &key_high,
+                   common::EpochManager::Participant *epoch)
+        : offset_(0),
+          key_low_(key_low),
+          lower_bound_(true),
+          exclusive_low_(false),
+          key_high_(key_high),
+          upper_bound_(true),
+          next_(node),
+          epoch_(epoch) {
+      this->epoch_->Enter();
+    }
+    MemoryIterator(LeafNode<KeyType, ValueType, LeafCapacity> *node, common::EpochManager::Participant *epoch)
+        : offset_(0), lower_bound_(false), exclusive_low_(false), upper_bound_(false), next_(node), epoch_(epoch) {
+      this->epoch_->Enter();
+    }
+    ~MemoryIterator() { this->epoch_->Exit(); }
+
+    // non-copyable, as the iterator holds an epoch
+    MemoryIterator(const MemoryIterator &) = delete;
+    MemoryIterator &operator=(const MemoryIterator &) = delete;
+
+    bool Next(KeyType &key, ValueType &val) {
+      this->FetchNextLeaf();
+      if (this->offset_ >= this->keys_.size()) return false;
+      key = this->keys_[this->offset_];
+      val = this->values_[this->offset_];
+      this->offset_++;
+      this->key_low_ = key;
+      this->lower_bound_ = this->exclusive_low_ = true;
+      return !this->upper_bound_ || key <= this->key_high_;
+    }
+  };
+
+  MemoryIterator *RangeQuery(const KeyType &key_low, const KeyType &key_high, QueryContext *context) {
+    Node<KeyType, ValueType, QueryContext, NodeMetadata> *leaf;
+    auto epoch = context->EpochParticipant(&this->epoch_manager_);
+    common::EpochGuard guard(epoch);
+    do {
+      auto root = this->StartTraversal(context);
+      int unused_offset;
+      root->LocateKey(key_low, leaf, unused_offset, context);
+    } while (context->restart_);
+    context->Clear();
+    return new MemoryIterator(static_cast<LeafNode<KeyType, ValueType, LeafCapacity> *>(leaf), key_low, key_high,
+                              epoch);
+  }
+
+  MemoryIterator *TreeScan(QueryContext *context) {
+    // no validation is required here, because the left-most child of a node
+    //  never changes: a split always moves the upper half to the new sibling
+    auto epoch = context->EpochParticipant(&this->epoch_manager_);
+    common::EpochGuard guard(epoch);
+    auto current = this->root_.load(std::memory_order_acquire);
+    while (current->Type() == NodeType::INTERNAL) {
+      current = static_cast<InternalNode<KeyType, ValueType, InternalCapacity> *>(current)->GetChild(0);
+    }
+    context->Clear();
+    return new MemoryIterator(static_cast<LeafNode<KeyType, ValueType, LeafCapacity> *>(current), epoch);
+  }
+};
+
+}  // namespace btree::implementation::olc
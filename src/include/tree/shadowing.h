@@ -0,0 +1,820 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <gtest/gtest_prod.h>
+
+#include "common/constants.h"
+#include "common/key_search.h"
+#include "common/macros.h"
+#include "tree/definitions.h"
+
+/**
+ * Shadowing B+Tree with twin-version nodes
+ *  Every logical node is a pair of twins, each of them has a version number
+ *  Readers always read the latest version (LATEST_VERSION), while a writer
+ *    shadows the modification into the other twin, whose version is negative
+ *    until the modification is published. Therefore, a reader never waits for,
+ *    nor is restarted by, a writer modifying the node it is reading
+ *  A reader only retries if its twin is reused by a newer writer, or restarts
+ *    from the root if a structure modification happens on its traversal path
+ *
+ * Writers are serialized by a tree-level latch, and publish all the twins they
+ *  modified in top-down order once the operation completes
+ * Similar to OLC, KeyType and ValueType have to be trivially copyable, and
+ *  underflow is tolerated (nodes are never merged nor de-allocated while the
+ *  tree is alive)
+ */
+namespace btree::implementation::shadow {
+
+/**
+ * @brief NodeMetadata definition for twin-version nodes
+ */
+class NodeMetadata {
+public:
+  /** Size of current node */
+  int size_;
+
+  /** Version of this twin, it is negative while a writer is modifying it */
+  std::atomic<int64_t> version_;
+
+  /** Constructor */
+  NodeMetadata() : size_(0), version_(0) {}
+
+  inline int64_t Version() const { return this->version_.load(std::memory_order_acquire); }
+
+  /**
+   * @brief Validate that the twin is not reused since `version`
+   *  All reads on the twin content should be done before the validation
+   */
+  inline bool Validate(int64_t version) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return this->version_.load(std::memory_order_relaxed) == version;
+  }
+
+  /**
+   * @brief Mark this twin as being modified, it will be `version` once it is
+   * published
+   */
+  inline void StartModification(int64_t version) {
+    this->version_.store(-version, std::memory_order_relaxed);
+    // the negative version has to be visible before any modification
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  inline void Publish() {
+    assert(this->version_.load(std::memory_order_relaxed) < 0);
+    this->version_.store(-this->version_.load(std::memory_order_relaxed), std::memory_order_release);
+  }
+};
+
+/**
+ * @brief QueryContext of Shadowing B+Tree
+ *  Readers use it to validate the parent of the visited node
+ *  Writers use it to collect the twins they modified
+ */
+class QueryContext {
+public:
+  /** Set whenever the traversal path is modified, the read is then restarted */
+  bool restart_;
+  /** Version metadata of both twins of the parent node */
+  const NodeMetadata *parent_twins_[2];
+  int64_t parent_version_;
+  /** Modified twins in bottom-up order, they will be published in reverse */
+  std::vector<NodeMetadata *> modified_;
+
+  QueryContext() : restart_(false), parent_twins_{nullptr, nullptr}, parent_version_(0), modified_(0) {}
+
+  void Clear() {
+    assert(this->modified_.empty());
+    this->restart_ = false;
+    this->parent_twins_[0] = this->parent_twins_[1] = nullptr;
+    this->parent_version_ = 0;
+  }
+
+  void SetParent(const NodeMetadata *twin, const NodeMetadata *other_twin, int64_t version) {
+    this->parent_twins_[0] = twin;
+    this->parent_twins_[1] = other_twin;
+    this->parent_version_ = version;
+  }
+
+  /**
+   * @brief The parent is valid if none of its twins is published since it was
+   * visited
+   */
+  void ValidateParent() {
+    if (this->parent_twins_[0] == nullptr) return;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    auto latest = std::max(this->parent_twins_[0]->Version(), this->parent_twins_[1]->Version());
+    if (latest != this->parent_version_) this->restart_ = true;
+  }
+
+  /**
+   * @brief Publish all modified twins in top-down order
+   */
+  void PublishModification() {
+    for (auto it = this->modified_.rbegin(); it != this->modified_.rend(); ++it) {
+      (*it)->Publish();
+    }
+    this->modified_.clear();
+  }
+};
+
+/**
+ * @brief LeafNode class definition
+ *  The primary twin is the one referenced by its parent and left sibling,
+ *  and it owns the other twin
+ */
+template <typename KeyType, typename ValueType, int Capacity>
+class LeafNode : public Node<KeyType, ValueType, QueryContext, NodeMetadata> {
+private:
+  static_assert(std::is_trivially_copyable_v<KeyType>, "Twin nodes are read while being copied");
+  static_assert(std::is_trivially_copyable_v<ValueType>, "Twin nodes are read while being copied");
+
+  KeyType keys_[Capacity];
+  ValueType values_[Capacity];
+  LeafNode<KeyType, ValueType, Capacity> *right_sibl_;
+  LeafNode<KeyType, ValueType, Capacity> *twin_;
+  bool primary_;
+
+  /** Twin constructor */
+  explicit LeafNode(LeafNode<KeyType, ValueType, Capacity> *primary)
+      : right_sibl_(nullptr), twin_(primary), primary_(false) {}
+
+  bool SearchKeyIndex(const KeyType &key, int &index) {
+    // the size can be stale during a read, but never out of range
+    auto size = std::clamp(this->Size(), 0, Capacity);
+    index = common::KeySearch<KeyType>::LowerBound(this->keys_, size, key);
+    return (index < size && this->keys_[index] == key);
+  }
+
+  void DeleteIndex(int index, bool &underflow) {
+    std::move(this->keys_ + index + 1, this->keys_ + this->Size(), this->keys_ + index);
+    std::move(this->values_ + index + 1, this->values_ + this->Size(), this->values_ + index);
+    underflow = (--this->Size() < UNDERFLOW_BOUND(Capacity));
+  }
+
+  void ShiftAndInsert(const KeyType &key, const ValueType &val, int insert_pos) {
+    std::move_backward(this->keys_ + insert_pos, this->keys_ + this->Size(), this->keys_ + this->Size() + 1);
+    std::move_backward(this->values_ + insert_pos, this->values_ + this->Size(), this->values_ + this->Size() + 1);
+    this->keys_[insert_pos] = key;
+    this->values_[insert_pos] = val;
+    this->Size()++;
+  }
+
+  /**
+   * Pick the latest published twin for reading, and retry until it is
+   * validated
+   */
+  template <typename ReadFunc>
+  void ReadLatest(ReadFunc &&read) {
+    while (true) {
+      auto view = LATEST_VERSION(this);
+      auto version = view->VersionInfo();
+      if (version < 0) continue;
+      read(view);
+      if (view->Metadata().Validate(version)) return;
+    }
+  }
+
+  /**
+   * Shadow the latest twin into the other one, which is returned for
+   * modification
+   *  It is published later by the tree, through the context
+   */
+  LeafNode<KeyType, ValueType, Capacity> *StartModification(QueryContext *context) {
+    auto latest = LATEST_VERSION(this);
+    auto shadow = latest->SiblingVersion();
+    assert(latest->VersionInfo() >= 0);
+    shadow->Metadata().StartModification(latest->VersionInfo() + 1);
+    shadow->Size() = latest->Size();
+    shadow->right_sibl_ = latest->right_sibl_;
+    std::copy(latest->keys_, latest->keys_ + latest->Size(), shadow->keys_);
+    std::copy(latest->values_, latest->values_ + latest->Size(), shadow->values_);
+    context->modified_.push_back(&shadow->Metadata());
+    return shadow;
+  }
+
+public:
+  LeafNode() : right_sibl_(nullptr), twin_(new LeafNode<KeyType, ValueType, Capacity>(this)), primary_(true) {
+    this->meta_.version_ = 1;
+  }
+
+  ~LeafNode() {
+    if (this->primary_) delete this->twin_;
+  }
+
+  /**
+   * Right sibling constructor, the new node is not visible to any reader yet
+   * @param keys        An array of keys from current LeafNode
+   * @param values      An array of values from current LeafNode
+   * @param start_idx   The new sibling should clone keys in the range of
+   * [start_idx, end)
+   * @param right_sibling
+   */
+  LeafNode(KeyType (&keys)[Capacity], ValueType (&values)[Capacity], int start_idx,
+           LeafNode<KeyType, ValueType, Capacity> *right_sibling)
+      : LeafNode() {
+    this->right_sibl_ = right_sibling;
+    this->Size() = Capacity - start_idx;
+    std::copy(keys + start_idx, keys + Capacity, this->keys_);
+    std::copy(values + start_idx, values + Capacity, this->values_);
+  }
+
+  constexpr NodeType Type() { return LEAF; };
+  LeafNode<KeyType, ValueType, Capacity> *RightSibling() const { return LATEST_VERSION(this)->right_sibl_; }
+  LeafNode<KeyType, ValueType, Capacity> *SiblingVersion() const { return this->twin_; }
+  int64_t VersionInfo() const { return this->meta_.Version(); }
+
+  std::string String() {
+    auto view = LATEST_VERSION(this);
+    std::stringstream ss;
+    ss << "[LEAF: ";
+    for (int idx = 0; idx < view->Size(); idx++) {
+      ss << "(" << view->keys_[idx] << "," << view->values_[idx] << ")";
+      if (idx < view->Size() - 1) ss << " ";
+    }
+    ss << "]";
+    return ss.str();
+  }
+
+  constexpr KeyType &GetKey(int offset) {
+    assert(offset >= 0 && offset < Capacity);
+    return this->keys_[offset];
+  }
+
+  /**
+   * Copy all entries whose key >= `key_low` from the latest twin into the
+   * buffers
+   * @param key_low     nullptr if all entries should be copied
+   * @param exclusive   Whether the entry of `key_low` should be skipped
+   * @param keys
+   * @param values
+   * @param right_sibling The right sibling of the copied twin
+   */
+  void CopyEntries(const KeyType *key_low, bool exclusive, std::vector<KeyType> &keys, std::vector<ValueType> &values,
+                   LeafNode<KeyType, ValueType, Capacity> *&right_sibling) {
+    this->ReadLatest([&](LeafNode<KeyType, ValueType, Capacity> *view) {
+      keys.clear();
+      values.clear();
+      int start_idx = 0;
+      if (key_low != nullptr && view->SearchKeyIndex(*key_low, start_idx) && exclusive) start_idx++;
+      auto size = std::clamp(view->Size(), 0, Capacity);
+      for (int idx = start_idx; idx < size; idx++) {
+        keys.push_back(view->keys_[idx]);
+        values.push_back(view->values_[idx]);
+      }
+      right_sibling = view->right_sibl_;
+    });
+  }
+
+  /**************************************************************************************
+   * @brief Core utilities are placed below, readers are thread-safe, while
+   *writers are expected to be serialized by the tree *
+   **************************************************************************************/
+
+  bool Insert(const KeyType &key, const ValueType &val, Split<KeyType, ValueType, QueryContext, NodeMetadata> &split,
+              QueryContext *context) {
+    int insert_pos;
+    bool found = LATEST_VERSION(this)->SearchKeyIndex(key, insert_pos);
+    auto shadow = this->StartModification(context);
+
+    if (found) {
+      shadow->values_[insert_pos] = val;
+      return false;
+    }
+
+    if (shadow->Size() < Capacity) {
+      shadow->ShiftAndInsert(key, val, insert_pos);
+      return false;
+    }
+
+    // the new sibling is not reachable until the parent is published
+    int boundary_idx = UNDERFLOW_BOUND(shadow->Size());
+    auto new_sibling =
+        new LeafNode<KeyType, ValueType, Capacity>(shadow->keys_, shadow->values_, boundary_idx, shadow->right_sibl_);
+    shadow->Size() = boundary_idx;
+    shadow->right_sibl_ = new_sibling;
+
+    if (insert_pos < boundary_idx) {
+      shadow->ShiftAndInsert(key, val, insert_pos);
+    } else {
+      new_sibling->ShiftAndInsert(key, val, insert_pos - boundary_idx);
+    }
+
+    split.left = this;
+    split.right = new_sibling;
+    split.boundary_key = RIGHTMOST_KEY(shadow);
+    return true;
+  }
+
+  bool Search(const KeyType &key, ValueType &value, QueryContext *context) {
+    bool found;
+    this->ReadLatest([&](LeafNode<KeyType, ValueType, Capacity> *view) {
+      int index;
+      found = view->SearchKeyIndex(key, index);
+      if (found) value = view->values_[index];
+    });
+    // the parent is published before its children, so if it is still valid,
+    // this leaf was not split during the read
+    context->ValidateParent();
+    return found;
+  }
+
+  bool Update(const KeyType &key, const ValueType &value, QueryContext *context) {
+    int index;
+    if (!LATEST_VERSION(this)->SearchKeyIndex(key, index)) return false;
+    this->StartModification(context)->values_[index] = value;
+    return true;
+  }
+
+  bool Delete(const KeyType &key, bool &underflow, QueryContext *context) {
+    int index;
+    // underflow is tolerated in Shadowing tree
+    underflow = false;
+    if (!LATEST_VERSION(this)->SearchKeyIndex(key, index)) return false;
+    bool unused_underflow;
+    this->StartModification(context)->DeleteIndex(index, unused_underflow);
+    return true;
+  }
+
+  bool OptimisticInsert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    int insert_pos;
+    auto latest = LATEST_VERSION(this);
+    if (!latest->SearchKeyIndex(key, insert_pos) && latest->Size() >= Capacity) return false;
+    Split<KeyType, ValueType, QueryContext, NodeMetadata> unused_split;
+    this->Insert(key, val, unused_split, context);
+    return true;
+  }
+
+  bool OptimisticDelete(const KeyType &key, bool &deleted, QueryContext *context) {
+    bool unused_underflow;
+    deleted = this->Delete(key, unused_underflow, context);
+    return true;
+  }
+
+  bool LocateKey(const KeyType &key, Node<KeyType, ValueType, QueryContext, NodeMetadata> *&child, int &position,
+                 QueryContext *context) {
+    bool found;
+    this->ReadLatest(
+        [&](LeafNode<KeyType, ValueType, Capacity> *view) { found = view->SearchKeyIndex(key, position); });
+    context->ValidateParent();
+    child = this;
+    return found;
+  }
+
+  /**
+   * Similar to the lock crabbing LeafNode::Balance, but it operates on the
+   * twins being modified (MODIFIED_VERSION), which means the caller has to
+   * start the modification on both nodes first
+   */
+  bool Balance(Node<KeyType, ValueType, QueryContext, NodeMetadata> *right, KeyType &boundary) {
+    auto left = MODIFIED_VERSION(this);
+    auto right_node = static_cast<LeafNode<KeyType, ValueType, Capacity> *>(right);
+    auto right_sibling = MODIFIED_VERSION(right_node);
+    if (left->Size() < UNDERFLOW_BOUND(Capacity) && right_sibling->Size() > UNDERFLOW_BOUND(Capacity)) {
+      boundary = LEFTMOST_KEY(right_sibling);
+      left->ShiftAndInsert(right_sibling->keys_[0], right_sibling->values_[0], left->Size());
+      bool unused_underflow = false;
+      right_sibling->DeleteIndex(0, unused_underflow);
+      return false;
+    }
+    if (left->Size() > UNDERFLOW_BOUND(Capacity) && right_sibling->Size() < UNDERFLOW_BOUND(Capacity)) {
+      right_sibling->ShiftAndInsert(left->keys_[left->Size() - 1], left->values_[left->Size() - 1], 0);
+      bool unused_underflow = false;
+      left->DeleteIndex(left->Size() - 1, unused_underflow);
+      boundary = RIGHTMOST_KEY(left);
+      return false;
+    }
+    std::copy(right_sibling->keys_, right_sibling->keys_ + right_sibling->Size(), left->keys_ + left->Size());
+    std::copy(right_sibling->values_, right_sibling->values_ + right_sibling->Size(), left->values_ + left->Size());
+    left->Size() += right_sibling->Size();
+    left->right_sibl_ = right_sibling->right_sibl_;
+    boundary = RIGHTMOST_KEY(left);
+    return true;
+  }
+};
+
+/**
+ * @brief InternalNode class definition
+ *  The primary twin owns the other twin, as well as the children of the
+ *  latest version
+ */
+template <typename KeyType, typename ValueType, int Capacity>
+class InternalNode : public Node<KeyType, ValueType, QueryContext, NodeMetadata> {
+private:
+  KeyType keys_[Capacity + common::Constants::OVERFLOW_SIZE];
+  Node<KeyType, ValueType, QueryContext, NodeMetadata> *child_[Capacity + common::Constants::OVERFLOW_SIZE];
+
+  InternalNode<KeyType, ValueType, Capacity> *right_sibl_;
+  InternalNode<KeyType, ValueType, Capacity> *twin_;
+  bool primary_;
+
+  /** Twin constructor */
+  explicit InternalNode(InternalNode<KeyType, ValueType, Capacity> *primary)
+      : right_sibl_(nullptr), twin_(primary), primary_(false) {}
+
+  void ShiftAndInsert(const KeyType &key, Node<KeyType, ValueType, QueryContext, NodeMetadata> *child, int insert_pos) {
+    if (insert_pos <= this->Size()) {
+      std::move_backward(this->keys_ + insert_pos, this->keys_ + this->Size(),
+                         this->keys_ + this->Size() + common::Constants::OVERFLOW_SIZE);
+      this->keys_[insert_pos] = key;
+    }
+    std::move_backward(this->child_ + insert_pos, this->child_ + this->Size(),
+                       this->child_ + this->Size() + common::Constants::OVERFLOW_SIZE);
+    this->child_[insert_pos] = child;
+    this->Size()++;
+  }
+
+  InternalNode<KeyType, ValueType, Capacity> *StartModification(QueryContext *context) {
+    auto latest = LATEST_VERSION(this);
+    auto shadow = latest->SiblingVersion();
+    assert(latest->VersionInfo() >= 0);
+    shadow->Metadata().StartModification(latest->VersionInfo() + 1);
+    shadow->Size() = latest->Size();
+    shadow->right_sibl_ = latest->right_sibl_;
+    std::copy(latest->keys_, latest->keys_ + latest->Size(), shadow->keys_);
+    std::copy(latest->child_, latest->child_ + latest->Size(), shadow->child_);
+    context->modified_.push_back(&shadow->Metadata());
+    return shadow;
+  }
+
+  /**
+   * Read the child which may contain `key` from the latest twin,
+   *  and let it be the parent of the context
+   */
+  Node<KeyType, ValueType, QueryContext, NodeMetadata> *TraverseChild(const KeyType &key, QueryContext *context) {
+    Node<KeyType, ValueType, QueryContext, NodeMetadata> *target;
+    InternalNode<KeyType, ValueType, Capacity> *view;
+    int64_t version;
+    while (true) {
+      view = LATEST_VERSION(this);
+      version = view->VersionInfo();
+      if (version < 0) continue;
+      target = view->child_[view->SearchChildIndex(key)];
+      if (view->Metadata().Validate(version)) break;
+    }
+    context->ValidateParent();
+    context->SetParent(&view->Metadata(), &view->SiblingVersion()->Metadata(), version);
+    return target;
+  }
+
+public:
+  InternalNode(Node<KeyType, ValueType, QueryContext, NodeMetadata> *left_chld,
+               Node<KeyType, ValueType, QueryContext, NodeMetadata> *right_chld, KeyType boundary_key)
+      : keys_{boundary_key, RIGHTMOST_KEY(right_chld)},
+        child_{left_chld, right_chld},
+        right_sibl_(nullptr),
+        twin_(new InternalNode<KeyType, ValueType, Capacity>(this)),
+        primary_(true) {
+    this->Size() = 2;
+    this->meta_.version_ = 1;
+  }
+
+  InternalNode(Split<KeyType, ValueType, QueryContext, NodeMetadata> &split)
+      : InternalNode(split.left, split.right, split.boundary_key) {}
+
+  /**
+   * Right sibling constructor, should only executed only when this is overflow
+   * @param keys        An array of keys from current InternalNode
+   * @param children    An array of child pointers from current InternalNode
+   * @param start_idx   The new sibling should clone keys in the range of
+   * [start_idx, end)
+   * @param right_sibling
+   */
+  InternalNode(
+      KeyType (&keys)[Capacity + common::Constants::OVERFLOW_SIZE],
+      Node<KeyType, ValueType, QueryContext, NodeMetadata> *(&children)[Capacity + common::Constants::OVERFLOW_SIZE],
+      int start_idx, InternalNode<KeyType, ValueType, Capacity> *right_sibling)
+      : right_sibl_(right_sibling), twin_(new InternalNode<KeyType, ValueType, Capacity>(this)), primary_(true) {
+    this->Size() = Capacity - start_idx + 1;
+    this->meta_.version_ = 1;
+    std::copy(keys + start_idx, keys + Capacity + common::Constants::OVERFLOW_SIZE, this->keys_);
+    std::copy(children + start_idx, children + Capacity + common::Constants::OVERFLOW_SIZE, this->child_);
+  }
+
+  ~InternalNode() {
+    if (!this->primary_) return;
+    auto latest = LATEST_VERSION(this);
+    for (int idx = 0; idx < latest->Size(); idx++) {
+      delete latest->child_[idx];
+    }
+    delete this->twin_;
+  }
+
+  int SearchChildIndex(const KeyType &key) {
+    auto size = std::clamp(this->Size(), 1, Capacity + common::Constants::OVERFLOW_SIZE);
+    return common::KeySearch<KeyType>::LowerBound(this->keys_, size - 1, key);
+  }
+
+  constexpr NodeType Type() { return INTERNAL; };
+  InternalNode<KeyType, ValueType, Capacity> *SiblingVersion() const { return this->twin_; }
+  int64_t VersionInfo() const { return this->meta_.Version(); }
+
+  std::string String() {
+    auto view = LATEST_VERSION(this);
+    std::stringstream ss;
+    ss << "[INTERNAL: ";
+    for (int idx = 0; idx < view->Size() - 1; idx++) {
+      ss << view->child_[idx]->String() << " | " << view->keys_[idx] << " | ";
+    }
+    ss << view->child_[view->Size() - 1]->String() << "]";
+    return ss.str();
+  }
+
+  constexpr KeyType &GetKey(int offset) {
+    assert(offset >= 0 && offset < Capacity);
+    return this->keys_[offset];
+  }
+
+  /**
+   * Get the child at index `idx` of the latest twin
+   */
+  Node<KeyType, ValueType, QueryContext, NodeMetadata> *GetChild(int idx) {
+    auto view = LATEST_VERSION(this);
+    assert(idx < view->meta_.size_ + 1);
+    return view->child_[idx];
+  }
+
+  InternalNode<KeyType, ValueType, Capacity> *RightSibling() const { return LATEST_VERSION(this)->right_sibl_; }
+
+  /**************************************************************************************
+   * @brief Core utilities are placed below, readers are thread-safe, while
+   *writers are expected to be serialized by the tree *
+   **************************************************************************************/
+
+  bool Insert(const KeyType &key, const ValueType &val, Split<KeyType, ValueType, QueryContext, NodeMetadata> &split,
+              QueryContext *context) {
+    auto latest = LATEST_VERSION(this);
+    int target_idx = latest->SearchChildIndex(key);
+    bool is_split = latest->child_[target_idx]->Insert(key, val, split, context);
+    if (!is_split) return false;
+
+    auto shadow = this->StartModification(context);
+    std::swap(shadow->keys_[target_idx], split.boundary_key);
+    shadow->ShiftAndInsert(split.boundary_key, split.right, target_idx + 1);
+    if (shadow->Size() <= Capacity) return false;
+
+    int boundary_idx = UNDERFLOW_BOUND(shadow->Size());
+    auto new_sibling = new InternalNode<KeyType, ValueType, Capacity>(shadow->keys_, shadow->child_, boundary_idx,
+                                                                      shadow->right_sibl_);
+    shadow->Size() = boundary_idx;
+    shadow->right_sibl_ = new_sibling;
+
+    split.left = this;
+    split.right = new_sibling;
+    split.boundary_key = shadow->keys_[boundary_idx - 1];
+    return true;
+  }
+
+  bool Search(const KeyType &key, ValueType &value, QueryContext *context) {
+    auto target = this->TraverseChild(key, context);
+    if (context->restart_) return false;
+    return target->Search(key, value, context);
+  }
+
+  bool Update(const KeyType &key, const ValueType &value, QueryContext *context) {
+    auto latest = LATEST_VERSION(this);
+    return latest->child_[latest->SearchChildIndex(key)]->Update(key, value, context);
+  }
+
+  bool LocateKey(const KeyType &key, Node<KeyType, ValueType, QueryContext, NodeMetadata> *&child, int &position,
+                 QueryContext *context) {
+    auto target = this->TraverseChild(key, context);
+    if (context->restart_) return false;
+    return target->LocateKey(key, child, position, context);
+  }
+
+  bool Delete(const KeyType &key, bool &underflow, QueryContext *context) {
+    auto latest = LATEST_VERSION(this);
+    return latest->child_[latest->SearchChildIndex(key)]->Delete(key, underflow, context);
+  }
+
+  bool OptimisticInsert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    auto latest = LATEST_VERSION(this);
+    return latest->child_[latest->SearchChildIndex(key)]->OptimisticInsert(key, val, context);
+  }
+
+  bool OptimisticDelete(const KeyType &key, bool &deleted, QueryContext *context) {
+    auto latest = LATEST_VERSION(this);
+    return latest->child_[latest->SearchChildIndex(key)]->OptimisticDelete(key, deleted, context);
+  }
+
+  /**
+   * Similar to the lock crabbing InternalNode::Balance, but it operates on the
+   * twins being modified (MODIFIED_VERSION)
+   */
+  bool Balance(Node<KeyType, ValueType, QueryContext, NodeMetadata> *right, KeyType &boundary) {
+    auto left = MODIFIED_VERSION(this);
+    auto right_node = static_cast<InternalNode<KeyType, ValueType, Capacity> *>(right);
+    auto right_sibling = MODIFIED_VERSION(right_node);
+    left->right_sibl_ = right_node;
+    if (left->Size() < UNDERFLOW_BOUND(Capacity) && right_sibling->Size() > UNDERFLOW_BOUND(Capacity)) {
+      left->child_[left->Size()] = right_sibling->child_[0];
+      left->keys_[left->Size()] = boundary;
+      boundary = right_sibling->keys_[0];
+      left->Size()++;
+      std::move(right_sibling->keys_ + 1, right_sibling->keys_ + right_sibling->Size(), right_sibling->keys_);
+      std::move(right_sibling->child_ + 1, right_sibling->child_ + right_sibling->Size(), right_sibling->child_);
+      right_sibling->Size()--;
+      return false;
+    }
+    if (left->Size() > UNDERFLOW_BOUND(Capacity) && right_sibling->Size() < UNDERFLOW_BOUND(Capacity)) {
+      right_sibling->ShiftAndInsert(boundary, left->child_[left->Size() - 1], 0);
+      --left->Size();
+      boundary = left->keys_[left->Size() - 1];
+      return false;
+    }
+    left->keys_[left->Size() - 1] = boundary;
+    std::copy(right_sibling->keys_, right_sibling->keys_ + right_sibling->Size(), left->keys_ + left->Size());
+    std::copy(right_sibling->child_, right_sibling->child_ + right_sibling->Size(), left->child_ + left->Size());
+    left->Size() += right_sibling->Size();
+    left->right_sibl_ = right_sibling->right_sibl_;
+    return true;
+  }
+};
+
+/**
+ * A memory Shadowing B+Tree implementation, readers never acquire any latch
+ */
+template <typename KeyType, typename ValueType, int LeafCapacity, int InternalCapacity>
+class MemoryBTree : public BTreeInterface<KeyType, ValueType, QueryContext> {
+private:
+  std::atomic<Node<KeyType, ValueType, QueryContext, NodeMetadata> *> root_;
+  /** Increased whenever `root_` changes, it acts as the version of the root's parent */
+  std::atomic<int64_t> root_version_;
+  /** Writers are serialized by this latch */
+  std::mutex writer_latch_;
+  FRIEND_TEST(ShadowBPlusTree, RightLinksAfterSplits);
+
+  /**
+   * Traverse the tree with a reader operation `read`, restart until it is
+   * validated
+   */
+  template <typename ReadFunc>
+  void Read(QueryContext *context, ReadFunc &&read) {
+    do {
+      context->Clear();
+      auto version = this->root_version_.load(std::memory_order_acquire);
+      read(this->root_.load(std::memory_order_acquire));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (this->root_version_.load(std::memory_order_relaxed) != version) context->restart_ = true;
+    } while (context->restart_);
+    context->Clear();
+  }
+
+  void InstallRoot(Node<KeyType, ValueType, QueryContext, NodeMetadata> *root) {
+    this->root_.store(root, std::memory_order_release);
+    this->root_version_.fetch_add(1, std::memory_order_release);
+  }
+
+public:
+  MemoryBTree() : root_(new LeafNode<KeyType, ValueType, LeafCapacity>()), root_version_(0) {}
+  ~MemoryBTree() { delete this->root_.load(); }
+
+  std::string String() const { return this->root_.load()->String(); }
+
+  bool Search(const KeyType &key, ValueType &val, QueryContext *context) {
+    bool found;
+    this->Read(context, [&](Node<KeyType, ValueType, QueryContext, NodeMetadata> *root) {
+      found = root->Search(key, val, context);
+    });
+    return found;
+  }
+
+  void Insert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    std::lock_guard<std::mutex> guard(this->writer_latch_);
+    context->Clear();
+    Split<KeyType, ValueType, QueryContext, NodeMetadata> split;
+    if (this->root_.load()->Insert(key, val, split, context)) {
+      // the new root has to be installed before its children are published
+      this->InstallRoot(new InternalNode<KeyType, ValueType, InternalCapacity>(split));
+    }
+    context->PublishModification();
+  }
+
+  bool Update(const KeyType &key, const ValueType &val, QueryContext *context) {
+    std::lock_guard<std::mutex> guard(this->writer_latch_);
+    context->Clear();
+    auto found = this->root_.load()->Update(key, val, context);
+    context->PublishModification();
+    return found;
+  }
+
+  bool Delete(const KeyType &key, QueryContext *context) {
+    std::lock_guard<std::mutex> guard(this->writer_latch_);
+    context->Clear();
+    bool unused_underflow;
+    auto deleted = this->root_.load()->Delete(key, unused_underflow, context);
+    context->PublishModification();
+    return deleted;
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> guard(this->writer_latch_);
+    auto old_root = this->root_.load();
+    this->InstallRoot(new LeafNode<KeyType, ValueType, LeafCapacity>());
+    delete old_root;
+  };
+
+  /**
+   * Iterator of Shadowing tree, which copies the latest twin of a whole leaf
+   * at a time
+   */
+  class MemoryIterator : public BTreeInterface<KeyType, ValueType, QueryContext>::Iterator {
+  private:
+    size_t offset_;
+    /** All the next returned keys should be >= key_low_ (or > if exclusive_low_) */
+    KeyType key_low_;
+    bool lower_bound_;
+    bool exclusive_low_;
+    KeyType key_high_;
+    bool upper_bound_;
+    LeafNode<KeyType, ValueType, LeafCapacity> *next_;
+    std::vector<KeyType> keys_;
+    std::vector<ValueType> values_;
+
+  public:
+    MemoryIterator(LeafNode<KeyType, ValueType, LeafCapacity> *node, const KeyType &key_low, const KeyType &key_high)
+        : offset_(0),
+          key_low_(key_low),
+          lower_bound_(true),
+          exclusive_low_(false),
+          key_high_(key_high),
+          upper_bound_(true),
+          next_(node) {}
+    MemoryIterator(LeafNode<KeyType, ValueType, LeafCapacity> *node)
+        : offset_(0), lower_bound_(false), exclusive_low_(false), upper_bound_(false), next_(node) {}
+    ~MemoryIterator() {}
+
+    bool Next(KeyType &key, ValueType &val) {
+      while (this->offset_ >= this->keys_.size() && this->next_ != nullptr) {
+        this->next_->CopyEntries(this->lower_bound_ ? &this->key_low_ : nullptr, this->exclusive_low_, this->keys_,
+                                 this->values_, this->next_);
+        this->offset_ = 0;
+      }
+      if (this->offset_ >= this->keys_.size()) return false;
+      key = this->keys_[this->offset_];
+      val = this->values_[this->offset_];
+      this->offset_++;
+      this->key_low_ = key;
+      this->lower_bound_ = this->exclusive_low_ = true;
+      return !this->upper_bound_ || key <= this->key_high_;
+    }
+  };
+
+  MemoryIterator *RangeQuery(const KeyType &key_low, const KeyType &key_high, QueryContext *context) {
+    Node<KeyType, ValueType, QueryContext, NodeMetadata> *leaf;
+    this->Read(context, [&](Node<KeyType, ValueType, QueryContext, NodeMetadata> *root) {
+      int unused_offset;
+      root->LocateKey(key_low, leaf, unused_offset, context);
+    });
+    return new MemoryIterator(static_cast<LeafNode<KeyType, ValueType, LeafCapacity> *>(leaf), key_low, key_high);
+  }
+
+  MemoryIterator *TreeScan(QueryContext *context) {
+    Node<KeyType, ValueType, QueryContext, NodeMetadata> *current;
+    this->Read(context, [&](Node<KeyType, ValueType, QueryContext, NodeMetadata> *root) {
+      // the left-most child of a node never changes, because a split always
+      // moves the upper half to the new sibling
+      current = root;
+      while (current->Type() == NodeType::INTERNAL) {
+        current = static_cast<InternalNode<KeyType, ValueType, InternalCapacity> *>(current)->GetChild(0);
+      }
+    });
+    return new MemoryIterator(static_cast<LeafNode<KeyType, ValueType, LeafCapacity> *>(current));
+  }
+};
+
+}  // namespace btree::implementation::shadow
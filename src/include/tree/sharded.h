@@ -0,0 +1,302 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "common/node_allocator.h"
+#include "common/numa.h"
+#include "tree/definitions.h"
+#include "tree/lock_crabbing.h"
+
+namespace btree::implementation {
+
+/**
+ * @brief Spread the keys over the shards by their hash, which balances any
+ *  key distribution, but every RangeQuery visits all shards
+ */
+template <typename KeyType>
+class HashPartitioner {
+public:
+  /**
+   * @throw std::invalid_argument if `shard_count` is 0
+   */
+  explicit HashPartitioner(std::size_t shard_count) : shard_count_(shard_count) {
+    if (shard_count == 0) throw std::invalid_argument("There should be at least one shard");
+  }
+
+  std::size_t ShardCount() const { return this->shard_count_; }
+
+  std::size_t ShardOf(const KeyType &key) const { return Mix(std::hash<KeyType>{}(key)) % this->shard_count_; }
+
+  /** Every shard may hold keys of [key_low, key_high] */
+  void ShardsOf(const KeyType & /* key_low */, const KeyType & /* key_high */, std::size_t &first,
+                std::size_t &last) const {
+    first = 0;
+    last = this->shard_count_ - 1;
+  }
+
+private:
+  std::size_t shard_count_;
+
+  /** std::hash of integers is usually the identity, the finalizer of MurmurHash3 spreads it */
+  static uint64_t Mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    return hash ^ (hash >> 33);
+  }
+};
+
+/**
+ * @brief Split the key space into consecutive ranges, so that a RangeQuery
+ *  only visits the shards overlapping it, but skewed keys hit a single shard
+ *  Shard I holds the keys in (split_keys[I - 1], split_keys[I]], i.e. the same
+ *    convention as the separators of an internal node
+ */
+template <typename KeyType>
+class RangePartitioner {
+public:
+  /**
+   * @throw std::invalid_argument if `split_keys` is not strictly ascending
+   */
+  explicit RangePartitioner(std::vector<KeyType> split_keys) : split_keys_(std::move(split_keys)) {
+    if (std::adjacent_find(this->split_keys_.begin(), this->split_keys_.end(), std::greater_equal<KeyType>()) !=
+        this->split_keys_.end()) {
+      throw std::invalid_argument("Split keys should be strictly ascending");
+    }
+  }
+
+  std::size_t ShardCount() const { return this->split_keys_.size() + 1; }
+
+  std::size_t ShardOf(const KeyType &key) const {
+    return std::lower_bound(this->split_keys_.begin(), this->split_keys_.end(), key) - this->split_keys_.begin();
+  }
+
+  void ShardsOf(const KeyType &key_low, const KeyType &key_high, std::size_t &first, std::size_t &last) const {
+    first = this->ShardOf(key_low);
+    last = this->ShardOf(key_high);
+  }
+
+private:
+  std::vector<KeyType> split_keys_;
+};
+
+/**
+ * @brief Front-end which partitions the keys over independent MemoryBTree
+ *  shards, so that each root and tree latch is only shared by the threads
+ *  working on its shard
+ *  Shards are spread round-robin over the NUMA nodes. The tree object itself,
+ *    i.e. its tree latch and root pointer, as well as all of its nodes, are
+ *    allocated on the memory of its node. Threads working mostly on the
+ *    shards of their node can be pinned there with common::Numa::BindThread()
+ *  Point operations only latch their shard. RangeQuery/TreeScan merge the
+ *    shards in key order, copying one leaf worth of entries per shard at a
+ *    time, so that no latch is held across shards
+ */
+template <typename KeyType, typename ValueType, int LeafCapacity, int InternalCapacity,
+          typename Partitioner = HashPartitioner<KeyType>, typename Latch = std::shared_mutex>
+class ShardedBTree : public BTreeInterface<KeyType, ValueType, BasicQueryContext<Latch>> {
+public:
+  using QueryContext = BasicQueryContext<Latch>;
+  using ShardType = MemoryBTree<KeyType, ValueType, LeafCapacity, InternalCapacity, common::NodePool<>, Latch>;
+
+private:
+  struct ShardDeleter {
+    void operator()(ShardType *shard) const {
+      shard->~ShardType();
+      std::free(shard);
+    }
+  };
+
+  Partitioner partitioner_;
+  std::vector<std::unique_ptr<ShardType, ShardDeleter>> shards_;
+  std::vector<int> numa_nodes_;
+
+  /**
+   * Allocate a shard on whole pages of `numa_node`, which is also preferred
+   *  for all of its nodes
+   */
+  static ShardType *NewShard(int numa_node) {
+    auto page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    auto size = (sizeof(ShardType) + page_size - 1) / page_size * page_size;
+    auto memory = std::aligned_alloc(std::max(page_size, alignof(ShardType)), size);
+    if (memory == nullptr) throw std::bad_alloc();
+    common::Numa::BindMemory(memory, size, numa_node);
+    ShardType *shard;
+    try {
+      shard = new (memory) ShardType();
+    } catch (...) {
+      std::free(memory);
+      throw;
+    }
+    shard->NodeAllocator()->BindToNode(numa_node);
+    return shard;
+  }
+
+public:
+  /**
+   * @param numa_node_count   Number of NUMA nodes to spread the shards over,
+   *    0 for all online nodes
+   */
+  explicit ShardedBTree(Partitioner partitioner, int numa_node_count = 0) : partitioner_(std::move(partitioner)) {
+    if (numa_node_count <= 0) numa_node_count = common::Numa::NodeCount();
+    this->shards_.reserve(this->partitioner_.ShardCount());
+    for (std::size_t idx = 0; idx < this->partitioner_.ShardCount(); ++idx) {
+      auto numa_node = static_cast<int>(idx % numa_node_count);
+      this->numa_nodes_.push_back(numa_node);
+      this->shards_.emplace_back(NewShard(numa_node));
+    }
+  }
+
+  std::size_t ShardCount() const { return this->shards_.size(); }
+  std::size_t ShardOf(const KeyType &key) const { return this->partitioner_.ShardOf(key); }
+  int NumaNodeOf(std::size_t shard) const { return this->numa_nodes_[shard]; }
+  ShardType &Shard(std::size_t shard) { return *this->shards_[shard]; }
+
+  /** One line per shard */
+  std::string String() const {
+    std::stringstream ss;
+    for (std::size_t idx = 0; idx < this->shards_.size(); ++idx) {
+      if (idx > 0) ss << "\n";
+      ss << this->shards_[idx]->String();
+    }
+    return ss.str();
+  }
+
+  bool Search(const KeyType &key, ValueType &val, QueryContext *context) {
+    return this->shards_[this->ShardOf(key)]->Search(key, val, context);
+  }
+
+  void Insert(const KeyType &key, const ValueType &val, QueryContext *context) {
+    this->shards_[this->ShardOf(key)]->Insert(key, val, context);
+  }
+
+  bool Update(const KeyType &key, const ValueType &val, QueryContext *context) {
+    return this->shards_[this->ShardOf(key)]->Update(key, val, context);
+  }
+
+  bool Delete(const KeyType &key, QueryContext *context) {
+    return this->shards_[this->ShardOf(key)]->Delete(key, context);
+  }
+
+  void Clear() {
+    for (auto &shard : this->shards_) shard->Clear();
+  }
+
+  /**
+   * @brief Merge of the scans of several shards in key order
+   *  Every shard is scanned with its own context, by batches of at most one
+   *    leaf, which are copied and released right away (see
+   *    MemoryIterator::NextBatch()). The smallest head of the batches is
+   *    returned next
+   *  The guarantees of a single MemoryIterator hold for every shard
+   */
+  class MergedIterator final : public BTreeInterface<KeyType, ValueType, QueryContext>::Iterator {
+  private:
+    struct Cursor {
+      QueryContext context_;
+      std::unique_ptr<typename ShardType::MemoryIterator> scan_;
+      KeyType keys_[LeafCapacity];
+      ValueType values_[LeafCapacity];
+      std::size_t offset_ = 0;
+      std::size_t count_ = 0;
+
+      void Fill() {
+        this->offset_ = 0;
+        this->count_ = this->scan_->NextBatch(this->keys_, this->values_, LeafCapacity);
+      }
+    };
+
+    std::size_t cursor_count_;
+    std::unique_ptr<Cursor[]> cursors_;
+
+  public:
+    /**
+     * Scan [key_low, key_high] of `count` shards from `first`, or all their
+     *  keys if the bounds are nullptr
+     */
+    MergedIterator(ShardedBTree *tree, std::size_t first, std::size_t count, const KeyType *key_low,
+                   const KeyType *key_high)
+        : cursor_count_(count), cursors_(new Cursor[count]) {
+      for (std::size_t idx = 0; idx < this->cursor_count_; ++idx) {
+        auto &cursor = this->cursors_[idx];
+        auto shard = tree->shards_[first + idx].get();
+        if (key_low != nullptr) {
+          cursor.scan_.reset(shard->RangeQuery(*key_low, *key_high, &cursor.context_));
+        } else {
+          cursor.scan_.reset(shard->TreeScan(&cursor.context_));
+        }
+        // release the latch of the shard before scanning the next one
+        cursor.Fill();
+      }
+    }
+
+    bool Next(KeyType &key, ValueType &val) {
+      Cursor *smallest = nullptr;
+      for (std::size_t idx = 0; idx < this->cursor_count_; ++idx) {
+        auto &cursor = this->cursors_[idx];
+        if (cursor.offset_ == cursor.count_) continue;
+        if (smallest == nullptr || cursor.keys_[cursor.offset_] < smallest->keys_[smallest->offset_]) {
+          smallest = &cursor;
+        }
+      }
+      if (smallest == nullptr) return false;
+      key = smallest->keys_[smallest->offset_];
+      val = smallest->values_[smallest->offset_++];
+      if (smallest->offset_ == smallest->count_) smallest->Fill();
+      return true;
+    }
+  };
+
+  /**
+   * The caller's context is not used, every visited shard is scanned with a
+   *  context of the iterator
+   */
+  MergedIterator *RangeQuery(const KeyType &key_low, const KeyType &key_high, QueryContext * /* context */) {
+    std::size_t first;
+    std::size_t last;
+    this->partitioner_.ShardsOf(key_low, key_high, first, last);
+    auto count = (key_high < key_low) ? 0 : last - first + 1;
+    return new MergedIterator(this, first, count, &key_low, &key_high);
+  }
+
+  MergedIterator *TreeScan(QueryContext * /* context */) {
+    return new MergedIterator(this, 0, this->shards_.size(), nullptr, nullptr);
+  }
+};
+
+}  // namespace btree::implementation
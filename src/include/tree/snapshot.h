@@ -0,0 +1,494 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "common/constants.h"
+#include "common/key_search.h"
+
+namespace btree::implementation {
+
+/**
+ * @brief Header of an on-disk tree image
+ *  The image is laid out as follows, and every offset is relative to the start
+ *  of the file, hence it can be memory-mapped at any address:
+ *  - this header
+ *  - `leaf_count_` leaf blocks, each with `leaf_capacity_` keys followed by
+ *    `leaf_capacity_` values, only the last block may be partially filled
+ *  - the internal levels, from the one right above the leaves up to the root:
+ *    level I holds the largest key of every node of level I - 1 (the leaves
+ *    for level 0), and every `internal_capacity_` keys form one of its nodes
+ *  Keys and values are stored as raw bytes, so an image should only be read
+ *  by a build with the same key/value types and byte order
+ */
+struct SnapshotHeader {
+  static constexpr uint64_t MAGIC = 0x50414e5345455254;  // "TREESNAP"
+  static constexpr uint32_t VERSION = 1;
+
+  uint64_t magic_;
+  uint32_t version_;
+  uint32_t key_size_;
+  uint32_t value_size_;
+  uint32_t leaf_capacity_;
+  uint32_t internal_capacity_;
+  /** Number of internal levels, the last one being the root */
+  uint32_t levels_;
+  uint64_t entries_;
+  uint64_t leaf_count_;
+  uint64_t leaf_offset_;
+  uint64_t level_offset_[common::Constants::MAX_HEIGHT];
+  /** Number of keys of every internal level */
+  uint64_t level_size_[common::Constants::MAX_HEIGHT];
+
+  /** Sections are aligned to the cache line size, as are the leaf blocks */
+  static constexpr uint64_t AlignUp(uint64_t offset) {
+    return (offset + common::Constants::CACHELINE_SIZE - 1) / common::Constants::CACHELINE_SIZE *
+           common::Constants::CACHELINE_SIZE;
+  }
+
+  /** Offset of the values within a leaf block */
+  template <typename KeyType, typename ValueType>
+  static constexpr uint64_t LeafValuesOffset(uint64_t leaf_capacity) {
+    return (leaf_capacity * sizeof(KeyType) + alignof(ValueType) - 1) / alignof(ValueType) * alignof(ValueType);
+  }
+
+  template <typename KeyType, typename ValueType>
+  static constexpr uint64_t LeafBlockSize(uint64_t leaf_capacity) {
+    static_assert(alignof(KeyType) <= common::Constants::CACHELINE_SIZE &&
+                      alignof(ValueType) <= common::Constants::CACHELINE_SIZE,
+                  "Snapshot sections are cache line aligned");
+    return AlignUp(LeafValuesOffset<KeyType, ValueType>(leaf_capacity) + leaf_capacity * sizeof(ValueType));
+  }
+};
+
+/**
+ * @brief Stream sorted entries into a tree image, see SnapshotHeader
+ *  Every full leaf block is written out right away, only the internal levels,
+ *  i.e. one key per leaf block, are kept in memory until Finish()
+ */
+template <typename KeyType, typename ValueType>
+class SnapshotWriter {
+  static_assert(std::is_trivially_copyable_v<KeyType> && std::is_trivially_copyable_v<ValueType>,
+                "Only trivially copyable keys and values can be written as raw bytes");
+
+public:
+  /**
+   * @throw std::runtime_error if `path` can't be opened for writing
+   */
+  SnapshotWriter(const std::string &path, int leaf_capacity, int internal_capacity)
+      : out_(path, std::ios::binary | std::ios::trunc),
+        block_(SnapshotHeader::LeafBlockSize<KeyType, ValueType>(leaf_capacity)),
+        block_size_(0) {
+    assert(leaf_capacity > 0 && internal_capacity > 1);
+    if (!this->out_) throw std::runtime_error("Can't open snapshot file " + path);
+    std::memset(&this->header_, 0, sizeof(this->header_));
+    this->header_.magic_ = SnapshotHeader::MAGIC;
+    this->header_.version_ = SnapshotHeader::VERSION;
+    this->header_.key_size_ = sizeof(KeyType);
+    this->header_.value_size_ = sizeof(ValueType);
+    this->header_.leaf_capacity_ = leaf_capacity;
+    this->header_.internal_capacity_ = internal_capacity;
+    this->header_.leaf_offset_ = SnapshotHeader::AlignUp(sizeof(SnapshotHeader));
+    // the header is rewritten by Finish(), once all offsets are known
+    this->Write(&this->header_, sizeof(this->header_));
+    this->Pad(this->header_.leaf_offset_);
+  }
+
+  // non-copyable, as it owns the output stream
+  SnapshotWriter(const SnapshotWriter &) = delete;
+  SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+  /**
+   * Append `count` entries, whose keys should be greater than all the
+   *  previously appended ones
+   */
+  void Append(const KeyType *keys, const ValueType *values, size_t count) {
+    auto capacity = static_cast<size_t>(this->header_.leaf_capacity_);
+    while (count > 0) {
+      auto copied = std::min(count, capacity - this->block_size_);
+      std::memcpy(this->BlockKeys() + this->block_size_, keys, copied * sizeof(KeyType));
+      std::memcpy(this->BlockValues() + this->block_size_, values, copied * sizeof(ValueType));
+      this->block_size_ += copied;
+      keys += copied;
+      values += copied;
+      count -= copied;
+      if (this->block_size_ == capacity) this->FlushBlock();
+    }
+  }
+
+  /**
+   * Write the last leaf block, the internal levels and the final header
+   * @throw std::runtime_error if any write failed
+   */
+  void Finish() {
+    if (this->block_size_ > 0) this->FlushBlock();
+    auto offset = this->header_.leaf_offset_ + this->header_.leaf_count_ * this->block_.size();
+    // every level is the list of the high keys of the nodes of the level below
+    auto level = std::move(this->high_keys_);
+    while (!level.empty()) {
+      if (this->header_.levels_ == common::Constants::MAX_HEIGHT) {
+        throw std::runtime_error("Snapshot is higher than the supported tree height");
+      }
+      this->header_.level_offset_[this->header_.levels_] = offset;
+      this->header_.level_size_[this->header_.levels_] = level.size();
+      this->header_.levels_++;
+      this->Write(level.data(), level.size() * sizeof(KeyType));
+      offset = SnapshotHeader::AlignUp(offset + level.size() * sizeof(KeyType));
+      this->Pad(offset);
+      if (level.size() <= this->header_.internal_capacity_) break;
+
+      std::vector<KeyType> parents;
+      for (size_t idx = this->header_.internal_capacity_; idx < level.size(); idx += this->header_.internal_capacity_) {
+        parents.push_back(level[idx - 1]);
+      }
+      parents.push_back(level.back());
+      level.swap(parents);
+    }
+    this->out_.seekp(0);
+    this->Write(&this->header_, sizeof(this->header_));
+    this->out_.flush();
+    if (!this->out_) throw std::runtime_error("Failed to write snapshot");
+  }
+
+private:
+  std::ofstream out_;
+  SnapshotHeader header_;
+  /** The leaf block being filled */
+  std::vector<char> block_;
+  size_t block_size_;
+  /** The largest key of every written leaf block */
+  std::vector<KeyType> high_keys_;
+
+  KeyType *BlockKeys() { return reinterpret_cast<KeyType *>(this->block_.data()); }
+  ValueType *BlockValues() {
+    return reinterpret_cast<ValueType *>(
+        this->block_.data() + SnapshotHeader::LeafValuesOffset<KeyType, ValueType>(this->header_.leaf_capacity_));
+  }
+
+  void FlushBlock() {
+    this->high_keys_.push_back(this->BlockKeys()[this->block_size_ - 1]);
+    this->Write(this->block_.data(), this->block_.size());
+    this->header_.entries_ += this->block_size_;
+    this->header_.leaf_count_++;
+    this->block_size_ = 0;
+  }
+
+  void Write(const void *data, size_t size) { this->out_.write(static_cast<const char *>(data), size); }
+
+  /** Zero-fill the output up to `offset` */
+  void Pad(uint64_t offset) {
+    static const char zeros[common::Constants::CACHELINE_SIZE] = {};
+    auto position = static_cast<uint64_t>(this->out_.tellp());
+    assert(offset >= position && offset - position <= sizeof(zeros));
+    this->Write(zeros, offset - position);
+  }
+};
+
+/**
+ * @brief Read-only B+Tree served directly from a memory-mapped tree image
+ *  Nothing is copied at startup: pages are faulted in by the descents, and
+ *  the OS page cache is shared by all processes mapping the same image
+ *  Since the image is immutable, no latch is taken by any operation
+ *  It also provides the entries in key order through begin()/end(), e.g. to
+ *  bulk load a MemoryBTree from the image
+ */
+template <typename KeyType, typename ValueType>
+class MappedBTree {
+  static_assert(std::is_trivially_copyable_v<KeyType> && std::is_trivially_copyable_v<ValueType>,
+                "Only trivially copyable keys and values can be read as raw bytes");
+
+public:
+  /**
+   * @throw std::runtime_error if `path` can't be mapped
+   * @throw std::invalid_argument if it is not an image of these key/value types
+   */
+  explicit MappedBTree(const std::string &path) {
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Can't open snapshot file " + path);
+    struct stat file_stat;
+    if (::fstat(fd, &file_stat) != 0) {
+      ::close(fd);
+      throw std::runtime_error("Can't stat snapshot file " + path);
+    }
+    this->size_ = file_stat.st_size;
+    if (this->size_ < sizeof(SnapshotHeader)) {
+      ::close(fd);
+      throw std::invalid_argument("Truncated snapshot file " + path);
+    }
+    auto data = ::mmap(nullptr, this->size_, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping stays valid after the file is closed
+    ::close(fd);
+    if (data == MAP_FAILED) throw std::runtime_error("Can't map snapshot file " + path);
+    this->data_ = static_cast<const char *>(data);
+    this->header_ = reinterpret_cast<const SnapshotHeader *>(this->data_);
+
+    const auto &header = *this->header_;
+    auto block_size = SnapshotHeader::LeafBlockSize<KeyType, ValueType>(header.leaf_capacity_);
+    // the bounds are compared in division form, so that no corrupted field can overflow them
+    bool valid = header.magic_ == SnapshotHeader::MAGIC && header.version_ == SnapshotHeader::VERSION &&
+                 header.levels_ <= common::Constants::MAX_HEIGHT && header.leaf_capacity_ > 0 &&
+                 header.internal_capacity_ > 1 && header.leaf_offset_ <= this->size_ &&
+                 header.leaf_count_ <= (this->size_ - header.leaf_offset_) / block_size;
+    // only the last leaf block may be partially filled, and the levels index all the leaves
+    valid = valid && (header.levels_ == 0) == (header.leaf_count_ == 0) &&
+            (header.leaf_count_ == 0 ? header.entries_ == 0
+                                     : (header.leaf_count_ - 1) * header.leaf_capacity_ < header.entries_ &&
+                                           header.entries_ <= header.leaf_count_ * header.leaf_capacity_);
+    uint64_t level_size = header.leaf_count_;
+    for (uint32_t level = 0; valid && level < header.levels_; ++level) {
+      valid = header.level_offset_[level] <= this->size_ &&
+              header.level_size_[level] <= (this->size_ - header.level_offset_[level]) / sizeof(KeyType) &&
+              header.level_size_[level] == level_size;
+      level_size = (level_size + header.internal_capacity_ - 1) / header.internal_capacity_;
+    }
+    // the root is a single node
+    valid = valid && (header.levels_ == 0 || header.level_size_[header.levels_ - 1] <= header.internal_capacity_);
+    if (!valid) {
+      this->Unmap();
+      throw std::invalid_argument("Corrupted snapshot file " + path);
+    }
+    if (header.key_size_ != sizeof(KeyType) || header.value_size_ != sizeof(ValueType)) {
+      this->Unmap();
+      throw std::invalid_argument("Snapshot file " + path + " has different key/value types");
+    }
+    this->block_size_ = block_size;
+    this->values_offset_ = SnapshotHeader::LeafValuesOffset<KeyType, ValueType>(header.leaf_capacity_);
+    // the internal levels are read by every descent
+    if (header.levels_ > 0) {
+      auto page_size = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+      auto levels_begin = header.level_offset_[0] / page_size * page_size;
+      ::madvise(const_cast<char *>(this->data_) + levels_begin, this->size_ - levels_begin, MADV_WILLNEED);
+    }
+  }
+
+  ~MappedBTree() { this->Unmap(); }
+
+  // non-copyable, as it owns the mapping
+  MappedBTree(const MappedBTree &) = delete;
+  MappedBTree &operator=(const MappedBTree &) = delete;
+
+  /** Number of entries */
+  size_t Size() const { return this->header_->entries_; }
+
+  bool Search(const KeyType &key, ValueType &value) const {
+    size_t leaf_idx;
+    if (!this->DescendToLeaf(key, leaf_idx)) return false;
+    auto index = this->LeafLowerBound(leaf_idx, key);
+    if (!(this->LeafKeys(leaf_idx)[index] == key)) return false;
+    value = this->LeafValues(leaf_idx)[index];
+    return true;
+  }
+
+  /**
+   * @brief Random access iterator over the entries, in key order
+   *  The entries are returned by value, as keys and values are stored apart
+   */
+  class EntryIterator {
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = std::pair<KeyType, ValueType>;
+    using difference_type = std::ptrdiff_t;
+    using reference = value_type;
+    /** Keeps the entry alive for `it->first` */
+    struct pointer {
+      value_type entry_;
+      const value_type *operator->() const { return &this->entry_; }
+    };
+
+    EntryIterator() : tree_(nullptr), index_(0) {}
+    EntryIterator(const MappedBTree *tree, size_t index) : tree_(tree), index_(index) {}
+
+    value_type operator*() const {
+      auto capacity = this->tree_->header_->leaf_capacity_;
+      auto leaf_idx = this->index_ / capacity;
+      auto offset = this->index_ % capacity;
+      return {this->tree_->LeafKeys(leaf_idx)[offset], this->tree_->LeafValues(leaf_idx)[offset]};
+    }
+    pointer operator->() const { return {**this}; }
+    value_type operator[](difference_type n) const { return *(*this + n); }
+
+    EntryIterator &operator++() {
+      this->index_++;
+      return *this;
+    }
+    EntryIterator operator++(int) {
+      auto copy = *this;
+      this->index_++;
+      return copy;
+    }
+    EntryIterator &operator--() {
+      this->index_--;
+      return *this;
+    }
+    EntryIterator operator--(int) {
+      auto copy = *this;
+      this->index_--;
+      return copy;
+    }
+    EntryIterator &operator+=(difference_type n) {
+      this->index_ += n;
+      return *this;
+    }
+    EntryIterator &operator-=(difference_type n) {
+      this->index_ -= n;
+      return *this;
+    }
+    friend EntryIterator operator+(EntryIterator it, difference_type n) { return it += n; }
+    friend EntryIterator operator+(difference_type n, EntryIterator it) { return it += n; }
+    friend EntryIterator operator-(EntryIterator it, difference_type n) { return it -= n; }
+    friend difference_type operator-(const EntryIterator &lhs, const EntryIterator &rhs) {
+      return static_cast<difference_type>(lhs.index_) - static_cast<difference_type>(rhs.index_);
+    }
+    friend bool operator==(const EntryIterator &lhs, const EntryIterator &rhs) { return lhs.index_ == rhs.index_; }
+    friend bool operator!=(const EntryIterator &lhs, const EntryIterator &rhs) { return lhs.index_ != rhs.index_; }
+    friend bool operator<(const EntryIterator &lhs, const EntryIterator &rhs) { return lhs.index_ < rhs.index_; }
+    friend bool operator>(const EntryIterator &lhs, const EntryIterator &rhs) { return lhs.index_ > rhs.index_; }
+    friend bool operator<=(const EntryIterator &lhs, const EntryIterator &rhs) { return lhs.index_ <= rhs.index_; }
+    friend bool operator>=(const EntryIterator &lhs, const EntryIterator &rhs) { return lhs.index_ >= rhs.index_; }
+
+  private:
+    const MappedBTree *tree_;
+    size_t index_;
+  };
+
+  EntryIterator begin() const { return EntryIterator(this, 0); }
+  EntryIterator end() const { return EntryIterator(this, this->Size()); }
+
+  /**
+   * @brief Iterator over a key range of the image, similar to
+   *  MemoryBTree::MemoryIterator but without any latch
+   */
+  class MappedIterator {
+  public:
+    /**
+     * Scan from `key_low` (inclusive) to `key_high` (inclusive)
+     */
+    MappedIterator(const MappedBTree *tree, const KeyType &key_low, const KeyType &key_high)
+        : tree_(tree), key_high_(key_high), upper_bound_(true), index_(tree->Size()) {
+      size_t leaf_idx;
+      if (tree->DescendToLeaf(key_low, leaf_idx)) {
+        this->index_ = leaf_idx * tree->header_->leaf_capacity_ + tree->LeafLowerBound(leaf_idx, key_low);
+      }
+    }
+    /**
+     * Scan the whole image
+     */
+    explicit MappedIterator(const MappedBTree *tree) : tree_(tree), upper_bound_(false), index_(0) {}
+
+    bool Next(KeyType &key, ValueType &val) {
+      if (this->index_ >= this->tree_->Size()) return false;
+      auto entry = *EntryIterator(this->tree_, this->index_);
+      if (this->upper_bound_ && this->key_high_ < entry.first) {
+        this->index_ = this->tree_->Size();
+        return false;
+      }
+      key = entry.first;
+      val = entry.second;
+      this->index_++;
+      return true;
+    }
+
+  private:
+    const MappedBTree *tree_;
+    KeyType key_high_;
+    bool upper_bound_;
+    /** Index of the next entry, see EntryIterator */
+    size_t index_;
+  };
+
+  MappedIterator *RangeQuery(const KeyType &key_low, const KeyType &key_high) const {
+    return new MappedIterator(this, key_low, key_high);
+  }
+  MappedIterator *TreeScan() const { return new MappedIterator(this); }
+
+private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  const SnapshotHeader *header_ = nullptr;
+  uint64_t block_size_ = 0;
+  uint64_t values_offset_ = 0;
+
+  void Unmap() {
+    if (this->data_ != nullptr) ::munmap(const_cast<char *>(this->data_), this->size_);
+    this->data_ = nullptr;
+  }
+
+  const KeyType *LevelKeys(uint32_t level) const {
+    return reinterpret_cast<const KeyType *>(this->data_ + this->header_->level_offset_[level]);
+  }
+  const KeyType *LeafKeys(size_t leaf_idx) const {
+    return reinterpret_cast<const KeyType *>(this->data_ + this->header_->leaf_offset_ + leaf_idx * this->block_size_);
+  }
+  const ValueType *LeafValues(size_t leaf_idx) const {
+    return reinterpret_cast<const ValueType *>(this->data_ + this->header_->leaf_offset_ +
+                                               leaf_idx * this->block_size_ + this->values_offset_);
+  }
+  int LeafSize(size_t leaf_idx) const {
+    auto capacity = this->header_->leaf_capacity_;
+    return std::min<uint64_t>(capacity, this->header_->entries_ - leaf_idx * capacity);
+  }
+  int LeafLowerBound(size_t leaf_idx, const KeyType &key) const {
+    return common::KeySearch<KeyType>::LowerBound(this->LeafKeys(leaf_idx), this->LeafSize(leaf_idx), key);
+  }
+
+  /**
+   * Search the internal levels from the root down
+   * @param leaf_idx  The leaf block which may contain `key`
+   * @return false if `key` is greater than all keys of the image
+   */
+  bool DescendToLeaf(const KeyType &key, size_t &leaf_idx) const {
+    const auto &header = *this->header_;
+    if (header.levels_ == 0) return false;
+    // the root is the only node of the last level
+    size_t node_idx = 0;
+    for (auto level = static_cast<int>(header.levels_) - 1; level >= 0; --level) {
+      auto first = node_idx * header.internal_capacity_;
+      auto size = std::min<uint64_t>(header.internal_capacity_, header.level_size_[level] - first);
+      auto index = common::KeySearch<KeyType>::LowerBound(this->LevelKeys(level) + first, size, key);
+      // only the right-most node of a level may lack a larger key
+      if (static_cast<uint64_t>(index) == size) return false;
+      node_idx = first + index;
+    }
+    leaf_idx = node_idx;
+    return true;
+  }
+};
+
+}  // namespace btree::implementation
@@ -0,0 +1,101 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "tree/blink.h"
+
+namespace btree::implementation::blink {
+
+TEST(BLinkLeafNode, MoveRightAfterSplit) {
+  LeafNode<int, int, 4> leaf;
+  QueryContext context;
+  Split<int, int, QueryContext, NodeMetadata> split;
+
+  for (int key = 1; key <= 4; ++key) {
+    EXPECT_FALSE(leaf.Insert(key, key, split, &context));
+  }
+  // the split is not posted to any parent, the new sibling is only reachable
+  // through the right-link
+  EXPECT_TRUE(leaf.Insert(5, 5, split, &context));
+  EXPECT_EQ(&leaf, split.left);
+  EXPECT_EQ(2, split.boundary_key);
+  EXPECT_EQ("[LEAF: (1,1) (2,2)]", leaf.String());
+
+  int value;
+  context.Clear();
+  EXPECT_TRUE(leaf.Search(2, value, &context));
+  EXPECT_EQ(0, context.right_moves_);
+  EXPECT_TRUE(leaf.Search(5, value, &context));
+  EXPECT_EQ(5, value);
+  EXPECT_EQ(1, context.right_moves_);
+
+  // writers landing on the stale node chase the right-link as well
+  EXPECT_FALSE(leaf.Insert(6, 6, split, &context));
+  EXPECT_EQ(2, context.right_moves_);
+  EXPECT_EQ("[LEAF: (3,3) (4,4) (5,5) (6,6)]", split.right->String());
+  delete split.right;
+}
+
+TEST(BLinkTree, RightLinksAfterSplits) {
+  using TreeNode = Node<int, int, QueryContext, NodeMetadata>;
+  using Inner = InternalNode<int, int, 4>;
+  using Leaf = LeafNode<int, int, 4>;
+  MemoryBTree<int, int, 4, 4> tree;
+  QueryContext context;
+  std::vector<int> keys(5000);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(0));
+  for (auto key : keys) tree.Insert(key, key, &context);
+
+  // the nodes of every level in key order, from the root down
+  std::vector<std::vector<TreeNode *>> levels{{tree.root_.load()}};
+  while (levels.back()[0]->Metadata().level_ > 0) {
+    std::vector<TreeNode *> children;
+    for (auto node : levels.back()) {
+      auto inner = static_cast<Inner *>(node);
+      for (int idx = 0; idx < inner->Size(); ++idx) children.push_back(inner->GetChild(idx));
+    }
+    levels.push_back(children);
+  }
+  ASSERT_LT(2U, levels.size());
+
+  // the right link of every node is the next node of its level
+  for (auto &level : levels) {
+    for (size_t idx = 0; idx < level.size(); ++idx) {
+      TreeNode *expected = (idx + 1 < level.size()) ? level[idx + 1] : nullptr;
+      if (level[idx]->Metadata().level_ > 0) {
+        EXPECT_EQ(expected, static_cast<Inner *>(level[idx])->RightSibling());
+      } else {
+        EXPECT_EQ(expected, static_cast<Leaf *>(level[idx])->RightSibling());
+      }
+    }
+  }
+}
+
+}  // namespace btree::implementation::blink
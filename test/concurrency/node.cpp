@@ -30,6 +30,8 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include <gtest/gtest.h>
 
 #include "common/constants.h"
+#include "common/hybrid_latch.h"
+#include "common/spinlock.h"
 #include "tree/lock_crabbing.h"
 
 using namespace btree::implementation;
@@ -228,3 +230,72 @@ std::unique_ptr<InternalNode<int, int, NODE_CAPACITY>>
     ConcurrentNodeTestFixture<InternalNode<int, int, NODE_CAPACITY>>::root(new InternalNode<int, int, NODE_CAPACITY>(
         new LeafNode<int, int, NODE_CAPACITY>(), new LeafNode<int, int, NODE_CAPACITY>(MAX_KEY + 1, MAX_KEY + 1),
         NODE_CAPACITY));
+
+template <class Latch>
+class LatchTestFixture : public ::testing::Test {};
+
+typedef ::testing::Types<SharedSpinlock, HybridLatch> LatchTypes;
+TYPED_TEST_CASE(LatchTestFixture, LatchTypes);
+
+TYPED_TEST(LatchTestFixture, SharedAndExclusive) {
+  TypeParam latch;
+  latch.lock_shared();
+  ASSERT_TRUE(latch.try_lock_shared());
+  ASSERT_FALSE(latch.try_lock());
+  latch.unlock_shared();
+  latch.unlock_shared();
+  ASSERT_TRUE(latch.try_lock());
+  ASSERT_FALSE(latch.try_lock_shared());
+  latch.unlock();
+
+  // writers exclude both readers and other writers
+  int counter = 0;
+  std::atomic<bool> violated = false;
+  std::thread threads[NO_THREADS];
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx] = std::thread([&, tidx]() {
+      for (int op = 0; op < MAX_OPERATION / NO_THREADS; ++op) {
+        if (tidx % 2 == 0) {
+          latch.lock();
+          int current = counter;
+          counter = -1;
+          counter = current + 1;
+          latch.unlock();
+        } else {
+          latch.lock_shared();
+          if (counter < 0) violated = true;
+          latch.unlock_shared();
+        }
+      }
+    });
+  }
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx].join();
+  }
+  EXPECT_FALSE(violated);
+  EXPECT_EQ(MAX_OPERATION / NO_THREADS * ((NO_THREADS + 1) / 2), counter);
+}
+
+TEST(HybridLatch, OptimisticRead) {
+  HybridLatch latch;
+  bool restart = false;
+  auto version = latch.ReadLockOrRestart(restart);
+  // shared readers do not invalidate optimistic readers
+  latch.lock_shared();
+  latch.unlock_shared();
+  latch.ReadUnlockOrRestart(version, restart);
+  EXPECT_FALSE(restart);
+
+  latch.lock();
+  EXPECT_TRUE(latch.IsWriteLocked());
+  latch.ReadUnlockOrRestart(version, restart);
+  EXPECT_TRUE(restart);
+  latch.unlock();
+
+  restart = false;
+  latch.ReadUnlockOrRestart(version, restart);
+  EXPECT_TRUE(restart);
+  restart = false;
+  EXPECT_NE(version, latch.ReadLockOrRestart(restart));
+  EXPECT_FALSE(restart);
+}
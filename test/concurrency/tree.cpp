@@ -21,15 +21,20 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <algorithm>
 #include <atomic>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <queue>
+#include <shared_mutex>
 #include <thread>
 
 #include <gtest/gtest.h>
 
 #include "common/constants.h"
+#include "common/hybrid_latch.h"
+#include "common/spinlock.h"
 #include "tree/lock_crabbing.h"
 
 using namespace btree::implementation;
@@ -183,4 +188,415 @@ TEST(ConcurrentTreeTest, DeleteAndSearch) {
     }
     context.Clear();
   }
-}
\ No newline at end of file
+}
+
+template <typename Tree>
+void InsertAndDeleteConcurrently() {
+  using QueryContext = typename Tree::QueryContext;
+  Tree tree;
+  // odd keys are pre-loaded and deleted concurrently, even keys are inserted
+  //  the writers only collide on shared leaves, which exercises both the
+  //  optimistic path and its pessimistic fallback
+  for (int key = 1; key <= MAX_KEY; key += 2) {
+    QueryContext context;
+    tree.Insert(key, key, &context);
+  }
+
+  std::atomic<int> next_key = 1;
+  std::thread threads[NO_THREADS];
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx] = std::thread([&]() {
+      QueryContext context;
+      while (true) {
+        int key = next_key++;
+        if (key > MAX_KEY) break;
+        if (key % 2 == 1) {
+          ASSERT_TRUE(tree.Delete(key, &context));
+        } else {
+          tree.Insert(key, key, &context);
+        }
+        context.Clear();
+      }
+    });
+  }
+
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx].join();
+  }
+
+  int value;
+  QueryContext context;
+  for (int key = 1; key <= MAX_KEY; ++key) {
+    auto found = tree.Search(key, value, &context);
+    if (key % 2 == 0) {
+      ASSERT_TRUE(found);
+      EXPECT_EQ(key, value);
+    } else {
+      ASSERT_FALSE(found);
+    }
+    context.Clear();
+  }
+}
+
+TEST(ConcurrentTreeTest, InsertAndDelete) {
+  InsertAndDeleteConcurrently<MemoryBTree<int, int, NODE_CAPACITY, NODE_CAPACITY>>();
+}
+
+TEST(ConcurrentTreeTest, InsertAndDeleteWithDeferredMerge) {
+  // most leaves never underflow, and the empty ones are rebalanced
+  InsertAndDeleteConcurrently<
+      MemoryBTree<int, int, NODE_CAPACITY, NODE_CAPACITY, DefaultNodeAllocator, std::shared_mutex, 0>>();
+  InsertAndDeleteConcurrently<
+      MemoryBTree<int, int, NODE_CAPACITY, NODE_CAPACITY, DefaultNodeAllocator, std::shared_mutex, 25>>();
+}
+
+TEST(ConcurrentTreeTest, DeleteAndMultiSearch) {
+  MemoryBTree<int, int, NODE_CAPACITY, NODE_CAPACITY> tree;
+  // even keys are never deleted, odd keys are deleted concurrently
+  for (int key = 1; key <= MAX_KEY; ++key) {
+    QueryContext context;
+    tree.Insert(key, key, &context);
+  }
+
+  std::atomic<int> next_key = 1;
+  std::thread threads[NO_THREADS];
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx] = std::thread([&, tidx]() {
+      QueryContext context;
+      constexpr int batch_size = 64;
+      int keys[batch_size], values[batch_size];
+      bool found[batch_size];
+      while (next_key <= MAX_KEY) {
+        if (tidx % 2 == 0) {
+          int key = next_key.fetch_add(2);
+          if (key <= MAX_KEY) {
+            ASSERT_TRUE(tree.Delete(key, &context));
+          }
+        } else {
+          for (auto &key : keys) key = rand() % MAX_KEY + 1;
+          tree.MultiSearch(keys, batch_size, values, found, &context);
+          for (int idx = 0; idx < batch_size; ++idx) {
+            if (keys[idx] % 2 == 0) {
+              ASSERT_TRUE(found[idx]);
+            }
+            if (found[idx]) {
+              EXPECT_EQ(keys[idx], values[idx]);
+            }
+          }
+        }
+        context.Clear();
+      }
+    });
+  }
+
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx].join();
+  }
+}
+
+TEST(ConcurrentTreeTest, BatchInsertAndSearch) {
+  MemoryBTree<int, int, NODE_CAPACITY, NODE_CAPACITY> tree;
+  std::thread threads[NO_THREADS];
+  // every thread inserts sorted batches of the keys congruent to its index
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx] = std::thread([&, tidx]() {
+      QueryContext context;
+      constexpr int batch_size = 64;
+      int keys[batch_size], value;
+      for (int start = tidx + 1; start <= MAX_KEY; start += batch_size * NO_THREADS) {
+        int count = 0;
+        for (int key = start; key <= MAX_KEY && count < batch_size; key += NO_THREADS) keys[count++] = key;
+        tree.BatchInsert(keys, keys, count, &context);
+        ASSERT_TRUE(tree.Search(keys[rand() % count], value, &context));
+      }
+    });
+  }
+
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx].join();
+  }
+  QueryContext context;
+  for (int key = 1; key <= MAX_KEY; ++key) {
+    int value;
+    ASSERT_TRUE(tree.Search(key, value, &context));
+    EXPECT_EQ(key, value);
+  }
+}
+
+TEST(ConcurrentTreeTest, CompactAndWrite) {
+  using Tree = MemoryBTree<int, int, NODE_CAPACITY, NODE_CAPACITY, DefaultNodeAllocator, std::shared_mutex, 0>;
+  Tree tree;
+  // odd keys are deleted and even keys are searched while the tree is compacted
+  //  over and over, the keys which are a multiple of 4 are deleted and inserted
+  //  back, so that the compacted nodes keep being split again
+  for (int key = 1; key <= MAX_KEY; ++key) {
+    Tree::QueryContext context;
+    tree.Insert(key, key, &context);
+  }
+
+  std::atomic<bool> finished = false;
+  std::atomic<int> next_key = 1;
+  std::thread compactor([&]() {
+    Tree::QueryContext context;
+    while (!finished) {
+      tree.Compact(1.0, &context);
+      EXPECT_TRUE(context.IsEmpty());
+    }
+  });
+  std::thread threads[NO_THREADS];
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx] = std::thread([&]() {
+      Tree::QueryContext context;
+      int value;
+      while (true) {
+        int key = next_key++;
+        if (key > MAX_KEY) break;
+        if (key % 2 == 1) {
+          ASSERT_TRUE(tree.Delete(key, &context));
+        } else if (key % 4 == 0) {
+          ASSERT_TRUE(tree.Delete(key, &context));
+          context.Clear();
+          tree.Insert(key, key, &context);
+        } else {
+          ASSERT_TRUE(tree.Search(key, value, &context));
+          EXPECT_EQ(key, value);
+        }
+        context.Clear();
+      }
+    });
+  }
+
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx].join();
+  }
+  finished = true;
+  compactor.join();
+
+  int value;
+  Tree::QueryContext context;
+  for (int key = 1; key <= MAX_KEY; ++key) {
+    auto found = tree.Search(key, value, &context);
+    if (key % 2 == 0) {
+      ASSERT_TRUE(found);
+      EXPECT_EQ(key, value);
+    } else {
+      ASSERT_FALSE(found);
+    }
+    context.Clear();
+  }
+  EXPECT_EQ(MAX_KEY / 2, tree.Occupancy().back().entries_);
+}
+
+TEST(ConcurrentTreeTest, AppendWithLeafCache) {
+  using Tree = MemoryBTree<int, int, NODE_CAPACITY, NODE_CAPACITY>;
+  Tree tree;
+  // every thread appends to its own key range, so that its cached leaf keeps
+  //  being hit, while negative keys are deleted and the tree is compacted, so
+  //  that the leaves keep being merged and freed
+  const int keys_per_thread = MAX_KEY / NO_THREADS;
+  for (int key = 1; key <= MAX_KEY; ++key) {
+    Tree::QueryContext context;
+    tree.Insert(-key, key, &context);
+  }
+
+  std::atomic<bool> finished = false;
+  std::thread compactor([&]() {
+    Tree::QueryContext context;
+    while (!finished) tree.Compact(1.0, &context);
+  });
+  std::thread deleter([&]() {
+    Tree::QueryContext context;
+    for (int key = 1; key <= MAX_KEY; ++key) ASSERT_TRUE(tree.Delete(-key, &context));
+  });
+  std::thread threads[NO_THREADS];
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx] = std::thread([&, tidx]() {
+      Tree::QueryContext context;
+      for (int idx = 0; idx < keys_per_thread; ++idx) tree.Insert(tidx * keys_per_thread + idx, tidx, &context);
+    });
+  }
+
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx].join();
+  }
+  deleter.join();
+  finished = true;
+  compactor.join();
+
+  int key;
+  int value;
+  int expected = 0;
+  Tree::QueryContext context;
+  std::unique_ptr<Tree::MemoryIterator> scan(tree.TreeScan(&context));
+  while (scan->Next(key, value)) {
+    ASSERT_EQ(expected, key);
+    EXPECT_EQ(expected / keys_per_thread, value);
+    expected++;
+  }
+  EXPECT_EQ(keys_per_thread * NO_THREADS, expected);
+}
+
+TEST(ConcurrentTreeTest, UpsertCounters) {
+  MemoryBTree<int, int, NODE_CAPACITY, NODE_CAPACITY> tree;
+  constexpr int counters = 1000;
+  constexpr int increments = 20000;
+  std::thread threads[NO_THREADS];
+  // all threads increment the same counters, which are created on first use
+  //  while they are incremented, the odd counters are reset by Update
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx] = std::thread([&, tidx]() {
+      QueryContext context;
+      for (int idx = 0; idx < increments; ++idx) {
+        int key = (idx * 7 + tidx) % counters;
+        if (key % 2 == 1) {
+          tree.Update(key, 0, &context);
+          continue;
+        }
+        tree.Upsert(
+            key, [](int &value, bool found) { value = found ? value + 1 : 1; }, &context);
+      }
+    });
+  }
+
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx].join();
+  }
+  QueryContext context;
+  long total = 0;
+  for (int key = 0; key < counters; ++key) {
+    int value;
+    ASSERT_EQ(key % 2 == 0, tree.Search(key, value, &context));
+    if (key % 2 == 0) total += value;
+  }
+  EXPECT_EQ(NO_THREADS * increments / 2, total);
+}
+
+TEST(ConcurrentTreeTest, ScanAndWrite) {
+  MemoryBTree<int, int, 4, 4> tree;
+  // even keys are never touched, odd keys are inserted and deleted concurrently
+  //  with the scans, which should still return every even key exactly once
+  for (int key = 2; key <= MAX_KEY; key += 2) {
+    QueryContext context;
+    tree.Insert(key, key, &context);
+  }
+
+  std::atomic<int> finished_scans = 0;
+  std::thread threads[NO_THREADS];
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx] = std::thread([&, tidx]() {
+      QueryContext context;
+      if (tidx % 2 == 0) {
+        for (int key = tidx + 1; finished_scans < NO_THREADS / 2; key = (key + NO_THREADS) % MAX_KEY) {
+          tree.Insert(key, key, &context);
+          context.Clear();
+          tree.Delete(key, &context);
+          context.Clear();
+        }
+        return;
+      }
+      for (int run = 0; run < 5; ++run) {
+        int key_low = (run == 0) ? 0 : rand() % MAX_KEY;
+        std::unique_ptr<MemoryBTree<int, int, 4, 4>::MemoryIterator> it(
+            (run == 0) ? tree.TreeScan(&context) : tree.RangeQuery(key_low, key_low + MAX_KEY / 10, &context));
+        int expected = key_low + key_low % 2 + ((key_low == 0) ? 2 : 0);
+        int prev = key_low - 1;
+        auto check = [&](int key, int value) {
+          // only EXPECT here, as the writers stop once all scans are finished
+          EXPECT_LT(prev, key);
+          EXPECT_EQ(key, value);
+          prev = key;
+          if (key % 2 == 1) return;
+          EXPECT_EQ(expected, key);
+          expected = key + 2;
+        };
+        int keys[7], values[7];
+        if (run % 2 == 1) {
+          // batch scans release the leaf latch after every call
+          while (auto count = it->NextBatch(keys, values, 7)) {
+            for (size_t idx = 0; idx < count; ++idx) check(keys[idx], values[idx]);
+          }
+        } else {
+          while (it->Next(keys[0], values[0])) check(keys[0], values[0]);
+        }
+        auto last_expected = std::min(MAX_KEY, (run == 0) ? MAX_KEY : key_low + MAX_KEY / 10) / 2 * 2;
+        EXPECT_EQ(last_expected + 2, expected);
+
+        // the same range in descending order
+        std::unique_ptr<MemoryBTree<int, int, 4, 4>::MemoryReverseIterator> reverse_it(
+            (run == 0) ? tree.ReverseTreeScan(&context)
+                       : tree.ReverseRangeQuery(key_low, key_low + MAX_KEY / 10, &context));
+        auto first_expected = key_low + key_low % 2 + ((key_low == 0) ? 2 : 0);
+        expected = last_expected;
+        prev = MAX_KEY + 1;
+        while (reverse_it->Next(keys[0], values[0])) {
+          EXPECT_GT(prev, keys[0]);
+          EXPECT_EQ(keys[0], values[0]);
+          prev = keys[0];
+          if (keys[0] % 2 == 1) continue;
+          EXPECT_EQ(expected, keys[0]);
+          expected = keys[0] - 2;
+        }
+        EXPECT_EQ(first_expected - 2, expected);
+      }
+      finished_scans++;
+    });
+  }
+
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx].join();
+  }
+}
+
+template <class Latch>
+class LatchPolicyTestFixture : public ::testing::Test {};
+
+typedef ::testing::Types<std::shared_mutex, SharedSpinlock, HybridLatch> LatchTypes;
+TYPED_TEST_CASE(LatchPolicyTestFixture, LatchTypes);
+
+TYPED_TEST(LatchPolicyTestFixture, InsertDeleteAndSearch) {
+  using Tree = MemoryBTree<int, int, NODE_CAPACITY, NODE_CAPACITY, DefaultNodeAllocator, TypeParam>;
+  Tree tree;
+  // odd keys are pre-loaded and deleted concurrently, even keys are inserted,
+  //  while the searchers check the keys which are never deleted
+  for (int key = 1; key <= MAX_KEY; key += 2) {
+    typename Tree::QueryContext context;
+    tree.Insert(key, key, &context);
+  }
+
+  std::atomic<int> next_key = 1;
+  std::thread threads[NO_THREADS];
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx] = std::thread([&, tidx]() {
+      typename Tree::QueryContext context;
+      int value;
+      while (true) {
+        if (tidx % 3 == 0) {
+          int key = rand() % (MAX_KEY / 2) * 2 + 2;
+          if (tree.Search(key, value, &context)) {
+            ASSERT_EQ(key, value);
+          }
+          if (next_key > MAX_KEY) break;
+          continue;
+        }
+        int key = next_key++;
+        if (key > MAX_KEY) break;
+        if (key % 2 == 1) {
+          ASSERT_TRUE(tree.Delete(key, &context));
+        } else {
+          tree.Insert(key, key, &context);
+        }
+        context.Clear();
+      }
+    });
+  }
+
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx].join();
+  }
+
+  int value;
+  typename Tree::QueryContext context;
+  for (int key = 1; key <= MAX_KEY; ++key) {
+    ASSERT_EQ(key % 2 == 0, tree.Search(key, value, &context));
+  }
+}
@@ -21,9 +21,21 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include "common/constants.h"
+#include "common/fixed_string.h"
+#include "common/key_search.h"
+#include "common/statistics.h"
 #include "tree/lock_crabbing.h"
 
 using namespace btree::implementation;
@@ -174,6 +186,9 @@ TEST(LeafNode, SplitInsertLeft) {
   EXPECT_EQ(4, split.boundary_key);
   EXPECT_EQ("[LEAF: (1,1) (3,3) (4,4)]", split.left->String());
   EXPECT_EQ("[LEAF: (5,5) (6,6)]", split.right->String());
+  auto right = static_cast<LeafNode<int, int, 4> *>(split.right);
+  EXPECT_EQ(split.left, right->LeftSibling());
+  EXPECT_EQ(nullptr, right->RightSibling());
 
   delete split.left;
   delete split.right;
@@ -197,6 +212,43 @@ TEST(LeafNode, SplitInsertRight) {
   delete split.right;
 }
 
+TEST(LeafNode, OptimisticInsertAndDelete) {
+  LeafNode<int, int, 4> leaf;
+  QueryContext context;
+
+  EXPECT_TRUE(leaf.OptimisticInsert(3, 3, &context));
+  EXPECT_TRUE(leaf.OptimisticInsert(1, 1, &context));
+  EXPECT_TRUE(leaf.OptimisticInsert(4, 4, &context));
+  EXPECT_TRUE(leaf.OptimisticInsert(2, 2, &context));
+  // all latches should be released after each optimistic op
+  EXPECT_EQ(context.smallest_unlk_idx_, 4);
+  EXPECT_EQ(context.latches_.size(), 4);
+  context.Clear();
+
+  // the leaf is full now, a new key requires a split -> not modified
+  EXPECT_FALSE(leaf.OptimisticInsert(5, 5, &context));
+  EXPECT_EQ("[LEAF: (1,1) (2,2) (3,3) (4,4)]", leaf.String());
+  // updating an existing key is always safe
+  EXPECT_TRUE(leaf.OptimisticInsert(4, 40, &context));
+  EXPECT_EQ("[LEAF: (1,1) (2,2) (3,3) (4,40)]", leaf.String());
+  EXPECT_EQ(context.smallest_unlk_idx_, 2);
+  context.Clear();
+
+  bool deleted;
+  EXPECT_TRUE(leaf.OptimisticDelete(2, deleted, &context));
+  EXPECT_TRUE(deleted);
+  EXPECT_TRUE(leaf.OptimisticDelete(2, deleted, &context));
+  EXPECT_FALSE(deleted);
+  EXPECT_TRUE(leaf.OptimisticDelete(3, deleted, &context));
+  EXPECT_TRUE(deleted);
+  // deleting one more key would make this leaf underflow
+  EXPECT_FALSE(leaf.OptimisticDelete(4, deleted, &context));
+  EXPECT_FALSE(deleted);
+  EXPECT_EQ("[LEAF: (1,1) (4,40)]", leaf.String());
+  EXPECT_EQ(context.smallest_unlk_idx_, 4);
+  context.Clear();
+}
+
 TEST(LeafNode, BalanceBorrowing) {
   QueryContext context;
   LeafNode<int, int, 3> leaf, *right_sibling;
@@ -619,4 +671,146 @@ TEST(InternalNode, DeleteAndBalance) {
   EXPECT_EQ("[LEAF: ]", new_root->String());
 }
 
+template <typename KeyType>
+void CheckKeySearch() {
+  constexpr auto MIN = std::numeric_limits<KeyType>::min();
+  constexpr auto MAX = std::numeric_limits<KeyType>::max();
+  for (int size = 0; size <= 300; ++size) {
+    // sorted keys with duplicates, spanning the whole domain of KeyType
+    std::vector<KeyType> keys(size);
+    for (auto &key : keys) key = static_cast<KeyType>((static_cast<uint64_t>(rand()) << 33) ^ rand());
+    if (size > 0) keys[0] = MIN;
+    if (size > 1) keys[size - 1] = MAX;
+    if (size > 4) keys[size / 2] = keys[size / 2 + 1];
+    std::sort(keys.begin(), keys.end());
+
+    // neighbors of every key, wrapping around without signed overflow
+    auto shift = [](KeyType key, int delta) {
+      return static_cast<KeyType>(static_cast<std::make_unsigned_t<KeyType>>(key) + delta);
+    };
+    std::vector<KeyType> probes = {MIN, MAX, 0, static_cast<KeyType>(-1)};
+    for (auto key : keys) {
+      probes.push_back(key);
+      probes.push_back(shift(key, 1));
+      probes.push_back(shift(key, -1));
+    }
+    for (auto probe : probes) {
+      int expected = std::lower_bound(keys.begin(), keys.end(), probe) - keys.begin();
+      ASSERT_EQ(expected, KeySearch<KeyType>::LowerBound(keys.data(), size, probe));
+    }
+  }
+}
+
+TEST(KeySearch, LowerBound) {
+  CheckKeySearch<int32_t>();
+  CheckKeySearch<uint32_t>();
+  CheckKeySearch<int64_t>();
+  CheckKeySearch<uint64_t>();
+  CheckKeySearch<int16_t>();
+
+  // the generic version
+  double keys[] = {-1.5, 0.0, 0.5, 2.0};
+  EXPECT_EQ(0, KeySearch<double>::LowerBound(keys, 4, -2.0));
+  EXPECT_EQ(2, KeySearch<double>::LowerBound(keys, 4, 0.5));
+  EXPECT_EQ(4, KeySearch<double>::LowerBound(keys, 4, 3.0));
+}
+
+template <typename KeyType, typename ValueType, std::size_t NodeSize>
+void CheckNodeCapacity() {
+  constexpr auto leaf_capacity = LeafNodeCapacity<KeyType, ValueType>(NodeSize);
+  constexpr auto internal_capacity = InternalNodeCapacity<KeyType, ValueType>(NodeSize);
+  // the capacities are the largest ones fitting in NodeSize bytes
+  EXPECT_LE(sizeof(LeafNode<KeyType, ValueType, leaf_capacity>), NodeSize);
+  EXPECT_GT(sizeof(LeafNode<KeyType, ValueType, leaf_capacity + 1>), NodeSize);
+  EXPECT_LE(sizeof(InternalNode<KeyType, ValueType, internal_capacity>), NodeSize);
+  EXPECT_GT(sizeof(InternalNode<KeyType, ValueType, internal_capacity + 1>), NodeSize);
+}
+
+TEST(NodeLayout, CacheLineAlignment) {
+  auto cache_line = [](const void *ptr) { return reinterpret_cast<uintptr_t>(ptr) / Constants::CACHELINE_SIZE; };
+  auto leaf = std::make_unique<LeafNode<int, int, 16>>();
+  auto inner = std::make_unique<InternalNode<int64_t, int, 16>>();
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(leaf.get()) % Constants::CACHELINE_SIZE);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(inner.get()) % Constants::CACHELINE_SIZE);
+
+  // the latch has its own cache line, the size shares one with the first keys
+  EXPECT_EQ(cache_line(leaf.get()), cache_line(&leaf->Metadata().latch_));
+  EXPECT_EQ(cache_line(leaf.get()) + 1, cache_line(&leaf->Size()));
+  EXPECT_EQ(cache_line(&leaf->Size()), cache_line(&leaf->GetKey(0)));
+  EXPECT_EQ(cache_line(&inner->Size()), cache_line(&inner->GetKey(0)));
+
+  common::NodePool<> pool;
+  auto pooled = new (&pool) LeafNode<int, int, 5, common::NodePool<>>();
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(pooled) % Constants::CACHELINE_SIZE);
+  delete pooled;
+}
+
+TEST(NodeLayout, SizeDerivedCapacity) {
+  CheckNodeCapacity<int, int, 256>();
+  CheckNodeCapacity<int, int, 4096>();
+  CheckNodeCapacity<int64_t, int64_t, 4096>();
+  CheckNodeCapacity<int, double, 1024>();
+  CheckNodeCapacity<double, char, 512>();
+  // leaves have both left and right sibling links
+  EXPECT_EQ(501, (LeafNodeCapacity<int, int>(4096)));
+  // compact latches shrink the node header
+  EXPECT_EQ(21, (LeafNodeCapacity<int, int>(256)));
+  EXPECT_EQ(27, (LeafNodeCapacity<int, int, SharedSpinlock>(256)));
+  EXPECT_LE(sizeof(LeafNode<int, int, 27, DefaultNodeAllocator, SharedSpinlock>), 256);
+}
+
+TEST(NodeLayout, TypeTag) {
+  static_assert(std::is_final_v<LeafNode<int, int, 4>> && std::is_final_v<InternalNode<int, int, 4>>,
+                "Calls on concrete nodes should be devirtualized");
+  auto left = new LeafNode<int, int, 4>(1, 1);
+  auto right = new LeafNode<int, int, 4>(3, 3);
+  EXPECT_EQ(NodeType::LEAF, left->Metadata().type_);
+  InternalNode<int, int, 4> inner(left, right, 1);
+  EXPECT_EQ(NodeType::INTERNAL, inner.Metadata().type_);
+  InternalNode<int, int, 4> empty_inner;
+  EXPECT_EQ(NodeType::INTERNAL, empty_inner.Metadata().type_);
+}
+
+TEST(LatencyHistogram, Buckets) {
+  EXPECT_EQ(0, LatencyHistogram::BucketIndex(0));
+  EXPECT_EQ(0, LatencyHistogram::BucketIndex(1));
+  EXPECT_EQ(1, LatencyHistogram::BucketIndex(2));
+  EXPECT_EQ(1, LatencyHistogram::BucketIndex(3));
+  EXPECT_EQ(10, LatencyHistogram::BucketIndex(1024));
+  EXPECT_EQ(LatencyHistogram::BUCKETS - 1, LatencyHistogram::BucketIndex(UINT64_MAX));
+
+  LatencyHistogram histogram;
+  EXPECT_EQ(0, histogram.Read().Percentile(0.5));
+  for (int idx = 0; idx < 99; ++idx) histogram.Record(100);
+  histogram.Record(5000);
+  auto snapshot = histogram.Read();
+  EXPECT_EQ(100, snapshot.count_);
+  EXPECT_DOUBLE_EQ(149, snapshot.Mean());
+  // the percentiles are bucket upper bounds
+  EXPECT_EQ(127, snapshot.Percentile(0.5));
+  EXPECT_EQ(8191, snapshot.Percentile(0.999));
+}
+
+TEST(FixedString, Comparison) {
+  FixedString<16> empty, abc("abc"), abd(std::string("abd")), ab("ab");
+  EXPECT_EQ(0u, empty.Size());
+  EXPECT_EQ("abc", abc.View());
+  EXPECT_TRUE(empty < ab && ab < abc && abc < abd);
+  EXPECT_TRUE(abc == FixedString<16>("abc") && abc != abd && abd >= abc && abc <= abc);
+  EXPECT_THROW(FixedString<4>("too long"), std::length_error);
+  static_assert(std::is_trivially_copyable_v<FixedString<16>>, "FixedString should be stored inline");
+}
+
+TEST(KeySeparator, SuffixTruncation) {
+  using common::KeySeparator;
+  EXPECT_EQ(3, KeySeparator<int>::Shortest(3, 10));
+  EXPECT_EQ("abx", KeySeparator<std::string>::Shortest("abcdef", "abxyz"));
+  EXPECT_EQ("b", KeySeparator<std::string>::Shortest("apple", "banana"));
+  // no prefix of right_min is both shorter than left_max and less than right_min
+  EXPECT_EQ("ab", KeySeparator<std::string>::Shortest("ab", "abc"));
+  EXPECT_EQ("abc", KeySeparator<std::string>::Shortest("abc", "abd"));
+  EXPECT_EQ("abc", KeySeparator<std::string>::Shortest("abc", "abdz"));
+  EXPECT_EQ("www.b", (KeySeparator<FixedString<32>>::Shortest("www.a.com/index", "www.b.com")));
+}
+
 }  // namespace btree::implementation
\ No newline at end of file
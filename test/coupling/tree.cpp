@@ -21,8 +21,15 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <algorithm>
 #include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <numeric>
+#include <string>
+#include <thread>
 #include <unordered_set>
 
 #include <gtest/gtest.h>
@@ -103,6 +110,60 @@ TEST(BPlusTree, Search) {
   EXPECT_FALSE(tree.Search(180, value, &context));
 }
 
+TEST(BPlusTree, UpdateAndUpsert) {
+  MemoryBTree<int, int, 4, 4> tree;
+  QueryContext context;
+
+  const int number_of_tuples = 1000;
+  for (int i = 0; i < number_of_tuples; i += 2) {
+    tree.Insert(i, i, &context);
+  }
+
+  // Update never inserts
+  int value;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    EXPECT_EQ(i % 2 == 0, tree.Update(i, -i, &context));
+    EXPECT_TRUE(context.IsEmpty());
+  }
+  for (int i = 0; i < number_of_tuples; ++i) {
+    EXPECT_EQ(i % 2 == 0, tree.Search(i, value, &context));
+    if (i % 2 == 0) {
+      EXPECT_EQ(-i, value);
+    }
+  }
+
+  // Upsert modifies the existing keys, and inserts the others, which splits
+  //  most of the leaves
+  int calls = 0;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    auto found = tree.Upsert(
+        i,
+        [&](int &value, bool exists) {
+          calls++;
+          value = exists ? value * 2 : i + 1;
+        },
+        &context);
+    EXPECT_EQ(i % 2 == 0, found);
+    EXPECT_TRUE(context.IsEmpty());
+  }
+  EXPECT_EQ(number_of_tuples, calls);
+  for (int i = 0; i < number_of_tuples; ++i) {
+    EXPECT_TRUE(tree.Search(i, value, &context));
+    EXPECT_EQ(i % 2 == 0 ? -2 * i : i + 1, value);
+  }
+
+  // a new key starts from a value-initialized value
+  MemoryBTree<int, int, 4, 4> counters;
+  for (int i = 0; i < 100; ++i) {
+    counters.Upsert(
+        i % 10, [](int &value, bool /* found */) { value++; }, &context);
+  }
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(counters.Search(i, value, &context));
+    EXPECT_EQ(10, value);
+  }
+}
+
 TEST(BPlusTree, DeleteWithoutMergeTest) {
   MemoryBTree<int, int, 4, 4> tree;
   QueryContext context;
@@ -270,6 +331,225 @@ TEST(BPlusTree, IteratorRangeScanTest) {
   }
 }
 
+TEST(BPlusTree, IteratorReverseScanTest) {
+  MemoryBTree<int, int, 4, 4> tree;
+  QueryContext context;
+
+  const int number_of_tuples = 10000;
+  std::vector<int> tuples(number_of_tuples);
+  std::iota(tuples.begin(), tuples.end(), 0);
+  std::random_shuffle(tuples.begin(), tuples.end());
+  for (auto key : tuples) {
+    tree.Insert(key, key, &context);
+  }
+  // delete the odd keys to exercise both borrowing and merging of leaves
+  for (auto key : tuples) {
+    if (key % 2 == 1) {
+      EXPECT_TRUE(tree.Delete(key, &context));
+    }
+  }
+
+  std::unique_ptr<MemoryBTree<int, int, 4, 4>::MemoryReverseIterator> it(tree.ReverseTreeScan(&context));
+  int key, value;
+  int expected = number_of_tuples - 2;
+  while (it->Next(key, value)) {
+    EXPECT_EQ(expected, key);
+    EXPECT_EQ(expected, value);
+    expected -= 2;
+  }
+  EXPECT_EQ(-2, expected);
+
+  const int runs = 10;
+  for (int i = 0; i < runs; i++) {
+    int start = rand() % number_of_tuples;
+    int end = rand() % number_of_tuples;
+    it.reset(tree.ReverseRangeQuery(start, end, &context));
+    int founds = 0;
+    expected = end / 2 * 2;
+    while (it->Next(key, value)) {
+      EXPECT_EQ(expected, key);
+      expected -= 2;
+      founds++;
+    }
+    EXPECT_EQ(start <= end ? end / 2 - (start + 1) / 2 + 1 : 0, founds);
+  }
+
+  MemoryBTree<int, int, 4, 4> empty_tree;
+  it.reset(empty_tree.ReverseTreeScan(&context));
+  EXPECT_FALSE(it->Next(key, value));
+}
+
+TEST(BPlusTree, ParallelScanTest) {
+  MemoryBTree<int, int, 4, 4> tree;
+  QueryContext context;
+
+  const int number_of_tuples = 10000;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    tree.Insert(i, i, &context);
+  }
+
+  auto bounds = tree.PartitionKeys(8, &context);
+  EXPECT_EQ(7, bounds.size());
+  EXPECT_TRUE(std::is_sorted(bounds.begin(), bounds.end()));
+  EXPECT_EQ(0, context.latches_.size());
+
+  // every partition is only appended by the thread scanning it
+  std::vector<std::vector<int>> partitions(8);
+  EXPECT_EQ(8, tree.ParallelScan(8, 3, [&](size_t partition, int key, int value) {
+    EXPECT_EQ(key, value);
+    partitions[partition].push_back(key);
+  }));
+  int expected = 0;
+  for (auto &partition : partitions) {
+    EXPECT_LT(number_of_tuples / 8 / 4, partition.size());
+    for (auto key : partition) EXPECT_EQ(expected++, key);
+  }
+  EXPECT_EQ(number_of_tuples, expected);
+
+  // a single-leaf tree can not be partitioned
+  MemoryBTree<int, int, 4, 4> small_tree;
+  small_tree.Insert(1, 1, &context);
+  EXPECT_TRUE(small_tree.PartitionKeys(8, &context).empty());
+  int founds = 0;
+  EXPECT_EQ(1, small_tree.ParallelScan(8, 8, [&](size_t /* partition */, int /* key */, int /* value */) {
+    founds++;
+  }));
+  EXPECT_EQ(1, founds);
+}
+
+TEST(BPlusTree, Statistics) {
+  MemoryBTree<int, int, 4, 4> tree;
+  QueryContext context;
+
+  auto levels = tree.Occupancy();
+  ASSERT_EQ(1, levels.size());
+  EXPECT_EQ(1, levels[0].nodes_);
+  EXPECT_EQ(0, levels[0].entries_);
+
+  const int number_of_tuples = 1000;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    tree.Insert(i, i, &context);
+  }
+  for (int i = 0; i < number_of_tuples; i += 2) {
+    tree.Delete(i, &context);
+  }
+
+  auto snapshot = tree.Statistics();
+  levels = tree.Occupancy();
+  ASSERT_LE(2, levels.size());
+  EXPECT_EQ(1, levels[0].nodes_);
+  auto &leaves = levels.back();
+  EXPECT_EQ(number_of_tuples / 2, leaves.entries_);
+  EXPECT_EQ(4, leaves.capacity_);
+  size_t histogram_nodes = 0;
+  for (auto count : leaves.fill_histogram_) histogram_nodes += count;
+  EXPECT_EQ(leaves.nodes_, histogram_nodes);
+  EXPECT_GE(leaves.FillFactor(), 0.5);
+  EXPECT_LE(leaves.FillFactor(), 1.0);
+  // every child of a level is a node of the next one
+  for (size_t level = 0; level + 1 < levels.size(); ++level) {
+    EXPECT_EQ(levels[level].entries_, levels[level + 1].nodes_);
+  }
+
+#ifdef ENABLE_STATISTICS
+  EXPECT_LE(leaves.nodes_, snapshot.leaf_splits_ + 1);
+  EXPECT_LT(0, snapshot.internal_splits_);
+  EXPECT_LE(levels.size() - 1, snapshot.root_changes_);
+  EXPECT_LT(0, snapshot.merges_ + snapshot.borrows_);
+  EXPECT_LE(snapshot.leaf_splits_, snapshot.optimistic_restarts_);
+#else
+  EXPECT_EQ(0, snapshot.leaf_splits_);
+  EXPECT_TRUE(snapshot.latch_waits_.empty());
+#endif
+}
+
+TEST(BPlusTree, IteratorBatchScanTest) {
+  MemoryBTree<int, int, 4, 4> tree;
+  QueryContext context;
+
+  const int number_of_tuples = 10000;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    tree.Insert(i, i, &context);
+  }
+
+  // the iterator lives on the stack, and releases its latch after every batch
+  const int runs = 10;
+  for (int i = 0; i < runs; i++) {
+    int start = rand() % number_of_tuples;
+    int end = rand() % number_of_tuples;
+    MemoryBTree<int, int, 4, 4>::MemoryIterator it(&tree, start, end, &context);
+    int keys[3], values[3];
+    int founds = 0;
+    while (auto count = it.NextBatch(keys, values, 3)) {
+      EXPECT_EQ(0, context.latches_.size());
+      for (size_t idx = 0; idx < count; ++idx) {
+        EXPECT_EQ(founds + start, keys[idx]);
+        EXPECT_EQ(founds + start, values[idx]);
+        founds++;
+      }
+    }
+    EXPECT_EQ(start <= end ? end - start + 1 : 0, founds);
+  }
+
+  // batches and single entries can be mixed
+  MemoryBTree<int, int, 4, 4>::MemoryIterator it(&tree, &context);
+  int keys[16], values[16], key, value;
+  int expected = 0;
+  while (true) {
+    auto count = it.NextBatch(keys, values, 16);
+    for (size_t idx = 0; idx < count; ++idx) EXPECT_EQ(expected++, keys[idx]);
+    if (!it.Next(key, value)) break;
+    EXPECT_EQ(expected++, key);
+  }
+  EXPECT_EQ(number_of_tuples, expected);
+}
+
+TEST(BPlusTree, ThreadLocalContext) {
+  MemoryBTree<int, int, 4, 4> tree;
+  auto context = QueryContext::ThreadLocal();
+  EXPECT_EQ(context, QueryContext::ThreadLocal());
+  EXPECT_TRUE(context->IsEmpty());
+
+  // every operation leaves the thread context ready for the next one
+  const int number_of_tuples = 10000;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    tree.Insert(i, i, QueryContext::ThreadLocal());
+    EXPECT_TRUE(context->IsEmpty());
+  }
+  for (int i = 0; i < number_of_tuples; i += 2) {
+    tree.Delete(i, QueryContext::ThreadLocal());
+  }
+  int value;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    EXPECT_EQ(i % 2 == 1, tree.Search(i, value, QueryContext::ThreadLocal()));
+  }
+
+  // a full scan moves over thousands of leaves, but only holds one of them
+  {
+    MemoryBTree<int, int, 4, 4>::MemoryIterator it(&tree, context);
+    int key, expected = 1;
+    while (it.Next(key, value)) {
+      EXPECT_EQ(expected, key);
+      EXPECT_GE(QueryContext::MAX_LATCHES, context->latches_.size());
+      expected += 2;
+    }
+    EXPECT_EQ(number_of_tuples + 1, expected);
+  }
+  EXPECT_TRUE(context->IsEmpty());
+
+  // other threads get their own context
+  QueryContext *other = nullptr;
+  std::thread([&]() { other = QueryContext::ThreadLocal(); }).join();
+  EXPECT_NE(context, other);
+
+  // the context never grows beyond its inline capacity
+  common::FixedVector<int, 2> latches;
+  latches.push_back(0);
+  latches.push_back(1);
+  EXPECT_THROW(latches.push_back(2), std::length_error);
+  EXPECT_EQ(2, latches.size());
+}
+
 TEST(BPlusTree, MassiveRandomInsertionAndQuery) {
   std::unordered_set<int> s;
   MemoryBTree<int, int, 4, 4> tree;
@@ -294,6 +574,168 @@ TEST(BPlusTree, MassiveRandomInsertionAndQuery) {
   }
 }
 
+TEST(BPlusTree, DeferredMerge) {
+  MemoryBTree<int, int, 8, 8> eager_tree;
+  MemoryBTree<int, int, 8, 8, common::DefaultNodeAllocator, std::shared_mutex, 0> lazy_tree;
+  QueryContext context;
+
+  const int number_of_tuples = 1000;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    eager_tree.Insert(i, i, &context);
+    lazy_tree.Insert(i, i, &context);
+  }
+  auto leaves = lazy_tree.Occupancy().back().nodes_;
+  EXPECT_EQ(eager_tree.Occupancy().back().nodes_, leaves);
+
+  // every leaf keeps at least one key, hence the lazy tree never rebalances
+  //  while the eager one merges most of its leaves
+  for (int i = 0; i < number_of_tuples; ++i) {
+    if (i % 4 == 0) continue;
+    EXPECT_TRUE(eager_tree.Delete(i, &context));
+    EXPECT_TRUE(lazy_tree.Delete(i, &context));
+  }
+  EXPECT_EQ(leaves, lazy_tree.Occupancy().back().nodes_);
+  EXPECT_GT(leaves, eager_tree.Occupancy().back().nodes_);
+  int value;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    EXPECT_EQ(i % 4 == 0, lazy_tree.Search(i, value, &context));
+  }
+
+  // reinserting the deleted keys fills the same leaves again without splits
+  for (int i = 0; i < number_of_tuples; ++i) {
+    if (i % 4 != 0) lazy_tree.Insert(i, i, &context);
+  }
+  EXPECT_EQ(leaves, lazy_tree.Occupancy().back().nodes_);
+
+  // empty leaves are still rebalanced, down to a single leaf
+  for (int i = 0; i < number_of_tuples; ++i) {
+    EXPECT_TRUE(lazy_tree.Delete(i, &context));
+  }
+  EXPECT_EQ("[LEAF: ]", lazy_tree.String());
+}
+
+TEST(BPlusTree, LeafCache) {
+  MemoryBTree<int, int, 8, 8> tree;
+  MemoryBTree<int, int, 8, 8> other_tree;
+  QueryContext context;
+
+  // appends alternate between two trees of the same type, which keep their
+  //  own leaf in the cache of this thread without ever using the other one
+  const int number_of_tuples = 1000;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    tree.Insert(i, i, &context);
+    other_tree.Insert(-i, i, &context);
+  }
+  // the right-most leaf is cached, merging it into its left sibling
+  //  invalidates it
+  for (int i = number_of_tuples - 1; i >= number_of_tuples - 8; --i) EXPECT_TRUE(tree.Delete(i, &context));
+  for (int i = number_of_tuples - 8; i < number_of_tuples; ++i) tree.Insert(i, i + 1, &context);
+  // hot keys of the same leaf, which is never split by overwrites
+  for (int round = 0; round < 10; ++round) {
+    for (int i = 500; i < 504; ++i) tree.Insert(i, i + round, &context);
+  }
+
+  int value;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    EXPECT_TRUE(tree.Search(i, value, &context));
+    EXPECT_EQ((i >= 500 && i < 504) ? i + 9 : (i >= number_of_tuples - 8) ? i + 1 : i, value);
+    EXPECT_TRUE(other_tree.Search(-i, value, &context));
+    EXPECT_EQ(i, value);
+  }
+  EXPECT_FALSE(other_tree.Search(1, value, &context));
+  int key;
+  int expected = 0;
+  std::unique_ptr<MemoryBTree<int, int, 8, 8>::MemoryIterator> scan(tree.TreeScan(&context));
+  while (scan->Next(key, value)) EXPECT_EQ(expected++, key);
+  EXPECT_EQ(number_of_tuples, expected);
+  scan.reset();
+#ifdef ENABLE_STATISTICS
+  EXPECT_LT(0, tree.Statistics().leaf_cache_hits_);
+  EXPECT_LT(0, other_tree.Statistics().leaf_cache_hits_);
+#endif
+
+  // the nodes of a cleared or reloaded tree are never reached again
+  tree.Clear();
+  tree.Insert(1, 1, &context);
+  EXPECT_EQ("[LEAF: (1,1)]", tree.String());
+  std::vector<std::pair<int, int>> entries{{2, 2}, {4, 4}};
+  tree.BulkLoad(entries.begin(), entries.end());
+  tree.Insert(3, 3, &context);
+  EXPECT_EQ("[LEAF: (2,2) (3,3) (4,4)]", tree.String());
+}
+
+TEST(BPlusTree, Compact) {
+  using LazyTree = MemoryBTree<int, int, 8, 8, common::DefaultNodeAllocator, std::shared_mutex, 0>;
+  LazyTree tree;
+  QueryContext context;
+
+  const int number_of_tuples = 10000;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    tree.Insert(i, i, &context);
+  }
+  // leave a single key in every run of 8, which keeps all leaves sparse
+  for (int i = 0; i < number_of_tuples; ++i) {
+    if (i % 8 != 0) tree.Delete(i, &context);
+  }
+  auto before = tree.Occupancy();
+  EXPECT_GT(0.3, before.back().FillFactor());
+
+  auto result = tree.Compact(1.0, &context);
+  EXPECT_TRUE(context.IsEmpty());
+  EXPECT_LT(0, result.leaf_merges_);
+  EXPECT_LT(0, result.internal_merges_);
+  EXPECT_EQ(result.leaf_merges_ * sizeof(LazyTree::LeafType) + result.internal_merges_ * sizeof(LazyTree::InternalType),
+            result.bytes_reclaimed_);
+  auto after = tree.Occupancy();
+  EXPECT_EQ(before.back().nodes_ - result.leaf_merges_, after.back().nodes_);
+  EXPECT_EQ(number_of_tuples / 8, after.back().entries_);
+  EXPECT_LT(0.5, after.back().FillFactor());
+  EXPECT_GT(before.size(), after.size());
+  for (size_t level = 0; level + 1 < after.size(); ++level) {
+    EXPECT_EQ(after[level].entries_, after[level + 1].nodes_);
+  }
+
+  // both sibling chains are still intact
+  int key, value, expected = 0;
+  std::unique_ptr<LazyTree::MemoryIterator> it(tree.TreeScan(&context));
+  while (it->Next(key, value)) {
+    EXPECT_EQ(expected, key);
+    expected += 8;
+  }
+  EXPECT_EQ(number_of_tuples, expected);
+  it.reset();
+  std::unique_ptr<LazyTree::MemoryReverseIterator> reverse_it(tree.ReverseTreeScan(&context));
+  while (reverse_it->Next(key, value)) {
+    expected -= 8;
+    EXPECT_EQ(expected, key);
+  }
+  EXPECT_EQ(0, expected);
+  reverse_it.reset();
+
+  // a second pass has nothing left to merge
+  result = tree.Compact(1.0, &context);
+  EXPECT_EQ(0, result.leaf_merges_ + result.internal_merges_);
+
+  // the compacted tree is still fully functional
+  for (int i = 0; i < number_of_tuples; ++i) {
+    if (i % 8 != 0) tree.Insert(i, i, &context);
+  }
+  for (int i = 0; i < number_of_tuples; ++i) {
+    EXPECT_TRUE(tree.Search(i, value, &context));
+    EXPECT_EQ(i, value);
+  }
+
+  // the root is collapsed once all of its children are merged
+  for (int i = 0; i < number_of_tuples; ++i) {
+    if (i % 1250 != 0) tree.Delete(i, &context);
+  }
+  EXPECT_LT(1, tree.Occupancy().size());
+  tree.Compact(1.0, &context);
+  after = tree.Occupancy();
+  ASSERT_EQ(1, after.size());
+  EXPECT_EQ(8, after[0].entries_);
+}
+
 TEST(BPlusTree, KeysInsertedAndDeletedInRandomOrder) {
   MemoryBTree<int, int, 4, 4> tree;
   QueryContext context;
@@ -317,4 +759,400 @@ TEST(BPlusTree, KeysInsertedAndDeletedInRandomOrder) {
   EXPECT_EQ("[LEAF: ]", tree.String());
 }
 
-}  // namespace btree::implementation
\ No newline at end of file
+TEST(NodePool, ReuseFreedSlots) {
+  common::NodePool<4096> pool;
+  auto first = pool.Allocate(100);
+  auto second = pool.Allocate(100);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(first) % common::Constants::CACHELINE_SIZE);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(second) % common::Constants::CACHELINE_SIZE);
+  EXPECT_EQ(&pool, common::NodePool<4096>::Owner(first, 100));
+  EXPECT_EQ(1, pool.SlabCount());
+
+  common::NodePool<4096>::Deallocate(first, 100);
+  EXPECT_EQ(first, pool.Allocate(100));
+  // objects larger than a slab get a dedicated one
+  auto large = pool.Allocate(10000);
+  EXPECT_EQ(&pool, common::NodePool<4096>::Owner(large, 10000));
+  EXPECT_EQ(2, pool.SlabCount());
+}
+
+TEST(BPlusTree, KeysInsertedAndDeletedWithNodePool) {
+  MemoryBTree<int, int, 4, 4, common::NodePool<>> tree;
+  QueryContext context;
+
+  constexpr int number_of_tuples = 100000;
+  std::vector<int> tuples(number_of_tuples);
+  for (int i = 0; i < number_of_tuples; ++i) {
+    tuples[i] = i;
+  }
+  // nodes freed by merges are reused by the next round of splits
+  for (int round = 0; round < 2; ++round) {
+    std::random_shuffle(tuples.begin(), tuples.end());
+    for (auto tuple : tuples) {
+      tree.Insert(tuple, tuple, &context);
+    }
+    for (int i = 0; i < number_of_tuples; ++i) {
+      int value;
+      EXPECT_TRUE(tree.Search(i, value, &context));
+      EXPECT_EQ(i, value);
+    }
+    std::random_shuffle(tuples.begin(), tuples.end());
+    for (auto tuple : tuples) {
+      EXPECT_TRUE(tree.Delete(tuple, &context));
+    }
+    EXPECT_EQ("[LEAF: ]", tree.String());
+  }
+}
+
+TEST(BPlusTree, BulkLoadPackedStructure) {
+  MemoryBTree<int, int, 4, 4> tree;
+
+  std::vector<std::pair<int, int>> tuples;
+  for (int i = 1; i <= 10; ++i) {
+    tuples.emplace_back(i, i);
+  }
+  tree.BulkLoad(tuples.begin(), tuples.begin() + 3);
+  EXPECT_EQ("[LEAF: (1,1) (2,2) (3,3)]", tree.String());
+
+  // the remaining entries are spread evenly, so no leaf underflows
+  tree.BulkLoad(tuples.begin(), tuples.end());
+  EXPECT_EQ(
+      "[INTERNAL: [LEAF: (1,1) (2,2) (3,3) (4,4)] | 4 | [LEAF: (5,5) (6,6) (7,7)] | 7 | [LEAF: (8,8) (9,9) (10,10)]]",
+      tree.String());
+
+  tree.BulkLoad(tuples.begin(), tuples.begin(), 0.5);
+  EXPECT_EQ("[LEAF: ]", tree.String());
+  tree.BulkLoad(tuples.begin(), tuples.begin() + 6, 0.5);
+  EXPECT_EQ("[INTERNAL: [LEAF: (1,1) (2,2)] | 2 | [LEAF: (3,3) (4,4)] | 4 | [LEAF: (5,5) (6,6)]]", tree.String());
+}
+
+TEST(BPlusTree, BulkLoadAndScan) {
+  MemoryBTree<int, int, 5, 5> tree;
+  QueryContext context;
+
+  constexpr int number_of_tuples = 100000;
+  std::vector<std::pair<int, int>> tuples;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    tuples.emplace_back(i, i);
+  }
+  tree.BulkLoad(tuples.begin(), tuples.end(), 0.8);
+
+  // the leaves are linked through their right siblings
+  std::unique_ptr<MemoryBTree<int, int, 5, 5>::MemoryIterator> it(tree.TreeScan(&context));
+  int key, value, count = 0;
+  while (it->Next(key, value)) {
+    EXPECT_EQ(count, key);
+    EXPECT_EQ(count, value);
+    count++;
+  }
+  EXPECT_EQ(number_of_tuples, count);
+}
+
+TEST(BPlusTree, BulkLoadThenModify) {
+  MemoryBTree<int, int, 4, 4> tree;
+  QueryContext context;
+
+  constexpr int number_of_tuples = 100000;
+  std::vector<std::pair<int, int>> tuples;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    tuples.emplace_back(2 * i, 2 * i);
+  }
+  for (auto fill_factor : {1.0, 0.7}) {
+    tree.BulkLoad(tuples.begin(), tuples.end(), fill_factor);
+
+    // the packed tree splits and merges like any other tree
+    int value;
+    for (int i = 0; i < number_of_tuples; ++i) {
+      tree.Insert(2 * i + 1, 2 * i + 1, &context);
+    }
+    for (int i = 0; i < 2 * number_of_tuples; ++i) {
+      EXPECT_TRUE(tree.Search(i, value, &context));
+      EXPECT_EQ(i, value);
+    }
+    std::vector<int> keys(2 * number_of_tuples);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::random_shuffle(keys.begin(), keys.end());
+    for (auto key : keys) {
+      EXPECT_TRUE(tree.Delete(key, &context));
+    }
+    EXPECT_EQ("[LEAF: ]", tree.String());
+  }
+}
+
+TEST(BPlusTree, ParallelBulkLoad) {
+  std::vector<std::pair<int, int>> tuples;
+  for (int i = 0; i < 5000; ++i) {
+    tuples.emplace_back(i, i);
+  }
+  // the threads split every level into runs, but build the same tree
+  MemoryBTree<int, int, 4, 5> serial_tree;
+  serial_tree.BulkLoad(tuples.begin(), tuples.end(), 0.9);
+  for (size_t threads : {2, 3, 8, 10000}) {
+    MemoryBTree<int, int, 4, 5> tree;
+    tree.BulkLoad(tuples.begin(), tuples.end(), 0.9, threads);
+    EXPECT_EQ(serial_tree.String(), tree.String());
+  }
+
+  MemoryBTree<int, int, 8, 8> tree;
+  QueryContext context;
+  constexpr int number_of_tuples = 1000000;
+  tuples.clear();
+  for (int i = 0; i < number_of_tuples; ++i) {
+    tuples.emplace_back(i, -i);
+  }
+  tree.BulkLoad(tuples.begin(), tuples.end(), 1.0, 8);
+  for (int i = 0; i < number_of_tuples; i += 7) {
+    int value;
+    EXPECT_TRUE(tree.Search(i, value, &context));
+    EXPECT_EQ(-i, value);
+  }
+  // the runs of the threads are stitched together
+  std::unique_ptr<MemoryBTree<int, int, 8, 8>::MemoryIterator> it(tree.TreeScan(&context));
+  int key, value, count = 0;
+  while (it->Next(key, value)) {
+    EXPECT_EQ(count, key);
+    count++;
+  }
+  EXPECT_EQ(number_of_tuples, count);
+}
+
+TEST(BPlusTree, SnapshotDumpAndLoad) {
+  using Tree = MemoryBTree<int, long, 8, 4>;
+  Tree tree;
+  QueryContext context;
+  auto path = ::testing::TempDir() + "btree_snapshot.bin";
+
+  // an empty tree is dumped as an empty image
+  tree.DumpSnapshot(path, &context);
+  {
+    MappedBTree<int, long> mapped(path);
+    long value;
+    EXPECT_EQ(0, mapped.Size());
+    EXPECT_FALSE(mapped.Search(0, value));
+    std::unique_ptr<MappedBTree<int, long>::MappedIterator> it(mapped.TreeScan());
+    int key;
+    EXPECT_FALSE(it->Next(key, value));
+  }
+
+  // the odd keys in [1, 2 * number_of_tuples)
+  constexpr int number_of_tuples = 10000;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    int key = (i * 7919 % number_of_tuples) * 2 + 1;
+    tree.Insert(key, key * 10L, &context);
+  }
+  tree.DumpSnapshot(path, &context);
+  EXPECT_TRUE(context.IsEmpty());
+
+  MappedBTree<int, long> mapped(path);
+  EXPECT_EQ(number_of_tuples, mapped.Size());
+  long value;
+  for (int key = 0; key <= 2 * number_of_tuples; ++key) {
+    ASSERT_EQ(key % 2 == 1, mapped.Search(key, value));
+    if (key % 2 == 1) {
+      EXPECT_EQ(key * 10L, value);
+    }
+  }
+  int key;
+  std::unique_ptr<MappedBTree<int, long>::MappedIterator> it(mapped.RangeQuery(100, 200));
+  int expected = 101;
+  while (it->Next(key, value)) {
+    EXPECT_EQ(expected, key);
+    EXPECT_EQ(key * 10L, value);
+    expected += 2;
+  }
+  EXPECT_EQ(201, expected);
+  it.reset(mapped.RangeQuery(2 * number_of_tuples, 3 * number_of_tuples));
+  EXPECT_FALSE(it->Next(key, value));
+
+  // the loaded tree is packed, but holds the same entries
+  Tree loaded;
+  loaded.LoadSnapshot(path, 1.0, 4);
+  EXPECT_EQ(number_of_tuples, loaded.Occupancy().back().entries_);
+  for (int key = 1; key < 2 * number_of_tuples; key += 2) {
+    ASSERT_TRUE(loaded.Search(key, value, &context));
+    EXPECT_EQ(key * 10L, value);
+  }
+  loaded.Insert(0, 0, &context);
+  EXPECT_TRUE(loaded.Search(0, value, &context));
+
+  // an image of other types is rejected
+  EXPECT_THROW((MappedBTree<int, int>(path)), std::invalid_argument);
+  EXPECT_THROW((MappedBTree<int, long>(path + ".missing")), std::runtime_error);
+  std::remove(path.c_str());
+}
+
+TEST(BPlusTree, SnapshotCorrupted) {
+  MemoryBTree<int, long, 8, 4> tree;
+  QueryContext context;
+  auto path = ::testing::TempDir() + "btree_snapshot.bin";
+  auto corrupted_path = ::testing::TempDir() + "btree_snapshot_corrupted.bin";
+  for (int i = 0; i < 1000; ++i) {
+    tree.Insert(i, i, &context);
+  }
+  tree.DumpSnapshot(path, &context);
+  std::ifstream file(path, std::ios::binary);
+  std::string image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  SnapshotHeader header;
+  std::memcpy(&header, image.data(), sizeof(header));
+  ASSERT_LT(0U, header.levels_);
+
+  auto expect_rejected = [&](auto corrupt) {
+    auto corrupted = header;
+    corrupt(corrupted);
+    auto corrupted_image = image;
+    std::memcpy(corrupted_image.data(), &corrupted, sizeof(corrupted));
+    std::ofstream(corrupted_path, std::ios::binary | std::ios::trunc) << corrupted_image;
+    EXPECT_THROW((MappedBTree<int, long>(corrupted_path)), std::invalid_argument);
+  };
+  expect_rejected([](SnapshotHeader &h) { h.entries_ = h.leaf_count_ * h.leaf_capacity_ + 1; });
+  expect_rejected([](SnapshotHeader &h) { h.internal_capacity_ = 1; });
+  expect_rejected([](SnapshotHeader &h) { h.leaf_offset_ = UINT64_MAX; });
+  // the byte sizes of these sections wrap around to 0
+  expect_rejected([](SnapshotHeader &h) { h.leaf_count_ = 1ULL << 57; });
+  expect_rejected([](SnapshotHeader &h) { h.level_size_[0] = 1ULL << 62; });
+  // the regions are consistent with the file size, but not with each other
+  expect_rejected([&](SnapshotHeader &h) {
+    h.leaf_offset_ = image.size();
+    h.leaf_count_ = 0;
+    h.entries_ = 0;
+  });
+  expect_rejected([](SnapshotHeader &h) { h.entries_ = (h.leaf_count_ - 1) * h.leaf_capacity_; });
+  expect_rejected([](SnapshotHeader &h) { h.level_size_[0]--; });
+  expect_rejected([](SnapshotHeader &h) { h.level_size_[h.levels_ - 1]++; });
+  expect_rejected([](SnapshotHeader &h) { h.levels_--; });
+
+  // the untouched image is still accepted
+  std::ofstream(corrupted_path, std::ios::binary | std::ios::trunc) << image;
+  EXPECT_EQ(1000, (MappedBTree<int, long>(corrupted_path).Size()));
+  std::remove(path.c_str());
+  std::remove(corrupted_path.c_str());
+}
+
+TEST(BPlusTree, MultiSearch) {
+  MemoryBTree<int, int, 4, 4> tree;
+  QueryContext context;
+
+  constexpr int number_of_tuples = 10000;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    tree.Insert(2 * i, -2 * i, &context);
+  }
+  EXPECT_EQ(0, tree.MultiSearch(nullptr, 0, nullptr, nullptr, &context));
+
+  // an unsorted batch with duplicated and missing keys
+  constexpr int batch_size = 256;
+  std::vector<int> keys(batch_size);
+  std::vector<int> values(batch_size, 1);
+  bool found[batch_size];
+  for (int round = 0; round < 100; ++round) {
+    size_t expected_found = 0;
+    for (auto &key : keys) {
+      key = rand() % (2 * number_of_tuples + 10) - 5;
+      expected_found += (key >= 0 && key < 2 * number_of_tuples && key % 2 == 0);
+    }
+    EXPECT_EQ(expected_found, tree.MultiSearch(keys.data(), batch_size, values.data(), found, &context));
+    for (int idx = 0; idx < batch_size; ++idx) {
+      int value;
+      ASSERT_EQ(tree.Search(keys[idx], value, &context), found[idx]);
+      if (found[idx]) {
+        EXPECT_EQ(value, values[idx]);
+      }
+    }
+  }
+
+  // a sorted batch covering the whole tree
+  keys.resize(2 * number_of_tuples);
+  values.resize(2 * number_of_tuples);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::unique_ptr<bool[]> all_found(new bool[keys.size()]);
+  EXPECT_EQ(number_of_tuples, tree.MultiSearch(keys.data(), keys.size(), values.data(), all_found.get(), &context));
+  for (int i = 0; i < 2 * number_of_tuples; ++i) {
+    ASSERT_EQ(i % 2 == 0, all_found[i]);
+    if (i % 2 == 0) {
+      EXPECT_EQ(-i, values[i]);
+    }
+  }
+}
+
+TEST(BPlusTree, BatchInsert) {
+  MemoryBTree<int, int, 4, 4> tree;
+  QueryContext context;
+
+  tree.BatchInsert(nullptr, nullptr, 0, &context);
+  EXPECT_EQ("[LEAF: ]", tree.String());
+  std::vector<int> keys = {1, 2, 3, 4, 5, 6, 7};
+  tree.BatchInsert(keys.data(), keys.data(), keys.size(), &context);
+  EXPECT_EQ("[INTERNAL: [LEAF: (1,1) (2,2) (3,3) (4,4)] | 4 | [LEAF: (5,5) (6,6) (7,7)]]", tree.String());
+
+  // sorted runs of even keys, then all keys in batches of various sizes
+  constexpr int number_of_tuples = 10000;
+  tree.Clear();
+  for (int i = 0; i < number_of_tuples; i += 100) {
+    std::vector<int> run;
+    for (int key = 2 * i; key < 2 * (i + 100); key += 2) run.push_back(key);
+    tree.BatchInsert(run.data(), run.data(), run.size(), &context);
+  }
+  keys.resize(2 * number_of_tuples);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::vector<int> values(keys.size());
+  std::transform(keys.begin(), keys.end(), values.begin(), [](int key) { return -key; });
+  for (size_t offset = 0, batch_size = 1; offset < keys.size(); offset += batch_size, batch_size = batch_size * 2 + 1) {
+    batch_size = std::min(batch_size, keys.size() - offset);
+    tree.BatchInsert(keys.data() + offset, values.data() + offset, batch_size, &context);
+  }
+
+  int value;
+  for (int i = 0; i < 2 * number_of_tuples; ++i) {
+    EXPECT_TRUE(tree.Search(i, value, &context));
+    EXPECT_EQ(-i, value);
+  }
+  // existing keys are updated rather than duplicated
+  std::unique_ptr<MemoryBTree<int, int, 4, 4>::MemoryIterator> it(tree.TreeScan(&context));
+  int key, count = 0;
+  while (it->Next(key, value)) {
+    EXPECT_EQ(count, key);
+    count++;
+  }
+  EXPECT_EQ(2 * number_of_tuples, count);
+}
+
+TEST(BPlusTree, StringKeys) {
+  // URL-like keys sharing long prefixes
+  std::vector<std::string> keys;
+  for (int i = 0; i < 5000; ++i) {
+    keys.push_back("https://www.example.com/users/" + std::to_string(i * 7919 % 5000) + "/profile");
+  }
+
+  MemoryBTree<std::string, int, 8, 8> tree;
+  MemoryBTree<common::FixedString<64>, int, 8, 8> inline_tree;
+  QueryContext context;
+  for (size_t idx = 0; idx < keys.size(); ++idx) {
+    tree.Insert(keys[idx], idx, &context);
+    inline_tree.Insert(keys[idx], idx, &context);
+  }
+  // leaf splits only push the distinguishing prefix of the keys up
+  auto structure = tree.String();
+  EXPECT_NE(std::string::npos, structure.find(" | https://www.example.com/users/1000 | "));
+  EXPECT_EQ(std::string::npos, structure.find("/profile | "));
+
+  int value;
+  for (size_t idx = 0; idx < keys.size(); ++idx) {
+    ASSERT_TRUE(tree.Search(keys[idx], value, &context));
+    EXPECT_EQ(static_cast<int>(idx), value);
+    ASSERT_TRUE(inline_tree.Search(keys[idx], value, &context));
+    EXPECT_EQ(static_cast<int>(idx), value);
+  }
+  EXPECT_FALSE(tree.Search("https://www.example.com/users/1", value, &context));
+  EXPECT_FALSE(inline_tree.Search("https://www.example.com/users/1", value, &context));
+
+  // the truncated separators keep routing correctly while leaves are merged
+  for (size_t idx = 0; idx < keys.size(); idx += 2) {
+    ASSERT_TRUE(tree.Delete(keys[idx], &context));
+    ASSERT_TRUE(inline_tree.Delete(keys[idx], &context));
+  }
+  for (size_t idx = 0; idx < keys.size(); ++idx) {
+    EXPECT_EQ(idx % 2 == 1, tree.Search(keys[idx], value, &context));
+    EXPECT_EQ(idx % 2 == 1, inline_tree.Search(keys[idx], value, &context));
+  }
+}
+
+}  // namespace btree::implementation
@@ -0,0 +1,387 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "tree/disk_btree.h"
+
+namespace btree::implementation::disk {
+
+// 13 entries per leaf, and 12 children per internal page
+using SmallTree = DiskBTree<int, int, 128>;
+
+static std::string TempPath(const std::string &name) {
+  auto path = ::testing::TempDir() + name;
+  std::remove(path.c_str());
+  return path;
+}
+
+TEST(DiskBTree, InsertAndQueryTest) {
+  auto path = TempPath("disk_insert_query.db");
+  {
+    SmallTree tree(path, 16);
+    SmallTree::QueryContext context;
+
+    for (auto key : {1, 3, 6, 2, 7, 10, 9, 8, 11, 4, 5, 12}) {
+      tree.Insert(key, key, &context);
+    }
+    for (int i = 1; i <= 12; ++i) {
+      int value;
+      EXPECT_TRUE(tree.Search(i, value, &context));
+      EXPECT_EQ(i, value);
+    }
+    int value;
+    EXPECT_FALSE(tree.Search(0, value, &context));
+    EXPECT_FALSE(tree.Search(13, value, &context));
+    EXPECT_EQ("[LEAF: (1,1) (2,2) (3,3) (4,4) (5,5) (6,6) (7,7) (8,8) (9,9) (10,10) (11,11) (12,12)]", tree.String());
+  }
+  std::remove(path.c_str());
+}
+
+TEST(DiskBTree, UpdateAndDelete) {
+  auto path = TempPath("disk_update_delete.db");
+  {
+    SmallTree tree(path, 16);
+    SmallTree::QueryContext context;
+
+    for (int key = 0; key < 200; ++key) tree.Insert(key, key, &context);
+    EXPECT_TRUE(tree.Update(5, 50, &context));
+    EXPECT_FALSE(tree.Update(500, 500, &context));
+    for (int key = 0; key < 200; key += 2) EXPECT_TRUE(tree.Delete(key, &context));
+    EXPECT_FALSE(tree.Delete(0, &context));
+
+    for (int key = 0; key < 200; ++key) {
+      int value;
+      EXPECT_EQ(key % 2 == 1, tree.Search(key, value, &context));
+      if (key % 2 == 1) {
+        EXPECT_EQ((key == 5) ? 50 : key, value);
+      }
+    }
+  }
+  std::remove(path.c_str());
+}
+
+TEST(DiskBTree, EvictionAndReopen) {
+  auto path = TempPath("disk_reopen.db");
+  const int num_keys = 20000;
+  std::vector<int> keys(num_keys);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(0));
+  {
+    // far fewer frames than pages
+    SmallTree tree(path, 32);
+    SmallTree::QueryContext context;
+    for (auto key : keys) tree.Insert(key, key * 2, &context);
+    EXPECT_GT(tree.Height(), 3);
+    EXPECT_GT(tree.Pool().PageReads(), 0U);
+    for (auto key : keys) {
+      int value;
+      EXPECT_TRUE(tree.Search(key, value, &context));
+      EXPECT_EQ(key * 2, value);
+    }
+  }
+  {
+    SmallTree tree(path, 32);
+    SmallTree::QueryContext context;
+    for (int key = 0; key < num_keys; ++key) {
+      int value;
+      EXPECT_TRUE(tree.Search(key, value, &context));
+      EXPECT_EQ(key * 2, value);
+    }
+    int value;
+    EXPECT_FALSE(tree.Search(num_keys, value, &context));
+  }
+  // the file of another kind of tree is rejected
+  EXPECT_THROW((DiskBTree<int, int, 256>(path, 8)), std::invalid_argument);
+  std::remove(path.c_str());
+}
+
+TEST(DiskBTree, IteratorScanTest) {
+  auto path = TempPath("disk_scan.db");
+  {
+    SmallTree tree(path, 16);
+    SmallTree::QueryContext context;
+    for (int key = 1000; key > 0; --key) tree.Insert(key * 2, key, &context);
+
+    int key;
+    int value;
+    int expected = 1;
+    std::unique_ptr<SmallTree::DiskIterator> scan(tree.TreeScan(&context));
+    while (scan->Next(key, value)) {
+      EXPECT_EQ(expected * 2, key);
+      EXPECT_EQ(expected, value);
+      expected++;
+    }
+    EXPECT_EQ(1001, expected);
+    scan.reset();
+
+    // bounds are not in the tree
+    expected = 50;
+    std::unique_ptr<SmallTree::DiskIterator> range(tree.RangeQuery(99, 1501, &context));
+    while (range->Next(key, value)) {
+      EXPECT_EQ(expected * 2, key);
+      expected++;
+    }
+    EXPECT_EQ(751, expected);
+    range.reset();
+
+    // an unfinished scan releases its leaf when destroyed
+    range.reset(tree.RangeQuery(10, 20, &context));
+    EXPECT_TRUE(range->Next(key, value));
+    range.reset();
+    tree.Insert(11, 11, &context);
+    EXPECT_TRUE(tree.Search(11, value, &context));
+  }
+  std::remove(path.c_str());
+}
+
+TEST(DiskBTree, Clear) {
+  auto path = TempPath("disk_clear.db");
+  {
+    SmallTree tree(path, 16);
+    SmallTree::QueryContext context;
+    for (int key = 0; key < 1000; ++key) tree.Insert(key, key, &context);
+    tree.Clear();
+    EXPECT_EQ(1, tree.Height());
+    EXPECT_EQ("[LEAF: ]", tree.String());
+    int value;
+    EXPECT_FALSE(tree.Search(1, value, &context));
+    tree.Insert(1, 1, &context);
+    EXPECT_TRUE(tree.Search(1, value, &context));
+  }
+  std::remove(path.c_str());
+}
+
+TEST(DiskBufferPool, AllFramesPinned) {
+  auto path = TempPath("disk_pool.db");
+  {
+    common::PageFile<128> file(path);
+    common::BufferPool<128> pool(&file, 2);
+    auto first = pool.NewPage();
+    auto second = pool.NewPage();
+    EXPECT_THROW(pool.NewPage(), std::runtime_error);
+    second->Unpin();
+    // the frame of the unpinned page is reused
+    auto third = pool.NewPage();
+    EXPECT_EQ(2U, third->Id());
+    EXPECT_EQ(3U, file.PageCount());
+    first->Unpin();
+    third->Unpin();
+  }
+  std::remove(path.c_str());
+}
+
+TEST(DiskBufferPool, DirtyVictimWrittenBack) {
+  auto path = TempPath("disk_pool.db");
+  {
+    common::PageFile<128> file(path);
+    // the flusher never runs, hence every victim is dirty
+    common::BufferPool<128> pool(&file, 2, std::chrono::hours(1));
+    for (int page = 0; page < 8; ++page) {
+      auto frame = pool.NewPage();
+      frame->LatchPtr()->lock();
+      frame->Data()[0] = static_cast<char>(page);
+      frame->MarkDirty();
+      frame->LatchPtr()->unlock();
+      frame->Unpin();
+    }
+    EXPECT_EQ(6U, pool.SyncWrites());
+    for (int page = 0; page < 8; ++page) {
+      auto frame = pool.FetchPage(page);
+      EXPECT_EQ(page, frame->Data()[0]);
+      frame->Unpin();
+    }
+  }
+  std::remove(path.c_str());
+}
+
+TEST(DiskConcurrentTreeTest, InsertAndSearch) {
+  auto path = TempPath("disk_concurrent.db");
+  const int num_threads = 4;
+  const int keys_per_thread = 5000;
+  {
+    SmallTree tree(path, 128);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&tree, t]() {
+        SmallTree::QueryContext context;
+        for (int idx = 0; idx < keys_per_thread; ++idx) {
+          int key = idx * num_threads + t;
+          tree.Insert(key, key, &context);
+          int value;
+          EXPECT_TRUE(tree.Search(key, value, &context));
+          EXPECT_EQ(key, value);
+        }
+      });
+    }
+    for (auto &thread : threads) thread.join();
+
+    SmallTree::QueryContext context;
+    int key;
+    int value;
+    int expected = 0;
+    std::unique_ptr<SmallTree::DiskIterator> scan(tree.TreeScan(&context));
+    while (scan->Next(key, value)) EXPECT_EQ(expected++, key);
+    EXPECT_EQ(num_threads * keys_per_thread, expected);
+  }
+  std::remove(path.c_str());
+}
+
+using SmallLog = common::WriteAheadLog<int, int>;
+
+/** Reset the clean flag of the meta page, as if the tree crashed */
+static void MarkUnclean(const std::string &path) {
+  common::PageFile<128> file(path);
+  char page[128];
+  file.ReadPage(0, page);
+  reinterpret_cast<MetaPage *>(page)->clean_ = 0;
+  file.WritePage(0, page);
+}
+
+TEST(DiskWriteAheadLog, RecoverAfterCrash) {
+  auto path = TempPath("disk_wal_tree.db");
+  auto log_path = TempPath("disk_wal_tree.log");
+  {
+    SmallLog wal(log_path, false);
+    SmallTree tree(path, 32, &wal);
+    SmallTree::QueryContext context;
+    for (int key = 0; key < 3000; ++key) tree.Insert(key, key, &context);
+    for (int key = 0; key < 3000; key += 3) EXPECT_TRUE(tree.Delete(key, &context));
+    for (int key = 1; key < 3000; key += 3) EXPECT_TRUE(tree.Update(key, -key, &context));
+  }
+  MarkUnclean(path);
+  // a torn batch at the end of the log is ignored
+  std::ofstream(log_path, std::ios::app | std::ios::binary) << "torn";
+
+  auto check = [&](SmallTree &tree) {
+    SmallTree::QueryContext context;
+    for (int key = 0; key < 3000; ++key) {
+      int value;
+      EXPECT_EQ(key % 3 != 0, tree.Search(key, value, &context));
+      if (key % 3 != 0) {
+        EXPECT_EQ((key % 3 == 1) ? -key : key, value);
+      }
+    }
+  };
+  {
+    SmallLog wal(log_path);
+    SmallTree tree(path, 32, &wal);
+    check(tree);
+    tree.Checkpoint();
+  }
+  // the page file is lost, and rebuilt from the compacted log
+  std::remove(path.c_str());
+  {
+    SmallLog wal(log_path);
+    SmallTree tree(path, 32, &wal);
+    check(tree);
+    tree.Clear();
+  }
+  {
+    SmallLog wal(log_path);
+    SmallTree tree(path, 32, &wal);
+    EXPECT_EQ("[LEAF: ]", tree.String());
+  }
+  std::remove(path.c_str());
+  std::remove(log_path.c_str());
+}
+
+TEST(DiskWriteAheadLog, GroupCommit) {
+  auto path = TempPath("disk_group_commit.db");
+  auto log_path = TempPath("disk_group_commit.log");
+  const int num_threads = 8;
+  const int keys_per_thread = 200;
+  {
+    SmallLog wal(log_path);
+    SmallTree tree(path, 128, &wal);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&tree, t]() {
+        SmallTree::QueryContext context;
+        for (int idx = 0; idx < keys_per_thread; ++idx) tree.Insert(idx * num_threads + t, t, &context);
+      });
+    }
+    for (auto &thread : threads) thread.join();
+    // every Insert returned after its record was synced
+    EXPECT_EQ(wal.DurableLsn(), num_threads * keys_per_thread * (1 + 2 * sizeof(int)));
+    EXPECT_LT(wal.BatchCount(), static_cast<std::size_t>(num_threads * keys_per_thread));
+  }
+  MarkUnclean(path);
+  {
+    SmallLog wal(log_path);
+    SmallTree tree(path, 128, &wal);
+    SmallTree::QueryContext context;
+    for (int key = 0; key < num_threads * keys_per_thread; ++key) {
+      int value;
+      EXPECT_TRUE(tree.Search(key, value, &context));
+      EXPECT_EQ(key % num_threads, value);
+    }
+  }
+  std::remove(path.c_str());
+  std::remove(log_path.c_str());
+}
+
+TEST(DiskWriteAheadLog, MonotonicLsnAcrossRewrite) {
+  auto log_path = TempPath("disk_rewrite.log");
+  uint64_t last_lsn = 0;
+  {
+    SmallLog wal(log_path);
+    for (int key = 0; key < 100; ++key) {
+      int value = key;
+      last_lsn = wal.Append(SmallLog::INSERT, key, &value);
+    }
+    wal.Flush();
+    // the rewritten log is much smaller than the current one
+    wal.Rewrite([](auto append) { append(0, 0); });
+    EXPECT_LE(last_lsn, wal.DurableLsn());
+    int value = 1;
+    auto lsn = wal.Append(SmallLog::INSERT, 1, &value);
+    EXPECT_LT(last_lsn, lsn);
+    wal.Flush();
+    last_lsn = lsn;
+  }
+  {
+    // the LSNs keep growing after the log is reopened
+    SmallLog wal(log_path);
+    EXPECT_LE(last_lsn, wal.DurableLsn());
+    wal.Reset();
+    int value = 2;
+    EXPECT_LT(last_lsn, wal.Append(SmallLog::INSERT, 2, &value));
+    wal.Flush();
+  }
+  std::remove(log_path.c_str());
+}
+
+}  // namespace btree::implementation::disk
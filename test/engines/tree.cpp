@@ -0,0 +1,331 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <memory>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "tree/blink.h"
+#include "tree/optimistic_lock_coupling.h"
+#include "tree/shadowing.h"
+
+namespace btree::implementation {
+
+/**
+ * The alternative in-memory engines share this suite, the directory of every
+ *  engine only tests its own internals
+ */
+template <template <typename, typename, int, int> class TreeType, typename Context>
+struct Engine {
+  template <int LeafCapacity, int InternalCapacity>
+  using Tree = TreeType<int, int, LeafCapacity, InternalCapacity>;
+  using QueryContext = Context;
+};
+
+typedef ::testing::Types<Engine<olc::MemoryBTree, olc::QueryContext>, Engine<shadow::MemoryBTree, shadow::QueryContext>,
+                         Engine<blink::MemoryBTree, blink::QueryContext>>
+    EngineTypes;
+
+template <class TypeParam>
+class EngineTreeTest : public ::testing::Test {};
+
+TYPED_TEST_SUITE(EngineTreeTest, EngineTypes);
+
+TYPED_TEST(EngineTreeTest, InsertAndQueryTest) {
+  typename TypeParam::template Tree<5, 5> tree;
+  typename TypeParam::QueryContext context;
+
+  for (auto key : {1, 3, 6, 2, 7, 10, 9, 8, 11, 4, 5, 12}) {
+    tree.Insert(key, key, &context);
+  }
+
+  for (int i = 1; i <= 12; ++i) {
+    int value;
+    EXPECT_EQ(true, tree.Search(i, value, &context));
+    EXPECT_EQ(i, value);
+  }
+  int value;
+  EXPECT_FALSE(tree.Search(0, value, &context));
+  EXPECT_FALSE(tree.Search(13, value, &context));
+}
+
+TYPED_TEST(EngineTreeTest, InsertReverseOrderAndSplitTest) {
+  typename TypeParam::template Tree<2, 3> tree;
+  typename TypeParam::QueryContext context;
+
+  for (int key = 12; key >= 1; --key) {
+    tree.Insert(key, key, &context);
+  }
+
+  for (int i = 1; i <= 12; ++i) {
+    int value;
+    EXPECT_EQ(true, tree.Search(i, value, &context));
+    EXPECT_EQ(i, value);
+  }
+}
+
+TYPED_TEST(EngineTreeTest, SplitStructure) {
+  typename TypeParam::template Tree<4, 4> tree;
+  typename TypeParam::QueryContext context;
+
+  for (int key = 1; key <= 6; ++key) {
+    tree.Insert(key, key, &context);
+  }
+  EXPECT_EQ("[INTERNAL: [LEAF: (1,1) (2,2)] | 2 | [LEAF: (3,3) (4,4) (5,5) (6,6)]]", tree.String());
+}
+
+TYPED_TEST(EngineTreeTest, UpdateAndDelete) {
+  typename TypeParam::template Tree<4, 4> tree;
+  typename TypeParam::QueryContext context;
+
+  for (int key = 1; key <= 6; ++key) {
+    tree.Insert(key, key, &context);
+  }
+  EXPECT_TRUE(tree.Update(3, 30, &context));
+  EXPECT_FALSE(tree.Update(7, 70, &context));
+  tree.Insert(4, 40, &context);
+  EXPECT_EQ("[INTERNAL: [LEAF: (1,1) (2,2)] | 2 | [LEAF: (3,30) (4,40) (5,5) (6,6)]]", tree.String());
+
+  // underflow is tolerated, nodes are never merged
+  EXPECT_TRUE(tree.Delete(1, &context));
+  EXPECT_TRUE(tree.Delete(2, &context));
+  EXPECT_FALSE(tree.Delete(2, &context));
+  EXPECT_EQ("[INTERNAL: [LEAF: ] | 2 | [LEAF: (3,30) (4,40) (5,5) (6,6)]]", tree.String());
+
+  int value;
+  EXPECT_FALSE(tree.Search(1, value, &context));
+  EXPECT_TRUE(tree.Search(4, value, &context));
+  EXPECT_EQ(40, value);
+}
+
+TYPED_TEST(EngineTreeTest, IteratorFullScanTest) {
+  using Tree = typename TypeParam::template Tree<4, 4>;
+  Tree tree;
+  typename TypeParam::QueryContext context;
+
+  const int number_of_tuples = 10000;
+  std::vector<int> tuples;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    tuples.push_back(i);
+  }
+  std::random_shuffle(tuples.begin(), tuples.end());
+
+  for (auto it = tuples.begin(); it != tuples.end(); ++it) {
+    tree.Insert(*it, *it, &context);
+  }
+
+  std::unique_ptr<typename Tree::MemoryIterator> it;
+  it.reset(tree.TreeScan(&context));
+
+  int key, value;
+  int i = 0;
+  while (it->Next(key, value)) {
+    EXPECT_EQ(i, key);
+    EXPECT_EQ(i, value);
+    i++;
+  }
+  EXPECT_EQ(number_of_tuples, i);
+}
+
+TYPED_TEST(EngineTreeTest, IteratorRangeScanTest) {
+  using Tree = typename TypeParam::template Tree<4, 4>;
+  Tree tree;
+  typename TypeParam::QueryContext context;
+
+  std::unique_ptr<typename Tree::MemoryIterator> it;
+  it.reset(tree.RangeQuery(INT_MIN, INT_MAX, &context));
+  int k, v;
+  EXPECT_FALSE(it->Next(k, v));
+
+  const int number_of_tuples = 10000;
+  std::vector<int> tuples;
+  for (int i = 0; i < number_of_tuples; ++i) {
+    tuples.push_back(i);
+  }
+  std::random_shuffle(tuples.begin(), tuples.end());
+
+  for (auto it = tuples.begin(); it != tuples.end(); ++it) {
+    tree.Insert(*it, *it, &context);
+  }
+
+  const int runs = 10;
+  for (int i = 0; i < runs; i++) {
+    int start = rand() % number_of_tuples;
+    int end = rand() % number_of_tuples;
+    it.reset(tree.RangeQuery(start, end, &context));
+    int key, value;
+    int founds = 0;
+    while (it->Next(key, value)) {
+      EXPECT_EQ(founds + start, key);
+      EXPECT_EQ(founds + start, value);
+      founds++;
+    }
+    EXPECT_EQ(start <= end ? end - start + 1 : 0, founds);
+  }
+}
+
+TYPED_TEST(EngineTreeTest, MassiveRandomInsertionAndQuery) {
+  std::unordered_set<int> s;
+  typename TypeParam::template Tree<4, 4> tree;
+  typename TypeParam::QueryContext context;
+  constexpr int tuples = 100000;
+  const int range = tuples * 10;
+
+  for (int i = 0; i < tuples; ++i) {
+    const int r = std::rand() % range;
+    s.insert(r);
+    tree.Insert(r, r, &context);
+  }
+
+  for (int i = 0; i < range; ++i) {
+    int value = -1;
+    if (s.find(i) != s.end()) {
+      EXPECT_EQ(true, tree.Search(i, value, &context));
+      EXPECT_EQ(i, value);
+    } else {
+      EXPECT_EQ(false, tree.Search(i, value, &context));
+    }
+  }
+}
+
+#define NO_THREADS 10
+#define MAX_KEY 100000
+#define NODE_CAPACITY 10
+
+template <class TypeParam>
+class EngineConcurrentTreeTest : public ::testing::Test {};
+
+TYPED_TEST_SUITE(EngineConcurrentTreeTest, EngineTypes);
+
+TYPED_TEST(EngineConcurrentTreeTest, InsertAndSearch) {
+  using QueryContext = typename TypeParam::QueryContext;
+  typename TypeParam::template Tree<NODE_CAPACITY, NODE_CAPACITY> tree;
+  std::array<std::atomic<bool>, MAX_KEY + 1> inserted;
+  for (auto &flag : inserted) flag = false;
+
+  std::atomic<int> next_key = 1;
+  std::thread threads[NO_THREADS];
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx] = std::thread([&, tidx]() {
+      QueryContext context;
+      while (true) {
+        // half of the threads are writers, the others are readers
+        if (tidx % 2 == 0) {
+          int key = next_key++;
+          if (key > MAX_KEY) break;
+          tree.Insert(key, key, &context);
+          inserted[key] = true;
+        } else {
+          if (next_key > MAX_KEY) break;
+          int value, key = rand() % MAX_KEY + 1;
+          // the flag has to be read before searching, as the key may be
+          // inserted right after the search
+          bool was_inserted = inserted[key];
+          auto found = tree.Search(key, value, &context);
+          if (was_inserted) {
+            ASSERT_TRUE(found);
+          }
+          if (found) {
+            EXPECT_EQ(key, value);
+          }
+        }
+      }
+    });
+  }
+
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx].join();
+  }
+
+  int value;
+  QueryContext context;
+  for (int key = 1; key <= MAX_KEY; ++key) {
+    auto found = tree.Search(key, value, &context);
+    ASSERT_TRUE(found);
+    EXPECT_EQ(key, value);
+  }
+}
+
+TYPED_TEST(EngineConcurrentTreeTest, InsertDeleteAndScan) {
+  using QueryContext = typename TypeParam::QueryContext;
+  using Tree = typename TypeParam::template Tree<NODE_CAPACITY, NODE_CAPACITY>;
+  Tree tree;
+  // odd keys are pre-loaded and deleted concurrently, even keys are inserted
+  for (int key = 1; key <= MAX_KEY; key += 2) {
+    QueryContext context;
+    tree.Insert(key, key, &context);
+  }
+
+  std::atomic<int> next_key = 1;
+  std::atomic<bool> done = false;
+  std::thread scanner([&]() {
+    QueryContext context;
+    while (!done) {
+      std::unique_ptr<typename Tree::MemoryIterator> it(tree.TreeScan(&context));
+      int key, value, prev = INT_MIN;
+      while (it->Next(key, value)) {
+        // the scan always returns unique keys in ascending order
+        ASSERT_LT(prev, key);
+        EXPECT_EQ(key, value);
+        prev = key;
+      }
+    }
+  });
+  std::thread threads[NO_THREADS];
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx] = std::thread([&]() {
+      QueryContext context;
+      while (true) {
+        int key = next_key++;
+        if (key > MAX_KEY) break;
+        if (key % 2 == 1) {
+          ASSERT_TRUE(tree.Delete(key, &context));
+        } else {
+          tree.Insert(key, key, &context);
+        }
+      }
+    });
+  }
+
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx].join();
+  }
+  done = true;
+  scanner.join();
+
+  int value;
+  QueryContext context;
+  for (int key = 1; key <= MAX_KEY; ++key) {
+    auto found = tree.Search(key, value, &context);
+    ASSERT_EQ(key % 2 == 0, found);
+  }
+}
+
+}  // namespace btree::implementation
@@ -0,0 +1,131 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "tree/optimistic_lock_coupling.h"
+
+namespace btree::implementation::olc {
+
+TEST(EpochManager, RetiredObjectsOutliveActiveParticipants) {
+  struct Tracked {
+    std::atomic<int> *freed_;
+    ~Tracked() { (*this->freed_)++; }
+  };
+  std::atomic<int> freed = 0;
+  common::EpochManager manager(1);
+  auto reader = manager.Register();
+  auto writer = manager.Register();
+
+  reader->Enter();
+  writer->Enter();
+  writer->Retire(new Tracked{&freed});
+  writer->Exit();
+  // the reader may still hold a reference, so the epoch can not advance twice
+  for (int i = 0; i < 4; ++i) writer->Reclaim();
+  EXPECT_EQ(0, freed);
+  EXPECT_EQ(1, writer->RetiredCount());
+
+  reader->Exit();
+  writer->Reclaim();
+  writer->Reclaim();
+  EXPECT_EQ(1, freed);
+  EXPECT_EQ(0, writer->RetiredCount());
+
+  // objects left by an unregistered participant are freed by the manager
+  writer->Retire(new Tracked{&freed});
+  manager.Unregister(writer);
+  EXPECT_TRUE(manager.TryAdvance());
+  EXPECT_TRUE(manager.TryAdvance());
+  EXPECT_EQ(2, freed);
+  manager.Unregister(reader);
+}
+
+TEST(OLCBPlusTree, IteratorSurvivesClear) {
+  MemoryBTree<int, int, 4, 4> tree;
+  QueryContext context;
+
+  for (int key = 0; key < 100; ++key) {
+    tree.Insert(key, key, &context);
+  }
+  std::unique_ptr<MemoryBTree<int, int, 4, 4>::MemoryIterator> it(tree.TreeScan(&context));
+  tree.Clear();
+  // the old leaves are retired, but not freed until the iterator is destroyed
+  int key, value, count = 0;
+  while (it->Next(key, value)) {
+    EXPECT_EQ(count++, key);
+  }
+  EXPECT_EQ(100, count);
+  EXPECT_FALSE(tree.Search(0, value, &context));
+  EXPECT_EQ("[LEAF: ]", tree.String());
+}
+
+#define NO_THREADS 10
+#define MAX_KEY 100000
+#define NODE_CAPACITY 10
+
+TEST(OLCConcurrentTreeTest, ClearWhileScanning) {
+  MemoryBTree<int, int, NODE_CAPACITY, NODE_CAPACITY> tree;
+  std::atomic<bool> done = false;
+  std::thread threads[NO_THREADS];
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx] = std::thread([&, tidx]() {
+      QueryContext context;
+      int value;
+      for (int key = 1; !done; key = key % MAX_KEY + 1) {
+        if (tidx % 2 == 0) {
+          tree.Insert(key, key, &context);
+          if (tree.Search(key, value, &context)) {
+            EXPECT_EQ(key, value);
+          }
+        } else {
+          // nodes of the cleared trees are still readable by the scans
+          std::unique_ptr<MemoryBTree<int, int, NODE_CAPACITY, NODE_CAPACITY>::MemoryIterator> it(
+              tree.RangeQuery(key, key + 100, &context));
+          int found, prev = INT_MIN;
+          while (it->Next(found, value)) {
+            ASSERT_LT(prev, found);
+            EXPECT_EQ(found, value);
+            prev = found;
+          }
+        }
+      }
+    });
+  }
+
+  for (int round = 0; round < 200; ++round) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    tree.Clear();
+  }
+  done = true;
+  for (int tidx = 0; tidx < NO_THREADS; ++tidx) {
+    threads[tidx].join();
+  }
+}
+
+}  // namespace btree::implementation::olc
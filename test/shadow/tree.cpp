@@ -0,0 +1,93 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "tree/shadowing.h"
+
+namespace btree::implementation::shadow {
+
+TEST(ShadowLeafNode, UnpublishedModificationIsInvisible) {
+  LeafNode<int, int, 4> leaf;
+  QueryContext context;
+  Split<int, int, QueryContext, NodeMetadata> split;
+
+  EXPECT_FALSE(leaf.Insert(1, 1, split, &context));
+  context.PublishModification();
+  EXPECT_EQ(2, LATEST_VERSION(&leaf)->VersionInfo());
+
+  // the writer modifies the other twin, readers still see the latest one
+  EXPECT_FALSE(leaf.Insert(2, 2, split, &context));
+  EXPECT_EQ(1, context.modified_.size());
+  EXPECT_EQ(MODIFIED_VERSION(&leaf), POSSIBLE_NEGATIVE_VERSION(&leaf));
+  EXPECT_GT(0, MODIFIED_VERSION(&leaf)->VersionInfo());
+  int value;
+  EXPECT_TRUE(leaf.Search(1, value, &context));
+  EXPECT_FALSE(leaf.Search(2, value, &context));
+  EXPECT_EQ("[LEAF: (1,1)]", leaf.String());
+
+  context.PublishModification();
+  EXPECT_TRUE(context.modified_.empty());
+  EXPECT_EQ(3, LATEST_VERSION(&leaf)->VersionInfo());
+  EXPECT_TRUE(leaf.Search(2, value, &context));
+  EXPECT_EQ(2, value);
+  EXPECT_EQ("[LEAF: (1,1) (2,2)]", leaf.String());
+}
+
+TEST(ShadowBPlusTree, RightLinksAfterSplits) {
+  using TreeNode = Node<int, int, QueryContext, NodeMetadata>;
+  using Inner = InternalNode<int, int, 4>;
+  MemoryBTree<int, int, 4, 4> tree;
+  QueryContext context;
+  std::vector<int> keys(5000);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(0));
+  for (auto key : keys) tree.Insert(key, key, &context);
+
+  // the nodes of every level in key order, from the root down
+  std::vector<std::vector<TreeNode *>> levels{{tree.root_.load()}};
+  while (levels.back()[0]->Type() == NodeType::INTERNAL) {
+    std::vector<TreeNode *> children;
+    for (auto node : levels.back()) {
+      auto inner = LATEST_VERSION(static_cast<Inner *>(node));
+      for (int idx = 0; idx < inner->Size(); ++idx) children.push_back(inner->GetChild(idx));
+    }
+    levels.push_back(children);
+  }
+  ASSERT_LT(2U, levels.size());
+
+  // the right link of every node is the next node of its level
+  for (auto &level : levels) {
+    for (size_t idx = 0; idx < level.size(); ++idx) {
+      TreeNode *expected = (idx + 1 < level.size()) ? level[idx + 1] : nullptr;
+      EXPECT_EQ(expected, level[idx]->RightSibling());
+    }
+  }
+}
+
+}  // namespace btree::implementation::shadow
@@ -0,0 +1,163 @@
+/*
+Copyright (C) 2021 Duy Nguyen
+All rights reserved.
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "tree/sharded.h"
+
+namespace btree::implementation {
+
+using HashShardedTree = ShardedBTree<int, int, 4, 4>;
+using RangeShardedTree = ShardedBTree<int, int, 4, 4, RangePartitioner<int>>;
+
+TEST(ShardedBTree, HashInsertSearchDelete) {
+  HashShardedTree tree(HashPartitioner<int>(4));
+  HashShardedTree::QueryContext context;
+  EXPECT_EQ(4U, tree.ShardCount());
+
+  for (int key = 0; key < 1000; ++key) tree.Insert(key, key, &context);
+  // every shard gets a fair share of the keys
+  for (std::size_t shard = 0; shard < tree.ShardCount(); ++shard) {
+    EXPECT_GT(tree.Shard(shard).Occupancy().back().entries_, 150U);
+  }
+  EXPECT_TRUE(tree.Update(10, 100, &context));
+  EXPECT_FALSE(tree.Update(1000, 1000, &context));
+  for (int key = 0; key < 1000; key += 2) EXPECT_TRUE(tree.Delete(key, &context));
+  for (int key = 0; key < 1000; ++key) {
+    int value;
+    EXPECT_EQ(key % 2 == 1, tree.Search(key, value, &context));
+    if (key % 2 == 1) {
+      EXPECT_EQ(key, value);
+    }
+  }
+
+  tree.Clear();
+  int value;
+  EXPECT_FALSE(tree.Search(1, value, &context));
+}
+
+TEST(ShardedBTree, MergedRangeQuery) {
+  HashShardedTree tree(HashPartitioner<int>(3));
+  HashShardedTree::QueryContext context;
+  for (int key = 500; key > 0; --key) tree.Insert(key * 2, key, &context);
+
+  int key;
+  int value;
+  int expected = 1;
+  std::unique_ptr<HashShardedTree::MergedIterator> scan(tree.TreeScan(&context));
+  while (scan->Next(key, value)) {
+    EXPECT_EQ(expected * 2, key);
+    EXPECT_EQ(expected, value);
+    expected++;
+  }
+  EXPECT_EQ(501, expected);
+
+  expected = 50;
+  std::unique_ptr<HashShardedTree::MergedIterator> range(tree.RangeQuery(99, 301, &context));
+  while (range->Next(key, value)) EXPECT_EQ(2 * expected++, key);
+  EXPECT_EQ(151, expected);
+
+  range.reset(tree.RangeQuery(301, 99, &context));
+  EXPECT_FALSE(range->Next(key, value));
+}
+
+TEST(ShardedBTree, RangePartitions) {
+  EXPECT_THROW(RangePartitioner<int>({10, 10}), std::invalid_argument);
+
+  RangeShardedTree tree(RangePartitioner<int>({100, 200}));
+  RangeShardedTree::QueryContext context;
+  EXPECT_EQ(3U, tree.ShardCount());
+  EXPECT_EQ(0U, tree.ShardOf(100));
+  EXPECT_EQ(1U, tree.ShardOf(101));
+  EXPECT_EQ(2U, tree.ShardOf(1000));
+
+  for (int key = 1; key <= 300; ++key) tree.Insert(key, key, &context);
+  EXPECT_EQ(100U, tree.Shard(1).Occupancy().back().entries_);
+
+  int key;
+  int value;
+  int expected = 150;
+  std::unique_ptr<RangeShardedTree::MergedIterator> range(tree.RangeQuery(150, 250, &context));
+  while (range->Next(key, value)) EXPECT_EQ(expected++, key);
+  EXPECT_EQ(251, expected);
+}
+
+TEST(ShardedBTree, NumaPlacement) {
+  EXPECT_GE(common::Numa::NodeCount(), 1);
+  HashShardedTree tree(HashPartitioner<int>(4), 2);
+  for (std::size_t shard = 0; shard < tree.ShardCount(); ++shard) {
+    EXPECT_EQ(static_cast<int>(shard % 2), tree.NumaNodeOf(shard));
+  }
+  // binding is best-effort, nodes are allocated either way
+  HashShardedTree::QueryContext context;
+  for (int key = 0; key < 1000; ++key) tree.Insert(key, key, &context);
+  EXPECT_GT(tree.Shard(0).NodeAllocator()->SlabCount(), 0U);
+}
+
+TEST(ShardedBTree, ConcurrentInsertAndScan) {
+  HashShardedTree tree(HashPartitioner<int>(4));
+  const int num_threads = 4;
+  const int keys_per_thread = 20000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&tree, t]() {
+      HashShardedTree::QueryContext context;
+      for (int idx = 0; idx < keys_per_thread; ++idx) {
+        int key = idx * num_threads + t;
+        tree.Insert(key, key, &context);
+        int value;
+        EXPECT_TRUE(tree.Search(key, value, &context));
+      }
+    });
+  }
+  // scans run concurrently with the inserts, and see ascending keys
+  threads.emplace_back([&tree]() {
+    HashShardedTree::QueryContext context;
+    for (int round = 0; round < 20; ++round) {
+      std::unique_ptr<HashShardedTree::MergedIterator> scan(tree.TreeScan(&context));
+      int key;
+      int value;
+      int previous = -1;
+      while (scan->Next(key, value)) {
+        EXPECT_LT(previous, key);
+        previous = key;
+      }
+    }
+  });
+  for (auto &thread : threads) thread.join();
+
+  HashShardedTree::QueryContext context;
+  int key;
+  int value;
+  int expected = 0;
+  std::unique_ptr<HashShardedTree::MergedIterator> scan(tree.TreeScan(&context));
+  while (scan->Next(key, value)) EXPECT_EQ(expected++, key);
+  EXPECT_EQ(num_threads * keys_per_thread, expected);
+}
+
+}  // namespace btree::implementation